@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "animpublic/interfaces/i_engine_interface.h"
+#include "animpublic/commands/core_commands.h"
+#include "animcore/serialization/asset_converter.h"
+
+// Upgrades an asset directory in place:
+//	animconverter <directory> <dataVersion>
+
+static void* Allocate(size_t size)
+{
+	return malloc(size);
+}
+
+static void Free(void* mem)
+{
+	free(mem);
+}
+
+using namespace animengine;
+int main(int argc, char** argv)
+{
+	if (argc != 3)
+	{
+		fprintf(stderr, "usage: %s <directory> <dataVersion>\n", argv[0]);
+		return 1;
+	}
+	const char* directory = argv[1];
+	uint32_t dataVersion = static_cast<uint32_t>(strtoul(argv[2], nullptr, 10));
+
+	auto& animController = anim::GetAnimEngineInterfaceController();
+	{
+		anim::CoreCommands coreCmds;
+		coreCmds.m_AllocateFn = &Allocate;
+		coreCmds.m_FreeFn = &Free;
+		animController.RegisterCoreCommands(coreCmds);
+	}
+
+	animController.InitializeRuntime();
+	Serialization::AssetConversionStats stats = Serialization::ConvertAssetDirectory(directory, dataVersion);
+	animController.FinalizeRuntime();
+
+	printf("%u converted, %u up to date, %u failed\n", stats.m_NumConverted, stats.m_NumUpToDate, stats.m_NumFailed);
+	return stats.m_NumFailed == 0 ? 0 : 1;
+}
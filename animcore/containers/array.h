@@ -3,13 +3,51 @@
 #include <type_traits>
 #include <string.h>
 #include <limits>
+#include <utility>
+#include <new>
 #include "animcore/util/assert.h"
 #include "animcore/memory/default_allocator.h"
 #include "animcore/math/utils.h"
 
 ANIM_NAMESPACE_BEGIN
 
-template<typename CountType, typename ObjectType, typename Allocator, bool = std::is_copy_constructible<ObjectType>::value>
+// Types for which moving an object to a new address is a plain memcpy. Specialize for types that are not
+// trivially copyable but can still be relocated bitwise.
+template<typename T>
+struct IsTriviallyRelocatable
+{
+	static constexpr bool Value = std::is_trivially_copyable<T>::value;
+};
+
+// Growth policies decide the capacity to allocate when a push does not fit anymore.
+struct DefaultArrayGrowthPolicy
+{
+	static uint32_t GetNewCapacity(uint32_t currentCapacity, uint32_t requiredCapacity)
+	{
+		uint32_t newCapacity = currentCapacity + currentCapacity / 2;
+		newCapacity = MAX(newCapacity, 4u);
+		return MAX(newCapacity, requiredCapacity);
+	}
+};
+
+struct DoublingArrayGrowthPolicy
+{
+	static uint32_t GetNewCapacity(uint32_t currentCapacity, uint32_t requiredCapacity)
+	{
+		uint32_t newCapacity = MAX(currentCapacity * 2, 4u);
+		return MAX(newCapacity, requiredCapacity);
+	}
+};
+
+struct ExactArrayGrowthPolicy
+{
+	static uint32_t GetNewCapacity(uint32_t, uint32_t requiredCapacity)
+	{
+		return requiredCapacity;
+	}
+};
+
+template<typename CountType, typename ObjectType, typename Allocator, typename GrowthPolicy = DefaultArrayGrowthPolicy, bool = std::is_copy_constructible<ObjectType>::value>
 class BaseArray
 {
 private:
@@ -136,19 +174,7 @@ public:
 	BaseArray(BaseArray&& other)
 		: BaseArray()
 	{
-		if (other.m_OwnsData)
-		{
-			std::swap(m_Data, other.m_Data);
-			std::swap(m_Capacity, other.m_Capacity);
-			std::swap(m_Size, other.m_Size);
-			std::swap(m_PreserveOrder, other.m_PreserveOrder);
-		}
-		else
-		{
-			Reallocate(other.m_Size);
-			CopyFrom(other.m_Data, other.m_Size);
-			m_PreserveOrder = other.m_PreserveOrder;
-		}
+		MoveFrom(std::move(other));
 	}
 
 	BaseArray(ObjectType* data, uint32_t numElements, uint32_t maxCapacity, bool ownsData)
@@ -170,30 +196,21 @@ public:
 
 	BaseArray& operator=(const BaseArray& other)
 	{
+		if (this == &other)
+			return *this;
 		Clear();
 		Reserve(other.m_Size);
 		CopyFrom(other.m_Data, other.m_Size);
+		m_Size = other.m_Size;
 		return *this;
 	}
 
 	BaseArray& operator=(BaseArray&& other)
 	{
+		if (this == &other)
+			return *this;
 		Clear();
-		if (other.m_OwnsData)
-		{
-			std::swap(m_Flags, other.m_Flags);
-			std::swap(m_Data, other.m_Data);
-			std::swap(m_Capacity, other.m_Capacity);
-			std::swap(m_Size, other.m_Size);
-		}
-		else
-		{
-			Reserve(other.m_Size);
-			for (uint32_t i = 0; i < other.m_Size; ++i)
-			{
-				new (&m_Data[i]) ObjectType(std::move(other.m_Data[i]));
-			}
-		}
+		MoveFrom(std::move(other));
 		return *this;
 	}
 
@@ -209,12 +226,37 @@ public:
 		if (m_Capacity < capacity)
 			Reallocate(capacity);
 	}
+
+	// Points the array at numElements elements it does not own, e.g. inside a memory-mapped file. The memory
+	// has to outlive the array. Growing the array moves the elements into an owned buffer first.
+	void AttachExternalBuffer(ObjectType* data, uint32_t numElements)
+	{
+		ANIM_ASSERT(m_Size == 0);
+		ANIM_VERIFY(numElements <= std::numeric_limits<CountType>::max());
+		if (m_OwnsData)
+			Allocator::Free(m_Data);
+		m_Data = data;
+		m_Size = numElements;
+		m_Capacity = numElements;
+		m_OwnsData = 0;
+	}
+
+	// False while the array points at a buffer attached with AttachExternalBuffer.
+	bool OwnsBuffer() const { return m_OwnsData != 0; }
+
+	// Drops unused capacity. Arrays that do not own their buffer keep it.
+	void ShrinkToFit()
+	{
+		if (m_OwnsData && m_Capacity > m_Size)
+			Reallocate(m_Size);
+	}
+
 	template<typename U = ObjectType>
-	typename std::enable_if<std::is_same<U, ObjectType>::value && std::is_pod<U>::value, void>::type 
+	typename std::enable_if<std::is_same<U, ObjectType>::value && std::is_pod<U>::value, void>::type
 		Clear() { m_Size = 0; }
 
 	template<typename U = ObjectType>
-	typename std::enable_if<std::is_same<U, ObjectType>::value && !std::is_pod<U>::value, void>::type 
+	typename std::enable_if<std::is_same<U, ObjectType>::value && !std::is_pod<U>::value, void>::type
 		Clear()
 	{
 		for (uint32_t i = 0; i < m_Size; ++i)
@@ -238,20 +280,20 @@ public:
 		}
 		else if (newSize > m_Size)
 		{
-			auto oldSize = m_Size;
 			Reserve(newSize);
-			for (uint32_t i = oldSize; i < newSize; ++i)
+			for (uint32_t i = m_Size; i < newSize; ++i)
 			{
 				auto& obj = m_Data[i];
 				new (&obj) ObjectType();
 			}
 		}
+		m_Size = newSize;
 	}
 
 	template<typename U = ObjectType>
 	typename std::enable_if<std::is_pod<U>::value, void>::type Resize(uint32_t newSize)
 	{
-		Reallocate(newSize);
+		Reserve(newSize);
 		m_Size = newSize;
 	}
 
@@ -263,26 +305,60 @@ public:
 	template<typename U = ObjectType>
 	typename std::enable_if<std::is_pod<U>::value, void>::type Push(const ObjectType& object)
 	{
-		if (m_Size + 1 > m_Capacity)
-			Reallocate(m_Size + 1);
-		memcpy(&m_Data[m_Size], &object, sizeof(ObjectType));
+		if (m_Size == m_Capacity)
+		{
+			// object may live in our own buffer, copy it out before growing
+			ObjectType tmp = object;
+			Grow(static_cast<uint64_t>(m_Size) + 1);
+			memcpy(&m_Data[m_Size], &tmp, sizeof(ObjectType));
+		}
+		else
+		{
+			memcpy(&m_Data[m_Size], &object, sizeof(ObjectType));
+		}
 		++m_Size;
 	}
 
 	template<typename U = ObjectType>
 	typename std::enable_if<!std::is_pod<U>::value, void>::type Push(const ObjectType& object)
 	{
-		if (m_Size + 1 > m_Capacity)
-			Reallocate(m_Size + 1);
-		new (&m_Data[m_Size]) ObjectType(object);
+		EmplaceBack(object);
 	}
 
 	template<typename U = ObjectType>
 	typename std::enable_if<!std::is_pod<U>::value, void>::type Push(ObjectType&& object)
 	{
-		if (m_Size + 1 > m_Capacity)
-			Reallocate(m_Size + 1);
-		new (&m_Data[m_Size]) ObjectType(std::move(object));
+		EmplaceBack(std::move(object));
+	}
+
+	template<typename ...Args>
+	ObjectType& EmplaceBack(Args&&... args)
+	{
+		if (m_Size == m_Capacity)
+		{
+			// Construct the new element before relocating, args may reference elements of this array.
+			uint32_t newCapacity = GetGrowCapacity(static_cast<uint64_t>(m_Size) + 1);
+			ObjectType* newData = Allocator::Allocate(newCapacity);
+			new (&newData[m_Size]) ObjectType(std::forward<Args>(args)...);
+			AdoptBuffer(newData, newCapacity);
+		}
+		else
+		{
+			new (&m_Data[m_Size]) ObjectType(std::forward<Args>(args)...);
+		}
+		return m_Data[m_Size++];
+	}
+
+	// Copies numItems elements to the end of the array, growing at most once.
+	void Append(const ObjectType* values, uint32_t numItems)
+	{
+		if (numItems == 0)
+			return;
+		ANIM_ASSERT(values + numItems <= m_Data || values >= m_Data + m_Capacity);
+		if (static_cast<uint64_t>(m_Size) + numItems > m_Capacity)
+			Grow(static_cast<uint64_t>(m_Size) + numItems);
+		CopyConstruct(&m_Data[m_Size], values, numItems);
+		m_Size += numItems;
 	}
 
 	template<typename U = ObjectType>
@@ -326,10 +402,7 @@ public:
 
 	ObjectType& Grow()
 	{
-		if (m_Size + 1 > m_Capacity)
-			Reallocate(m_Size + 1);
-		new (&m_Data[m_Size]) ObjectType();
-		return m_Data[m_Size++];
+		return EmplaceBack();
 	}
 
 	void RemoveAt(uint32_t index)
@@ -337,34 +410,101 @@ public:
 		ANIM_ASSERT(index < m_Size);
 		if (!m_PreserveOrder)
 		{
-			std::swap(m_Data[index], m_Data[--m_Size]);
+			if (index + 1 != m_Size)
+				m_Data[index] = std::move(m_Data[m_Size - 1]);
 		}
 		else
 		{
-			m_Data[index].~ObjectType();
-			for (uint32_t i = index; i < m_Size - 1; ++i)
+			for (uint32_t i = index; i + 1 < m_Size; ++i)
 			{
-				m_Data[index] = std::move(m_Data[index + 1]);
+				m_Data[i] = std::move(m_Data[i + 1]);
 			}
-			--m_Size;
 		}
+		m_Data[m_Size - 1].~ObjectType();
+		--m_Size;
 	}
 
-private:
-	void Reallocate(uint32_t newSize)
+protected:
+	// Aborts if requiredCapacity does not fit into CountType, the element count would wrap around.
+	uint32_t GetGrowCapacity(uint64_t requiredCapacity) const
+	{
+		ANIM_VERIFY(requiredCapacity <= std::numeric_limits<CountType>::max());
+		uint32_t newCapacity = GrowthPolicy::GetNewCapacity(m_Capacity, static_cast<uint32_t>(requiredCapacity));
+		return MIN(newCapacity, static_cast<uint32_t>(std::numeric_limits<CountType>::max()));
+	}
+
+	void Grow(uint64_t requiredCapacity)
+	{
+		Reallocate(GetGrowCapacity(requiredCapacity));
+	}
+
+	void Reallocate(uint32_t newCapacity)
+	{
+		ANIM_VERIFY(newCapacity <= std::numeric_limits<CountType>::max());
+		ANIM_ASSERT(newCapacity >= m_Size);
+		ObjectType* newData = newCapacity > 0 ? Allocator::Allocate(newCapacity) : nullptr;
+		AdoptBuffer(newData, newCapacity);
+	}
+
+	// Relocates the live elements into newData, and takes ownership of it unless it is memory like an inline buffer.
+	void AdoptBuffer(ObjectType* newData, uint32_t newCapacity, bool ownsData = true)
 	{
-		ANIM_ASSERT(newSize < std::numeric_limits<CountType>::max());
-		auto newData = Allocator::Allocate(newSize);// : nullptr;
 		if (m_Data != nullptr)
 		{
 			if (newData != nullptr)
-				memcpy(newData, m_Data, (MAX(m_Size, newSize) * sizeof(ObjectType)));
+				RelocateTo(newData);
 			if (m_OwnsData)
 				Allocator::Free(m_Data);
 		}
 		m_Data = newData;
-		m_OwnsData = 1;
-		m_Capacity = newSize;
+		m_OwnsData = ownsData ? 1 : 0;
+		m_Capacity = newCapacity;
+	}
+
+	// Takes other's buffer when it owns one, otherwise moves its elements over. Expects this array to be empty.
+	void MoveFrom(BaseArray&& other)
+	{
+		ANIM_ASSERT(m_Size == 0);
+		m_PreserveOrder = other.m_PreserveOrder;
+		if (other.m_OwnsData)
+		{
+			if (m_OwnsData)
+				Allocator::Free(m_Data);
+			m_Data = other.m_Data;
+			m_Capacity = other.m_Capacity;
+			m_Size = other.m_Size;
+			m_OwnsData = 1;
+			other.m_Data = nullptr;
+			other.m_Capacity = 0;
+			other.m_Size = 0;
+		}
+		else
+		{
+			Reserve(other.m_Size);
+			for (uint32_t i = 0; i < other.m_Size; ++i)
+			{
+				new (&m_Data[i]) ObjectType(std::move(other.m_Data[i]));
+			}
+			m_Size = other.m_Size;
+			other.Clear();
+		}
+	}
+
+private:
+	template<typename U = ObjectType>
+	typename std::enable_if<std::is_same<U, ObjectType>::value && IsTriviallyRelocatable<U>::Value, void>::type RelocateTo(U* newData)
+	{
+		memcpy(newData, m_Data, m_Size * sizeof(U));
+	}
+
+	template<typename U = ObjectType>
+	typename std::enable_if<std::is_same<U, ObjectType>::value && !IsTriviallyRelocatable<U>::Value, void>::type RelocateTo(U* newData)
+	{
+		for (uint32_t i = 0; i < m_Size; ++i)
+		{
+			new (&newData[i]) U(std::move(m_Data[i]));
+			m_Data[i].~U();
+		}
 	}
 
 	template<typename U = ObjectType>
@@ -382,6 +522,21 @@ private:
 		}
 	}
 
+	template<typename U = ObjectType>
+	static typename std::enable_if<std::is_same<U, ObjectType>::value && std::is_trivially_copyable<U>::value, void>::type CopyConstruct(U* dst, const U* values, uint32_t numItems)
+	{
+		memcpy(dst, values, numItems * sizeof(U));
+	}
+
+	template<typename U = ObjectType>
+	static typename std::enable_if<std::is_same<U, ObjectType>::value && !std::is_trivially_copyable<U>::value, void>::type CopyConstruct(U* dst, const U* values, uint32_t numItems)
+	{
+		for (uint32_t i = 0; i < numItems; ++i)
+		{
+			new (&dst[i]) U(values[i]);
+		}
+	}
+
 	ObjectType* m_Data;
 	CountType m_Size;
 	CountType m_Capacity;
@@ -396,10 +551,10 @@ private:
 	};
 };
 
-template<typename CountType, typename ObjectType, typename Allocator>
-class BaseArray<CountType, ObjectType, Allocator, false> : public BaseArray<CountType, ObjectType, Allocator, true>
+template<typename CountType, typename ObjectType, typename Allocator, typename GrowthPolicy>
+class BaseArray<CountType, ObjectType, Allocator, GrowthPolicy, false> : public BaseArray<CountType, ObjectType, Allocator, GrowthPolicy, true>
 {
-	using BaseArray<CountType, ObjectType, Allocator, true>::BaseArray;
+	using BaseArray<CountType, ObjectType, Allocator, GrowthPolicy, true>::BaseArray;
 public:
 	BaseArray() = default;
 	BaseArray(const BaseArray&) = delete;
@@ -414,19 +569,75 @@ using Array = BaseArray<uint16_t, ObjectType, Allocator>;
 template<typename ObjectType, typename Allocator = DefaultAllocatorT<ObjectType>>
 using BigArray = BaseArray<uint32_t, ObjectType, Allocator>;
 
-template<typename ObjectType, uint32_t FIXED_SIZE, typename Allocator = DefaultAllocatorT<ObjectType>>
-class InplaceArray : public BaseArray<uint16_t, ObjectType, Allocator>
+// Array that keeps up to INLINE_CAPACITY elements inside the object and only goes to the allocator once it outgrows them.
+template<typename ObjectType, uint32_t INLINE_CAPACITY, typename Allocator = DefaultAllocatorT<ObjectType>>
+class SmallArray : public BaseArray<uint16_t, ObjectType, Allocator>
 {
 	typedef BaseArray<uint16_t, ObjectType, Allocator> super;
 public:
-	InplaceArray() : super(reinterpret_cast<float*>(m_FixedBuffer), 0, FIXED_SIZE, false) {}
-	InplaceArray(const InplaceArray&) = default;
-	InplaceArray(InplaceArray&& other) = default;
-	~InplaceArray() = default;
-	InplaceArray& operator=(const InplaceArray&) = default;
-	InplaceArray& operator=(InplaceArray&& other) = default;
+	SmallArray()
+		: super(reinterpret_cast<ObjectType*>(m_InlineBuffer), 0, INLINE_CAPACITY, false)
+	{
+	}
+
+	SmallArray(const SmallArray& other)
+		: SmallArray()
+	{
+		super::Append(other.GetBuffer(), other.Size());
+	}
+
+	SmallArray(SmallArray&& other)
+		: SmallArray()
+	{
+		super::operator=(std::move(other));
+		other.ResetToInline();
+	}
+
+	~SmallArray()
+	{
+		// Elements may live in m_InlineBuffer, destroy them while it is still alive.
+		super::Clear();
+	}
+
+	SmallArray& operator=(const SmallArray& other)
+	{
+		super::operator=(other);
+		return *this;
+	}
+
+	SmallArray& operator=(SmallArray&& other)
+	{
+		super::operator=(std::move(other));
+		other.ResetToInline();
+		return *this;
+	}
+
+	bool IsInline() const { return super::GetBuffer() == GetInlineBuffer(); }
+
+	// Moves the elements back into the inline buffer once they fit again. Like Array, keeps a buffer it does not own.
+	void ShrinkToFit()
+	{
+		if (IsInline() || !super::OwnsBuffer())
+			return;
+		if (super::Size() <= INLINE_CAPACITY)
+			super::AdoptBuffer(GetInlineBuffer(), INLINE_CAPACITY, false);
+		else
+			super::ShrinkToFit();
+	}
+
 private:
-	uint8_t m_FixedBuffer[sizeof(ObjectType)*FIXED_SIZE];
+	// A moved-from array that had spilled to the heap is left without a buffer, give it back its inline one.
+	void ResetToInline()
+	{
+		if (super::GetBuffer() == nullptr)
+			super::AdoptBuffer(GetInlineBuffer(), INLINE_CAPACITY, false);
+	}
+
+	ObjectType* GetInlineBuffer() { return reinterpret_cast<ObjectType*>(m_InlineBuffer); }
+	const ObjectType* GetInlineBuffer() const { return reinterpret_cast<const ObjectType*>(m_InlineBuffer); }
+
+	static_assert(INLINE_CAPACITY > 0 && INLINE_CAPACITY <= std::numeric_limits<uint16_t>::max(), "Invalid inline capacity");
+	typename std::aligned_storage<sizeof(ObjectType), alignof(ObjectType)>::type m_InlineBuffer[INLINE_CAPACITY];
 };
 
 ANIM_NAMESPACE_END
\ No newline at end of file
@@ -0,0 +1,433 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <tuple>
+#include <new>
+#include "animcore/util/namespace.h"
+#include "animcore/util/assert.h"
+#include "animcore/memory/default_allocator.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLAT_HASH_MAP_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+ANIM_NAMESPACE_BEGIN
+
+namespace flat_hash_map_detail
+{
+	// A control byte is either Ctrl_Empty or the 7 low bits (H2) of the hash of the key stored in the slot.
+	static constexpr int8_t Ctrl_Empty = -128;
+	static constexpr uint32_t Group_Width = 16;
+	static constexpr uint32_t Min_Capacity = Group_Width;
+
+	inline uint32_t CountTrailingZeros(uint32_t mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return static_cast<uint32_t>(index);
+#else
+		return static_cast<uint32_t>(__builtin_ctz(mask));
+#endif
+	}
+
+	// std::hash is the identity for integers, spread the bits before splitting the hash into H1 and H2.
+	inline uint64_t MixHash(uint64_t hash)
+	{
+		hash ^= hash >> 32;
+		hash *= 0x9E3779B97F4A7C15ull;
+		return hash ^ (hash >> 29);
+	}
+
+	// Group_Width consecutive control bytes, matched in parallel.
+	class Group
+	{
+	public:
+		explicit Group(const int8_t* ctrl)
+		{
+#ifdef FLAT_HASH_MAP_SSE2
+			m_Ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+#else
+			memcpy(m_Ctrl, ctrl, Group_Width);
+#endif
+		}
+
+		// Bit i is set if control byte i equals value.
+		uint32_t Match(int8_t value) const
+		{
+#ifdef FLAT_HASH_MAP_SSE2
+			return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(value), m_Ctrl)));
+#else
+			uint32_t mask = 0;
+			for (uint32_t i = 0; i < Group_Width; ++i)
+			{
+				mask |= static_cast<uint32_t>(m_Ctrl[i] == value) << i;
+			}
+			return mask;
+#endif
+		}
+
+		uint32_t MatchEmpty() const { return Match(Ctrl_Empty); }
+
+	private:
+#ifdef FLAT_HASH_MAP_SSE2
+		__m128i m_Ctrl;
+#else
+		int8_t m_Ctrl[Group_Width];
+#endif
+	};
+}
+
+// Open addressing hash map storing its entries inline in a single allocation (SwissTable layout).
+// Probing is linear and looks at Group_Width control bytes at once. Erase shifts the following entries back
+// instead of leaving tombstones, so lookups never slow down with churn.
+// Any insert or erase invalidates iterators and pointers to entries.
+template<
+	typename Key,
+	typename T,
+	typename Hash = std::hash<Key>,
+	typename KeyEqual = std::equal_to<Key>>
+class FlatHashMap
+{
+public:
+	typedef Key key_type;
+	typedef T mapped_type;
+	typedef std::pair<const Key, T> value_type;
+
+private:
+	template<typename MapType, typename ValueType>
+	class Iterator_Base
+	{
+	public:
+		Iterator_Base() : m_Map(nullptr), m_Index(0) {}
+		Iterator_Base(MapType* map, uint32_t index) : m_Map(map), m_Index(index) { SkipEmpty(); }
+
+		ValueType& operator*() const { return m_Map->m_Slots[m_Index]; }
+		ValueType* operator->() const { return &m_Map->m_Slots[m_Index]; }
+
+		Iterator_Base& operator++()
+		{
+			++m_Index;
+			SkipEmpty();
+			return *this;
+		}
+
+		bool operator==(const Iterator_Base& other) const { return m_Map == other.m_Map && m_Index == other.m_Index; }
+		bool operator!=(const Iterator_Base& other) const { return !(*this == other); }
+
+	private:
+		void SkipEmpty()
+		{
+			while (m_Map != nullptr && m_Index < m_Map->m_Capacity && m_Map->m_Ctrl[m_Index] == flat_hash_map_detail::Ctrl_Empty)
+			{
+				++m_Index;
+			}
+		}
+
+		MapType* m_Map;
+		uint32_t m_Index;
+		friend class FlatHashMap;
+	};
+
+public:
+	typedef Iterator_Base<FlatHashMap, value_type> Iterator;
+	typedef Iterator_Base<const FlatHashMap, const value_type> ConstIterator;
+	typedef Iterator iterator;
+	typedef ConstIterator const_iterator;
+
+	FlatHashMap()
+		: m_Ctrl(nullptr)
+		, m_Slots(nullptr)
+		, m_Capacity(0)
+		, m_Size(0)
+	{
+	}
+
+	FlatHashMap(const FlatHashMap& other)
+		: FlatHashMap()
+	{
+		reserve(other.m_Size);
+		for (const auto& entry : other)
+		{
+			InsertUnique(entry.first, entry.second);
+		}
+	}
+
+	FlatHashMap(FlatHashMap&& other)
+		: FlatHashMap()
+	{
+		Swap(other);
+	}
+
+	~FlatHashMap()
+	{
+		DestroyAll();
+	}
+
+	FlatHashMap& operator=(const FlatHashMap& other)
+	{
+		if (this != &other)
+		{
+			FlatHashMap tmp(other);
+			Swap(tmp);
+		}
+		return *this;
+	}
+
+	FlatHashMap& operator=(FlatHashMap&& other)
+	{
+		if (this != &other)
+		{
+			DestroyAll();
+			Swap(other);
+		}
+		return *this;
+	}
+
+	Iterator begin() { return Iterator(this, 0); }
+	Iterator end() { return Iterator(this, m_Capacity); }
+	ConstIterator begin() const { return ConstIterator(this, 0); }
+	ConstIterator end() const { return ConstIterator(this, m_Capacity); }
+
+	size_t size() const { return m_Size; }
+	bool empty() const { return m_Size == 0; }
+	size_t capacity() const { return m_Capacity; }
+
+	Iterator find(const Key& key) { return Iterator(this, FindIndex(key)); }
+	ConstIterator find(const Key& key) const { return ConstIterator(this, FindIndex(key)); }
+	size_t count(const Key& key) const { return FindIndex(key) != m_Capacity ? 1 : 0; }
+
+	T& operator[](const Key& key)
+	{
+		return emplace(key).first->second;
+	}
+
+	std::pair<Iterator, bool> insert(const value_type& value)
+	{
+		return emplace(value.first, value.second);
+	}
+
+	template<typename ...Args>
+	std::pair<Iterator, bool> emplace(const Key& key, Args&&... args)
+	{
+		uint32_t index = FindIndex(key);
+		if (index != m_Capacity)
+			return std::make_pair(Iterator(this, index), false);
+		index = InsertUnique(key, std::forward<Args>(args)...);
+		return std::make_pair(Iterator(this, index), true);
+	}
+
+	size_t erase(const Key& key)
+	{
+		uint32_t index = FindIndex(key);
+		if (index == m_Capacity)
+			return 0;
+		EraseAt(index);
+		return 1;
+	}
+
+	// Returns an iterator to the entry that moved into the erased slot, or the next one if none did.
+	Iterator erase(ConstIterator iter)
+	{
+		ANIM_ASSERT(iter.m_Map == this && iter.m_Index < m_Capacity);
+		EraseAt(iter.m_Index);
+		return Iterator(this, iter.m_Index);
+	}
+
+	Iterator erase(Iterator iter)
+	{
+		ANIM_ASSERT(iter.m_Map == this && iter.m_Index < m_Capacity);
+		EraseAt(iter.m_Index);
+		return Iterator(this, iter.m_Index);
+	}
+
+	void clear()
+	{
+		for (uint32_t i = 0; i < m_Capacity; ++i)
+		{
+			if (m_Ctrl[i] != flat_hash_map_detail::Ctrl_Empty)
+				m_Slots[i].~value_type();
+		}
+		if (m_Ctrl != nullptr)
+			memset(m_Ctrl, flat_hash_map_detail::Ctrl_Empty, m_Capacity + flat_hash_map_detail::Group_Width);
+		m_Size = 0;
+	}
+
+	void reserve(size_t numElements)
+	{
+		uint32_t capacity = flat_hash_map_detail::Min_Capacity;
+		while (GetMaxLoad(capacity) < numElements)
+		{
+			capacity *= 2;
+		}
+		if (capacity > m_Capacity)
+			Rehash(capacity);
+	}
+
+private:
+	static inline uint64_t HashKey(const Key& key)
+	{
+		return flat_hash_map_detail::MixHash(static_cast<uint64_t>(Hash()(key)));
+	}
+
+	static inline int8_t H2(uint64_t hash) { return static_cast<int8_t>(hash & 0x7F); }
+	static inline uint64_t H1(uint64_t hash) { return hash >> 7; }
+
+	// Keep at most 7/8 of the slots occupied.
+	static inline size_t GetMaxLoad(uint32_t capacity) { return capacity - capacity / 8; }
+
+	uint32_t FindIndex(const Key& key) const
+	{
+		using namespace flat_hash_map_detail;
+		if (m_Size == 0)
+			return m_Capacity;
+
+		uint64_t hash = HashKey(key);
+		int8_t h2 = H2(hash);
+		uint32_t mask = m_Capacity - 1;
+		uint32_t offset = static_cast<uint32_t>(H1(hash)) & mask;
+		while (true)
+		{
+			Group group(m_Ctrl + offset);
+			uint32_t matches = group.Match(h2);
+			while (matches != 0)
+			{
+				uint32_t index = (offset + CountTrailingZeros(matches)) & mask;
+				if (KeyEqual()(m_Slots[index].first, key))
+					return index;
+				matches &= matches - 1;
+			}
+			if (group.MatchEmpty() != 0)
+				return m_Capacity;
+			offset = (offset + Group_Width) & mask;
+		}
+	}
+
+	uint32_t FindFirstEmpty(uint64_t hash) const
+	{
+		using namespace flat_hash_map_detail;
+		uint32_t mask = m_Capacity - 1;
+		uint32_t offset = static_cast<uint32_t>(H1(hash)) & mask;
+		while (true)
+		{
+			uint32_t empties = Group(m_Ctrl + offset).MatchEmpty();
+			if (empties != 0)
+				return (offset + CountTrailingZeros(empties)) & mask;
+			offset = (offset + Group_Width) & mask;
+		}
+	}
+
+	// The first Group_Width - 1 control bytes are mirrored after the last slot so groups never have to wrap.
+	void SetCtrl(uint32_t index, int8_t value)
+	{
+		m_Ctrl[index] = value;
+		if (index < flat_hash_map_detail::Group_Width - 1)
+			m_Ctrl[m_Capacity + index] = value;
+	}
+
+	template<typename ...Args>
+	uint32_t InsertUnique(const Key& key, Args&&... args)
+	{
+		if (m_Size + 1 > GetMaxLoad(m_Capacity))
+			Rehash(m_Capacity == 0 ? flat_hash_map_detail::Min_Capacity : m_Capacity * 2);
+
+		uint64_t hash = HashKey(key);
+		uint32_t index = FindFirstEmpty(hash);
+		new (&m_Slots[index]) value_type(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+		SetCtrl(index, H2(hash));
+		++m_Size;
+		return index;
+	}
+
+	void EraseAt(uint32_t index)
+	{
+		using namespace flat_hash_map_detail;
+		uint32_t mask = m_Capacity - 1;
+		m_Slots[index].~value_type();
+		--m_Size;
+
+		// Backward shift: pull every following entry of the probe run whose home slot is not after the hole.
+		uint32_t hole = index;
+		uint32_t cur = (index + 1) & mask;
+		while (m_Ctrl[cur] != Ctrl_Empty)
+		{
+			uint32_t home = static_cast<uint32_t>(H1(HashKey(m_Slots[cur].first))) & mask;
+			if (((cur - home) & mask) >= ((cur - hole) & mask))
+			{
+				MoveSlot(hole, cur);
+				SetCtrl(hole, m_Ctrl[cur]);
+				hole = cur;
+			}
+			cur = (cur + 1) & mask;
+		}
+		SetCtrl(hole, Ctrl_Empty);
+	}
+
+	void MoveSlot(uint32_t dst, uint32_t src)
+	{
+		new (&m_Slots[dst]) value_type(std::move(const_cast<Key&>(m_Slots[src].first)), std::move(m_Slots[src].second));
+		m_Slots[src].~value_type();
+	}
+
+	void Rehash(uint32_t newCapacity)
+	{
+		using namespace flat_hash_map_detail;
+		ANIM_ASSERT((newCapacity & (newCapacity - 1)) == 0);
+		int8_t* oldCtrl = m_Ctrl;
+		value_type* oldSlots = m_Slots;
+		uint32_t oldCapacity = m_Capacity;
+
+		// Control bytes first, their size is a multiple of Group_Width so the slots stay aligned.
+		size_t ctrlSize = newCapacity + Group_Width;
+		static_assert(alignof(value_type) <= Group_Width, "Entry alignment not supported");
+		m_Ctrl = static_cast<int8_t*>(DefaultAllocator::Allocate(ctrlSize + newCapacity * sizeof(value_type)));
+		m_Slots = reinterpret_cast<value_type*>(m_Ctrl + ctrlSize);
+		m_Capacity = newCapacity;
+		memset(m_Ctrl, Ctrl_Empty, ctrlSize);
+
+		for (uint32_t i = 0; i < oldCapacity; ++i)
+		{
+			if (oldCtrl[i] == Ctrl_Empty)
+				continue;
+			auto& entry = oldSlots[i];
+			uint64_t hash = HashKey(entry.first);
+			uint32_t index = FindFirstEmpty(hash);
+			new (&m_Slots[index]) value_type(std::move(const_cast<Key&>(entry.first)), std::move(entry.second));
+			SetCtrl(index, H2(hash));
+			entry.~value_type();
+		}
+		DefaultAllocator::Free(oldCtrl);
+	}
+
+	void DestroyAll()
+	{
+		clear();
+		DefaultAllocator::Free(m_Ctrl);
+		m_Ctrl = nullptr;
+		m_Slots = nullptr;
+		m_Capacity = 0;
+	}
+
+	void Swap(FlatHashMap& other)
+	{
+		std::swap(m_Ctrl, other.m_Ctrl);
+		std::swap(m_Slots, other.m_Slots);
+		std::swap(m_Capacity, other.m_Capacity);
+		std::swap(m_Size, other.m_Size);
+	}
+
+	int8_t* m_Ctrl;
+	value_type* m_Slots;
+	uint32_t m_Capacity;
+	uint32_t m_Size;
+};
+
+ANIM_NAMESPACE_END
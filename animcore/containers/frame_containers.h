@@ -0,0 +1,20 @@
+#pragma once
+#include "animcore/util/namespace.h"
+#include "animcore/memory/frame_arena.h"
+#include "animcore/containers/array.h"
+#include <unordered_map>
+
+ANIM_NAMESPACE_BEGIN
+
+// Containers whose storage comes from the FrameArena. They must not outlive the frame after the one they were filled in.
+template<typename ObjectType>
+using FrameArray = BaseArray<uint32_t, ObjectType, FrameAllocatorT<ObjectType>>;
+
+template<
+	typename Key,
+	typename T,
+	typename Hash = std::hash<Key>,
+	typename KeyEqual = std::equal_to<Key>>
+	using FrameUnorderedMap = std::unordered_map<Key, T, Hash, KeyEqual, FrameSTDAllocator<std::pair<const Key, T>>>;
+
+ANIM_NAMESPACE_END
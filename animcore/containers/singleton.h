@@ -10,6 +10,7 @@ class Singleton
 public:
 	Singleton() {}
 	static T& Instance() { return *m_Instance; }
+	static bool IsInitialized() { return m_Instance != nullptr; }
 	template<typename ...Args>
 	static void Initialize(Args... args)
 	{
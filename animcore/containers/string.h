@@ -1,10 +1,65 @@
 #pragma once
+#include <stdint.h>
+#include <string.h>
 #include "animcore/util/namespace.h"
 #include "animcore/memory/default_allocator.h"
+#include "animcore/math/hash64.h"
 #include <string>
 
 ANIM_NAMESPACE_BEGIN
 
 using SimpleString = std::basic_string<char, std::char_traits<char>, DefaultSTDAllocator<char>>;
 
-ANIM_NAMESPACE_END
\ No newline at end of file
+// Characters owned by someone else, e.g. a SimpleString, the StringTable or a mapped file. Not necessarily
+// null terminated.
+class StringView
+{
+public:
+	StringView()
+		: m_Data(""), m_Length(0)
+	{}
+
+	StringView(const char* data, uint32_t length)
+		: m_Data(data), m_Length(length)
+	{}
+
+	StringView(const char* str)
+		: m_Data(str), m_Length(static_cast<uint32_t>(strlen(str)))
+	{}
+
+	StringView(const SimpleString& str)
+		: m_Data(str.c_str()), m_Length(static_cast<uint32_t>(str.length()))
+	{}
+
+	const char* Data() const { return m_Data; }
+	uint32_t Length() const { return m_Length; }
+	bool IsEmpty() const { return m_Length == 0; }
+	char operator[](uint32_t index) const { return m_Data[index]; }
+
+	SimpleString ToString() const { return SimpleString(m_Data, m_Length); }
+	uint64_t GetHash() const { return HashUtils::Compute(m_Data, m_Length); }
+
+	bool operator==(const StringView& other) const
+	{
+		return m_Length == other.m_Length && memcmp(m_Data, other.m_Data, m_Length) == 0;
+	}
+	bool operator!=(const StringView& other) const { return !(*this == other); }
+
+private:
+	const char* m_Data;
+	uint32_t m_Length;
+};
+
+ANIM_NAMESPACE_END
+
+namespace std
+{
+	template<>
+	struct hash<animengine::StringView>
+	{
+		std::size_t operator()(const animengine::StringView& k) const
+		{
+			return static_cast<size_t>(k.GetHash());
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include "string_table.h"
+#include <string.h>
+#include <mutex>
+#include "animcore/memory/default_allocator.h"
+#include "animcore/util/assert.h"
+
+ANIM_NAMESPACE_BEGIN
+
+StringTable::StringTable(uint32_t pageSize)
+	: m_NumStrings(0)
+	, m_PageCursor(nullptr)
+	, m_PageRemaining(0)
+	, m_PageSize(pageSize)
+	, m_NumBytesUsed(0)
+{
+	for (auto& block : m_Blocks)
+	{
+		block.store(nullptr, std::memory_order_relaxed);
+	}
+	StringView* firstBlock = static_cast<StringView*>(DefaultAllocator::Allocate(Strings_Per_Block * sizeof(StringView)));
+	firstBlock[0] = StringView();
+	m_Blocks[0].store(firstBlock, std::memory_order_relaxed);
+	m_Indices.emplace(StringView(), 0u);
+	m_NumStrings.store(1, std::memory_order_release);
+}
+
+StringTable::~StringTable()
+{
+	for (auto& block : m_Blocks)
+	{
+		DefaultAllocator::Free(block.load(std::memory_order_relaxed));
+	}
+	for (char* page : m_Pages)
+	{
+		DefaultAllocator::Free(page);
+	}
+}
+
+StringID StringTable::Intern(StringView str)
+{
+	{
+		std::shared_lock<std::shared_timed_mutex> lock(m_Mutex);
+		auto iter = m_Indices.find(str);
+		if (iter != m_Indices.end())
+			return StringID(iter->second);
+	}
+
+	std::unique_lock<std::shared_timed_mutex> lock(m_Mutex);
+	auto iter = m_Indices.find(str);
+	if (iter != m_Indices.end())
+		return StringID(iter->second);
+
+	uint32_t index = m_NumStrings.load(std::memory_order_relaxed);
+	uint32_t blockIndex = index / Strings_Per_Block;
+	ANIM_VERIFY(blockIndex < Max_Blocks);
+	StringView* block = m_Blocks[blockIndex].load(std::memory_order_relaxed);
+	if (block == nullptr)
+	{
+		block = static_cast<StringView*>(DefaultAllocator::Allocate(Strings_Per_Block * sizeof(StringView)));
+		m_Blocks[blockIndex].store(block, std::memory_order_release);
+	}
+
+	StringView stored(StoreCharacters(str), str.Length());
+	block[index % Strings_Per_Block] = stored;
+	m_Indices.emplace(stored, index);
+	m_NumStrings.store(index + 1, std::memory_order_release);
+	return StringID(index);
+}
+
+StringID StringTable::Find(StringView str) const
+{
+	std::shared_lock<std::shared_timed_mutex> lock(m_Mutex);
+	auto iter = m_Indices.find(str);
+	if (iter == m_Indices.end())
+		return StringID();
+	return StringID(iter->second);
+}
+
+const char* StringTable::StoreCharacters(StringView str)
+{
+	uint32_t numBytes = str.Length() + 1;
+	char* dst;
+	if (numBytes > m_PageSize / 4)
+	{
+		// Long strings get their own allocation instead of wasting the rest of the current page.
+		dst = static_cast<char*>(DefaultAllocator::Allocate(numBytes));
+		m_Pages.Push(dst);
+	}
+	else
+	{
+		if (numBytes > m_PageRemaining)
+		{
+			m_PageCursor = static_cast<char*>(DefaultAllocator::Allocate(m_PageSize));
+			m_PageRemaining = m_PageSize;
+			m_Pages.Push(m_PageCursor);
+		}
+		dst = m_PageCursor;
+		m_PageCursor += numBytes;
+		m_PageRemaining -= numBytes;
+	}
+	memcpy(dst, str.Data(), str.Length());
+	dst[str.Length()] = '\0';
+	m_NumBytesUsed += numBytes;
+	return dst;
+}
+
+ANIM_NAMESPACE_END
@@ -0,0 +1,94 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <shared_mutex>
+#include "animcore/util/namespace.h"
+#include "animcore/containers/array.h"
+#include "animcore/containers/flat_hash_map.h"
+#include "animcore/containers/singleton.h"
+#include "animcore/containers/string.h"
+
+ANIM_NAMESPACE_BEGIN
+
+// Id of a string interned in the StringTable. Equal strings get equal ids, so comparing and hashing names is
+// a single integer operation. Ids are only meaningful within one process, files store the text.
+class StringID
+{
+public:
+	StringID()
+		: m_Index(0)
+	{}
+
+	explicit StringID(uint32_t index)
+		: m_Index(index)
+	{}
+
+	uint32_t GetIndex() const { return m_Index; }
+	// Id 0 is always the empty string.
+	bool IsEmpty() const { return m_Index == 0; }
+
+	bool operator==(const StringID& other) const { return m_Index == other.m_Index; }
+	bool operator!=(const StringID& other) const { return m_Index != other.m_Index; }
+	bool operator<(const StringID& other) const { return m_Index < other.m_Index; }
+
+private:
+	uint32_t m_Index;
+};
+
+// Stores every distinct bone, curve and property name once. The characters of an interned string never move
+// and stay null terminated, so views returned by GetString are valid until the table is shut down.
+// Lookups by text take a shared lock, GetString is lock free.
+class StringTable : public Singleton<StringTable>
+{
+public:
+	static constexpr uint32_t Default_Page_Size = 64 * 1024;
+	static constexpr uint32_t Strings_Per_Block = 1024;
+	static constexpr uint32_t Max_Blocks = 4096;
+
+	explicit StringTable(uint32_t pageSize = Default_Page_Size);
+	~StringTable();
+	StringTable(const StringTable&) = delete;
+	StringTable& operator=(const StringTable&) = delete;
+
+	StringID Intern(StringView str);
+	// Empty id if the string was never interned.
+	StringID Find(StringView str) const;
+
+	StringView GetString(StringID id) const
+	{
+		uint32_t index = id.GetIndex();
+		ANIM_ASSERT(index < m_NumStrings.load(std::memory_order_acquire));
+		return m_Blocks[index / Strings_Per_Block].load(std::memory_order_acquire)[index % Strings_Per_Block];
+	}
+
+	uint32_t GetNumStrings() const { return m_NumStrings.load(std::memory_order_acquire); }
+	// Characters stored, including the null terminators.
+	size_t GetNumBytesUsed() const { return m_NumBytesUsed; }
+
+private:
+	const char* StoreCharacters(StringView str);
+
+	mutable std::shared_timed_mutex m_Mutex;
+	FlatHashMap<StringView, uint32_t> m_Indices;
+	std::atomic<StringView*> m_Blocks[Max_Blocks];
+	std::atomic<uint32_t> m_NumStrings;
+	BigArray<char*> m_Pages;
+	char* m_PageCursor;
+	uint32_t m_PageRemaining;
+	uint32_t m_PageSize;
+	size_t m_NumBytesUsed;
+};
+
+ANIM_NAMESPACE_END
+
+namespace std
+{
+	template<>
+	struct hash<animengine::StringID>
+	{
+		std::size_t operator()(const animengine::StringID& k) const
+		{
+			return static_cast<size_t>(animengine::HashUtils::Compute(k.GetIndex()));
+		}
+	};
+}
@@ -2,6 +2,11 @@
 #include "animcore/memory/pointers.h"
 #include "animpublic/commands/core_commands.h"
 #include "animcore/containers/array.h"
+#include "animcore/containers/string_table.h"
+#include "animcore/memory/frame_arena.h"
+#include "animcore/objectmodel/object_manager.h"
+#include "animcore/serialization/reflection.h"
+#include "animcore/threading/job_system.h"
 
 ANIM_NAMESPACE_BEGIN
 static anim::CoreCommands s_CoreCommands;
@@ -11,6 +16,7 @@ class EngineInterfaceImpl : public EngineInterface
 public:
 	virtual void InitializeRuntime() override;
 	virtual void FinalizeRuntime() override;
+	virtual void BeginFrame() override;
 	virtual void RegisterCoreCommands(anim::CoreCommands& commandStruct) override
 	{
 		s_CoreCommands = commandStruct;
@@ -23,10 +29,27 @@ void EngineInterfaceImpl::InitializeRuntime()
 {
 	Array<int> stuff;
 	stuff.Push(5);
+	FrameArena::Initialize();
+	JobSystem::Initialize();
+	StringTable::Initialize();
+	Reflection::TypeRegistry::Initialize();
+	ObjectManager::Initialize();
 }
 
 void EngineInterfaceImpl::FinalizeRuntime()
 {
+	// Finish the queued loads before the registry goes away.
+	JobSystem::Shutdown();
+	ObjectManager::Shutdown();
+	Reflection::TypeRegistry::Shutdown();
+	StringTable::Shutdown();
+	FrameArena::Shutdown();
+}
+
+void EngineInterfaceImpl::BeginFrame()
+{
+	FrameArena::Instance().BeginFrame();
+	ObjectManager::Instance().DispatchMainThreadCallbacks();
 }
 
 anim::CoreCommands& EngineInterface::GetCoreCommands()
@@ -0,0 +1,84 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "animcore/util/namespace.h"
+
+ANIM_NAMESPACE_BEGIN
+
+// IEEE 754 binary16 conversions. Rounds to nearest even, overflows to infinity and keeps NaNs.
+inline uint16_t FloatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+	const uint32_t absBits = bits & 0x7FFFFFFFu;
+
+	if (absBits >= 0x7F800000u)
+	{
+		// Infinity stays infinity, NaN keeps a payload bit so it does not turn into infinity.
+		return sign | 0x7C00u | (absBits > 0x7F800000u ? 0x0200u : 0u);
+	}
+	if (absBits >= 0x477FF000u)
+	{
+		// Rounds to a value past the largest half.
+		return sign | 0x7C00u;
+	}
+	if (absBits < 0x38800000u)
+	{
+		// Subnormal half, or zero. Shift the implicit bit in and round to nearest even.
+		if (absBits < 0x33000000u)
+			return sign;
+		const uint32_t exponent = absBits >> 23;
+		const uint32_t mantissa = (absBits & 0x007FFFFFu) | 0x00800000u;
+		const uint32_t shift = 126 - exponent;
+		uint32_t half = mantissa >> shift;
+		const uint32_t remainder = mantissa & ((1u << shift) - 1);
+		const uint32_t halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (half & 1u)))
+			++half;
+		return sign | static_cast<uint16_t>(half);
+	}
+
+	// Normal half. Rebias the exponent and round the mantissa, a carry correctly bumps the exponent.
+	uint32_t half = (absBits - 0x38000000u) >> 13;
+	const uint32_t remainder = absBits & 0x1FFFu;
+	if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u)))
+		++half;
+	return sign | static_cast<uint16_t>(half);
+}
+
+inline float HalfToFloat(uint16_t half)
+{
+	const uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+	uint32_t exponent = (half >> 10) & 0x1Fu;
+	uint32_t mantissa = half & 0x03FFu;
+	uint32_t bits;
+	if (exponent == 0x1Fu)
+	{
+		bits = sign | 0x7F800000u | (mantissa << 13);
+	}
+	else if (exponent != 0)
+	{
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+	else if (mantissa == 0)
+	{
+		bits = sign;
+	}
+	else
+	{
+		// Subnormal half, normalize it.
+		exponent = 113;
+		while ((mantissa & 0x0400u) == 0)
+		{
+			mantissa <<= 1;
+			--exponent;
+		}
+		bits = sign | (exponent << 23) | ((mantissa & 0x03FFu) << 13);
+	}
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+ANIM_NAMESPACE_END
@@ -1,68 +1,230 @@
 #pragma once
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
+#include <wchar.h>
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#pragma intrinsic(_umul128)
+#endif
 
 namespace animengine
 {
 	namespace HashUtils
 	{
-		const uint64_t FNV_prime = 1099511628211UL;
-		const uint64_t FNV_offset_basis = 14695981039346656037UL;
+		// Word-at-a-time 64 bit hash (wyhash family). Input is consumed 8 or 16 bytes per step and mixed with
+		// 64x64->128 bit multiplies. The constexpr variant runs the exact same algorithm, so a name hashed at
+		// compile time matches the same name hashed at runtime. Words are always read as little endian.
+		const uint64_t Default_Seed = 0;
 
-		//------------------------------------------------------------------------------
-		uint64_t Compute(const void * data, size_t length)
+		namespace Detail
 		{
-			const char * input = static_cast<const char *>(data);
-			uint64_t result = FNV_offset_basis;
-			for (size_t i = 0; i < length; ++i)
+			constexpr uint64_t Hash_Secret[4] = { 0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull };
+
+			// Full 128 bit product of a and b, low half returned in a and high half in b.
+			constexpr void MultiplyPortable(uint64_t & a, uint64_t & b)
+			{
+				uint64_t ha = a >> 32, hb = b >> 32, la = static_cast<uint32_t>(a), lb = static_cast<uint32_t>(b);
+				uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+				uint64_t t = rl + (rm0 << 32);
+				uint64_t carry = t < rl;
+				uint64_t lo = t + (rm1 << 32);
+				carry += lo < t;
+				uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+				a = lo;
+				b = hi;
+			}
+
+			struct RuntimeOps
+			{
+				static inline uint64_t Read8(const uint8_t * p)
+				{
+					uint64_t value;
+					memcpy(&value, p, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+					value = __builtin_bswap64(value);
+#endif
+					return value;
+				}
+
+				static inline uint64_t Read4(const uint8_t * p)
+				{
+					uint32_t value;
+					memcpy(&value, p, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+					value = __builtin_bswap32(value);
+#endif
+					return value;
+				}
+
+				static inline void Multiply(uint64_t & a, uint64_t & b)
+				{
+#if defined(__SIZEOF_INT128__)
+					__uint128_t r = a;
+					r *= b;
+					a = static_cast<uint64_t>(r);
+					b = static_cast<uint64_t>(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+					a = _umul128(a, b, &b);
+#else
+					MultiplyPortable(a, b);
+#endif
+				}
+			};
+
+			struct ConstexprOps
 			{
-				result = (result ^ input[i]) * FNV_prime;
+				static constexpr uint64_t Read8(const char * p)
+				{
+					uint64_t value = 0;
+					for (int i = 7; i >= 0; --i)
+						value = (value << 8) | static_cast<uint8_t>(p[i]);
+					return value;
+				}
+
+				static constexpr uint64_t Read4(const char * p)
+				{
+					uint64_t value = 0;
+					for (int i = 3; i >= 0; --i)
+						value = (value << 8) | static_cast<uint8_t>(p[i]);
+					return value;
+				}
+
+				static constexpr void Multiply(uint64_t & a, uint64_t & b)
+				{
+					MultiplyPortable(a, b);
+				}
+			};
+
+			template <typename Ops>
+			constexpr uint64_t Mix(uint64_t a, uint64_t b)
+			{
+				Ops::Multiply(a, b);
+				return a ^ b;
+			}
+
+			template <typename Ops, typename Byte>
+			constexpr uint64_t Hash(const Byte * p, size_t length, uint64_t seed)
+			{
+				seed ^= Mix<Ops>(seed ^ Hash_Secret[0], Hash_Secret[1]);
+				uint64_t a = 0;
+				uint64_t b = 0;
+				if (length <= 16)
+				{
+					if (length >= 4)
+					{
+						size_t middle = (length >> 3) << 2;
+						a = (Ops::Read4(p) << 32) | Ops::Read4(p + middle);
+						b = (Ops::Read4(p + length - 4) << 32) | Ops::Read4(p + length - 4 - middle);
+					}
+					else if (length > 0)
+					{
+						a = (static_cast<uint64_t>(static_cast<uint8_t>(p[0])) << 16) |
+							(static_cast<uint64_t>(static_cast<uint8_t>(p[length >> 1])) << 8) |
+							static_cast<uint64_t>(static_cast<uint8_t>(p[length - 1]));
+					}
+				}
+				else
+				{
+					size_t remaining = length;
+					if (remaining > 48)
+					{
+						uint64_t seed1 = seed;
+						uint64_t seed2 = seed;
+						do
+						{
+							seed = Mix<Ops>(Ops::Read8(p) ^ Hash_Secret[1], Ops::Read8(p + 8) ^ seed);
+							seed1 = Mix<Ops>(Ops::Read8(p + 16) ^ Hash_Secret[2], Ops::Read8(p + 24) ^ seed1);
+							seed2 = Mix<Ops>(Ops::Read8(p + 32) ^ Hash_Secret[3], Ops::Read8(p + 40) ^ seed2);
+							p += 48;
+							remaining -= 48;
+						} while (remaining > 48);
+						seed ^= seed1 ^ seed2;
+					}
+					while (remaining > 16)
+					{
+						seed = Mix<Ops>(Ops::Read8(p) ^ Hash_Secret[1], Ops::Read8(p + 8) ^ seed);
+						p += 16;
+						remaining -= 16;
+					}
+					a = Ops::Read8(p + remaining - 16);
+					b = Ops::Read8(p + remaining - 8);
+				}
+				a ^= Hash_Secret[1];
+				b ^= seed;
+				Ops::Multiply(a, b);
+				return Mix<Ops>(a ^ Hash_Secret[0] ^ length, b ^ Hash_Secret[1]);
+			}
+
+			constexpr size_t StrLen(const char * value)
+			{
+				size_t length = 0;
+				while (value[length] != 0)
+					++length;
+				return length;
 			}
-			return result;
 		}
 
 		//------------------------------------------------------------------------------
-		uint64_t Compute(const char * value)
+		inline uint64_t Compute(const void * data, size_t length, uint64_t seed = Default_Seed)
 		{
-			const char * input = value;
-			uint64_t result = FNV_offset_basis;
-			while (*input)
-			{
-				result = (result ^ *input) * FNV_prime;
-				++input;
-			}
-			return result;
+			return Detail::Hash<Detail::RuntimeOps>(static_cast<const uint8_t *>(data), length, seed);
 		}
 
 		//------------------------------------------------------------------------------
-		uint64_t Compute(const wchar_t * value)
+		inline uint64_t Compute(const char * value)
+		{
+			return Compute(value, strlen(value));
+		}
+
+		//------------------------------------------------------------------------------
+		inline uint64_t Compute(const wchar_t * value)
 		{
 			size_t strLen = wcslen(value);
-			return Compute(reinterpret_cast<const char *>(value), strLen * sizeof(wchar_t));
+			return Compute(value, strLen * sizeof(wchar_t));
+		}
+
+		//------------------------------------------------------------------------------
+		inline uint64_t Compute(const int & value)
+		{
+			return Compute(&value, sizeof(value));
+		}
+
+		//------------------------------------------------------------------------------
+		inline uint64_t Compute(const unsigned int & value)
+		{
+			return Compute(&value, sizeof(value));
 		}
 
 		//------------------------------------------------------------------------------
-		uint64_t Compute(const int & value)
+		inline uint64_t Compute(const int64_t & value)
 		{
 			return Compute(&value, sizeof(value));
 		}
 
 		//------------------------------------------------------------------------------
-		uint64_t Compute(const unsigned int & value)
+		inline uint64_t Compute(const uint64_t & value)
 		{
 			return Compute(&value, sizeof(value));
 		}
 
 		//------------------------------------------------------------------------------
-		uint64_t Compute(const int64_t & value)
+		// Compile time hash of a null terminated string, equal to Compute(value) for the same string.
+		constexpr uint64_t ComputeConstexpr(const char * value, uint64_t seed = Default_Seed)
 		{
-			return Compute((const void *)&value, sizeof(value));
+			return Detail::Hash<Detail::ConstexprOps>(value, Detail::StrLen(value), seed);
 		}
 
 		//------------------------------------------------------------------------------
-		uint64_t Compute(const uint64_t & value)
+		// Folds two words, like the halves of a GUID, into a hash where every input bit flips every output bit
+		// about half the time. One multiply folded to 64 bits leaves the top input bits with a visible bias, so
+		// the full 128 bit product is multiplied once more, as Compute does for its last 16 bytes.
+		inline uint64_t Mix(uint64_t a, uint64_t b)
 		{
-			return Compute((const void *)&value, sizeof(value));
+			a ^= Detail::Hash_Secret[0];
+			b ^= Detail::Hash_Secret[1];
+			Detail::RuntimeOps::Multiply(a, b);
+			return Detail::Mix<Detail::RuntimeOps>(a ^ Detail::Hash_Secret[2], b ^ Detail::Hash_Secret[3]);
 		}
 
 		//------------------------------------------------------------------------------
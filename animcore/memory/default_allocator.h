@@ -1,7 +1,9 @@
 #pragma once
+#include <utility>
 #include "animcore/util/namespace.h"
 #include "animcore/interface/engine_interface.h"
 #include "animpublic/commands/core_commands.h"
+#include "animcore/memory/small_object_allocator.h"
 
 ANIM_NAMESPACE_BEGIN
 
@@ -12,11 +14,23 @@ public:
 	{
 		if (data == nullptr)
 			return;
+#ifdef ANIM_USE_SMALL_OBJECT_ALLOCATOR
+		if (SmallObjectAllocator::Free(data))
+			return;
+#endif
 		EngineInterface::GetCoreCommands().m_FreeFn(data);
 	}
 
 	static void* Allocate(size_t size)
 	{
+#ifdef ANIM_USE_SMALL_OBJECT_ALLOCATOR
+		if (size <= SmallObjectAllocator::Max_Small_Size)
+		{
+			void* data = SmallObjectAllocator::Allocate(size);
+			if (data != nullptr)
+				return data;
+		}
+#endif
 		return EngineInterface::GetCoreCommands().m_AllocateFn(size);
 	}
 
@@ -27,7 +41,7 @@ public:
 	}
 
 	template<typename T, typename ...Args>
-	static T* Create(Args... args)
+	static T* Create(Args&&... args)
 	{
 		return new (Allocate<T>()) T(std::forward<Args>(args)...);
 	}
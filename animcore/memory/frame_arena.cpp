@@ -0,0 +1,198 @@
+#include "frame_arena.h"
+#include <string.h>
+#include "animcore/memory/default_allocator.h"
+#include "animcore/math/utils.h"
+#include "animcore/util/assert.h"
+
+ANIM_NAMESPACE_BEGIN
+
+#ifdef FRAME_ARENA_DEBUG
+static constexpr uint8_t Poison_Value = 0xCD;
+#endif
+
+FrameArena::FrameArena(size_t blockSize)
+	: m_CurrentBuffer(nullptr)
+	, m_BlockSize(blockSize)
+	, m_FrameIndex(0)
+{
+	memset(&m_LastFrameStats, 0, sizeof(m_LastFrameStats));
+	for (auto& buffer : m_Buffers)
+	{
+		buffer.m_State.store(0, std::memory_order_relaxed);
+		buffer.m_NumBlocks = 1;
+		buffer.m_Blocks[0].m_Size = m_BlockSize;
+		buffer.m_Blocks[0].m_Data = static_cast<uint8_t*>(DefaultAllocator::Allocate(m_BlockSize));
+		buffer.m_Overflow = nullptr;
+		buffer.m_BytesOverflowed = 0;
+	}
+	m_CurrentBuffer.store(&m_Buffers[0], std::memory_order_release);
+}
+
+FrameArena::~FrameArena()
+{
+	for (auto& buffer : m_Buffers)
+	{
+		for (uint32_t i = 0; i < buffer.m_NumBlocks; ++i)
+		{
+			DefaultAllocator::Free(buffer.m_Blocks[i].m_Data);
+		}
+		buffer.m_NumBlocks = 0;
+		FreeOverflow(buffer);
+	}
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+	ANIM_ASSERT((alignment & (alignment - 1)) == 0);
+	// Offsets always stay Default_Alignment aligned, bigger alignments pay for the worst case padding.
+	size_t paddedSize = (size + Default_Alignment - 1) & ~(Default_Alignment - 1);
+	if (alignment > Default_Alignment)
+		paddedSize += alignment - Default_Alignment;
+
+	Buffer& buffer = *m_CurrentBuffer.load(std::memory_order_acquire);
+	while (true)
+	{
+		uint64_t state = buffer.m_State.fetch_add(paddedSize, std::memory_order_acq_rel);
+		uint32_t blockIndex = static_cast<uint32_t>(state >> Offset_Bits);
+		size_t offset = static_cast<size_t>(state & Offset_Mask);
+
+		const Block& block = buffer.m_Blocks[blockIndex];
+		if (offset + paddedSize <= block.m_Size)
+		{
+			uintptr_t address = reinterpret_cast<uintptr_t>(block.m_Data + offset);
+			address = (address + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+			return reinterpret_cast<void*>(address);
+		}
+
+		if (!AdvanceBlock(buffer, blockIndex, paddedSize))
+			return AllocateOverflow(buffer, size, alignment);
+	}
+}
+
+bool FrameArena::AdvanceBlock(Buffer& buffer, uint64_t observedBlockIndex, size_t minSize)
+{
+	std::lock_guard<std::mutex> lock(m_GrowMutex);
+	uint64_t state = buffer.m_State.load(std::memory_order_acquire);
+	if ((state >> Offset_Bits) != observedBlockIndex)
+		return true;
+
+	uint32_t nextIndex = static_cast<uint32_t>(observedBlockIndex + 1);
+	if (nextIndex >= Max_Blocks_Per_Buffer)
+		return false;
+
+	Block& nextBlock = buffer.m_Blocks[nextIndex];
+	if (nextIndex < buffer.m_NumBlocks && nextBlock.m_Size < minSize)
+	{
+		DefaultAllocator::Free(nextBlock.m_Data);
+		nextBlock.m_Data = nullptr;
+	}
+
+	if (nextIndex >= buffer.m_NumBlocks || nextBlock.m_Data == nullptr)
+	{
+		nextBlock.m_Size = MAX(m_BlockSize, minSize);
+		nextBlock.m_Data = static_cast<uint8_t*>(DefaultAllocator::Allocate(nextBlock.m_Size));
+		if (nextBlock.m_Data == nullptr)
+		{
+			nextBlock.m_Size = 0;
+			return false;
+		}
+		buffer.m_NumBlocks = MAX(buffer.m_NumBlocks, nextIndex + 1);
+	}
+
+	buffer.m_State.store(static_cast<uint64_t>(nextIndex) << Offset_Bits, std::memory_order_release);
+	return true;
+}
+
+// Slow path for frames that outgrew their blocks, every further allocation of the frame takes the lock.
+void* FrameArena::AllocateOverflow(Buffer& buffer, size_t size, size_t alignment)
+{
+	size_t headerSize = (sizeof(OverflowBlock) + Default_Alignment - 1) & ~(Default_Alignment - 1);
+	size_t blockSize = headerSize + size + (alignment > Default_Alignment ? alignment - Default_Alignment : 0);
+	auto block = static_cast<OverflowBlock*>(DefaultAllocator::Allocate(blockSize));
+	ANIM_ASSERT(block != nullptr);
+	if (block == nullptr)
+		return nullptr;
+
+	std::lock_guard<std::mutex> lock(m_GrowMutex);
+	block->m_Next = buffer.m_Overflow;
+	block->m_Size = blockSize;
+	buffer.m_Overflow = block;
+	buffer.m_BytesOverflowed += blockSize;
+
+	uintptr_t address = reinterpret_cast<uintptr_t>(block) + headerSize;
+	address = (address + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+	return reinterpret_cast<void*>(address);
+}
+
+void FrameArena::FreeOverflow(Buffer& buffer)
+{
+	OverflowBlock* block = buffer.m_Overflow;
+	while (block != nullptr)
+	{
+		OverflowBlock* next = block->m_Next;
+		DefaultAllocator::Free(block);
+		block = next;
+	}
+	buffer.m_Overflow = nullptr;
+	buffer.m_BytesOverflowed = 0;
+}
+
+size_t FrameArena::GetBytesUsed(const Buffer& buffer) const
+{
+	uint64_t state = buffer.m_State.load(std::memory_order_acquire);
+	uint32_t blockIndex = static_cast<uint32_t>(state >> Offset_Bits);
+	size_t offset = static_cast<size_t>(state & Offset_Mask);
+
+	size_t bytesUsed = MIN(offset, buffer.m_Blocks[blockIndex].m_Size);
+	for (uint32_t i = 0; i < blockIndex; ++i)
+	{
+		bytesUsed += buffer.m_Blocks[i].m_Size;
+	}
+	return bytesUsed;
+}
+
+size_t FrameArena::GetBytesReserved(const Buffer& buffer) const
+{
+	size_t bytesReserved = 0;
+	for (uint32_t i = 0; i < buffer.m_NumBlocks; ++i)
+	{
+		bytesReserved += buffer.m_Blocks[i].m_Size;
+	}
+	return bytesReserved;
+}
+
+void FrameArena::ResetBuffer(Buffer& buffer)
+{
+#ifdef FRAME_ARENA_DEBUG
+	uint64_t state = buffer.m_State.load(std::memory_order_acquire);
+	uint32_t lastBlock = static_cast<uint32_t>(state >> Offset_Bits);
+	for (uint32_t i = 0; i <= lastBlock; ++i)
+	{
+		size_t bytesToPoison = i < lastBlock ? buffer.m_Blocks[i].m_Size : MIN(static_cast<size_t>(state & Offset_Mask), buffer.m_Blocks[i].m_Size);
+		memset(buffer.m_Blocks[i].m_Data, Poison_Value, bytesToPoison);
+	}
+#endif
+	buffer.m_State.store(0, std::memory_order_release);
+	std::lock_guard<std::mutex> lock(m_GrowMutex);
+	FreeOverflow(buffer);
+}
+
+void FrameArena::BeginFrame()
+{
+	const Buffer& finished = *m_CurrentBuffer.load(std::memory_order_acquire);
+	m_LastFrameStats.m_FrameIndex = m_FrameIndex;
+	m_LastFrameStats.m_BytesUsed = GetBytesUsed(finished);
+	m_LastFrameStats.m_BytesReserved = GetBytesReserved(finished);
+	{
+		std::lock_guard<std::mutex> lock(m_GrowMutex);
+		m_LastFrameStats.m_BytesOverflowed = finished.m_BytesOverflowed;
+	}
+	m_LastFrameStats.m_HighWaterMark = m_LastFrameStats.m_BytesUsed + m_LastFrameStats.m_BytesOverflowed;
+
+	++m_FrameIndex;
+	Buffer& next = m_Buffers[m_FrameIndex & 1];
+	ResetBuffer(next);
+	m_CurrentBuffer.store(&next, std::memory_order_release);
+}
+
+ANIM_NAMESPACE_END
@@ -0,0 +1,137 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include "animcore/util/namespace.h"
+#include "animcore/containers/singleton.h"
+
+//#define FRAME_ARENA_DEBUG
+
+ANIM_NAMESPACE_BEGIN
+
+// Bump-pointer allocator for data that only lives for the current update tick.
+// The arena is double buffered: memory handed out during frame N stays valid until BeginFrame is called
+// for frame N + 2, so work started in one frame can overlap with the next one. Nothing is ever freed
+// individually; blocks are kept between frames and reused. A frame that fills all Max_Blocks_Per_Buffer
+// blocks gets the rest of its allocations from DefaultAllocator, freed when its buffer is recycled.
+class FrameArena : public Singleton<FrameArena>
+{
+public:
+	static constexpr size_t Default_Block_Size = 1024 * 1024;
+	static constexpr size_t Default_Alignment = 16;
+	static constexpr uint32_t Max_Blocks_Per_Buffer = 64;
+
+	struct FrameStats
+	{
+		uint64_t m_FrameIndex;
+		// Up to the end of the frame's last allocation in its blocks.
+		size_t m_BytesUsed;
+		size_t m_BytesReserved;
+		// Allocated from DefaultAllocator after the blocks ran out.
+		size_t m_BytesOverflowed;
+		// Peak memory of the frame. Nothing is freed during a frame, so that is all it allocated.
+		size_t m_HighWaterMark;
+	};
+
+	explicit FrameArena(size_t blockSize = Default_Block_Size);
+	~FrameArena();
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	void* Allocate(size_t size, size_t alignment = Default_Alignment);
+
+	template<typename T>
+	T* Allocate(size_t numElements = 1)
+	{
+		return static_cast<T*>(Allocate(numElements * sizeof(T), alignof(T) > Default_Alignment ? alignof(T) : Default_Alignment));
+	}
+
+	// Call once per update tick. Recycles the buffer used two frames ago.
+	void BeginFrame();
+	uint64_t GetFrameIndex() const { return m_FrameIndex; }
+	// Usage of the frame that ended with the last BeginFrame call.
+	const FrameStats& GetLastFrameStats() const { return m_LastFrameStats; }
+
+private:
+	static constexpr uint32_t Offset_Bits = 48;
+	static constexpr uint64_t Offset_Mask = (1ull << Offset_Bits) - 1;
+
+	struct Block
+	{
+		size_t m_Size;
+		uint8_t* m_Data;
+	};
+
+	// Header of an allocation that did not fit into the blocks, the data follows it.
+	struct OverflowBlock
+	{
+		OverflowBlock* m_Next;
+		size_t m_Size;
+	};
+
+	struct Buffer
+	{
+		// Current block index in the top bits, offset inside that block in the low Offset_Bits bits.
+		std::atomic<uint64_t> m_State;
+		Block m_Blocks[Max_Blocks_Per_Buffer];
+		uint32_t m_NumBlocks;
+		// Guarded by m_GrowMutex.
+		OverflowBlock* m_Overflow;
+		size_t m_BytesOverflowed;
+	};
+
+	bool AdvanceBlock(Buffer& buffer, uint64_t observedBlockIndex, size_t minSize);
+	void* AllocateOverflow(Buffer& buffer, size_t size, size_t alignment);
+	void FreeOverflow(Buffer& buffer);
+	size_t GetBytesUsed(const Buffer& buffer) const;
+	size_t GetBytesReserved(const Buffer& buffer) const;
+	void ResetBuffer(Buffer& buffer);
+
+	Buffer m_Buffers[2];
+	std::atomic<Buffer*> m_CurrentBuffer;
+	std::mutex m_GrowMutex;
+	size_t m_BlockSize;
+	uint64_t m_FrameIndex;
+	FrameStats m_LastFrameStats;
+};
+
+template<typename T>
+class FrameAllocatorT
+{
+public:
+	static T* Allocate(size_t numElements = 1)
+	{
+		return FrameArena::Instance().Allocate<T>(numElements);
+	}
+
+	static void Free(void*)
+	{
+	}
+};
+
+template<typename T>
+class FrameSTDAllocator
+{
+public:
+	typedef T value_type;
+	FrameSTDAllocator() = default;
+	template<typename U>
+	FrameSTDAllocator(const FrameSTDAllocator<U>& other) {}
+
+	T* allocate(std::size_t n)
+	{
+		return FrameArena::Instance().Allocate<T>(n);
+	}
+
+	void deallocate(T*, std::size_t)
+	{
+	}
+};
+
+template<typename T, typename U>
+bool operator==(const FrameSTDAllocator<T>&, const FrameSTDAllocator<U>&) { return true; }
+template<typename T, typename U>
+bool operator!=(const FrameSTDAllocator<T>&, const FrameSTDAllocator<U>&) { return false; }
+
+ANIM_NAMESPACE_END
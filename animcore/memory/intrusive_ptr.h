@@ -0,0 +1,140 @@
+#pragma once
+#include <stddef.h>
+#include <utility>
+#include "animcore/util/namespace.h"
+
+ANIM_NAMESPACE_BEGIN
+
+// Pointer to an object that keeps its own reference count. T provides AddReference() and ReleaseReference();
+// ReleaseReference is responsible for destroying the object when the count drops to zero.
+// Same size as a raw pointer and never allocates.
+template<typename T>
+class IntrusivePtr
+{
+	template<typename U>
+	friend class IntrusivePtr;
+public:
+	// Tag for taking over a reference the caller already added.
+	struct AdoptReference {};
+
+	constexpr IntrusivePtr()
+		: m_Object(nullptr)
+	{}
+
+	constexpr IntrusivePtr(std::nullptr_t)
+		: IntrusivePtr()
+	{}
+
+	IntrusivePtr(T* object)
+		: m_Object(object)
+	{
+		if (m_Object != nullptr)
+			m_Object->AddReference();
+	}
+
+	IntrusivePtr(T* object, AdoptReference)
+		: m_Object(object)
+	{}
+
+	IntrusivePtr(const IntrusivePtr& other)
+		: IntrusivePtr(other.m_Object)
+	{}
+
+	template<typename U>
+	IntrusivePtr(const IntrusivePtr<U>& other)
+		: IntrusivePtr(other.m_Object)
+	{}
+
+	IntrusivePtr(IntrusivePtr&& other)
+		: m_Object(other.m_Object)
+	{
+		other.m_Object = nullptr;
+	}
+
+	template<typename U>
+	IntrusivePtr(IntrusivePtr<U>&& other)
+		: m_Object(other.m_Object)
+	{
+		other.m_Object = nullptr;
+	}
+
+	~IntrusivePtr()
+	{
+		Reset();
+	}
+
+	IntrusivePtr& operator=(const IntrusivePtr& other)
+	{
+		IntrusivePtr(other).Swap(*this);
+		return *this;
+	}
+
+	template<typename U>
+	IntrusivePtr& operator=(const IntrusivePtr<U>& other)
+	{
+		IntrusivePtr(other).Swap(*this);
+		return *this;
+	}
+
+	IntrusivePtr& operator=(IntrusivePtr&& other)
+	{
+		IntrusivePtr(std::move(other)).Swap(*this);
+		return *this;
+	}
+
+	template<typename U>
+	IntrusivePtr& operator=(IntrusivePtr<U>&& other)
+	{
+		IntrusivePtr(std::move(other)).Swap(*this);
+		return *this;
+	}
+
+	void Reset()
+	{
+		T* object = m_Object;
+		m_Object = nullptr;
+		if (object != nullptr)
+			object->ReleaseReference();
+	}
+
+	// Gives up ownership without releasing the reference.
+	T* Detach()
+	{
+		T* object = m_Object;
+		m_Object = nullptr;
+		return object;
+	}
+
+	void Swap(IntrusivePtr& other)
+	{
+		std::swap(m_Object, other.m_Object);
+	}
+
+	T* operator->() const { return m_Object; }
+	T& operator*() const { return *m_Object; }
+	T* Get() const { return m_Object; }
+	explicit operator bool() const { return m_Object != nullptr; }
+
+private:
+	T* m_Object;
+};
+
+template<typename T, typename U>
+bool operator==(const IntrusivePtr<T>& a, const IntrusivePtr<U>& b)
+{
+	return a.Get() == b.Get();
+}
+
+template<typename T, typename U>
+bool operator!=(const IntrusivePtr<T>& a, const IntrusivePtr<U>& b)
+{
+	return a.Get() != b.Get();
+}
+
+template<typename T, typename U>
+IntrusivePtr<T> StaticPointerCast(const IntrusivePtr<U>& ptr)
+{
+	return IntrusivePtr<T>(static_cast<T*>(ptr.Get()));
+}
+
+ANIM_NAMESPACE_END
@@ -1,8 +1,8 @@
 #pragma once
 #include "animcore/util/namespace.h"
+#include <stdint.h>
 #include <memory>
 #include <atomic>
-#include <functional>
 #include <type_traits>
 #include "animcore/memory/default_allocator.h"
 
@@ -11,17 +11,97 @@ ANIM_NAMESPACE_BEGIN
 
 namespace shared_ptr_detail
 {
+	// Destroys the owned object. context is whatever was stored next to it, e.g. an inline deleter.
+	typedef void(*DeleterFn)(void* object, void* context);
+
+	// The strong references together hold one weak reference, so whoever drops the last weak reference
+	// frees the block, and always after the object was destroyed.
+	// A block is a single DefaultAllocator allocation. MakeShared stores the object and the custom deleter
+	// constructor stores the deleter in the same allocation, right behind the block.
 	struct ControlBlock
 	{
-		ControlBlock()
-			: m_WeakCount(0)
-			, m_StrongCount(0)
+		std::atomic<uint32_t> m_StrongCount;
+		std::atomic<uint32_t> m_WeakCount;
+		DeleterFn m_Deleter;
+		void* m_Object;
+		void* m_Context;
+
+		void AddStrongReference()
+		{
+			m_StrongCount.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// Fails once the object is gone, used to lock a WeakPtr.
+		bool TryAddStrongReference()
+		{
+			uint32_t count = m_StrongCount.load(std::memory_order_relaxed);
+			while (count != 0)
+			{
+				if (m_StrongCount.compare_exchange_weak(count, count + 1, std::memory_order_relaxed))
+					return true;
+			}
+			return false;
+		}
+
+		void ReleaseStrongReference()
 		{
+			if (m_StrongCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				m_Deleter(m_Object, m_Context);
+				ReleaseWeakReference();
+			}
+		}
+
+		void AddWeakReference()
+		{
+			m_WeakCount.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		void ReleaseWeakReference()
+		{
+			if (m_WeakCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				this->~ControlBlock();
+				DefaultAllocator::Free(this);
+			}
 		}
-		std::atomic<uint16_t> m_WeakCount;
-		std::atomic<uint16_t> m_StrongCount;
-		std::function<void()> m_Deleter;
 	};
+
+	// Allocates a block holding one strong reference, with payloadSize bytes aligned to payloadAlignment
+	// behind it. The caller fills in the deleter.
+	inline ControlBlock* AllocateControlBlock(size_t payloadSize, size_t payloadAlignment, void*& payloadOut)
+	{
+		size_t offset = (sizeof(ControlBlock) + payloadAlignment - 1) & ~(payloadAlignment - 1);
+		uint8_t* memory = static_cast<uint8_t*>(DefaultAllocator::Allocate(offset + payloadSize));
+		ControlBlock* block = new (memory) ControlBlock;
+		block->m_StrongCount.store(1, std::memory_order_relaxed);
+		block->m_WeakCount.store(1, std::memory_order_relaxed);
+		block->m_Deleter = nullptr;
+		block->m_Object = nullptr;
+		block->m_Context = nullptr;
+		payloadOut = memory + offset;
+		return block;
+	}
+
+	template<typename T>
+	void DestroyWithAllocator(void* object, void*)
+	{
+		DefaultAllocator::Destroy(static_cast<T*>(object));
+	}
+
+	template<typename T>
+	void DestroyInPlace(void* object, void*)
+	{
+		static_cast<T*>(object)->~T();
+	}
+
+	template<typename T, typename D>
+	void InvokeInlineDeleter(void* object, void* context)
+	{
+		D* deleter = static_cast<D*>(context);
+		(*deleter)(static_cast<T*>(object));
+		deleter->~D();
+	}
 }
 
 template<typename T>
@@ -32,20 +112,24 @@ class SharedPtr
 {
 	template<typename U>
 	friend class SharedPtr;
+	template<typename U>
+	friend class WeakPtr;
 public:
+	// The object lives in the same allocation as the control block.
 	template<typename ...Args>
-	static SharedPtr<T> MakeShared(Args... args)
+	static SharedPtr<T> MakeShared(Args&&... args)
 	{
-		uint8_t* controlBlockptr = static_cast<uint8_t*>(DefaultAllocator::Allocate(sizeof(T) + sizeof(shared_ptr_detail::ControlBlock)));
-		uint8_t* dataPtr = controlBlockptr + sizeof(shared_ptr_detail::ControlBlock);
-		T* data = new (dataPtr) T(std::forward<Args>(args)...);
-		auto controlBlock = new (controlBlockptr) shared_ptr_detail::ControlBlock;
-		return SharedPtr<T>(data, controlBlock, [](T* obj) -> void { obj->~T(); });
+		void* storage = nullptr;
+		shared_ptr_detail::ControlBlock* block = shared_ptr_detail::AllocateControlBlock(sizeof(T), alignof(T), storage);
+		T* data = new (storage) T(std::forward<Args>(args)...);
+		block->m_Deleter = &shared_ptr_detail::DestroyInPlace<T>;
+		block->m_Object = data;
+		return SharedPtr<T>(data, block);
 	}
 
 	constexpr SharedPtr() 
-		: m_Object(nullptr)
-		, m_ControlBlock(nullptr)
+		: m_ControlBlock(nullptr)
+		, m_Object(nullptr)
 	{}
 
 	constexpr SharedPtr(std::nullptr_t)
@@ -53,72 +137,115 @@ public:
 	{}
 
 	SharedPtr(T* data)
-		: SharedPtr(data, [](T* dataPtr) -> void { DefaultAllocator::Destroy(dataPtr); })
+		: SharedPtr(data, &shared_ptr_detail::DestroyWithAllocator<T>, nullptr)
 	{}
-	
+
+	// deleter(data, context) runs when the last strong reference is released.
+	SharedPtr(T* data, shared_ptr_detail::DeleterFn deleter, void* context)
+		: SharedPtr()
+	{
+		if (data != nullptr)
+		{
+			void* payload = nullptr;
+			m_ControlBlock = shared_ptr_detail::AllocateControlBlock(0, 1, payload);
+			m_ControlBlock->m_Deleter = deleter;
+			m_ControlBlock->m_Object = data;
+			m_ControlBlock->m_Context = context;
+			m_Object = data;
+		}
+	}
+
+	// The deleter is stored inline in the control block allocation.
+	template<typename D>
+	SharedPtr(T* data, D&& customDeleter)
+		: SharedPtr()
+	{
+		typedef typename std::decay<D>::type Deleter;
+		if (data != nullptr)
+		{
+			void* payload = nullptr;
+			m_ControlBlock = shared_ptr_detail::AllocateControlBlock(sizeof(Deleter), alignof(Deleter), payload);
+			new (payload) Deleter(std::forward<D>(customDeleter));
+			m_ControlBlock->m_Deleter = &shared_ptr_detail::InvokeInlineDeleter<T, Deleter>;
+			m_ControlBlock->m_Object = data;
+			m_ControlBlock->m_Context = payload;
+			m_Object = data;
+		}
+	}
+
+	SharedPtr(const SharedPtr& other)
+		: m_ControlBlock(other.m_ControlBlock)
+		, m_Object(other.m_Object)
+	{
+		if (m_ControlBlock != nullptr)
+		{
+			m_ControlBlock->AddStrongReference();
+		}
+	}
+
 	template<typename U>
 	SharedPtr(const SharedPtr<U>& other)
 		: m_ControlBlock(other.m_ControlBlock)
 		, m_Object(other.m_Object)
 	{
-		if (m_ControlBlock)
+		if (m_ControlBlock != nullptr)
 		{
-			m_ControlBlock->m_StrongCount++;
+			m_ControlBlock->AddStrongReference();
 		}
 	}
 
+	// Shares ownership with other but points at object, used for casts.
 	template<typename U>
-	SharedPtr(T* data, U && customDeleter)
+	SharedPtr(const SharedPtr<U>& other, T* object)
+		: m_ControlBlock(object != nullptr ? other.m_ControlBlock : nullptr)
+		, m_Object(object)
 	{
-		if (data != nullptr)
+		if (m_ControlBlock != nullptr)
 		{
-			m_ControlBlock = DefaultAllocator::Create<shared_ptr_detail::ControlBlock>();
-			m_Object = data;
-			m_ControlBlock->m_StrongCount++;
-			m_ControlBlock->m_Deleter = [c = std::forward<U>(customDeleter), data]() -> void { c(data); };
+			m_ControlBlock->AddStrongReference();
 		}
 	}
 
 	SharedPtr(SharedPtr&& other)
-		: m_ControlBlock(nullptr)
-		, m_Object(nullptr)
+		: m_ControlBlock(other.m_ControlBlock)
+		, m_Object(other.m_Object)
 	{
-		std::swap(m_ControlBlock, other.m_ControlBlock);
-		std::swap(m_Object, other.m_Object);
+		other.m_ControlBlock = nullptr;
+		other.m_Object = nullptr;
+	}
+
+	template<typename U>
+	SharedPtr(SharedPtr<U>&& other)
+		: m_ControlBlock(other.m_ControlBlock)
+		, m_Object(other.m_Object)
+	{
+		other.m_ControlBlock = nullptr;
+		other.m_Object = nullptr;
 	}
 	
 	SharedPtr& operator=(const SharedPtr& other)
 	{
-		Release();
-		m_ControlBlock = other.m_ControlBlock;
-		m_Object = other.m_Object;
-		if (m_ControlBlock != nullptr)
-		{
-			m_ControlBlock->m_StrongCount++;
-		}
+		SharedPtr(other).Swap(*this);
 		return *this;
 	}
 
 	template<typename U>
 	SharedPtr<T>& operator=(const SharedPtr<U>& other)
 	{
-		Release();
-		m_Object = other.m_Object;
-		m_ControlBlock = other.m_ControlBlock;		
-		if (m_ControlBlock != nullptr)
-		{
-			m_ControlBlock->m_StrongCount++;
-		}
+		SharedPtr(other).Swap(*this);
+		return *this;
+	}
+
+	SharedPtr& operator=(SharedPtr&& other)
+	{
+		SharedPtr(std::move(other)).Swap(*this);
 		return *this;
 	}
 
 	template<typename U>
 	SharedPtr<T>& operator=(SharedPtr<U>&& other)
 	{
-		Release();
-		m_Object = other.m_Object;
-		other.m_Object = nullptr;
-		std::swap(m_ControlBlock, other.m_ControlBlock);
+		SharedPtr(std::move(other)).Swap(*this);
 		return *this;
 	}
 
@@ -142,6 +269,12 @@ public:
 		return m_Object;
 	}
 
+	// Only a snapshot when other threads share the object.
+	uint32_t GetUseCount() const
+	{
+		return m_ControlBlock != nullptr ? m_ControlBlock->m_StrongCount.load(std::memory_order_relaxed) : 0;
+	}
+
 	~SharedPtr()
 	{
 		Release();
@@ -149,19 +282,19 @@ public:
 
 	void Release()
 	{
-		if (m_ControlBlock != nullptr)
+		shared_ptr_detail::ControlBlock* block = m_ControlBlock;
+		m_ControlBlock = nullptr;
+		m_Object = nullptr;
+		if (block != nullptr)
 		{
-			if (std::atomic_fetch_sub<uint16_t>(&m_ControlBlock->m_StrongCount, 1) == 1)
-			{
-				m_ControlBlock->m_Deleter();
-				if (m_ControlBlock->m_WeakCount == 0)
-				{
-					DefaultAllocator::Destroy(m_ControlBlock);
-				}
-			}
-			m_ControlBlock = nullptr;
+			block->ReleaseStrongReference();
 		}
-		m_Object = nullptr;
+	}
+
+	void Swap(SharedPtr& other)
+	{
+		std::swap(m_ControlBlock, other.m_ControlBlock);
+		std::swap(m_Object, other.m_Object);
 	}
 
 	WeakPtr<T> GetWeakPtr() const
@@ -169,29 +302,25 @@ public:
 		return WeakPtr<T>(*this);
 	}
 private:
-	template<typename U>
-	SharedPtr(T* data, shared_ptr_detail::ControlBlock* block, U&& customDeleter)
+	// Adopts the strong reference the block was created with.
+	SharedPtr(T* data, shared_ptr_detail::ControlBlock* block)
 		: m_ControlBlock(block)
 		, m_Object(data)
 	{
-		m_ControlBlock->m_StrongCount++;
-		m_ControlBlock->m_Deleter = [c = std::forward<U>(customDeleter), data]() -> void { c(data); };
 	}
+
 	explicit SharedPtr(const WeakPtr<T>& ptr)
-		: m_ControlBlock(ptr.m_ControlBlock)
+		: SharedPtr()
 	{
-		if (m_ControlBlock != nullptr)
+		if (ptr.m_ControlBlock != nullptr && ptr.m_ControlBlock->TryAddStrongReference())
 		{
-			if (std::atomic_fetch_add<uint16_t>(&m_ControlBlock->m_StrongCount, 1) == 0)
-			{
-				m_ControlBlock = nullptr;
-			}
+			m_ControlBlock = ptr.m_ControlBlock;
+			m_Object = ptr.m_Object;
 		}
 	}
 
 	shared_ptr_detail::ControlBlock* m_ControlBlock;
 	T* m_Object;
-	friend class WeakPtr<T>;
 };
 
 template<typename T, typename U>
@@ -206,31 +335,34 @@ bool operator!=(const SharedPtr<T>& a, const SharedPtr<U>& b)
 	return a.Get() != b.Get();
 }
 
+template<typename T, typename U>
+SharedPtr<T> StaticPointerCast(const SharedPtr<U>& ptr)
+{
+	return SharedPtr<T>(ptr, static_cast<T*>(const_cast<U*>(ptr.Get())));
+}
+
 template<typename T>
 class WeakPtr
 {
 	template<typename U>
 	friend class WeakPtr;
+	friend class SharedPtr<T>;
 public:
-	WeakPtr() {}
+	WeakPtr()
+		: m_ControlBlock(nullptr)
+		, m_Object(nullptr)
+	{}
+
 	WeakPtr(const WeakPtr& other)
 		: m_ControlBlock(other.m_ControlBlock)
 		, m_Object(other.m_Object)
 	{
 		if (m_ControlBlock != nullptr)
 		{
-			m_ControlBlock->m_WeakCount++;
+			m_ControlBlock->AddWeakReference();
 		}
 	}
 
-	WeakPtr(WeakPtr&& other)
-		: m_ControlBlock(nullptr)
-		, m_Object(nullptr)
-	{
-		std::swap(m_ControlBlock, other.m_ControlBlock);
-		std::swap(m_Object, other.m_Object);
-	}
-
 	template<typename U>
 	WeakPtr(const WeakPtr<U>& other)
 		: m_ControlBlock(other.m_ControlBlock)
@@ -238,64 +370,55 @@ public:
 	{
 		if (m_ControlBlock != nullptr)
 		{
-			m_ControlBlock->m_WeakCount++;
+			m_ControlBlock->AddWeakReference();
 		}
 	}
 
+	WeakPtr(WeakPtr&& other)
+		: m_ControlBlock(other.m_ControlBlock)
+		, m_Object(other.m_Object)
+	{
+		other.m_ControlBlock = nullptr;
+		other.m_Object = nullptr;
+	}
+
 	template<typename U>
 	WeakPtr(WeakPtr<U>&& other)
-		: m_ControlBlock(nullptr)
-		, m_Object(nullptr)
+		: m_ControlBlock(other.m_ControlBlock)
+		, m_Object(other.m_Object)
 	{
-		std::swap(m_ControlBlock, other.m_ControlBlock);
-		m_Object = other.m_Object;
+		other.m_ControlBlock = nullptr;
 		other.m_Object = nullptr;
 	}
 
 	WeakPtr& operator=(const WeakPtr& other)
 	{
-		Release();
-		m_ControlBlock = other.m_ControlBlock;
-		m_Object = other.m_Object;
-		if (m_ControlBlock != nullptr)
-		{
-			m_ControlBlock->m_WeakCount++;
-		}
+		WeakPtr(other).Swap(*this);
 		return *this;
 	}
 
 	template<typename U>
 	WeakPtr<T>& operator=(const WeakPtr<U>& other)
 	{
-		Release();
-		m_ControlBlock = other.m_ControlBlock;
-		m_Object = other.m_Object;
-		if (m_ControlBlock != nullptr)
-		{
-			m_ControlBlock->m_WeakCount++;
-		}
+		WeakPtr(other).Swap(*this);
 		return *this;
 	}
 
-	template<typename U>
-	WeakPtr<T>& operator=(WeakPtr<U>&& other)
+	WeakPtr& operator=(WeakPtr&& other)
 	{
-		Release();
-		std::swap(m_ControlBlock, other.m_ControlBlock);
-		m_Object = other.m_Object;
-		other.m_Object = nullptr;
+		WeakPtr(std::move(other)).Swap(*this);
 		return *this;
 	}
 
-	WeakPtr operator=(WeakPtr&& other)
+	template<typename U>
+	WeakPtr<T>& operator=(WeakPtr<U>&& other)
 	{
-		Release();
-		std::swap(m_ControlBlock, other.m_ControlBlock);
-		std::swap(m_Object, other.m_Object);
+		WeakPtr(std::move(other)).Swap(*this);
 		return *this;
 	}
 
-	SharedPtr<T> Lock()
+	// Returns nullptr once the object was destroyed.
+	SharedPtr<T> Lock() const
 	{
 		return SharedPtr<T>(*this);
 	}
@@ -307,32 +430,33 @@ public:
 
 	void Release()
 	{
-		if (m_ControlBlock != nullptr)
+		shared_ptr_detail::ControlBlock* block = m_ControlBlock;
+		m_ControlBlock = nullptr;
+		m_Object = nullptr;
+		if (block != nullptr)
 		{
-			if (m_ControlBlock->m_StrongCount == 0)
-			{
-				if (std::atomic_fetch_sub<uint16_t>(&m_ControlBlock->m_WeakCount, 1) == 1)
-				{
-					DefaultAllocator::Destroy(m_ControlBlock);
-				}
-			}
-			m_ControlBlock = nullptr;
+			block->ReleaseWeakReference();
 		}
 	}
+
+	void Swap(WeakPtr& other)
+	{
+		std::swap(m_ControlBlock, other.m_ControlBlock);
+		std::swap(m_Object, other.m_Object);
+	}
 private:
 	explicit WeakPtr(const SharedPtr<T>& sharedPtr)
+		: m_ControlBlock(sharedPtr.m_ControlBlock)
+		, m_Object(sharedPtr.m_Object)
 	{
-		m_ControlBlock = sharedPtr.m_ControlBlock;
-		m_Object = sharedPtr.m_Object;
 		if (m_ControlBlock != nullptr)
 		{
-			m_ControlBlock->m_WeakCount++;
+			m_ControlBlock->AddWeakReference();
 		}
 	}
 
-	friend class SharedPtr<T>;
+	shared_ptr_detail::ControlBlock* m_ControlBlock;
 	T* m_Object;
-	mutable shared_ptr_detail::ControlBlock* m_ControlBlock;
 };
 
 template<typename T>
@@ -342,9 +466,9 @@ class UniquePtr
 	friend class UniquePtr;
 public:
 	template<typename ...Args>
-	static UniquePtr MakeUnique(Args... args)
+	static UniquePtr MakeUnique(Args&&... args)
 	{
-		return UniquePtr(DefaultAllocator::Create(std::forward<Args>(args)...));
+		return UniquePtr(DefaultAllocator::Create<T>(std::forward<Args>(args)...));
 	}
 
 	constexpr UniquePtr()
@@ -381,6 +505,7 @@ public:
 	{
 		Reset();
 		std::swap(m_Object, other.m_Object);
+		return *this;
 	}
 
 	template<typename U>
@@ -389,6 +514,7 @@ public:
 		Reset();
 		m_Object = other.m_Object;
 		other.m_Object = nullptr;
+		return *this;
 	}
 
 	void Reset(T* data = nullptr)
@@ -414,7 +540,7 @@ public:
 	{
 		auto tmp = m_Object;
 		m_Object = nullptr;
-		return m_Object;
+		return tmp;
 	}
 private:
 	T* m_Object;
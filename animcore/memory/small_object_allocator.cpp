@@ -0,0 +1,302 @@
+#include "small_object_allocator.h"
+#include <atomic>
+#include <mutex>
+#include "animcore/interface/engine_interface.h"
+#include "animcore/util/assert.h"
+#include "animpublic/commands/core_commands.h"
+
+ANIM_NAMESPACE_BEGIN
+
+namespace
+{
+	static constexpr uint32_t Transfer_Batch_Size = 32;
+	static constexpr uint32_t Max_Cached_Blocks = Transfer_Batch_Size * 2;
+	static constexpr uint32_t Slabs_Per_Chunk = 16;
+	static constexpr size_t Slab_Header_Size = 64;
+	// Slab directory capacity. Must be a power of two.
+	static constexpr uint32_t Directory_Size = 1 << 16;
+	static constexpr uint32_t Directory_Bits = 16;
+	// The directory is only filled halfway so probes stay short, also for Owns on blocks of the host. That is
+	// 2GB of small objects, beyond that Allocate fails and DefaultAllocator goes to the host.
+	static constexpr uint32_t Max_Registered_Slabs = Directory_Size / 2;
+
+	struct FreeBlock
+	{
+		FreeBlock* m_Next;
+	};
+
+	struct SlabHeader
+	{
+		uint32_t m_SizeClass;
+	};
+	static_assert(sizeof(SlabHeader) <= Slab_Header_Size, "Slab header does not fit");
+
+	struct CentralFreeList
+	{
+		std::mutex m_Mutex;
+		FreeBlock* m_FreeBlocks = nullptr;
+		uint8_t* m_CarveCursor = nullptr;
+		uint8_t* m_CarveEnd = nullptr;
+
+		std::atomic<uint64_t> m_NumAllocations{ 0 };
+		std::atomic<uint64_t> m_NumFrees{ 0 };
+		std::atomic<uint64_t> m_NumSlabs{ 0 };
+		std::atomic<uint64_t> m_NumCentralTransfers{ 0 };
+	};
+
+	struct SlabPool
+	{
+		std::mutex m_Mutex;
+		uint8_t* m_NextSlab = nullptr;
+		uint32_t m_NumSlabsLeft = 0;
+		uint32_t m_NumRegisteredSlabs = 0;
+		std::atomic<uint64_t> m_NumHostAllocations{ 0 };
+	};
+
+	struct ThreadCache
+	{
+		FreeBlock* m_FreeBlocks[SmallObjectAllocator::Num_Size_Classes];
+		uint32_t m_NumFree[SmallObjectAllocator::Num_Size_Classes];
+		uint64_t m_NumAllocations[SmallObjectAllocator::Num_Size_Classes];
+		uint64_t m_NumFrees[SmallObjectAllocator::Num_Size_Classes];
+
+		~ThreadCache()
+		{
+			Flush();
+		}
+
+		void Flush();
+	};
+
+	// All of these are constant-initialized so they are usable before any dynamic initializer runs.
+	static CentralFreeList s_CentralLists[SmallObjectAllocator::Num_Size_Classes];
+	static SlabPool s_SlabPool;
+	static std::atomic<uintptr_t> s_SlabDirectory[Directory_Size];
+	static thread_local ThreadCache t_ThreadCache;
+
+	inline uintptr_t GetSlabKey(const void* data)
+	{
+		return reinterpret_cast<uintptr_t>(data) / SmallObjectAllocator::Slab_Size;
+	}
+
+	inline uint32_t GetDirectoryIndex(uintptr_t slabKey)
+	{
+		return static_cast<uint32_t>((static_cast<uint64_t>(slabKey) * 0x9E3779B97F4A7C15ull) >> (64 - Directory_Bits));
+	}
+
+	bool RegisterSlab(const void* slab)
+	{
+		uintptr_t key = GetSlabKey(slab);
+		uint32_t index = GetDirectoryIndex(key);
+		for (uint32_t i = 0; i < Directory_Size; ++i)
+		{
+			uintptr_t expected = 0;
+			if (s_SlabDirectory[index].compare_exchange_strong(expected, key, std::memory_order_release, std::memory_order_relaxed))
+				return true;
+			index = (index + 1) & (Directory_Size - 1);
+		}
+		return false;
+	}
+
+	inline SlabHeader* GetSlabHeader(const void* data)
+	{
+		return reinterpret_cast<SlabHeader*>(reinterpret_cast<uintptr_t>(data) & ~(SmallObjectAllocator::Slab_Size - 1));
+	}
+
+	// Must be called with the owning central list locked.
+	uint8_t* AcquireSlab()
+	{
+		std::lock_guard<std::mutex> lock(s_SlabPool.m_Mutex);
+		if (s_SlabPool.m_NumRegisteredSlabs == Max_Registered_Slabs)
+			return nullptr;
+		if (s_SlabPool.m_NumSlabsLeft == 0)
+		{
+			// Over-allocate by one slab so the chunk can be aligned to the slab size.
+			size_t chunkSize = (Slabs_Per_Chunk + 1) * SmallObjectAllocator::Slab_Size;
+			auto chunk = static_cast<uint8_t*>(EngineInterface::GetCoreCommands().m_AllocateFn(chunkSize));
+			if (chunk == nullptr)
+				return nullptr;
+			s_SlabPool.m_NumHostAllocations.fetch_add(1, std::memory_order_relaxed);
+			uintptr_t aligned = (reinterpret_cast<uintptr_t>(chunk) + SmallObjectAllocator::Slab_Size - 1) & ~(SmallObjectAllocator::Slab_Size - 1);
+			s_SlabPool.m_NextSlab = reinterpret_cast<uint8_t*>(aligned);
+			s_SlabPool.m_NumSlabsLeft = Slabs_Per_Chunk;
+		}
+
+		uint8_t* slab = s_SlabPool.m_NextSlab;
+		if (!RegisterSlab(slab))
+			return nullptr;
+		s_SlabPool.m_NextSlab += SmallObjectAllocator::Slab_Size;
+		--s_SlabPool.m_NumSlabsLeft;
+		++s_SlabPool.m_NumRegisteredSlabs;
+		return slab;
+	}
+
+	// Pulls up to Transfer_Batch_Size blocks from the central list into the thread cache.
+	bool RefillThreadCache(ThreadCache& cache, uint32_t sizeClass)
+	{
+		auto& central = s_CentralLists[sizeClass];
+		size_t blockSize = SmallObjectAllocator::GetBlockSize(sizeClass);
+		uint32_t numTransferred = 0;
+		FreeBlock* head = nullptr;
+
+		std::lock_guard<std::mutex> lock(central.m_Mutex);
+		while (numTransferred < Transfer_Batch_Size && central.m_FreeBlocks != nullptr)
+		{
+			FreeBlock* block = central.m_FreeBlocks;
+			central.m_FreeBlocks = block->m_Next;
+			block->m_Next = head;
+			head = block;
+			++numTransferred;
+		}
+
+		while (numTransferred < Transfer_Batch_Size)
+		{
+			if (central.m_CarveCursor == nullptr || central.m_CarveCursor + blockSize > central.m_CarveEnd)
+			{
+				uint8_t* slab = AcquireSlab();
+				if (slab == nullptr)
+					break;
+				reinterpret_cast<SlabHeader*>(slab)->m_SizeClass = sizeClass;
+				central.m_CarveCursor = slab + Slab_Header_Size;
+				central.m_CarveEnd = slab + SmallObjectAllocator::Slab_Size;
+				central.m_NumSlabs.fetch_add(1, std::memory_order_relaxed);
+			}
+			auto block = reinterpret_cast<FreeBlock*>(central.m_CarveCursor);
+			central.m_CarveCursor += blockSize;
+			block->m_Next = head;
+			head = block;
+			++numTransferred;
+		}
+
+		if (numTransferred == 0)
+			return false;
+
+		central.m_NumCentralTransfers.fetch_add(1, std::memory_order_relaxed);
+		central.m_NumAllocations.fetch_add(cache.m_NumAllocations[sizeClass], std::memory_order_relaxed);
+		cache.m_NumAllocations[sizeClass] = 0;
+		cache.m_FreeBlocks[sizeClass] = head;
+		cache.m_NumFree[sizeClass] = numTransferred;
+		return true;
+	}
+
+	// Hands numBlocks blocks from the thread cache back to the central list.
+	void ReleaseToCentral(ThreadCache& cache, uint32_t sizeClass, uint32_t numBlocks)
+	{
+		FreeBlock* head = cache.m_FreeBlocks[sizeClass];
+		if (head == nullptr)
+			return;
+
+		FreeBlock* tail = head;
+		uint32_t numReleased = 1;
+		while (numReleased < numBlocks && tail->m_Next != nullptr)
+		{
+			tail = tail->m_Next;
+			++numReleased;
+		}
+		cache.m_FreeBlocks[sizeClass] = tail->m_Next;
+		cache.m_NumFree[sizeClass] -= numReleased;
+
+		auto& central = s_CentralLists[sizeClass];
+		std::lock_guard<std::mutex> lock(central.m_Mutex);
+		tail->m_Next = central.m_FreeBlocks;
+		central.m_FreeBlocks = head;
+		central.m_NumCentralTransfers.fetch_add(1, std::memory_order_relaxed);
+		central.m_NumFrees.fetch_add(cache.m_NumFrees[sizeClass], std::memory_order_relaxed);
+		cache.m_NumFrees[sizeClass] = 0;
+	}
+
+	void ThreadCache::Flush()
+	{
+		for (uint32_t sizeClass = 0; sizeClass < SmallObjectAllocator::Num_Size_Classes; ++sizeClass)
+		{
+			ReleaseToCentral(*this, sizeClass, m_NumFree[sizeClass]);
+			auto& central = s_CentralLists[sizeClass];
+			central.m_NumAllocations.fetch_add(m_NumAllocations[sizeClass], std::memory_order_relaxed);
+			central.m_NumFrees.fetch_add(m_NumFrees[sizeClass], std::memory_order_relaxed);
+			m_NumAllocations[sizeClass] = 0;
+			m_NumFrees[sizeClass] = 0;
+		}
+	}
+}
+
+void* SmallObjectAllocator::Allocate(size_t size)
+{
+	if (size > Max_Small_Size)
+		return nullptr;
+
+	uint32_t sizeClass = GetSizeClass(size);
+	ThreadCache& cache = t_ThreadCache;
+	if (cache.m_FreeBlocks[sizeClass] == nullptr && !RefillThreadCache(cache, sizeClass))
+		return nullptr;
+
+	FreeBlock* block = cache.m_FreeBlocks[sizeClass];
+	cache.m_FreeBlocks[sizeClass] = block->m_Next;
+	--cache.m_NumFree[sizeClass];
+	++cache.m_NumAllocations[sizeClass];
+	return block;
+}
+
+bool SmallObjectAllocator::Free(void* data)
+{
+	if (!Owns(data))
+		return false;
+
+	uint32_t sizeClass = GetSlabHeader(data)->m_SizeClass;
+	ANIM_ASSERT(sizeClass < Num_Size_Classes);
+	ThreadCache& cache = t_ThreadCache;
+	auto block = static_cast<FreeBlock*>(data);
+	block->m_Next = cache.m_FreeBlocks[sizeClass];
+	cache.m_FreeBlocks[sizeClass] = block;
+	++cache.m_NumFree[sizeClass];
+	++cache.m_NumFrees[sizeClass];
+
+	if (cache.m_NumFree[sizeClass] > Max_Cached_Blocks)
+		ReleaseToCentral(cache, sizeClass, Transfer_Batch_Size);
+	return true;
+}
+
+bool SmallObjectAllocator::Owns(const void* data)
+{
+	if (data == nullptr)
+		return false;
+
+	uintptr_t key = GetSlabKey(data);
+	uint32_t index = GetDirectoryIndex(key);
+	for (uint32_t i = 0; i < Directory_Size; ++i)
+	{
+		uintptr_t cur = s_SlabDirectory[index].load(std::memory_order_acquire);
+		if (cur == key)
+			return true;
+		if (cur == 0)
+			return false;
+		index = (index + 1) & (Directory_Size - 1);
+	}
+	return false;
+}
+
+void SmallObjectAllocator::FlushThreadCache()
+{
+	t_ThreadCache.Flush();
+}
+
+void SmallObjectAllocator::GetStats(SizeClassStats(&statsOut)[Num_Size_Classes])
+{
+	for (uint32_t sizeClass = 0; sizeClass < Num_Size_Classes; ++sizeClass)
+	{
+		const auto& central = s_CentralLists[sizeClass];
+		auto& stats = statsOut[sizeClass];
+		stats.m_BlockSize = static_cast<uint32_t>(GetBlockSize(sizeClass));
+		stats.m_NumAllocations = central.m_NumAllocations.load(std::memory_order_relaxed);
+		stats.m_NumFrees = central.m_NumFrees.load(std::memory_order_relaxed);
+		stats.m_NumSlabs = central.m_NumSlabs.load(std::memory_order_relaxed);
+		stats.m_NumCentralTransfers = central.m_NumCentralTransfers.load(std::memory_order_relaxed);
+		stats.m_BytesReserved = stats.m_NumSlabs * Slab_Size;
+	}
+}
+
+uint64_t SmallObjectAllocator::GetNumHostAllocations()
+{
+	return s_SlabPool.m_NumHostAllocations.load(std::memory_order_relaxed);
+}
+
+ANIM_NAMESPACE_END
@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "animcore/util/namespace.h"
+
+ANIM_NAMESPACE_BEGIN
+
+// Size-classed allocator for small blocks. Every thread keeps a cache of free blocks per size class,
+// so the common Allocate/Free pair never takes a lock. Thread caches are refilled from (and drained into)
+// a central free list per size class, which only goes to the host AllocateFn when it needs a new slab.
+// Slabs are never handed back to the host while the runtime is alive.
+class SmallObjectAllocator
+{
+public:
+	static constexpr size_t Size_Class_Granularity = 16;
+	static constexpr size_t Max_Small_Size = 256;
+	static constexpr uint32_t Num_Size_Classes = static_cast<uint32_t>(Max_Small_Size / Size_Class_Granularity);
+	static constexpr size_t Slab_Size = 64 * 1024;
+
+	struct SizeClassStats
+	{
+		uint32_t m_BlockSize;
+		uint64_t m_NumAllocations;
+		uint64_t m_NumFrees;
+		uint64_t m_NumSlabs;
+		uint64_t m_NumCentralTransfers;
+		uint64_t m_BytesReserved;
+	};
+
+	// Returns nullptr if the size is too big or no slab could be obtained; callers fall back to the host.
+	static void* Allocate(size_t size);
+	// Returns false if the block was not allocated by this allocator.
+	static bool Free(void* data);
+	static bool Owns(const void* data);
+
+	// Returns every block cached by the calling thread to the central lists and publishes its counters.
+	// Statistics only include thread-local activity up to the last transfer or flush.
+	static void FlushThreadCache();
+	static void GetStats(SizeClassStats(&statsOut)[Num_Size_Classes]);
+	static uint64_t GetNumHostAllocations();
+
+	static inline uint32_t GetSizeClass(size_t size)
+	{
+		return size == 0 ? 0 : static_cast<uint32_t>((size - 1) / Size_Class_Granularity);
+	}
+
+	static inline size_t GetBlockSize(uint32_t sizeClass)
+	{
+		return (sizeClass + 1) * Size_Class_Granularity;
+	}
+};
+
+ANIM_NAMESPACE_END
@@ -0,0 +1,51 @@
+#include "load_handle.h"
+#include "animcore/objectmodel/object_manager.h"
+
+ANIM_NAMESPACE_BEGIN
+
+LoadRequest::LoadRequest(const ObjectID& objectID)
+	: m_ObjectID(objectID)
+	, m_State(State::Pending)
+{
+}
+
+void LoadRequest::AddCallback(Callback callback, LoadCallbackThread thread)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_CallbackMutex);
+		if (!IsDone())
+		{
+			m_Callbacks.Push(PendingCallback{ std::move(callback), thread });
+			return;
+		}
+	}
+	Dispatch(callback, thread, m_Result);
+}
+
+void LoadRequest::Complete(const IntrusivePtr<ManagedObject>& result)
+{
+	Array<PendingCallback> callbacks;
+	{
+		std::lock_guard<std::mutex> lock(m_CallbackMutex);
+		ANIM_ASSERT(!IsDone());
+		m_Result = result;
+		m_State.store(result.Get() != nullptr ? State::Loaded : State::Failed, std::memory_order_release);
+		callbacks = std::move(m_Callbacks);
+	}
+	for (const auto& pending : callbacks)
+	{
+		Dispatch(pending.m_Callback, pending.m_Thread, m_Result);
+	}
+}
+
+void LoadRequest::Dispatch(const Callback& callback, LoadCallbackThread thread, const IntrusivePtr<ManagedObject>& result)
+{
+	if (thread == LoadCallbackThread::Worker)
+	{
+		callback(result);
+		return;
+	}
+	ObjectManager::Instance().QueueMainThreadCallback([callback, result]() { callback(result); });
+}
+
+ANIM_NAMESPACE_END
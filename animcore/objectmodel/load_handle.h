@@ -0,0 +1,133 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include "animcore/util/namespace.h"
+#include "animcore/containers/array.h"
+#include "animcore/memory/pointers.h"
+#include "animcore/memory/intrusive_ptr.h"
+#include "animcore/objectmodel/object_id.h"
+#include "animcore/objectmodel/managed_object.h"
+#include "animcore/threading/job_system.h"
+
+ANIM_NAMESPACE_BEGIN
+
+enum class LoadCallbackThread : uint8_t
+{
+	// Runs on the worker that finished the load, or inline if the load already finished.
+	Worker,
+	// Queued and run by ObjectManager::DispatchMainThreadCallbacks, once per frame.
+	Main,
+};
+
+// Shared state of one in-flight load. Every LoadHandle for the same ObjectID points at the same request
+// while the load is running.
+class LoadRequest
+{
+public:
+	enum class State : uint8_t
+	{
+		Pending,
+		Loaded,
+		Failed,
+	};
+
+	typedef std::function<void(const IntrusivePtr<ManagedObject>&)> Callback;
+
+	explicit LoadRequest(const ObjectID& objectID);
+
+	const ObjectID& GetObjectID() const { return m_ObjectID; }
+	State GetState() const { return m_State.load(std::memory_order_acquire); }
+	bool IsDone() const { return GetState() != State::Pending; }
+	// Only valid once IsDone returns true.
+	const IntrusivePtr<ManagedObject>& GetResult() const { return m_Result; }
+
+	void AddCallback(Callback callback, LoadCallbackThread thread);
+	// Publishes the result and fires the callbacks. Called exactly once by the ObjectManager.
+	void Complete(const IntrusivePtr<ManagedObject>& result);
+
+	static void Dispatch(const Callback& callback, LoadCallbackThread thread, const IntrusivePtr<ManagedObject>& result);
+
+private:
+	struct PendingCallback
+	{
+		Callback m_Callback;
+		LoadCallbackThread m_Thread;
+	};
+
+	ObjectID m_ObjectID;
+	std::atomic<State> m_State;
+	IntrusivePtr<ManagedObject> m_Result;
+	std::mutex m_CallbackMutex;
+	Array<PendingCallback> m_Callbacks;
+};
+
+// Future for a managed object of type T. Cheap to copy; a handle to an object that was already
+// registered is complete from the start and does not allocate.
+template<typename T>
+class LoadHandle
+{
+public:
+	LoadHandle() = default;
+
+	explicit LoadHandle(const SharedPtr<LoadRequest>& request)
+		: m_Request(request)
+	{
+	}
+
+	explicit LoadHandle(const IntrusivePtr<ManagedObject>& object)
+		: m_Object(object)
+	{
+	}
+
+	bool IsValid() const { return m_Request.Get() != nullptr || m_Object.Get() != nullptr; }
+	bool IsDone() const { return m_Request.Get() == nullptr || m_Request->IsDone(); }
+
+	// Returns nullptr while the load is in flight, if it failed, or if the object is not a T.
+	IntrusivePtr<T> Get() const
+	{
+		if (m_Request.Get() == nullptr)
+			return CastResult(m_Object);
+		if (!m_Request->IsDone())
+			return nullptr;
+		return CastResult(m_Request->GetResult());
+	}
+
+	// Blocks until the load finished, running other queued jobs meanwhile.
+	IntrusivePtr<T> Wait() const
+	{
+		if (!IsDone())
+		{
+			const LoadRequest* request = m_Request.Get();
+			JobSystem::Instance().WaitUntil([request]() { return request->IsDone(); });
+		}
+		return Get();
+	}
+
+	void OnComplete(std::function<void(const IntrusivePtr<T>&)> callback, LoadCallbackThread thread = LoadCallbackThread::Main)
+	{
+		auto wrapped = [callback](const IntrusivePtr<ManagedObject>& result) { callback(CastResult(result)); };
+		if (m_Request.Get() != nullptr)
+		{
+			m_Request->AddCallback(wrapped, thread);
+		}
+		else
+		{
+			LoadRequest::Dispatch(wrapped, thread, m_Object);
+		}
+	}
+
+private:
+	static IntrusivePtr<T> CastResult(const IntrusivePtr<ManagedObject>& result)
+	{
+		if (result.Get() == nullptr || !result->GetReflectedClassInfo().DerivesFrom(T::GetStaticClassInfo()))
+			return nullptr;
+		return StaticPointerCast<T>(result);
+	}
+
+	SharedPtr<LoadRequest> m_Request;
+	IntrusivePtr<ManagedObject> m_Object;
+};
+
+ANIM_NAMESPACE_END
@@ -1,9 +1,17 @@
 #include "managed_object.h"
 #include <rttr/registration.h>
+#include "animcore/objectmodel/object_manager.h"
 
 ANIM_NAMESPACE_BEGIN
 
 IMPLEMENT_CONCRETE_DERIVED_CLASS(ManagedObject, Object);
 
+void ManagedObject::Destroy(ManagedObject* object)
+{
+	if (ObjectManager::IsInitialized())
+		ObjectManager::Instance().UnregisterManagedObject(object);
+	else
+		DefaultAllocator::Destroy(object);
+}
 
 ANIM_NAMESPACE_END
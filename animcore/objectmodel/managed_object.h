@@ -1,14 +1,56 @@
 #pragma once
+#include <stdint.h>
+#include <atomic>
 #include "animcore/util/namespace.h"
 #include "animcore/objectmodel/object.h"
 #include "animcore/objectmodel/object_id.h"
 
 ANIM_NAMESPACE_BEGIN
 class ObjectManager;
+// Object owned by the ObjectManager. The reference count lives in the object itself so an
+// IntrusivePtr<ManagedObject> is a single pointer and handing out references never allocates.
 class ManagedObject : public Object
 {
 	DECLARE_DERIVED_CLASS();
 	typedef Object super;
+public:
+	ManagedObject()
+		: m_ReferenceCount(0)
+	{}
+
+	// Copies start out unreferenced.
+	ManagedObject(const ManagedObject& other)
+		: super(other)
+		, m_ReferenceCount(0)
+	{}
+
+	ManagedObject& operator=(const ManagedObject& other)
+	{
+		super::operator=(other);
+		return *this;
+	}
+
+	void AddReference() { m_ReferenceCount.fetch_add(1, std::memory_order_relaxed); }
+	// Fails once the count dropped to zero, the object is being destroyed then. The ObjectManager does not hold
+	// references itself and takes them this way, so a lookup can never bring an object back.
+	bool TryAddReference()
+	{
+		uint32_t count = m_ReferenceCount.load(std::memory_order_relaxed);
+		do
+		{
+			if (count == 0)
+				return false;
+		} while (!m_ReferenceCount.compare_exchange_weak(count, count + 1, std::memory_order_relaxed));
+		return true;
+	}
+	// Releasing the last reference hands the object back to the ObjectManager, which unregisters and destroys it.
+	void ReleaseReference()
+	{
+		if (m_ReferenceCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			Destroy(this);
+	}
+	uint32_t GetReferenceCount() const { return m_ReferenceCount.load(std::memory_order_relaxed); }
+
 #ifndef EDITOR_AVAILABLE
 public:
 	const ObjectID& GetObjectID() { return m_ObjectID; }
@@ -21,6 +63,10 @@ public:
 private:
 	void SetObjectID(const ObjectID& obj) { super::SetObjectID(obj); }
 #endif
+private:
+	static void Destroy(ManagedObject* object);
+
+	std::atomic<uint32_t> m_ReferenceCount;
 	friend class ObjectManager;
 };
 
@@ -1,7 +1,6 @@
 #include "object_id.h"
 #include <stdint.h>
 #include <string.h>
-#include "animcore/math/hash64.h"
 #ifdef WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <objbase.h>
@@ -19,9 +18,9 @@ bool ObjectID::isValid() const
 	for (uint32_t i = 0; i < 16; ++i)
 	{
 		if (m_Data[i] != 0)
-			return false;
+			return true;
 	}
-	return true;
+	return false;
 }
 
 ObjectID ObjectID::CreateNewGuid()
@@ -69,10 +68,5 @@ bool ObjectID::operator<=(const ObjectID& other) const
 	return !(*this > other);
 }
 
-uint64_t ObjectID::GetHash() const
-{
-	return HashUtils::Compute(m_Data, sizeof(m_Data));
-}
-
 ANIM_NAMESPACE_END
 
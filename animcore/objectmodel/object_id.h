@@ -1,6 +1,8 @@
 #pragma once
 #include "animcore/util/namespace.h"
+#include "animcore/math/hash64.h"
 #include <stdint.h>
+#include <string.h>
 #include <functional>
 
 ANIM_NAMESPACE_BEGIN
@@ -17,7 +19,14 @@ public:
 	bool operator<(const ObjectID& other) const;
 	bool operator>=(const ObjectID& other) const;
 	bool operator<=(const ObjectID& other) const;
-	uint64_t GetHash() const;
+	// IDs are GUIDs, folding the two halves with HashUtils::Mix is cheaper than hashing all 16 bytes.
+	uint64_t GetHash() const
+	{
+		uint64_t low, high;
+		memcpy(&low, m_Data, sizeof(low));
+		memcpy(&high, m_Data + sizeof(low), sizeof(high));
+		return HashUtils::Mix(low, high);
+	}
 	uint8_t m_Data[16];
 };
 
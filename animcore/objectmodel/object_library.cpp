@@ -0,0 +1,232 @@
+#include "object_library.h"
+#include <atomic>
+#include <string.h>
+#include "animcore/objectmodel/object_manager.h"
+#include "animcore/serialization/serialization.h"
+#include "animcore/threading/job_system.h"
+
+ANIM_NAMESPACE_BEGIN
+
+namespace
+{
+	static constexpr uint32_t Header_Size = 24;
+	static constexpr uint32_t Entry_Size = 40;
+
+	template <typename T>
+	T Load(const uint8_t* src)
+	{
+		T value;
+		memcpy(&value, src, sizeof(value));
+		return value;
+	}
+}
+
+ObjectLibraryWriter::ObjectLibraryWriter(Serialization::IWriteStream& output, uint32_t dataVersion, uint32_t encodingFlags)
+	: m_Output(output)
+	, m_OutputPosition(0)
+	, m_DataVersion(dataVersion)
+	, m_EncodingFlags(encodingFlags)
+	, m_IsFinished(false)
+{
+	// The table of contents offset is patched in by Finish.
+	uint32_t header[Header_Size / sizeof(uint32_t)] = { ObjectLibrary::Magic, ObjectLibrary::Version, 0, 0, 0, 0 };
+	WriteOutput(header, sizeof(header));
+}
+
+void ObjectLibraryWriter::AddObject(const ObjectID& objectID, const ManagedObject* object)
+{
+	ANIM_ASSERT(!m_IsFinished && object != nullptr);
+	m_EntryStream.Reset();
+	{
+		Serialization::Serializer res(m_EntryStream, m_DataVersion, m_EncodingFlags);
+		res.Serialize(object);
+	}
+
+	static const uint8_t padding[Serialization::Max_Data_Alignment] = {};
+	uint32_t misalignment = static_cast<uint32_t>(m_OutputPosition % Serialization::Max_Data_Alignment);
+	if (misalignment != 0)
+	{
+		WriteOutput(padding, Serialization::Max_Data_Alignment - misalignment);
+	}
+
+	ObjectLibrary::Entry entry;
+	entry.m_ObjectID = objectID;
+	entry.m_TypeID = object->GetReflectedClassInfo().GetTypeID();
+	entry.m_Offset = m_OutputPosition;
+	entry.m_Size = m_EntryStream.GetNumBytesWritten();
+	m_Entries.Push(entry);
+	for (uint32_t i = 0; i < m_EntryStream.GetNumChunks(); ++i)
+	{
+		WriteOutput(m_EntryStream.GetChunkData(i), m_EntryStream.GetChunkSize(i));
+	}
+}
+
+void ObjectLibraryWriter::Finish()
+{
+	ANIM_ASSERT(!m_IsFinished);
+	uint64_t tocOffset = m_OutputPosition;
+	for (const ObjectLibrary::Entry& entry : m_Entries)
+	{
+		uint32_t reserved = 0;
+		WriteOutput(entry.m_ObjectID.m_Data, sizeof(entry.m_ObjectID.m_Data));
+		WriteOutput(&entry.m_TypeID, sizeof(entry.m_TypeID));
+		WriteOutput(&entry.m_Offset, sizeof(entry.m_Offset));
+		WriteOutput(&entry.m_Size, sizeof(entry.m_Size));
+		WriteOutput(&reserved, sizeof(reserved));
+	}
+	uint32_t numEntries = m_Entries.Size();
+	m_Output.Patch(8, &numEntries, sizeof(numEntries));
+	m_Output.Patch(16, &tocOffset, sizeof(tocOffset));
+	m_IsFinished = true;
+}
+
+void ObjectLibraryWriter::WriteOutput(const void* data, uint32_t numBytes)
+{
+	m_Output.Write(data, numBytes);
+	m_OutputPosition += numBytes;
+}
+
+ObjectLibrary::ObjectLibrary()
+{
+}
+
+bool ObjectLibrary::Open(const char* path)
+{
+	Close();
+	if (!m_File.Open(path) || m_File.GetSize() < Header_Size)
+		return false;
+
+	const uint8_t* data = m_File.GetData();
+	const uint64_t size = m_File.GetSize();
+	const uint32_t numEntries = Load<uint32_t>(data + 8);
+	const uint64_t tocOffset = Load<uint64_t>(data + 16);
+	if (Load<uint32_t>(data) != Magic || Load<uint32_t>(data + 4) != Version ||
+		tocOffset > size || (size - tocOffset) / Entry_Size < numEntries)
+	{
+		Close();
+		return false;
+	}
+
+	m_Entries.Resize(numEntries);
+	m_EntryIndices.reserve(numEntries);
+	for (uint32_t i = 0; i < numEntries; ++i)
+	{
+		const uint8_t* src = data + tocOffset + uint64_t(i) * Entry_Size;
+		Entry& entry = m_Entries[i];
+		memcpy(entry.m_ObjectID.m_Data, src, sizeof(entry.m_ObjectID.m_Data));
+		entry.m_TypeID = Load<uint64_t>(src + 16);
+		entry.m_Offset = Load<uint64_t>(src + 24);
+		entry.m_Size = Load<uint32_t>(src + 32);
+		if (entry.m_Offset > tocOffset || entry.m_Size > tocOffset - entry.m_Offset ||
+			entry.m_Offset % Serialization::Max_Data_Alignment != 0)
+		{
+			Close();
+			return false;
+		}
+		m_EntryIndices.emplace(entry.m_ObjectID, i);
+	}
+	return true;
+}
+
+void ObjectLibrary::Close()
+{
+	m_EntryIndices.clear();
+	m_Entries.Clear();
+	m_File.Close();
+}
+
+int32_t ObjectLibrary::FindEntry(const ObjectID& objectID) const
+{
+	auto iter = m_EntryIndices.find(objectID);
+	if (iter == m_EntryIndices.end())
+		return -1;
+	return static_cast<int32_t>(iter->second);
+}
+
+ManagedObject* ObjectLibrary::ReadEntry(uint32_t index) const
+{
+	const Entry& entry = m_Entries[index];
+	Serialization::MappedReadStream stream(m_File, entry.m_Offset, entry.m_Size);
+	Serialization::Deserializer res(stream);
+	ManagedObject* object = nullptr;
+	if (res.IsValid())
+	{
+		res.Deserialize(object);
+	}
+	// A truncated or corrupt entry leaves a half read object behind.
+	if (object != nullptr && !res.IsValid())
+	{
+		DefaultAllocator::Destroy(object);
+		object = nullptr;
+	}
+	ANIM_ASSERT(object == nullptr || object->GetReflectedClassInfo().GetTypeID() == entry.m_TypeID);
+	return object;
+}
+
+uint32_t ObjectLibrary::LoadAll(BigArray<IntrusivePtr<ManagedObject>>* objectsOut)
+{
+	const uint32_t numEntries = m_Entries.Size();
+	BigArray<ManagedObject*> loaded;
+	loaded.Resize(numEntries);
+
+	// Entries are handed out in batches so thousands of small objects do not turn into thousands of jobs, but
+	// there are still a few batches per worker to even out entries of different sizes.
+	JobSystem& jobSystem = JobSystem::Instance();
+	const uint32_t numBatches = (jobSystem.GetNumWorkers() + 1) * 4;
+	const uint32_t batchSize = (numEntries + numBatches - 1) / numBatches;
+	std::atomic<uint32_t> numPending(0);
+	for (uint32_t first = 0; first < numEntries; first += batchSize)
+	{
+		const uint32_t last = first + batchSize < numEntries ? first + batchSize : numEntries;
+		numPending.fetch_add(1, std::memory_order_relaxed);
+		jobSystem.Schedule([this, &loaded, &numPending, first, last]()
+		{
+			for (uint32_t i = first; i < last; ++i)
+			{
+				loaded[i] = ReadEntry(i);
+			}
+			numPending.fetch_sub(1, std::memory_order_release);
+		});
+	}
+	jobSystem.WaitUntil([&numPending]() { return numPending.load(std::memory_order_acquire) == 0; });
+
+	ObjectManager& objectManager = ObjectManager::Instance();
+	uint32_t numFailed = 0;
+	if (objectsOut != nullptr)
+	{
+		objectsOut->Reserve(objectsOut->Size() + numEntries);
+	}
+	for (uint32_t i = 0; i < numEntries; ++i)
+	{
+		IntrusivePtr<ManagedObject> object;
+		if (loaded[i] != nullptr)
+		{
+			object = objectManager.RegisterManagedObject(m_Entries[i].m_ObjectID, IntrusivePtr<ManagedObject>(loaded[i]));
+		}
+		else
+		{
+			++numFailed;
+		}
+		if (objectsOut != nullptr)
+		{
+			objectsOut->Push(std::move(object));
+		}
+	}
+	return numFailed;
+}
+
+Serialization::IReadStream* ObjectLibrary::OpenObjectStream(const ObjectID& objectID)
+{
+	int32_t index = FindEntry(objectID);
+	if (index < 0)
+		return nullptr;
+	const Entry& entry = m_Entries[index];
+	return DefaultAllocator::Create<Serialization::MappedReadStream>(m_File, entry.m_Offset, entry.m_Size);
+}
+
+void ObjectLibrary::CloseObjectStream(Serialization::IReadStream* stream)
+{
+	DefaultAllocator::Destroy(stream);
+}
+
+ANIM_NAMESPACE_END
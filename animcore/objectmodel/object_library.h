@@ -0,0 +1,95 @@
+#pragma once
+#include <stdint.h>
+#include "animcore/util/namespace.h"
+#include "animcore/containers/array.h"
+#include "animcore/containers/flat_hash_map.h"
+#include "animcore/memory/intrusive_ptr.h"
+#include "animcore/objectmodel/managed_object.h"
+#include "animcore/objectmodel/object_id.h"
+#include "animcore/objectmodel/object_stream_provider.h"
+#include "animcore/serialization/chunked_write_stream.h"
+#include "animcore/serialization/mapped_file.h"
+
+ANIM_NAMESPACE_BEGIN
+
+// Many managed objects in one file, written by ObjectLibraryWriter. Every entry is a complete serialized
+// stream, the same as a single asset file, aligned to Max_Data_Alignment so it can be read in place. A table
+// of contents at the end lists the ObjectID, type id, offset and size of each entry, so entries can be found
+// and loaded independently:
+//	header:	magic, library version, number of entries, offset of the table of contents
+//	entries
+//	table of contents
+// Arrays deserialized from a library point into the mapping, so the library has to outlive every object
+// loaded from it. Also an IObjectStreamProvider, so single objects can go through the regular ObjectManager
+// loads.
+class ObjectLibrary : public IObjectStreamProvider
+{
+public:
+	static constexpr uint32_t Magic = 0x424C4E41; // "ANLB"
+	static constexpr uint32_t Version = 1;
+
+	struct Entry
+	{
+		ObjectID m_ObjectID;
+		uint64_t m_TypeID;
+		uint64_t m_Offset;
+		uint32_t m_Size;
+	};
+
+	ObjectLibrary();
+	ObjectLibrary(const ObjectLibrary&) = delete;
+	ObjectLibrary& operator=(const ObjectLibrary&) = delete;
+
+	// False if the file cannot be mapped or its table of contents is broken.
+	bool Open(const char* path);
+	void Close();
+
+	uint32_t GetNumEntries() const { return m_Entries.Size(); }
+	const Entry& GetEntry(uint32_t index) const { return m_Entries[index]; }
+	// -1 if the library has no entry for objectID.
+	int32_t FindEntry(const ObjectID& objectID) const;
+
+	// Deserializes every entry on the JobSystem, then registers the objects with the ObjectManager on the
+	// calling thread in table of contents order, so the outcome does not depend on scheduling. Entries whose
+	// object is already registered keep the registered one. Returns the number of entries that could not be
+	// loaded. objectsOut, if given, receives the registered object of every entry in order. The ObjectManager
+	// does not keep objects alive, without objectsOut they are released again right away.
+	uint32_t LoadAll(BigArray<IntrusivePtr<ManagedObject>>* objectsOut = nullptr);
+
+	virtual Serialization::IReadStream* OpenObjectStream(const ObjectID& objectID) override;
+	virtual void CloseObjectStream(Serialization::IReadStream* stream) override;
+
+private:
+	ManagedObject* ReadEntry(uint32_t index) const;
+
+	Serialization::MappedFile m_File;
+	BigArray<Entry> m_Entries;
+	FlatHashMap<ObjectID, uint32_t> m_EntryIndices;
+};
+
+// Writes an ObjectLibrary file.
+class ObjectLibraryWriter
+{
+public:
+	ObjectLibraryWriter(Serialization::IWriteStream& output, uint32_t dataVersion, uint32_t encodingFlags = 0);
+	ObjectLibraryWriter(const ObjectLibraryWriter&) = delete;
+	ObjectLibraryWriter& operator=(const ObjectLibraryWriter&) = delete;
+
+	// Entries are loaded and registered in the order they are added.
+	void AddObject(const ObjectID& objectID, const ManagedObject* object);
+	// Writes the table of contents. Nothing can be added afterwards.
+	void Finish();
+
+private:
+	void WriteOutput(const void* data, uint32_t numBytes);
+
+	Serialization::IWriteStream& m_Output;
+	Serialization::ChunkedWriteStream m_EntryStream;
+	BigArray<ObjectLibrary::Entry> m_Entries;
+	uint64_t m_OutputPosition;
+	uint32_t m_DataVersion;
+	uint32_t m_EncodingFlags;
+	bool m_IsFinished;
+};
+
+ANIM_NAMESPACE_END
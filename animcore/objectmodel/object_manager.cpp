@@ -0,0 +1,234 @@
+#include "object_manager.h"
+#include <new>
+#include "animcore/serialization/serialization.h"
+#include "animcore/threading/job_system.h"
+
+ANIM_NAMESPACE_BEGIN
+
+ObjectManager::ObjectManager(uint32_t numShards)
+	: m_ShardMemory(nullptr)
+	, m_Shards(nullptr)
+	, m_ShardMask(0)
+	, m_StreamProvider(nullptr)
+{
+	uint32_t shardCount = 1;
+	while (shardCount < numShards)
+	{
+		shardCount *= 2;
+	}
+	m_ShardMask = shardCount - 1;
+
+	m_ShardMemory = static_cast<uint8_t*>(DefaultAllocator::Allocate(shardCount * Shard_Stride + Cache_Line_Size));
+	uintptr_t aligned = (reinterpret_cast<uintptr_t>(m_ShardMemory) + Cache_Line_Size - 1) & ~(static_cast<uintptr_t>(Cache_Line_Size) - 1);
+	m_Shards = reinterpret_cast<uint8_t*>(aligned);
+	for (uint32_t i = 0; i < shardCount; ++i)
+	{
+		new (m_Shards + i * Shard_Stride) Shard();
+	}
+}
+
+ObjectManager::~ObjectManager()
+{
+	// Queued callbacks and in-flight requests hold results, releasing the last reference to one unregisters it.
+	// They are released while the shards still exist, IsInitialized stays true until the destructor returned.
+	for (;;)
+	{
+		BigArray<std::function<void()>> callbacks;
+		BigArray<SharedPtr<LoadRequest>> requests;
+		{
+			std::lock_guard<std::mutex> lock(m_MainThreadCallbackMutex);
+			callbacks = std::move(m_MainThreadCallbacks);
+		}
+		for (uint32_t i = 0; i <= m_ShardMask; ++i)
+		{
+			Shard& shard = *reinterpret_cast<Shard*>(m_Shards + i * Shard_Stride);
+			auto lock = LockExclusive(shard);
+			for (auto& entry : shard.m_InFlight)
+			{
+				requests.Push(std::move(entry.second));
+			}
+			shard.m_InFlight.clear();
+		}
+		if (callbacks.Size() == 0 && requests.Size() == 0)
+			break;
+	}
+
+	// The registry holds no references. Objects still referenced now are destroyed by ManagedObject::Destroy
+	// without unregistering once the manager is gone.
+	for (uint32_t i = 0; i <= m_ShardMask; ++i)
+	{
+		reinterpret_cast<Shard*>(m_Shards + i * Shard_Stride)->~Shard();
+	}
+	DefaultAllocator::Free(m_ShardMemory);
+}
+
+IntrusivePtr<ManagedObject> ObjectManager::RegisterManagedObject(const ObjectID& objectID, const IntrusivePtr<ManagedObject>& object)
+{
+	Shard& shard = GetShard(objectID);
+	object->SetObjectID(objectID);
+	auto lock = LockExclusive(shard);
+	return Register(shard, objectID, object);
+}
+
+IntrusivePtr<ManagedObject> ObjectManager::Register(Shard& shard, const ObjectID& objectID, const IntrusivePtr<ManagedObject>& object)
+{
+	auto result = shard.m_Objects.emplace(objectID, object.Get());
+	if (result.second)
+		return object;
+	ManagedObject* registered = result.first->second;
+	if (registered->TryAddReference())
+		return IntrusivePtr<ManagedObject>(registered, IntrusivePtr<ManagedObject>::AdoptReference());
+	// The registered object is being destroyed and waits for the lock to unregister, it leaves a replaced entry alone.
+	result.first->second = object.Get();
+	return object;
+}
+
+void ObjectManager::UnregisterManagedObject(ManagedObject* object)
+{
+	ANIM_ASSERT_SLOW(object->GetReferenceCount() == 0);
+	{
+		Shard& shard = GetShard(object->GetObjectID());
+		auto lock = LockExclusive(shard);
+		// A duplicate that lost the race in RegisterManagedObject must not remove the registered object.
+		auto iter = shard.m_Objects.find(object->GetObjectID());
+		if (iter != shard.m_Objects.end() && iter->second == object)
+			shard.m_Objects.erase(iter);
+	}
+	DefaultAllocator::Destroy(object);
+}
+
+SharedPtr<LoadRequest> ObjectManager::RequestLoad(const ObjectID& objectID, IntrusivePtr<ManagedObject>& objectOut)
+{
+	if (!objectID.isValid())
+		return nullptr;
+
+	Shard& shard = GetShard(objectID);
+	{
+		auto lock = LockShared(shard);
+		auto iter = shard.m_Objects.find(objectID);
+		if (iter != shard.m_Objects.end() && iter->second->TryAddReference())
+		{
+			objectOut = IntrusivePtr<ManagedObject>(iter->second, IntrusivePtr<ManagedObject>::AdoptReference());
+			return nullptr;
+		}
+	}
+
+	SharedPtr<LoadRequest> request;
+	{
+		auto lock = LockExclusive(shard);
+		// Someone may have finished or started the load while the shard was unlocked. An object that is being
+		// destroyed is loaded again.
+		auto iter = shard.m_Objects.find(objectID);
+		if (iter != shard.m_Objects.end() && iter->second->TryAddReference())
+		{
+			objectOut = IntrusivePtr<ManagedObject>(iter->second, IntrusivePtr<ManagedObject>::AdoptReference());
+			return nullptr;
+		}
+		auto inFlight = shard.m_InFlight.find(objectID);
+		if (inFlight != shard.m_InFlight.end())
+			return inFlight->second;
+
+		request = SharedPtr<LoadRequest>(DefaultAllocator::Create<LoadRequest>(objectID));
+		shard.m_InFlight.emplace(objectID, request);
+	}
+
+	JobSystem::Instance().Schedule([request]() { ObjectManager::Instance().ExecuteLoad(request); });
+	return request;
+}
+
+void ObjectManager::ExecuteLoad(SharedPtr<LoadRequest> request)
+{
+	const ObjectID& objectID = request->GetObjectID();
+	IntrusivePtr<ManagedObject> object;
+	ManagedObject* data = ReadManagedObject(objectID);
+	if (data != nullptr)
+	{
+		data->SetObjectID(objectID);
+		object = IntrusivePtr<ManagedObject>(data);
+	}
+
+	// Released once the shard is unlocked, releasing the last reference unregisters.
+	IntrusivePtr<ManagedObject> duplicate;
+	{
+		Shard& shard = GetShard(objectID);
+		auto lock = LockExclusive(shard);
+		if (object.Get() != nullptr)
+		{
+			IntrusivePtr<ManagedObject> registered = Register(shard, objectID, object);
+			// RegisterManagedObject got there while the object was loading, everyone gets the registered one.
+			if (registered.Get() != object.Get())
+			{
+				duplicate = std::move(object);
+				object = std::move(registered);
+			}
+		}
+		shard.m_InFlight.erase(objectID);
+	}
+	request->Complete(object);
+}
+
+ManagedObject* ObjectManager::ReadManagedObject(const ObjectID& objectID)
+{
+	IObjectStreamProvider* provider = m_StreamProvider.load(std::memory_order_acquire);
+	if (provider == nullptr)
+		return nullptr;
+	Serialization::IReadStream* stream = provider->OpenObjectStream(objectID);
+	if (stream == nullptr)
+		return nullptr;
+
+	ManagedObject* object = nullptr;
+	{
+		Serialization::Deserializer res(*stream);
+		if (res.IsValid())
+			res.Deserialize(object);
+		if (object != nullptr && !res.IsValid())
+		{
+			DefaultAllocator::Destroy(object);
+			object = nullptr;
+		}
+	}
+	provider->CloseObjectStream(stream);
+	return object;
+}
+
+void ObjectManager::QueueMainThreadCallback(std::function<void()> callback)
+{
+	std::lock_guard<std::mutex> lock(m_MainThreadCallbackMutex);
+	m_MainThreadCallbacks.Push(std::move(callback));
+}
+
+void ObjectManager::DispatchMainThreadCallbacks()
+{
+	BigArray<std::function<void()>> callbacks;
+	{
+		std::lock_guard<std::mutex> lock(m_MainThreadCallbackMutex);
+		callbacks = std::move(m_MainThreadCallbacks);
+	}
+	for (auto& callback : callbacks)
+	{
+		callback();
+	}
+}
+
+ObjectManager::ShardStats ObjectManager::GetShardStats(uint32_t shardIndex) const
+{
+	ANIM_ASSERT(shardIndex <= m_ShardMask);
+	Shard& shard = *reinterpret_cast<Shard*>(m_Shards + shardIndex * Shard_Stride);
+	ShardStats stats;
+	{
+		std::shared_lock<std::shared_timed_mutex> lock(shard.m_Mutex);
+		stats.m_NumObjects = shard.m_Objects.size();
+	}
+#ifdef ANIM_OBJECT_MANAGER_LOCK_STATS
+	stats.m_NumReadLocks = shard.m_NumReadLocks.load(std::memory_order_relaxed);
+	stats.m_NumWriteLocks = shard.m_NumWriteLocks.load(std::memory_order_relaxed);
+#else
+	stats.m_NumReadLocks = 0;
+	stats.m_NumWriteLocks = 0;
+#endif
+	stats.m_NumContendedReadLocks = shard.m_NumContendedReadLocks.load(std::memory_order_relaxed);
+	stats.m_NumContendedWriteLocks = shard.m_NumContendedWriteLocks.load(std::memory_order_relaxed);
+	return stats;
+}
+
+ANIM_NAMESPACE_END
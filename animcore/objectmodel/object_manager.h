@@ -1,48 +1,168 @@
 #pragma once
 #include "animcore/util/namespace.h"
+#include <atomic>
 #include <mutex>
+#include <shared_mutex>
 
 #include "animcore/objectmodel/object_id.h"
+#include "animcore/objectmodel/managed_object.h"
+#include "animcore/objectmodel/load_handle.h"
+#include "animcore/objectmodel/object_stream_provider.h"
 #include "animcore/memory/default_allocator.h"
 #include "animcore/memory/pointers.h"
+#include "animcore/memory/intrusive_ptr.h"
 #include "animcore/containers/singleton.h"
-#include "animcore/containers/unordered_map.h"
+#include "animcore/containers/array.h"
+#include "animcore/containers/flat_hash_map.h"
 #include "animcore/util/assert.h"
 
 ANIM_NAMESPACE_BEGIN
 
+// Registry of every live ManagedObject, keyed by ObjectID.
+// The registry is split into shards selected by the ObjectID hash, each with its own reader/writer lock,
+// so lookups from different threads only contend when they hit the same shard and never block each other
+// unless someone is registering or unregistering in that shard.
+// Loads run on the JobSystem. Requests for an object that is already being loaded join the in-flight load.
+// Objects are reference counted intrusively. The registry does not own them: the last IntrusivePtr to go away
+// calls back into UnregisterManagedObject through ManagedObject::ReleaseReference, and lookups only hand out
+// objects whose count has not dropped to zero yet.
 class ObjectManager : public Singleton<ObjectManager>
 {
-public:	
-	template<typename T>
-	SharedPtr<T> GetManagedObject(const ObjectID& objectID);
+public:
+	static constexpr uint32_t Default_Num_Shards = 32;
+
+	struct ShardStats
+	{
+		uint64_t m_NumObjects;
+		// 0 unless built with ANIM_OBJECT_MANAGER_LOCK_STATS.
+		uint64_t m_NumReadLocks;
+		uint64_t m_NumWriteLocks;
+		// Lock acquisitions that could not be satisfied by a try_lock and had to wait. Always counted, they
+		// only touch the shard when its lock is contended anyway.
+		uint64_t m_NumContendedReadLocks;
+		uint64_t m_NumContendedWriteLocks;
+	};
+
+	// numShards is rounded up to a power of two.
+	explicit ObjectManager(uint32_t numShards = Default_Num_Shards);
+	~ObjectManager();
+	ObjectManager(const ObjectManager&) = delete;
+	ObjectManager& operator=(const ObjectManager&) = delete;
 
 	template<typename T>
-	SharedPtr<T> LoadManagedObject(const ObjectID& objectID)
+	IntrusivePtr<T> GetManagedObject(const ObjectID& objectID)
 	{
-		auto ret = GetManagedObject<T>(objectID);
-		if (ret != nullptr)
-			return ret;
-		// Loading kickoff here
-		T* data = nullptr;
+		Shard& shard = GetShard(objectID);
+		auto lock = LockShared(shard);
+		auto iter = shard.m_Objects.find(objectID);
+		if (iter == shard.m_Objects.end() || !iter->second->TryAddReference())
+			return nullptr;
+		return IntrusivePtr<T>(static_cast<T*>(iter->second), typename IntrusivePtr<T>::AdoptReference());
+	}
 
-		auto ptr = SharedPtr<T>(data, [](T* obj) -> void { ObjectManager::Instance().UnregisterManagedObject(obj); });
-		m_ObjectMap[objectID] = ptr;
+	// Returns immediately. The handle is already complete if the object is registered.
+	template<typename T>
+	LoadHandle<T> LoadManagedObjectAsync(const ObjectID& objectID)
+	{
+		IntrusivePtr<ManagedObject> object;
+		SharedPtr<LoadRequest> request = RequestLoad(objectID, object);
+		if (request.Get() == nullptr)
+			return LoadHandle<T>(object);
+		return LoadHandle<T>(request);
 	}
 
 	template<typename T>
-	void UnregisterManagedObject(T* object)
+	IntrusivePtr<T> LoadManagedObject(const ObjectID& objectID)
 	{
-		ANIM_ASSERT_SLOW(m_ObjectMap.find(object->GetObjectID()) != m_ObjectMap.end());
-		m_ObjectMap.erase(object->GetObjectID());
-		object->~ManagedObject();
-		DefaultAllocator::Free(object);
+		return LoadManagedObjectAsync<T>(objectID).Wait();
 	}
+
+	// Registers object under objectID unless another thread got there first, in which case the object
+	// that is already registered is returned instead. The object stays registered while references to it exist.
+	IntrusivePtr<ManagedObject> RegisterManagedObject(const ObjectID& objectID, const IntrusivePtr<ManagedObject>& object);
+
+	// Called once the last reference to object was released.
+	void UnregisterManagedObject(ManagedObject* object);
+
+	// The provider must outlive every load started while it is set.
+	void SetStreamProvider(IObjectStreamProvider* provider) { m_StreamProvider.store(provider, std::memory_order_release); }
+
+	void QueueMainThreadCallback(std::function<void()> callback);
+	// Runs the LoadCallbackThread::Main callbacks of finished loads. Called by the engine every frame.
+	void DispatchMainThreadCallbacks();
+
+	uint32_t GetNumShards() const { return m_ShardMask + 1; }
+	ShardStats GetShardStats(uint32_t shardIndex) const;
+
 private:
-	std::mutex m_ObjectMapMutex;
-	UnorderedMap<ObjectID, SharedPtr<ManagedObject>> m_ObjectMap;
+	struct Shard
+	{
+		std::shared_timed_mutex m_Mutex;
+		FlatHashMap<ObjectID, ManagedObject*> m_Objects;
+		FlatHashMap<ObjectID, SharedPtr<LoadRequest>> m_InFlight;
+#ifdef ANIM_OBJECT_MANAGER_LOCK_STATS
+		std::atomic<uint64_t> m_NumReadLocks{ 0 };
+		std::atomic<uint64_t> m_NumWriteLocks{ 0 };
+#endif
+		std::atomic<uint64_t> m_NumContendedReadLocks{ 0 };
+		std::atomic<uint64_t> m_NumContendedWriteLocks{ 0 };
+	};
+
+	// Shards are padded to whole cache lines so neighbouring locks do not share one.
+	static constexpr size_t Cache_Line_Size = 64;
+	static constexpr size_t Shard_Stride = (sizeof(Shard) + Cache_Line_Size - 1) & ~(Cache_Line_Size - 1);
+
+	Shard& GetShard(const ObjectID& objectID) const
+	{
+		// FlatHashMap consumes the low bits of the hash, shard with the high ones.
+		uint32_t index = static_cast<uint32_t>(objectID.GetHash() >> 32) & m_ShardMask;
+		return *reinterpret_cast<Shard*>(m_Shards + index * Shard_Stride);
+	}
+
+	static std::shared_lock<std::shared_timed_mutex> LockShared(Shard& shard)
+	{
+		std::shared_lock<std::shared_timed_mutex> lock(shard.m_Mutex, std::try_to_lock);
+		if (!lock.owns_lock())
+		{
+			shard.m_NumContendedReadLocks.fetch_add(1, std::memory_order_relaxed);
+			lock.lock();
+		}
+#ifdef ANIM_OBJECT_MANAGER_LOCK_STATS
+		shard.m_NumReadLocks.fetch_add(1, std::memory_order_relaxed);
+#endif
+		return lock;
+	}
+
+	static std::unique_lock<std::shared_timed_mutex> LockExclusive(Shard& shard)
+	{
+		std::unique_lock<std::shared_timed_mutex> lock(shard.m_Mutex, std::try_to_lock);
+		if (!lock.owns_lock())
+		{
+			shard.m_NumContendedWriteLocks.fetch_add(1, std::memory_order_relaxed);
+			lock.lock();
+		}
+#ifdef ANIM_OBJECT_MANAGER_LOCK_STATS
+		shard.m_NumWriteLocks.fetch_add(1, std::memory_order_relaxed);
+#endif
+		return lock;
+	}
+
+	// Registers object, or returns the object registered under objectID while it is alive. Expects the shard to
+	// be locked exclusively.
+	static IntrusivePtr<ManagedObject> Register(Shard& shard, const ObjectID& objectID, const IntrusivePtr<ManagedObject>& object);
+	// Either returns the registered object in objectOut, or the (possibly shared) request loading it.
+	SharedPtr<LoadRequest> RequestLoad(const ObjectID& objectID, IntrusivePtr<ManagedObject>& objectOut);
+	void ExecuteLoad(SharedPtr<LoadRequest> request);
+	ManagedObject* ReadManagedObject(const ObjectID& objectID);
+
+	uint8_t* m_ShardMemory;
+	uint8_t* m_Shards;
+	uint32_t m_ShardMask;
+	std::atomic<IObjectStreamProvider*> m_StreamProvider;
+	std::mutex m_MainThreadCallbackMutex;
+	BigArray<std::function<void()>> m_MainThreadCallbacks;
 };
 
 
 
-ANIM_NAMESPACE_END
+ANIM_NAMESPACE_END
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+#include "animcore/util/namespace.h"
+#include "animcore/objectmodel/object_id.h"
+
+ANIM_NAMESPACE_BEGIN
+
+namespace Serialization
+{
+	class IReadStream;
+}
+
+// Source of serialized managed objects, implemented by the host or by an archive.
+// Both functions are called from job system workers, concurrently and for different objects.
+class IObjectStreamProvider
+{
+public:
+	virtual ~IObjectStreamProvider() {}
+	// Returns nullptr if there is no data for objectID.
+	virtual Serialization::IReadStream* OpenObjectStream(const ObjectID& objectID) = 0;
+	virtual void CloseObjectStream(Serialization::IReadStream* stream) = 0;
+};
+
+ANIM_NAMESPACE_END
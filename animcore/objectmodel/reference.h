@@ -2,6 +2,7 @@
 #include <type_traits>
 #include "animcore/util/namespace.h"
 #include "animcore/objectmodel/managed_object.h"
+#include "animcore/objectmodel/load_handle.h"
 
 ANIM_NAMESPACE_BEGIN
 
@@ -20,11 +21,68 @@ struct IsManagedObject<T, typename std::enable_if<std::is_base_of<ManagedObject,
 template<typename T>
 struct Reference
 {
-	static_assert(IsManagedObject<T>::Value, "Reference can only be to a ManagedObject (or derived class)");
 public:
 	Reference() = default;
+
+	Reference(const Reference& other)
+		: m_ObjectID(other.m_ObjectID)
+		, m_ObjPtr(other.m_ObjPtr)
+	{
+		if (other.m_PendingLoad.Get() != nullptr)
+			m_PendingLoad = UniquePtr<LoadHandle<T>>::MakeUnique(*other.m_PendingLoad.Get());
+	}
+
+	Reference(Reference&&) = default;
+
+	Reference& operator=(const Reference& other)
+	{
+		if (this != &other)
+		{
+			m_ObjectID = other.m_ObjectID;
+			m_ObjPtr = other.m_ObjPtr;
+			m_PendingLoad.Reset();
+			if (other.m_PendingLoad.Get() != nullptr)
+				m_PendingLoad = UniquePtr<LoadHandle<T>>::MakeUnique(*other.m_PendingLoad.Get());
+		}
+		return *this;
+	}
+
+	Reference& operator=(Reference&&) = default;
+
+	// Deserialization only starts loading the referenced object. Returns nullptr until that load finished.
+	IntrusivePtr<T> Get()
+	{
+		// Checked here rather than at class scope so objects can reference their own type.
+		static_assert(IsManagedObject<T>::Value, "Reference can only be to a ManagedObject (or derived class)");
+		if (m_PendingLoad.Get() != nullptr && m_PendingLoad->IsDone())
+		{
+			m_ObjPtr = m_PendingLoad->Get();
+			m_PendingLoad.Reset();
+		}
+		return m_ObjPtr;
+	}
+
+	bool IsLoading() const { return m_PendingLoad.Get() != nullptr && !m_PendingLoad->IsDone(); }
+
+	// Loads that already finished are resolved right away; only loads still in flight allocate.
+	void SetLoad(const LoadHandle<T>& handle)
+	{
+		m_ObjPtr = nullptr;
+		m_PendingLoad.Reset();
+		if (handle.IsDone())
+			m_ObjPtr = handle.Get();
+		else
+			m_PendingLoad = UniquePtr<LoadHandle<T>>::MakeUnique(handle);
+	}
+
 	ObjectID m_ObjectID;
-	SharedPtr<T> m_ObjPtr;
+	IntrusivePtr<T> m_ObjPtr;
+
+private:
+	// Out of line, so a Reference stays as small as the ObjectID and one pointer to the object.
+	UniquePtr<LoadHandle<T>> m_PendingLoad;
 };
 
+static_assert(sizeof(Reference<ManagedObject>) == sizeof(ObjectID) + 2 * sizeof(void*), "Reference grew, keep pending loads out of line");
+
 ANIM_NAMESPACE_END
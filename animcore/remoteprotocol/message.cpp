@@ -1,8 +1,69 @@
 #include "message.h"
+#include <string.h>
+#include "animcore/serialization/serialization.h"
 
 ANIM_NAMESPACE_BEGIN
 
 IMPLEMENT_CONCRETE_DERIVED_CLASS(Message, Object);
 
+namespace
+{
+	// Copies everything out of the buffer, so arrays are never read in place from a buffer that gets reused.
+	// Reading past the end of a truncated or corrupt message fails the stream, the missing bytes read as zeros.
+	class MessageReadStream : public Serialization::IReadStream
+	{
+	public:
+		MessageReadStream(const void* buffer, uint32_t size)
+			: m_Buffer(static_cast<const uint8_t*>(buffer)), m_Size(size), m_Position(0), m_HasFailed(false)
+		{}
+
+		virtual void Read(void* dst, uint32_t numBytes) override
+		{
+			uint32_t available = m_Size - m_Position;
+			uint32_t numCopied = numBytes < available ? numBytes : available;
+			if (numCopied < numBytes)
+			{
+				m_HasFailed = true;
+				memset(static_cast<uint8_t*>(dst) + numCopied, 0, numBytes - numCopied);
+			}
+			if (numCopied > 0)
+			{
+				memcpy(dst, m_Buffer + m_Position, numCopied);
+			}
+			m_Position += numCopied;
+		}
+		virtual void Reset() override
+		{
+			m_Position = 0;
+			m_HasFailed = false;
+		}
+		virtual uint32_t GetNumBytesRead() const override { return m_Position; }
+		virtual bool HasFailed() const override { return m_HasFailed; }
+
+	private:
+		const uint8_t* m_Buffer;
+		uint32_t m_Size;
+		uint32_t m_Position;
+		bool m_HasFailed;
+	};
+}
+
+Message* ReadMessage(const void* buffer, uint32_t numBytes)
+{
+	MessageReadStream stream(buffer, numBytes);
+	Serialization::Deserializer res(stream);
+	Message* msg = nullptr;
+	if (res.IsValid())
+	{
+		res.Deserialize(msg);
+	}
+	// A message that read past its end is corrupt, whatever it read is not to be trusted.
+	if (msg != nullptr && !res.IsValid())
+	{
+		DefaultAllocator::Destroy(msg);
+		msg = nullptr;
+	}
+	return msg;
+}
 
 ANIM_NAMESPACE_END
@@ -1,4 +1,5 @@
 #pragma once
+#include <stdint.h>
 #include "animcore/util/namespace.h"
 #include "animcore/objectmodel/object.h"
 
@@ -11,4 +12,11 @@ public:
 	virtual ~Message() {}
 };
 
-ANIM_NAMESPACE_END
\ No newline at end of file
+// Data version every message is serialized with.
+static constexpr uint32_t Message_Data_Version = 1;
+
+// Deserializes a message written by MessageWriter. Nothing of the returned message points into buffer, so
+// the buffer can be reused right away.
+Message* ReadMessage(const void* buffer, uint32_t numBytes);
+
+ANIM_NAMESPACE_END
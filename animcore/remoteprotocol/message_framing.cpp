@@ -0,0 +1,299 @@
+#include "message_framing.h"
+#include <string.h>
+#include "animcore/remoteprotocol/message.h"
+#include "animcore/serialization/serialization.h"
+
+ANIM_NAMESPACE_BEGIN
+
+MessageBufferPool::MessageBufferPool()
+	: m_NumPooledBytes(0)
+{
+}
+
+BigArray<uint8_t> MessageBufferPool::Acquire(uint32_t size)
+{
+	BigArray<uint8_t> buffer;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		// Smallest buffer that is large enough, otherwise the largest one so it only has to grow.
+		uint32_t best = m_FreeBuffers.Size();
+		for (uint32_t i = 0; i < m_FreeBuffers.Size(); ++i)
+		{
+			uint32_t capacity = m_FreeBuffers[i].Capacity();
+			if (best == m_FreeBuffers.Size())
+			{
+				best = i;
+				continue;
+			}
+			uint32_t bestCapacity = m_FreeBuffers[best].Capacity();
+			bool fits = capacity >= size;
+			bool bestFits = bestCapacity >= size;
+			if ((fits && (!bestFits || capacity < bestCapacity)) || (!fits && !bestFits && capacity > bestCapacity))
+			{
+				best = i;
+			}
+		}
+		if (best != m_FreeBuffers.Size())
+		{
+			buffer = std::move(m_FreeBuffers[best]);
+			m_FreeBuffers.RemoveAt(best);
+			m_NumPooledBytes -= buffer.Capacity();
+		}
+	}
+	buffer.Resize(size);
+	return buffer;
+}
+
+void MessageBufferPool::Release(BigArray<uint8_t>&& buffer)
+{
+	BigArray<uint8_t> released(std::move(buffer));
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (m_FreeBuffers.Size() < Max_Pooled_Buffers && m_NumPooledBytes + released.Capacity() <= Max_Pooled_Bytes)
+	{
+		m_NumPooledBytes += released.Capacity();
+		m_FreeBuffers.Push(std::move(released));
+	}
+}
+
+MessageReader::MessageReader(MessageBufferPool& pool, uint32_t maxMessageSize)
+	: m_Pool(pool)
+	, m_StagingBegin(0)
+	, m_StagingEnd(0)
+	, m_LargeMessageFilled(0)
+	, m_LargeMessageRequestID(0)
+	, m_IsReceivingLargeMessage(false)
+	, m_MaxMessageSize(maxMessageSize)
+{
+	m_Staging.Resize(Staging_Size);
+}
+
+MessageReader::~MessageReader()
+{
+	Reset();
+}
+
+void MessageReader::Reset()
+{
+	if (m_IsReceivingLargeMessage)
+	{
+		m_Pool.Release(std::move(m_LargeMessage));
+		m_IsReceivingLargeMessage = false;
+	}
+	m_StagingBegin = 0;
+	m_StagingEnd = 0;
+}
+
+void MessageReader::GetReceiveBuffer(uint8_t*& dstOut, uint32_t& capacityOut)
+{
+	if (m_IsReceivingLargeMessage)
+	{
+		dstOut = m_LargeMessage.GetBuffer() + m_LargeMessageFilled;
+		capacityOut = m_LargeMessage.Size() - m_LargeMessageFilled;
+		return;
+	}
+	// Only the start of an incomplete message is left over, moving it to the front is cheap.
+	if (m_StagingBegin > 0)
+	{
+		memmove(m_Staging.GetBuffer(), m_Staging.GetBuffer() + m_StagingBegin, m_StagingEnd - m_StagingBegin);
+		m_StagingEnd -= m_StagingBegin;
+		m_StagingBegin = 0;
+	}
+	dstOut = m_Staging.GetBuffer() + m_StagingEnd;
+	capacityOut = Staging_Size - m_StagingEnd;
+}
+
+void MessageReader::CommitReceive(uint32_t numBytes)
+{
+	if (m_IsReceivingLargeMessage)
+	{
+		ANIM_ASSERT(m_LargeMessageFilled + numBytes <= m_LargeMessage.Size());
+		m_LargeMessageFilled += numBytes;
+	}
+	else
+	{
+		ANIM_ASSERT(m_StagingEnd + numBytes <= Staging_Size);
+		m_StagingEnd += numBytes;
+	}
+}
+
+MessageReader::Result MessageReader::NextMessage(Message*& msgOut, uint32_t& requestIDOut)
+{
+	msgOut = nullptr;
+	if (m_IsReceivingLargeMessage)
+	{
+		if (m_LargeMessageFilled < m_LargeMessage.Size())
+			return Result::Incomplete;
+		requestIDOut = m_LargeMessageRequestID;
+		msgOut = ReadMessage(m_LargeMessage.GetBuffer(), m_LargeMessage.Size());
+		m_Pool.Release(std::move(m_LargeMessage));
+		m_IsReceivingLargeMessage = false;
+		return msgOut != nullptr ? Result::Complete : Result::Error;
+	}
+
+	uint32_t numAvailable = m_StagingEnd - m_StagingBegin;
+	if (numAvailable < sizeof(MessageHeader))
+		return Result::Incomplete;
+	MessageHeader header;
+	memcpy(&header, m_Staging.GetBuffer() + m_StagingBegin, sizeof(header));
+	if (header.m_Size > m_MaxMessageSize)
+		return Result::Error;
+
+	const uint8_t* payload = m_Staging.GetBuffer() + m_StagingBegin + sizeof(header);
+	uint32_t numPayloadAvailable = numAvailable - sizeof(header);
+	if (numPayloadAvailable >= header.m_Size)
+	{
+		requestIDOut = header.m_RequestID;
+		msgOut = ReadMessage(payload, header.m_Size);
+		m_StagingBegin += sizeof(header) + header.m_Size;
+		return msgOut != nullptr ? Result::Complete : Result::Error;
+	}
+
+	if (sizeof(header) + header.m_Size > Staging_Size)
+	{
+		m_LargeMessage = m_Pool.Acquire(header.m_Size);
+		memcpy(m_LargeMessage.GetBuffer(), payload, numPayloadAvailable);
+		m_LargeMessageFilled = numPayloadAvailable;
+		m_LargeMessageRequestID = header.m_RequestID;
+		m_IsReceivingLargeMessage = true;
+		m_StagingBegin = 0;
+		m_StagingEnd = 0;
+	}
+	return Result::Incomplete;
+}
+
+MessageWriter::MessageWriter(uint32_t maxMessageSize)
+	: m_QueuedStream(0)
+	, m_CurrentSegment(0)
+	, m_SegmentOffset(0)
+	, m_MaxMessageSize(maxMessageSize)
+{
+}
+
+bool MessageWriter::Encode(const Message* msg, uint32_t requestID)
+{
+	Serialization::ChunkedWriteStream& stream = m_Streams[m_QueuedStream];
+	uint32_t headerPosition = stream.GetNumBytesWritten();
+	MessageHeader header = { 0, requestID };
+	stream.Write(&header, sizeof(header));
+	{
+		Serialization::Serializer res(stream, Message_Data_Version);
+		res.Serialize(msg);
+	}
+	uint32_t size = stream.GetNumBytesWritten() - headerPosition - static_cast<uint32_t>(sizeof(header));
+	if (size > m_MaxMessageSize)
+	{
+		stream.Truncate(headerPosition);
+		return false;
+	}
+	header.m_Size = size;
+	stream.Patch(headerPosition, &header, sizeof(header));
+	return true;
+}
+
+bool MessageWriter::BeginSend()
+{
+	if (!IsDone())
+		return true;
+	if (GetNumQueuedBytes() == 0)
+		return false;
+
+	Serialization::ChunkedWriteStream& stream = m_Streams[m_QueuedStream];
+	m_QueuedStream ^= 1;
+	m_Streams[m_QueuedStream].Reset();
+	m_Segments.Clear();
+	m_CurrentSegment = 0;
+	m_SegmentOffset = 0;
+	for (uint32_t i = 0; i < stream.GetNumChunks(); ++i)
+	{
+		if (stream.GetChunkSize(i) > 0)
+		{
+			m_Segments.Push({ stream.GetChunkData(i), stream.GetChunkSize(i) });
+		}
+	}
+	return true;
+}
+
+MessageWriter::Segment MessageWriter::GetSegment(uint32_t index) const
+{
+	Segment segment = m_Segments[m_CurrentSegment + index];
+	if (index == 0)
+	{
+		segment.m_Data += m_SegmentOffset;
+		segment.m_Size -= m_SegmentOffset;
+	}
+	return segment;
+}
+
+bool MessageWriter::CommitSend(size_t numBytes)
+{
+	while (numBytes > 0)
+	{
+		ANIM_ASSERT(m_CurrentSegment < m_Segments.Size());
+		uint32_t remaining = m_Segments[m_CurrentSegment].m_Size - m_SegmentOffset;
+		if (numBytes < remaining)
+		{
+			m_SegmentOffset += static_cast<uint32_t>(numBytes);
+			break;
+		}
+		numBytes -= remaining;
+		++m_CurrentSegment;
+		m_SegmentOffset = 0;
+	}
+	return IsDone();
+}
+
+void MessageWriter::Reset()
+{
+	m_Streams[0].Reset();
+	m_Streams[1].Reset();
+	m_Segments.Clear();
+	m_CurrentSegment = 0;
+	m_SegmentOffset = 0;
+}
+
+PendingRequestTable::PendingRequestTable()
+	: m_NextRequestID(1)
+{
+}
+
+uint32_t PendingRequestTable::Add(Callback callback)
+{
+	uint32_t requestID = m_NextRequestID;
+	// Skips 0 and, after wrapping around, requests that are still waiting for a response.
+	while (requestID == 0 || m_Callbacks.count(requestID) != 0)
+	{
+		++requestID;
+	}
+	m_NextRequestID = requestID + 1;
+	m_Callbacks.emplace(requestID, std::move(callback));
+	return requestID;
+}
+
+void PendingRequestTable::Remove(uint32_t requestID)
+{
+	m_Callbacks.erase(requestID);
+}
+
+bool PendingRequestTable::Complete(uint32_t requestID, UniquePtr<Message> response)
+{
+	auto iter = m_Callbacks.find(requestID);
+	if (iter == m_Callbacks.end())
+		return false;
+	// Taken out first, the callback may send new requests.
+	Callback callback = std::move(iter->second);
+	m_Callbacks.erase(iter);
+	callback(std::move(response));
+	return true;
+}
+
+void PendingRequestTable::FailAll()
+{
+	FlatHashMap<uint32_t, Callback> failed(std::move(m_Callbacks));
+	m_Callbacks.clear();
+	for (auto& entry : failed)
+	{
+		entry.second(UniquePtr<Message>());
+	}
+}
+
+ANIM_NAMESPACE_END
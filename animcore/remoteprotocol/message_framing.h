@@ -0,0 +1,167 @@
+#pragma once
+#include <stdint.h>
+#include <functional>
+#include <mutex>
+#include "animcore/util/namespace.h"
+#include "animcore/containers/array.h"
+#include "animcore/containers/flat_hash_map.h"
+#include "animcore/memory/pointers.h"
+#include "animcore/serialization/chunked_write_stream.h"
+
+ANIM_NAMESPACE_BEGIN
+
+class Message;
+
+// Every message goes over the connection as a header followed by m_Size bytes of serialized message.
+// A response carries the m_RequestID of its request, so a client can have many requests in flight and match
+// responses arriving in any order. Request id 0 is never used for requests.
+struct MessageHeader
+{
+	uint32_t m_Size;
+	uint32_t m_RequestID;
+};
+
+static constexpr uint32_t Default_Max_Message_Size = 256 * 1024 * 1024;
+
+// Buffers for messages too large to be assembled in a MessageReader's staging buffer. Buffers are recycled
+// so streaming large messages does not allocate and fault in fresh pages for every one of them.
+class MessageBufferPool
+{
+public:
+	static constexpr uint32_t Max_Pooled_Buffers = 8;
+	static constexpr size_t Max_Pooled_Bytes = 512 * 1024 * 1024;
+
+	MessageBufferPool();
+	MessageBufferPool(const MessageBufferPool&) = delete;
+	MessageBufferPool& operator=(const MessageBufferPool&) = delete;
+
+	// The contents of the returned buffer are undefined.
+	BigArray<uint8_t> Acquire(uint32_t size);
+	void Release(BigArray<uint8_t>&& buffer);
+
+private:
+	std::mutex m_Mutex;
+	BigArray<BigArray<uint8_t>> m_FreeBuffers;
+	size_t m_NumPooledBytes;
+};
+
+// Reassembles messages from a byte stream. Data is received into a staging buffer that can hold many small
+// messages, so pipelined requests cost one receive call. Messages that do not fit into the staging buffer
+// are received straight into a pooled buffer of their final size.
+//	uint8_t* dst; uint32_t capacity;
+//	reader.GetReceiveBuffer(dst, capacity);
+//	reader.CommitReceive(recv(socket, dst, capacity));
+//	while (reader.NextMessage(msg, requestID) == MessageReader::Result::Complete) ...
+class MessageReader
+{
+public:
+	static constexpr uint32_t Staging_Size = 64 * 1024;
+
+	enum class Result
+	{
+		Complete,
+		Incomplete,
+		// Larger than the maximum message size or not a valid message, the connection should be dropped.
+		Error
+	};
+
+	MessageReader(MessageBufferPool& pool, uint32_t maxMessageSize = Default_Max_Message_Size);
+	~MessageReader();
+	MessageReader(const MessageReader&) = delete;
+	MessageReader& operator=(const MessageReader&) = delete;
+
+	void SetMaxMessageSize(uint32_t maxMessageSize) { m_MaxMessageSize = maxMessageSize; }
+	void GetReceiveBuffer(uint8_t*& dstOut, uint32_t& capacityOut);
+	void CommitReceive(uint32_t numBytes);
+	// On Complete msgOut is a new message owned by the caller.
+	Result NextMessage(Message*& msgOut, uint32_t& requestIDOut);
+	// Drops everything received so far, e.g. after the connection was closed.
+	void Reset();
+
+private:
+	MessageBufferPool& m_Pool;
+	BigArray<uint8_t> m_Staging;
+	uint32_t m_StagingBegin;
+	uint32_t m_StagingEnd;
+	BigArray<uint8_t> m_LargeMessage;
+	uint32_t m_LargeMessageFilled;
+	uint32_t m_LargeMessageRequestID;
+	bool m_IsReceivingLargeMessage;
+	uint32_t m_MaxMessageSize;
+};
+
+// Serializes messages with their headers into batches that are sent with a single gather write, straight out
+// of the serializer's chunks. Messages encoded while a batch is being sent are queued for the next batch, so
+// everything that piles up during one write goes out with the next one.
+//	writer.Encode(msg, requestID); ...
+//	while (writer.BeginSend())
+//		writer.CommitSend(sendmsg(socket, writer.GetSegment(0 .. GetNumSegments)));
+class MessageWriter
+{
+public:
+	struct Segment
+	{
+		const uint8_t* m_Data;
+		uint32_t m_Size;
+	};
+
+	explicit MessageWriter(uint32_t maxMessageSize = Default_Max_Message_Size);
+	MessageWriter(const MessageWriter&) = delete;
+	MessageWriter& operator=(const MessageWriter&) = delete;
+
+	void SetMaxMessageSize(uint32_t maxMessageSize) { m_MaxMessageSize = maxMessageSize; }
+	// Queues a message. False if it is larger than the maximum message size, it is dropped then.
+	bool Encode(const Message* msg, uint32_t requestID);
+	uint32_t GetNumQueuedBytes() const { return m_Streams[m_QueuedStream].GetNumBytesWritten(); }
+
+	// Starts sending the queued messages unless the previous batch is still being sent. Returns false if
+	// there is nothing to send.
+	bool BeginSend();
+	// Segments of the current batch that still have to be sent, the first one already advanced past what was
+	// sent before.
+	uint32_t GetNumSegments() const { return m_Segments.Size() - m_CurrentSegment; }
+	Segment GetSegment(uint32_t index) const;
+	// Returns true once the current batch was sent.
+	bool CommitSend(size_t numBytes);
+	bool IsDone() const { return m_CurrentSegment == m_Segments.Size(); }
+	bool HasDataToSend() const { return !IsDone() || GetNumQueuedBytes() > 0; }
+	// Drops the current batch and everything queued, e.g. after the connection was closed.
+	void Reset();
+
+private:
+	// One stream is being sent while messages are queued into the other one.
+	Serialization::ChunkedWriteStream m_Streams[2];
+	uint32_t m_QueuedStream;
+	SmallArray<Segment, 8> m_Segments;
+	uint32_t m_CurrentSegment;
+	uint32_t m_SegmentOffset;
+	uint32_t m_MaxMessageSize;
+};
+
+// Callbacks of the requests a client is waiting for, by request id.
+class PendingRequestTable
+{
+public:
+	// Called with the response, or with nullptr if the request failed.
+	typedef std::function<void(UniquePtr<Message>)> Callback;
+
+	PendingRequestTable();
+
+	// Returns the request id, never 0.
+	uint32_t Add(Callback callback);
+	// Forgets a request without calling its callback, e.g. when it could not be sent.
+	void Remove(uint32_t requestID);
+	// Calls the callback of the request. Returns false if no request with that id is pending.
+	bool Complete(uint32_t requestID, UniquePtr<Message> response);
+	// Calls every callback with nullptr. Callbacks may add new requests.
+	void FailAll();
+
+	bool IsPending(uint32_t requestID) const { return m_Callbacks.count(requestID) != 0; }
+	size_t GetNumPending() const { return m_Callbacks.size(); }
+
+private:
+	FlatHashMap<uint32_t, Callback> m_Callbacks;
+	uint32_t m_NextRequestID;
+};
+
+ANIM_NAMESPACE_END
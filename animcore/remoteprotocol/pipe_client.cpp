@@ -1,31 +1,74 @@
+#ifdef WIN32
 #include "pipe_client.h"
-#include "animcore/serialization/serialization.h"
+#include <string.h>
 #include "animcore/remoteprotocol/message.h"
+#include "animcore/remoteprotocol/message_framing.h"
+#include "animcore/remoteprotocol/stream_messages.h"
+#include "animcore/remoteprotocol/stream_subscriptions.h"
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #undef SendMessage
 
 ANIM_NAMESPACE_BEGIN
 
-static constexpr size_t Buffer_Size = 4096;
+// SendMessageAsync starts writing once this many bytes of requests are queued.
+static constexpr uint32_t Batch_Send_Size = 64 * 1024;
 
+// Overlapped reads and writes: while requests are written the responses that already arrived are read, so a
+// large batch cannot deadlock with a server that stops reading until its answers were read.
 class PipeClient : public IPipeClient
 {
 public:
 	PipeClient();
 	virtual ~PipeClient();
 	virtual Message* SendMessage(const Message* msgToSend) override;
+	virtual uint32_t SendMessageAsync(const Message* msgToSend, ResponseCallback callback) override;
+	virtual bool PollResponses() override;
+	virtual bool WaitForResponse(uint32_t requestID) override;
+	virtual bool WaitForResponses() override;
+	virtual size_t GetNumPendingRequests() const override { return pendingRequests_.GetNumPending(); }
+	virtual uint32_t Subscribe(uint32_t streamID, uint64_t key, float rate, SnapshotCallback callback, float* negotiatedRateOut) override;
+	virtual void Unsubscribe(uint32_t subscriptionID) override;
 	virtual bool ConnectToServer(const char* pipeName) override;
 	virtual void DisconnectFromServer() override;
+	virtual void SetMaxMessageSize(uint32_t maxMessageSize) override;
 private:
+	// Sends and receives until the response to requestID arrived, or nothing is pending for requestID 0.
+	// Returns after a single pass if wait is false.
+	bool Pump(bool wait, uint32_t requestID);
+	bool StartWrite();
+	bool FinishWrite();
+	bool StartRead();
+	bool FinishRead();
+
 	HANDLE pipeInstanceHandle_;
-	uint8_t inputBuffer[Buffer_Size];
-	uint8_t outputBuffer[Buffer_Size];
+	OVERLAPPED writeOverlapped_;
+	OVERLAPPED readOverlapped_;
+	bool isWritePending_;
+	bool isReadPending_;
+	MessageBufferPool bufferPool_;
+	MessageReader reader_;
+	MessageWriter writer_;
+	PendingRequestTable pendingRequests_;
+	SubscriptionTable subscriptions_;
 };
 
 PipeClient::PipeClient()
 	: pipeInstanceHandle_(INVALID_HANDLE_VALUE)
+	, isWritePending_(false)
+	, isReadPending_(false)
+	, reader_(bufferPool_)
 {
+	memset(&writeOverlapped_, 0, sizeof(writeOverlapped_));
+	memset(&readOverlapped_, 0, sizeof(readOverlapped_));
+	writeOverlapped_.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	readOverlapped_.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+}
+
+void PipeClient::SetMaxMessageSize(uint32_t maxMessageSize)
+{
+	reader_.SetMaxMessageSize(maxMessageSize);
+	writer_.SetMaxMessageSize(maxMessageSize);
 }
 
 UniquePtr<IPipeClient> IPipeClient::CreateClient()
@@ -35,6 +78,7 @@ UniquePtr<IPipeClient> IPipeClient::CreateClient()
 
 bool PipeClient::ConnectToServer(const char* pipeName)
 {
+	DisconnectFromServer();
 	while (1)
 	{
 		pipeInstanceHandle_ = CreateFile(
@@ -43,7 +87,7 @@ bool PipeClient::ConnectToServer(const char* pipeName)
 			0,
 			NULL,
 			OPEN_EXISTING,
-			0,
+			FILE_FLAG_OVERLAPPED,
 			NULL);
 
 		if (pipeInstanceHandle_ != INVALID_HANDLE_VALUE)
@@ -58,72 +102,225 @@ bool PipeClient::ConnectToServer(const char* pipeName)
 			return false;
 	}
 
-	DWORD pipeMode = PIPE_READMODE_MESSAGE;
-	BOOL success = SetNamedPipeHandleState(
-		pipeInstanceHandle_,
-		&pipeMode,
-		NULL,
-		NULL);
-
-	if (!success)
-		return false;
-
+	// Byte mode is the default, messages are framed by MessageWriter.
 	return true;
 }
 
 PipeClient::~PipeClient()
 {
 	DisconnectFromServer();
+	CloseHandle(writeOverlapped_.hEvent);
+	CloseHandle(readOverlapped_.hEvent);
 }
 
 void PipeClient::DisconnectFromServer()
 {
-	CloseHandle(pipeInstanceHandle_);
-	pipeInstanceHandle_ = INVALID_HANDLE_VALUE;
+	if (pipeInstanceHandle_ != INVALID_HANDLE_VALUE)
+	{
+		// The buffers of pending operations must stay untouched until they were cancelled.
+		CancelIo(pipeInstanceHandle_);
+		DWORD numBytes;
+		if (isWritePending_)
+			GetOverlappedResult(pipeInstanceHandle_, &writeOverlapped_, &numBytes, TRUE);
+		if (isReadPending_)
+			GetOverlappedResult(pipeInstanceHandle_, &readOverlapped_, &numBytes, TRUE);
+		CloseHandle(pipeInstanceHandle_);
+		pipeInstanceHandle_ = INVALID_HANDLE_VALUE;
+	}
+	isWritePending_ = false;
+	isReadPending_ = false;
+	reader_.Reset();
+	writer_.Reset();
+	subscriptions_.Clear();
+	pendingRequests_.FailAll();
 }
 
 Message* PipeClient::SendMessage(const Message* msgToSend)
 {
-	DWORD numBytesWritten = 0;
 	Message* response = nullptr;
+	uint32_t requestID = SendMessageAsync(msgToSend, [&response](UniquePtr<Message> msg) { response = msg.Release(); });
+	if (requestID != 0)
+	{
+		WaitForResponse(requestID);
+	}
+	return response;
+}
 
+uint32_t PipeClient::SendMessageAsync(const Message* msgToSend, ResponseCallback callback)
+{
 	ANIM_ASSERT(msgToSend != nullptr);
+	if (pipeInstanceHandle_ == INVALID_HANDLE_VALUE)
+		return 0;
+
+	uint32_t requestID = pendingRequests_.Add(std::move(callback));
+	if (!writer_.Encode(msgToSend, requestID))
+	{
+		pendingRequests_.Remove(requestID);
+		return 0;
+	}
+	if (writer_.GetNumQueuedBytes() >= Batch_Send_Size)
+	{
+		Pump(false, 0);
+	}
+	return requestID;
+}
+
+uint32_t PipeClient::Subscribe(uint32_t streamID, uint64_t key, float rate, SnapshotCallback callback, float* negotiatedRateOut)
+{
+	SubscribeMessage request;
+	request.m_StreamID = streamID;
+	request.m_Key = key;
+	request.m_Rate = rate;
+	uint32_t subscriptionID = 0;
+	// Added as soon as the answer is read, the first update may follow right behind it.
+	uint32_t requestID = SendMessageAsync(&request, [&](UniquePtr<Message> response)
+	{
+		subscriptionID = subscriptions_.Add(response.Get(), std::move(callback), negotiatedRateOut);
+	});
+	if (requestID != 0)
 	{
-		MemoryStream memStream(outputBuffer, Buffer_Size);
-		Serialization::Serializer res(memStream);
-		res.serialize(msgToSend);
-		numBytesWritten = static_cast<DWORD>(memStream.getNumBytesWritten());
+		WaitForResponse(requestID);
 	}
+	return subscriptionID;
+}
 
-	BOOL success = WriteFile(
-		pipeInstanceHandle_,
-		outputBuffer,
-		numBytesWritten,
-		&numBytesWritten,
-		NULL);
+void PipeClient::Unsubscribe(uint32_t subscriptionID)
+{
+	subscriptions_.Remove(subscriptionID);
+	UnsubscribeMessage request;
+	request.m_SubscriptionID = subscriptionID;
+	SendMessageAsync(&request, [](UniquePtr<Message>) {});
+}
+
+bool PipeClient::PollResponses()
+{
+	return Pump(false, 0);
+}
+
+bool PipeClient::WaitForResponse(uint32_t requestID)
+{
+	return Pump(true, requestID);
+}
+
+bool PipeClient::WaitForResponses()
+{
+	return Pump(true, 0);
+}
 
-	do
+bool PipeClient::Pump(bool wait, uint32_t requestID)
+{
+	while (pipeInstanceHandle_ != INVALID_HANDLE_VALUE)
 	{
-		success = ReadFile(
-			pipeInstanceHandle_,
-			inputBuffer,
-			Buffer_Size,
-			&numBytesWritten,
-			NULL);
+		// Reads first, the callbacks may queue new requests.
+		if (!FinishWrite() || !FinishRead() || !StartRead() || !StartWrite())
+		{
+			DisconnectFromServer();
+			return false;
+		}
+		bool isDone = requestID != 0 ? !pendingRequests_.IsPending(requestID) : pendingRequests_.GetNumPending() == 0;
+		if (isDone || !wait)
+			return pipeInstanceHandle_ != INVALID_HANDLE_VALUE;
 
-		if (!success && GetLastError() != ERROR_MORE_DATA)
-			break;
-	} while (!success);
+		HANDLE events[2];
+		DWORD numEvents = 0;
+		if (isWritePending_)
+			events[numEvents++] = writeOverlapped_.hEvent;
+		if (isReadPending_)
+			events[numEvents++] = readOverlapped_.hEvent;
+		ANIM_ASSERT(numEvents > 0);
+		WaitForMultipleObjects(numEvents, events, FALSE, INFINITE);
+	}
+	return false;
+}
 
-	if (!success)
-		return nullptr;
+// Pipes have no gather writes, the segments are written one after the other without copying them.
+bool PipeClient::StartWrite()
+{
+	while (!isWritePending_ && writer_.BeginSend())
+	{
+		MessageWriter::Segment segment = writer_.GetSegment(0);
+		if (!WriteFile(pipeInstanceHandle_, segment.m_Data, segment.m_Size, NULL, &writeOverlapped_))
+		{
+			if (GetLastError() != ERROR_IO_PENDING)
+				return false;
+			isWritePending_ = true;
+			return true;
+		}
+		DWORD numBytesWritten = 0;
+		if (!GetOverlappedResult(pipeInstanceHandle_, &writeOverlapped_, &numBytesWritten, FALSE))
+			return false;
+		writer_.CommitSend(numBytesWritten);
+	}
+	return true;
+}
 
+bool PipeClient::FinishWrite()
+{
+	if (!isWritePending_)
+		return true;
+	DWORD numBytesWritten = 0;
+	if (!GetOverlappedResult(pipeInstanceHandle_, &writeOverlapped_, &numBytesWritten, FALSE))
+		return GetLastError() == ERROR_IO_INCOMPLETE;
+	isWritePending_ = false;
+	writer_.CommitSend(numBytesWritten);
+	return true;
+}
+
+// Runs the callbacks of the responses and stream updates received so far and reads more while requests are
+// pending or subscriptions active. The reader is only touched while no read is pending, the pending read owns its
+// receive buffer.
+bool PipeClient::StartRead()
+{
+	while (!isReadPending_ && pipeInstanceHandle_ != INVALID_HANDLE_VALUE &&
+		(pendingRequests_.GetNumPending() > 0 || subscriptions_.GetNumSubscriptions() > 0))
 	{
-		MemoryStream memStream(inputBuffer, Buffer_Size);
-		Serialization::Deserializer res(memStream);
-		res.deserialize(response);
+		Message* response = nullptr;
+		uint32_t requestID = 0;
+		MessageReader::Result result = reader_.NextMessage(response, requestID);
+		if (result == MessageReader::Result::Error)
+			return false;
+		if (result == MessageReader::Result::Complete)
+		{
+			// Stream updates have request id 0.
+			UniquePtr<Message> msg(response);
+			bool isValid = requestID != 0 ? pendingRequests_.Complete(requestID, std::move(msg)) : subscriptions_.HandleUpdate(msg.Get());
+			if (!isValid)
+				return false;
+			continue;
+		}
+
+		uint8_t* dst;
+		uint32_t capacity;
+		reader_.GetReceiveBuffer(dst, capacity);
+		if (!ReadFile(pipeInstanceHandle_, dst, capacity, NULL, &readOverlapped_))
+		{
+			if (GetLastError() != ERROR_IO_PENDING)
+				return false;
+			isReadPending_ = true;
+			return true;
+		}
+		DWORD numBytesRead = 0;
+		if (!GetOverlappedResult(pipeInstanceHandle_, &readOverlapped_, &numBytesRead, FALSE) || numBytesRead == 0)
+			return false;
+		reader_.CommitReceive(numBytesRead);
 	}
-	return response;
+	return true;
+}
+
+bool PipeClient::FinishRead()
+{
+	if (!isReadPending_)
+		return true;
+	DWORD numBytesRead = 0;
+	if (!GetOverlappedResult(pipeInstanceHandle_, &readOverlapped_, &numBytesRead, FALSE))
+		return GetLastError() == ERROR_IO_INCOMPLETE;
+	isReadPending_ = false;
+	if (numBytesRead == 0)
+		return false;
+	reader_.CommitReceive(numBytesRead);
+	return true;
 }
 
 ANIM_NAMESPACE_END
+
+#endif
@@ -1,4 +1,7 @@
 #pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
 #include "animcore/util/namespace.h"
 #include "animcore/memory/pointers.h"
 ANIM_NAMESPACE_BEGIN
@@ -11,10 +14,43 @@ public:
 	IPipeClient& operator=(const IPipeClient&) = delete;
 	virtual ~IPipeClient() {}
 
+	// Called with the response, or with nullptr if the request failed or the connection was closed.
+	typedef std::function<void(UniquePtr<Message>)> ResponseCallback;
+
 	static UniquePtr<IPipeClient> CreateClient();
+	// Sends a request and blocks until its response arrived. The caller owns the returned message, nullptr on
+	// failure. Callbacks of asynchronous requests that complete meanwhile are run too.
 	virtual Message* SendMessage(const Message* msgToSend) = 0;
+	// Queues a request and returns its request id without waiting for the response, 0 if the client is not
+	// connected or the request is too large. Queued requests go out together with the next write, many
+	// requests can be in flight at once and their responses may complete in any order. Callbacks run on the
+	// thread calling PollResponses, WaitForResponse(s) or SendMessage; SendMessageAsync itself may run the
+	// callbacks of earlier requests once enough requests are queued.
+	virtual uint32_t SendMessageAsync(const Message* msgToSend, ResponseCallback callback) = 0;
+	// Sends queued requests and runs the callbacks of responses that already arrived, without blocking.
+	// Returns false if the connection was closed.
+	virtual bool PollResponses() = 0;
+	// Block until the response to requestID arrived, or until no request is pending. Return false if the
+	// connection was closed, the callbacks of the pending requests were run with nullptr then.
+	virtual bool WaitForResponse(uint32_t requestID) = 0;
+	virtual bool WaitForResponses() = 0;
+	virtual size_t GetNumPendingRequests() const = 0;
+
+	// Called with the latest snapshot of a subscription, rebuilt from the deltas the server pushed. sequence counts
+	// the snapshots published for the key, gaps are snapshots the server coalesced away.
+	typedef std::function<void(const uint8_t* data, uint32_t numBytes, uint32_t sequence)> SnapshotCallback;
+	// Subscribes to the snapshots the server publishes for key on streamID, at up to rate snapshots per second, 0
+	// for as many as the server allows. Blocks until the server answered and returns the subscription id, 0 if
+	// the server does not publish streamID. negotiatedRateOut, if not nullptr, receives the rate the server
+	// agreed to. Callbacks run like those of responses; PollResponses regularly to receive the snapshots.
+	// Subscriptions end when the connection is closed.
+	virtual uint32_t Subscribe(uint32_t streamID, uint64_t key, float rate, SnapshotCallback callback, float* negotiatedRateOut = nullptr) = 0;
+	// Snapshot callbacks may unsubscribe.
+	virtual void Unsubscribe(uint32_t subscriptionID) = 0;
 	virtual bool ConnectToServer(const char* pipeName) = 0;
 	virtual void DisconnectFromServer() = 0;
+	// SendMessage fails for larger requests or responses. Defaults to Default_Max_Message_Size.
+	virtual void SetMaxMessageSize(uint32_t maxMessageSize) = 0;
 protected:
 	IPipeClient() {}
 };
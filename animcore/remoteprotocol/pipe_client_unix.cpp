@@ -0,0 +1,288 @@
+#ifndef WIN32
+#include "pipe_client.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "animcore/remoteprotocol/message.h"
+#include "animcore/remoteprotocol/message_framing.h"
+#include "animcore/remoteprotocol/stream_messages.h"
+#include "animcore/remoteprotocol/stream_subscriptions.h"
+#include "animcore/remoteprotocol/unix_socket.h"
+
+ANIM_NAMESPACE_BEGIN
+
+// How long to wait for the server to accept the connection, like WaitNamedPipe on Windows.
+static constexpr uint32_t Connect_Timeout_Ms = 500;
+static constexpr uint32_t Max_Write_Segments = 64;
+// SendMessageAsync starts writing once this many bytes of requests are queued.
+static constexpr uint32_t Batch_Send_Size = 64 * 1024;
+
+// The socket is non-blocking: while requests are written the responses that already arrived are read, so a
+// large batch cannot deadlock with a server that stops reading until its answers were read.
+class PipeClient : public IPipeClient
+{
+public:
+	PipeClient();
+	virtual ~PipeClient();
+	virtual Message* SendMessage(const Message* msgToSend) override;
+	virtual uint32_t SendMessageAsync(const Message* msgToSend, ResponseCallback callback) override;
+	virtual bool PollResponses() override;
+	virtual bool WaitForResponse(uint32_t requestID) override;
+	virtual bool WaitForResponses() override;
+	virtual size_t GetNumPendingRequests() const override { return pendingRequests_.GetNumPending(); }
+	virtual uint32_t Subscribe(uint32_t streamID, uint64_t key, float rate, SnapshotCallback callback, float* negotiatedRateOut) override;
+	virtual void Unsubscribe(uint32_t subscriptionID) override;
+	virtual bool ConnectToServer(const char* pipeName) override;
+	virtual void DisconnectFromServer() override;
+	virtual void SetMaxMessageSize(uint32_t maxMessageSize) override;
+private:
+	// Sends and receives until the response to requestID arrived, or nothing is pending for requestID 0.
+	// Returns after a single pass if wait is false.
+	bool Pump(bool wait, uint32_t requestID);
+	bool SendRequests();
+	bool ReceiveResponses();
+
+	int socket_;
+	MessageBufferPool bufferPool_;
+	MessageReader reader_;
+	MessageWriter writer_;
+	PendingRequestTable pendingRequests_;
+	SubscriptionTable subscriptions_;
+};
+
+PipeClient::PipeClient()
+	: socket_(-1)
+	, reader_(bufferPool_)
+{
+}
+
+UniquePtr<IPipeClient> IPipeClient::CreateClient()
+{
+	return UniquePtr<PipeClient>::MakeUnique();
+}
+
+void PipeClient::SetMaxMessageSize(uint32_t maxMessageSize)
+{
+	reader_.SetMaxMessageSize(maxMessageSize);
+	writer_.SetMaxMessageSize(maxMessageSize);
+}
+
+bool PipeClient::ConnectToServer(const char* pipeName)
+{
+	DisconnectFromServer();
+
+	sockaddr_un addr;
+	socklen_t addrLength;
+	bool isFile;
+	if (!UnixSocket::GetAddress(pipeName, addr, addrLength, isFile))
+		return false;
+
+	socket_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (socket_ < 0)
+		return false;
+
+	// connect blocks while the server's backlog is full, the send timeout bounds the wait.
+	timeval timeout = { Connect_Timeout_Ms / 1000, (Connect_Timeout_Ms % 1000) * 1000 };
+	setsockopt(socket_, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	int result;
+	do
+	{
+		result = connect(socket_, reinterpret_cast<const sockaddr*>(&addr), addrLength);
+	} while (result != 0 && errno == EINTR);
+	if (result != 0 || fcntl(socket_, F_SETFL, fcntl(socket_, F_GETFL) | O_NONBLOCK) != 0)
+	{
+		DisconnectFromServer();
+		return false;
+	}
+	return true;
+}
+
+PipeClient::~PipeClient()
+{
+	DisconnectFromServer();
+}
+
+void PipeClient::DisconnectFromServer()
+{
+	if (socket_ >= 0)
+	{
+		close(socket_);
+		socket_ = -1;
+	}
+	reader_.Reset();
+	writer_.Reset();
+	subscriptions_.Clear();
+	pendingRequests_.FailAll();
+}
+
+Message* PipeClient::SendMessage(const Message* msgToSend)
+{
+	Message* response = nullptr;
+	uint32_t requestID = SendMessageAsync(msgToSend, [&response](UniquePtr<Message> msg) { response = msg.Release(); });
+	if (requestID != 0)
+	{
+		WaitForResponse(requestID);
+	}
+	return response;
+}
+
+uint32_t PipeClient::SendMessageAsync(const Message* msgToSend, ResponseCallback callback)
+{
+	ANIM_ASSERT(msgToSend != nullptr);
+	if (socket_ < 0)
+		return 0;
+
+	uint32_t requestID = pendingRequests_.Add(std::move(callback));
+	if (!writer_.Encode(msgToSend, requestID))
+	{
+		pendingRequests_.Remove(requestID);
+		return 0;
+	}
+	if (writer_.GetNumQueuedBytes() >= Batch_Send_Size)
+	{
+		Pump(false, 0);
+	}
+	return requestID;
+}
+
+uint32_t PipeClient::Subscribe(uint32_t streamID, uint64_t key, float rate, SnapshotCallback callback, float* negotiatedRateOut)
+{
+	SubscribeMessage request;
+	request.m_StreamID = streamID;
+	request.m_Key = key;
+	request.m_Rate = rate;
+	uint32_t subscriptionID = 0;
+	// Added as soon as the answer is read, the first update may follow right behind it.
+	uint32_t requestID = SendMessageAsync(&request, [&](UniquePtr<Message> response)
+	{
+		subscriptionID = subscriptions_.Add(response.Get(), std::move(callback), negotiatedRateOut);
+	});
+	if (requestID != 0)
+	{
+		WaitForResponse(requestID);
+	}
+	return subscriptionID;
+}
+
+void PipeClient::Unsubscribe(uint32_t subscriptionID)
+{
+	subscriptions_.Remove(subscriptionID);
+	UnsubscribeMessage request;
+	request.m_SubscriptionID = subscriptionID;
+	SendMessageAsync(&request, [](UniquePtr<Message>) {});
+}
+
+bool PipeClient::PollResponses()
+{
+	return Pump(false, 0);
+}
+
+bool PipeClient::WaitForResponse(uint32_t requestID)
+{
+	return Pump(true, requestID);
+}
+
+bool PipeClient::WaitForResponses()
+{
+	return Pump(true, 0);
+}
+
+bool PipeClient::Pump(bool wait, uint32_t requestID)
+{
+	while (socket_ >= 0)
+	{
+		if (!SendRequests() || !ReceiveResponses())
+		{
+			DisconnectFromServer();
+			return false;
+		}
+		bool isDone = requestID != 0 ? !pendingRequests_.IsPending(requestID) : pendingRequests_.GetNumPending() == 0;
+		if (isDone || !wait)
+			return socket_ >= 0;
+
+		pollfd pollSocket = {};
+		pollSocket.fd = socket_;
+		// Callbacks may have queued new requests since they were sent.
+		pollSocket.events = writer_.HasDataToSend() ? POLLIN | POLLOUT : POLLIN;
+		if (poll(&pollSocket, 1, -1) < 0 && errno != EINTR)
+		{
+			DisconnectFromServer();
+			return false;
+		}
+	}
+	return false;
+}
+
+// Writes as much of the queued requests as the socket takes. False if the connection failed.
+bool PipeClient::SendRequests()
+{
+	while (writer_.BeginSend())
+	{
+		iovec segments[Max_Write_Segments];
+		uint32_t numSegments = writer_.GetNumSegments();
+		numSegments = numSegments < Max_Write_Segments ? numSegments : Max_Write_Segments;
+		for (uint32_t i = 0; i < numSegments; ++i)
+		{
+			MessageWriter::Segment segment = writer_.GetSegment(i);
+			segments[i].iov_base = const_cast<uint8_t*>(segment.m_Data);
+			segments[i].iov_len = segment.m_Size;
+		}
+		msghdr header = {};
+		header.msg_iov = segments;
+		header.msg_iovlen = numSegments;
+		ssize_t numBytesWritten = sendmsg(socket_, &header, MSG_NOSIGNAL);
+		if (numBytesWritten >= 0)
+		{
+			writer_.CommitSend(static_cast<size_t>(numBytesWritten));
+			continue;
+		}
+		if (errno == EINTR)
+			continue;
+		return errno == EAGAIN || errno == EWOULDBLOCK;
+	}
+	return true;
+}
+
+// Reads what arrived so far and runs the callbacks of the completed requests and the stream updates, which
+// have request id 0. False if the connection failed.
+bool PipeClient::ReceiveResponses()
+{
+	while (socket_ >= 0 && (pendingRequests_.GetNumPending() > 0 || subscriptions_.GetNumSubscriptions() > 0))
+	{
+		Message* response = nullptr;
+		uint32_t requestID = 0;
+		MessageReader::Result result = reader_.NextMessage(response, requestID);
+		if (result == MessageReader::Result::Error)
+			return false;
+		if (result == MessageReader::Result::Complete)
+		{
+			UniquePtr<Message> msg(response);
+			bool isValid = requestID != 0 ? pendingRequests_.Complete(requestID, std::move(msg)) : subscriptions_.HandleUpdate(msg.Get());
+			if (!isValid)
+				return false;
+			continue;
+		}
+
+		uint8_t* dst;
+		uint32_t capacity;
+		reader_.GetReceiveBuffer(dst, capacity);
+		ssize_t numBytesRead = recv(socket_, dst, capacity, 0);
+		if (numBytesRead < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+		}
+		if (numBytesRead == 0)
+			return false;
+		reader_.CommitReceive(static_cast<uint32_t>(numBytesRead));
+	}
+	return true;
+}
+
+ANIM_NAMESPACE_END
+
+#endif
@@ -1,58 +1,111 @@
+#ifdef WIN32
 #include "pipe_server.h"
+#include <atomic>
+#include <string>
+#include <string.h>
 #include "animcore/containers/array.h"
-#include "animcore/serialization/serialization.h"
+#include "animcore/memory/default_allocator.h"
+#include "animcore/remoteprotocol/message.h"
+#include "animcore/remoteprotocol/message_framing.h"
+#include "animcore/remoteprotocol/request_dispatcher.h"
+#include "animcore/remoteprotocol/stream_subscriptions.h"
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 
 ANIM_NAMESPACE_BEGIN
 
-static constexpr size_t Buffer_Size = 4096;
 static constexpr uint32_t Pipe_Timeout = 5000;
-
+// Requests of one client that can wait for their answers before the server stops reading from it.
+static constexpr uint32_t Max_Queued_Requests = 256;
+
+// Byte mode pipes carrying length prefixed messages, so messages are not limited by the pipe buffers. A single
+// I/O thread waits on all instances and hands the requests to a RequestDispatcher, which wakes it up through
+// responseEvent_ once answers are ready. The read and the write of an instance can be in flight at the same
+// time and signal the same event. Stream updates are pushed from the same thread, the wait times out when the
+// next one is due.
 class PipeServer : public IPipeServer
 {
 public:
 	PipeServer();
 	~PipeServer();
 	virtual DispatchCallback SetDispatchCallback(DispatchCallback callback) override;
+	virtual void SetMaxMessageSize(uint32_t maxMessageSize) override { maxMessageSize_ = maxMessageSize; }
+	virtual void SetNumDispatchThreads(uint32_t numThreads) override { numDispatchThreads_ = numThreads; }
+	virtual void RegisterStream(uint32_t streamID, float maxRate) override { streams_.RegisterStream(streamID, maxRate); }
+	virtual void PublishSnapshot(uint32_t streamID, uint64_t key, const void* data, uint32_t numBytes) override { streams_.Publish(streamID, key, data, numBytes); }
+	virtual bool HasSubscribers(uint32_t streamID, uint64_t key) override { return streams_.HasSubscribers(streamID, key); }
 	virtual void RunServer(const char* pipeName, size_t numInstances) override;
+	virtual void StopServer() override;
 private:
-	bool ConnectToNewClient(size_t pipeIndex);
+	void ConnectToNewClient(size_t pipeIndex);
 	void DisconnectAndReconnect(size_t pipeIndex);
-	size_t GetAnswerToRequest(size_t pipeIndex);
+	// Completes finished reads and writes, sends answers, queues requests and starts the next read and write
+	// until nothing changes anymore.
+	void ServiceInstance(size_t pipeIndex);
+	void PushStreamUpdates();
 
 	std::string pipeName_;
 	DispatchCallback dispatchCallback_;
+	uint32_t maxMessageSize_;
+	uint32_t numDispatchThreads_;
+	MessageBufferPool bufferPool_;
+	UniquePtr<RequestDispatcher> dispatcher_;
+	BigArray<RequestDispatcher::Response> responses_;
+	Array<uint32_t> readyInstances_;
+	StreamPublisher streams_;
+	Array<uint32_t> updatedInstances_;
+	Array<uint32_t> failedInstances_;
 
 	enum class PipeInstanceState
 	{
 		CONNECTING,
-		READING,
-		WRITING
+		CONNECTED
 	};
 	struct PipeInstance
 	{
-		OVERLAPPED overLapped_;
+		PipeInstance(MessageBufferPool& pool, uint32_t maxMessageSize)
+			: reader_(pool, maxMessageSize)
+			, writer_(maxMessageSize)
+			, pipeState_(PipeInstanceState::CONNECTING)
+			, isReadPending_(false)
+			, isWritePending_(false)
+		{}
+
+		// ConnectNamedPipe uses readOverlapped_ too.
+		OVERLAPPED readOverlapped_;
+		OVERLAPPED writeOverlapped_;
 		HANDLE pipeInstanceHandle_;
-		uint8_t inputBuffer_[Buffer_Size];
-		uint8_t outputBuffer_[Buffer_Size];
-		DWORD numBytesToRead_;
-		DWORD numBytesToWrite_;
+		MessageReader reader_;
+		MessageWriter writer_;
 		PipeInstanceState pipeState_;
-		BOOL pendingIO_;
+		bool isReadPending_;
+		bool isWritePending_;
 	};
-	Array<PipeInstance> pipeInstances_;
+	Array<UniquePtr<PipeInstance>> pipeInstances_;
+	// One event per instance, followed by responseEvent_ and stopEvent_.
 	Array<HANDLE> pipeEvents_;
-	bool shutdownServer_;
+	HANDLE responseEvent_;
+	HANDLE stopEvent_;
+	std::atomic<bool> shutdownServer_;
 };
 
 PipeServer::PipeServer()
-	: shutdownServer_(false)
-	, dispatchCallback_(nullptr)
+	: dispatchCallback_(nullptr)
+	, maxMessageSize_(Default_Max_Message_Size)
+	, numDispatchThreads_(0)
+	, responseEvent_(CreateEvent(NULL, FALSE, FALSE, NULL))
+	, stopEvent_(CreateEvent(NULL, TRUE, FALSE, NULL))
+	, shutdownServer_(false)
 {
 }
 
+void PipeServer::StopServer()
+{
+	shutdownServer_.store(true, std::memory_order_release);
+	SetEvent(stopEvent_);
+}
+
 IPipeServer::DispatchCallback PipeServer::SetDispatchCallback(IPipeServer::DispatchCallback callback)
 {
 	auto tmp = dispatchCallback_;
@@ -60,84 +113,283 @@ IPipeServer::DispatchCallback PipeServer::SetDispatchCallback(IPipeServer::Dispa
 	return tmp;
 }
 
-size_t PipeServer::GetAnswerToRequest(size_t pipeIndex)
-{
-	Message* msg = nullptr;
-	{
-		MemoryStream memStream(pipeInstances_[pipeIndex].inputBuffer_, Buffer_Size);
-		Serialization::Deserializer deserializer(memStream);
-		deserializer.deserialize(msg);
-	}
-	size_t numBytesWritten = 0;
-	ASSETCACHE_ASSERT(msg != nullptr);
-	auto responseMsg = dispatchCallback_(std::unique_ptr<Message>(msg));
-	{
-		MemoryStream memStream(pipeInstances_[pipeIndex].outputBuffer_, Buffer_Size);
-		Serialization::Serializer serializer(memStream);
-		serializer.serialize(responseMsg.get());
-		numBytesWritten = memStream.getNumBytesWritten();
-	}
-	return numBytesWritten;
-}
-
 UniquePtr<IPipeServer> IPipeServer::CreateServer()
 {
 	return UniquePtr<PipeServer>::MakeUnique();
 }
 
-// returns false if already connected, true otherwise
-bool PipeServer::ConnectToNewClient(size_t pipeIndex)
+void PipeServer::ConnectToNewClient(size_t pipeIndex)
 {
-	BOOL isConnected = ConnectNamedPipe(pipeInstances_[pipeIndex].pipeInstanceHandle_, &pipeInstances_[pipeIndex].overLapped_);
-
-	if (isConnected)
+	PipeInstance& instance = *pipeInstances_[pipeIndex].Get();
+	instance.pipeState_ = PipeInstanceState::CONNECTING;
+	if (ConnectNamedPipe(instance.pipeInstanceHandle_, &instance.readOverlapped_))
 	{
-		return false;
+		instance.pipeState_ = PipeInstanceState::CONNECTED;
+		return;
 	}
 
-	bool ioPending = false;
 	switch (GetLastError())
 	{
-		// The overlapped connection in progress. 
+		// The overlapped connection in progress.
 	case ERROR_IO_PENDING:
-		ioPending = true;
+		instance.isReadPending_ = true;
 		break;
 
-		// Client is already connected, so signal an event. 
+		// Client is already connected.
 	case ERROR_PIPE_CONNECTED:
-		if (SetEvent(pipeEvents_[pipeIndex]))
-			break;
+		instance.pipeState_ = PipeInstanceState::CONNECTED;
+		break;
 
-		// If an error occurs during the connect operation... 
+		// If an error occurs during the connect operation, the first read fails and the instance reconnects.
 	default:
-	{
-		return false;
-	}
+		break;
 	}
-	return ioPending;
 }
 
 void PipeServer::DisconnectAndReconnect(size_t pipeIndex)
 {
-	BOOL result = DisconnectNamedPipe(pipeInstances_[pipeIndex].pipeInstanceHandle_);
+	PipeInstance& instance = *pipeInstances_[pipeIndex].Get();
+	// The buffers of pending operations must stay untouched until they were cancelled.
+	CancelIo(instance.pipeInstanceHandle_);
+	DWORD numBytes;
+	if (instance.isReadPending_)
+		GetOverlappedResult(instance.pipeInstanceHandle_, &instance.readOverlapped_, &numBytes, TRUE);
+	if (instance.isWritePending_)
+		GetOverlappedResult(instance.pipeInstanceHandle_, &instance.writeOverlapped_, &numBytes, TRUE);
+	instance.isReadPending_ = false;
+	instance.isWritePending_ = false;
+
+	BOOL result = DisconnectNamedPipe(instance.pipeInstanceHandle_);
 	ANIM_ASSERT(result);
+	instance.reader_.Reset();
+	instance.writer_.Reset();
+	dispatcher_->Reset(static_cast<uint32_t>(pipeIndex));
+	streams_.RemoveConnection(static_cast<uint32_t>(pipeIndex));
+
+	ConnectToNewClient(pipeIndex);
+	// Whatever happened, the loop has to look at the instance again.
+	SetEvent(pipeEvents_[pipeIndex]);
+}
 
-	pipeInstances_[pipeIndex].pendingIO_ = ConnectToNewClient(pipeIndex);
+// Subscription requests are answered right away, the others go to the dispatcher. Nothing is read while answers
+// are stuck or too many requests are queued, so a client that sends faster than it is answered or does not read
+// its answers is held up by the pipe buffers instead of growing the server's queues.
+void PipeServer::ServiceInstance(size_t pipeIndex)
+{
+	PipeInstance& instance = *pipeInstances_[pipeIndex].Get();
+	uint32_t connection = static_cast<uint32_t>(pipeIndex);
+	if (instance.pipeState_ == PipeInstanceState::CONNECTING)
+	{
+		if (instance.isReadPending_)
+		{
+			DWORD numBytes;
+			if (!GetOverlappedResult(instance.pipeInstanceHandle_, &instance.readOverlapped_, &numBytes, FALSE))
+			{
+				if (GetLastError() != ERROR_IO_INCOMPLETE)
+					DisconnectAndReconnect(pipeIndex);
+				return;
+			}
+			instance.isReadPending_ = false;
+		}
+		instance.pipeState_ = PipeInstanceState::CONNECTED;
+	}
 
-	pipeInstances_[pipeIndex].pipeState_ =
-		pipeInstances_[pipeIndex].pendingIO_ ?
-		PipeServer::PipeInstanceState::CONNECTING :
-		PipeServer::PipeInstanceState::READING;
+	// Starting an operation resets the event the other one signals when it completes. Both are checked again
+	// after anything was started, so the loop only ends once neither completed since the last check.
+	bool isChecking = true;
+	while (isChecking)
+	{
+		isChecking = false;
+		if (instance.isReadPending_)
+		{
+			DWORD bytesRead;
+			if (GetOverlappedResult(instance.pipeInstanceHandle_, &instance.readOverlapped_, &bytesRead, FALSE))
+			{
+				instance.isReadPending_ = false;
+				if (bytesRead == 0)
+				{
+					DisconnectAndReconnect(pipeIndex);
+					return;
+				}
+				instance.reader_.CommitReceive(bytesRead);
+			}
+			else if (GetLastError() != ERROR_IO_INCOMPLETE)
+			{
+				DisconnectAndReconnect(pipeIndex);
+				return;
+			}
+		}
+		if (instance.isWritePending_)
+		{
+			DWORD bytesWritten;
+			if (GetOverlappedResult(instance.pipeInstanceHandle_, &instance.writeOverlapped_, &bytesWritten, FALSE))
+			{
+				instance.isWritePending_ = false;
+				instance.writer_.CommitSend(bytesWritten);
+			}
+			else if (GetLastError() != ERROR_IO_INCOMPLETE)
+			{
+				DisconnectAndReconnect(pipeIndex);
+				return;
+			}
+		}
+
+		responses_.Clear();
+		dispatcher_->TakeResponses(connection, responses_);
+		for (const auto& response : responses_)
+		{
+			if (response.m_Message.Get() == nullptr || !instance.writer_.Encode(response.m_Message.Get(), response.m_RequestID))
+			{
+				responses_.Clear();
+				DisconnectAndReconnect(pipeIndex);
+				return;
+			}
+		}
+		responses_.Clear();
+
+		// The reader belongs to the pending read until it completes.
+		uint32_t numQueued = dispatcher_->GetNumQueued(connection);
+		bool canRead = !instance.isReadPending_ && !instance.isWritePending_;
+		while (canRead && numQueued < Max_Queued_Requests)
+		{
+			Message* msg = nullptr;
+			uint32_t requestID = 0;
+			MessageReader::Result result = instance.reader_.NextMessage(msg, requestID);
+			if (result == MessageReader::Result::Incomplete)
+				break;
+			if (result == MessageReader::Result::Error)
+			{
+				DisconnectAndReconnect(pipeIndex);
+				return;
+			}
+			UniquePtr<Message> answer = streams_.HandleRequest(connection, msg);
+			if (answer.Get() == nullptr)
+			{
+				dispatcher_->Push(connection, msg, requestID);
+				++numQueued;
+				continue;
+			}
+			DefaultAllocator::Destroy(msg);
+			if (!instance.writer_.Encode(answer.Get(), requestID))
+			{
+				DisconnectAndReconnect(pipeIndex);
+				return;
+			}
+		}
+
+		// Pipes have no gather writes, the segments are written one after the other without copying them.
+		if (!instance.isWritePending_ && instance.writer_.BeginSend())
+		{
+			MessageWriter::Segment segment = instance.writer_.GetSegment(0);
+			if (WriteFile(instance.pipeInstanceHandle_, segment.m_Data, segment.m_Size, NULL, &instance.writeOverlapped_))
+			{
+				DWORD bytesWritten;
+				GetOverlappedResult(instance.pipeInstanceHandle_, &instance.writeOverlapped_, &bytesWritten, FALSE);
+				instance.writer_.CommitSend(bytesWritten);
+			}
+			else if (GetLastError() == ERROR_IO_PENDING)
+			{
+				instance.isWritePending_ = true;
+			}
+			else
+			{
+				DisconnectAndReconnect(pipeIndex);
+				return;
+			}
+			isChecking = true;
+		}
+
+		if (canRead && numQueued < Max_Queued_Requests && !instance.isWritePending_)
+		{
+			uint8_t* dst;
+			uint32_t capacity;
+			instance.reader_.GetReceiveBuffer(dst, capacity);
+			if (ReadFile(instance.pipeInstanceHandle_, dst, capacity, NULL, &instance.readOverlapped_))
+			{
+				DWORD bytesRead;
+				GetOverlappedResult(instance.pipeInstanceHandle_, &instance.readOverlapped_, &bytesRead, FALSE);
+				if (bytesRead == 0)
+				{
+					DisconnectAndReconnect(pipeIndex);
+					return;
+				}
+				instance.reader_.CommitReceive(bytesRead);
+			}
+			else if (GetLastError() == ERROR_IO_PENDING)
+			{
+				instance.isReadPending_ = true;
+			}
+			else
+			{
+				DisconnectAndReconnect(pipeIndex);
+				return;
+			}
+			isChecking = true;
+		}
+	}
+}
+
+// Updates only go to instances that wrote everything before, the others skip them until they caught up.
+void PipeServer::PushStreamUpdates()
+{
+	updatedInstances_.Clear();
+	failedInstances_.Clear();
+	streams_.PushUpdates([this](uint32_t connection)
+	{
+		const PipeInstance& instance = *pipeInstances_[connection].Get();
+		return instance.pipeState_ == PipeInstanceState::CONNECTED && instance.writer_.IsDone();
+	}, [this](uint32_t connection, const StreamUpdateMessage& update)
+	{
+		MessageWriter& writer = pipeInstances_[connection]->writer_;
+		bool isFirst = writer.GetNumQueuedBytes() == 0;
+		// Fails for snapshots larger than the maximum message size, the client could not read them either.
+		if (!writer.Encode(&update, 0))
+		{
+			failedInstances_.Push(connection);
+		}
+		else if (isFirst)
+		{
+			updatedInstances_.Push(connection);
+		}
+	});
+	// Not while PushUpdates runs, disconnecting removes subscriptions.
+	for (uint32_t pipeIndex : failedInstances_)
+	{
+		if (pipeInstances_[pipeIndex]->pipeState_ == PipeInstanceState::CONNECTED)
+		{
+			DisconnectAndReconnect(pipeIndex);
+		}
+	}
+	for (uint32_t pipeIndex : updatedInstances_)
+	{
+		if (pipeInstances_[pipeIndex]->pipeState_ == PipeInstanceState::CONNECTED)
+		{
+			ServiceInstance(pipeIndex);
+		}
+	}
 }
 
 void PipeServer::RunServer(const char* pipeName, size_t numInstances)
 {
+	ANIM_ASSERT(dispatchCallback_ != nullptr && numInstances > 0 && numInstances + 2 <= MAXIMUM_WAIT_OBJECTS);
 	pipeName_ = pipeName;
 	pipeInstances_.Resize(numInstances);
-	pipeEvents_.Resize(numInstances);
+	pipeEvents_.Resize(numInstances + 2);
+	pipeEvents_[numInstances] = responseEvent_;
+	pipeEvents_[numInstances + 1] = stopEvent_;
+	HANDLE responseEvent = responseEvent_;
+	dispatcher_ = UniquePtr<RequestDispatcher>::MakeUnique(dispatchCallback_, static_cast<uint32_t>(numInstances), numDispatchThreads_, [responseEvent]()
+	{
+		SetEvent(responseEvent);
+	});
 
 	for (size_t i = 0; i < numInstances; ++i)
 	{
+		pipeInstances_[i] = UniquePtr<PipeInstance>::MakeUnique(bufferPool_, maxMessageSize_);
+		PipeInstance& instance = *pipeInstances_[i].Get();
+		memset(&instance.readOverlapped_, 0, sizeof(instance.readOverlapped_));
+		memset(&instance.writeOverlapped_, 0, sizeof(instance.writeOverlapped_));
+
 		pipeEvents_[i] = CreateEvent(
 			NULL,
 			TRUE,
@@ -146,152 +398,82 @@ void PipeServer::RunServer(const char* pipeName, size_t numInstances)
 
 		ANIM_ASSERT(pipeEvents_[i] != NULL);
 
-		pipeInstances_[i].overLapped_.hEvent = pipeEvents_[i];
-		pipeInstances_[i].pipeInstanceHandle_ = CreateNamedPipe(
+		instance.readOverlapped_.hEvent = pipeEvents_[i];
+		instance.writeOverlapped_.hEvent = pipeEvents_[i];
+		instance.pipeInstanceHandle_ = CreateNamedPipe(
 			pipeName,
 			PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
-			PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT,
+			PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
 			static_cast<DWORD>(numInstances),
-			Buffer_Size,
-			Buffer_Size,
+			MessageReader::Staging_Size,
+			MessageReader::Staging_Size,
 			Pipe_Timeout,
 			NULL);
-		ANIM_ASSERT(pipeInstances_[i].pipeInstanceHandle_ != INVALID_HANDLE_VALUE);
+		ANIM_ASSERT(instance.pipeInstanceHandle_ != INVALID_HANDLE_VALUE);
 
-		pipeInstances_[i].pendingIO_ = ConnectToNewClient(i);
-		pipeInstances_[i].pipeState_ = pipeInstances_[i].pendingIO_ ?
-			PipeServer::PipeInstanceState::CONNECTING :
-			PipeServer::PipeInstanceState::READING;
+		ConnectToNewClient(i);
 	}
 
-	while (!shutdownServer_)
+	while (!shutdownServer_.load(std::memory_order_acquire))
 	{
+		int timeout = streams_.GetMillisecondsUntilDue();
 		DWORD dwait = WaitForMultipleObjects(
-			static_cast<DWORD>(numInstances),
+			static_cast<DWORD>(numInstances + 2),
 			pipeEvents_.GetBuffer(),
 			FALSE,
-			INFINITE);
+			timeout < 0 ? INFINITE : static_cast<DWORD>(timeout));
 
 		size_t pipeIndex = dwait - WAIT_OBJECT_0;
-		ANIM_ASSERT(pipeIndex >= 0 && pipeIndex < numInstances);
-
-		if (pipeInstances_[pipeIndex].pendingIO_)
-		{
-			DWORD bytesTransferred;
-			BOOL success = GetOverlappedResult(
-				pipeInstances_[pipeIndex].pipeInstanceHandle_,
-				&pipeInstances_[pipeIndex].overLapped_,
-				&bytesTransferred, FALSE);
-
-			switch (pipeInstances_[pipeIndex].pipeState_)
-			{
-			case PipeInstanceState::CONNECTING:
-			{
-				ANIM_ASSERT(success);
-				pipeInstances_[pipeIndex].pipeState_ = PipeInstanceState::READING;
-			}
-			break;
-			case PipeInstanceState::READING:
-			{
-				if (!success || bytesTransferred == 0)
-				{
-					DisconnectAndReconnect(pipeIndex);
-					continue;
-				}
-				pipeInstances_[pipeIndex].numBytesToRead_ = bytesTransferred;
-				pipeInstances_[pipeIndex].pipeState_ = PipeInstanceState::WRITING;
-			}
+		if (pipeIndex == numInstances + 1)
 			break;
-
-			case PipeInstanceState::WRITING:
+		if (pipeIndex == numInstances)
+		{
+			readyInstances_.Clear();
+			dispatcher_->TakeReadyConnections(readyInstances_);
+			for (uint32_t readyIndex : readyInstances_)
 			{
-				if (!success || bytesTransferred != pipeInstances_[pipeIndex].numBytesToWrite_)
+				if (pipeInstances_[readyIndex]->pipeState_ == PipeInstanceState::CONNECTED)
 				{
-					DisconnectAndReconnect(pipeIndex);
-					continue;
+					ServiceInstance(readyIndex);
 				}
-				pipeInstances_[pipeIndex].pipeState_ = PipeInstanceState::READING;
-			}
-			break;
-			default:
-				ANIM_ASSERT(false);
 			}
 		}
-
-		switch (pipeInstances_[pipeIndex].pipeState_)
-		{
-		case PipeInstanceState::READING:
+		else if (dwait != WAIT_TIMEOUT)
 		{
-			BOOL success = ReadFile(
-				pipeInstances_[pipeIndex].pipeInstanceHandle_,
-				pipeInstances_[pipeIndex].inputBuffer_,
-				Buffer_Size,
-				&pipeInstances_[pipeIndex].numBytesToRead_,
-				&pipeInstances_[pipeIndex].overLapped_);
-
-			if (success && pipeInstances_[pipeIndex].numBytesToRead_ != 0)
-			{
-				pipeInstances_[pipeIndex].pendingIO_ = false;
-				pipeInstances_[pipeIndex].pipeState_ = PipeInstanceState::WRITING;
-				continue;
-			}
-
-			if (!success && (GetLastError() == ERROR_IO_PENDING))
-			{
-				pipeInstances_[pipeIndex].pendingIO_ = true;
-				continue;
-			}
-
-			// Error
-			DisconnectAndReconnect(pipeIndex);
+			ANIM_ASSERT(pipeIndex < numInstances);
+			ResetEvent(pipeEvents_[pipeIndex]);
+			ServiceInstance(pipeIndex);
 		}
-		break;
-
-		case PipeInstanceState::WRITING:
-		{
-			pipeInstances_[pipeIndex].numBytesToWrite_ = (DWORD)GetAnswerToRequest(pipeIndex);
-
-			DWORD bytesWritten;
-			BOOL success = WriteFile(
-				pipeInstances_[pipeIndex].pipeInstanceHandle_,
-				pipeInstances_[pipeIndex].outputBuffer_,
-				pipeInstances_[pipeIndex].numBytesToWrite_,
-				&bytesWritten,
-				&pipeInstances_[pipeIndex].overLapped_);
-
-			if (success && bytesWritten == pipeInstances_[pipeIndex].numBytesToWrite_)
-			{
-				pipeInstances_[pipeIndex].pendingIO_ = false;
-				pipeInstances_[pipeIndex].pipeState_ = PipeInstanceState::READING;
-				continue;
-			}
-
-			if (!success && (GetLastError() == ERROR_IO_PENDING))
-			{
-				pipeInstances_[pipeIndex].pendingIO_ = true;
-				continue;
-			}
-
-			DisconnectAndReconnect(pipeIndex);
-		}
-		break;
+		PushStreamUpdates();
+	}
 
-		default:
-			ANIM_ASSERT(false);
-		}
+	for (size_t i = 0; i < pipeInstances_.Size(); ++i)
+	{
+		CancelIo(pipeInstances_[i]->pipeInstanceHandle_);
+		DWORD numBytes;
+		if (pipeInstances_[i]->isReadPending_)
+			GetOverlappedResult(pipeInstances_[i]->pipeInstanceHandle_, &pipeInstances_[i]->readOverlapped_, &numBytes, TRUE);
+		if (pipeInstances_[i]->isWritePending_)
+			GetOverlappedResult(pipeInstances_[i]->pipeInstanceHandle_, &pipeInstances_[i]->writeOverlapped_, &numBytes, TRUE);
 	}
+	dispatcher_.Reset();
 }
 
 PipeServer::~PipeServer()
 {
 	for (const auto& pipeInstance : pipeInstances_)
 	{
-		CloseHandle(pipeInstance.pipeInstanceHandle_);
+		CloseHandle(pipeInstance->pipeInstanceHandle_);
 	}
 	for (const auto& handle : pipeEvents_)
 	{
-		CloseHandle(handle);
+		if (handle != stopEvent_ && handle != responseEvent_)
+			CloseHandle(handle);
 	}
+	CloseHandle(responseEvent_);
+	CloseHandle(stopEvent_);
 }
 
 ANIM_NAMESPACE_END
+
+#endif
@@ -1,4 +1,5 @@
 #pragma once
+#include <stdint.h>
 #include "animcore/util/namespace.h"
 #include "animcore/memory/pointers.h"
 
@@ -13,9 +14,29 @@ public:
 	IPipeServer& operator=(const IPipeServer&) = delete;
 	virtual ~IPipeServer() {}
 
+	// Called on the server's dispatch threads, concurrently for requests of different clients. Requests of one
+	// client are dispatched one at a time, in the order they were sent.
 	typedef UniquePtr<Message>(*DispatchCallback)(UniquePtr<Message>);
 	virtual DispatchCallback SetDispatchCallback(DispatchCallback callback) = 0;
+	// Connections sending larger requests are dropped. Set before RunServer.
+	virtual void SetMaxMessageSize(uint32_t maxMessageSize) = 0;
+	// Threads running the dispatch callback, 0 picks one per hardware thread. Set before RunServer.
+	virtual void SetNumDispatchThreads(uint32_t numThreads) = 0;
+	// Lets clients subscribe to the snapshots published on streamID, at up to maxRate snapshots per second. The
+	// server answers SubscribeMessage and UnsubscribeMessage itself, the dispatch callback never sees them.
+	virtual void RegisterStream(uint32_t streamID, float maxRate) = 0;
+	// Can be called from any thread, e.g. every tick with the pose of an AnimHandle and the handle as key. Only
+	// the latest snapshot of a key is kept; subscribers get it at their rate as a delta against the one they got
+	// before, and miss the snapshots published while their connection was backed up.
+	virtual void PublishSnapshot(uint32_t streamID, uint64_t key, const void* data, uint32_t numBytes) = 0;
+	// Whether anyone subscribed to key, publishing snapshots nobody subscribed to is wasted work.
+	virtual bool HasSubscribers(uint32_t streamID, uint64_t key) = 0;
+	// Serves up to numInstances clients at once until StopServer is called. Blocks the calling thread.
 	virtual void RunServer(const char* pipeName, size_t numInstances) = 0;
+	// Can be called from any thread, RunServer returns soon after.
+	virtual void StopServer() = 0;
+	// Named pipes on Windows, Unix domain sockets everywhere else. Names are used the same on both: the part
+	// after the last backslash of a Windows pipe name like \\.\pipe\animengine names the socket.
 	static UniquePtr<IPipeServer> CreateServer();
 protected:
 	IPipeServer() {}
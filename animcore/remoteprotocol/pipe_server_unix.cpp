@@ -0,0 +1,509 @@
+#ifndef WIN32
+#include "pipe_server.h"
+#include <atomic>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "animcore/containers/array.h"
+#include "animcore/memory/default_allocator.h"
+#include "animcore/remoteprotocol/message.h"
+#include "animcore/remoteprotocol/message_framing.h"
+#include "animcore/remoteprotocol/request_dispatcher.h"
+#include "animcore/remoteprotocol/stream_subscriptions.h"
+#include "animcore/remoteprotocol/unix_socket.h"
+
+ANIM_NAMESPACE_BEGIN
+
+static constexpr int Max_Events = 64;
+static constexpr uint32_t Max_Write_Segments = 64;
+// Requests of one client that can wait for their answers before the server stops reading from it.
+static constexpr uint32_t Max_Queued_Requests = 256;
+// epoll tokens that are not instance indices.
+static constexpr uint64_t Listen_Token = ~0ull;
+static constexpr uint64_t Stop_Token = ~1ull;
+static constexpr uint64_t Response_Token = ~2ull;
+
+// Stream sockets carrying length prefixed messages. A single I/O thread waits on all instances with epoll and
+// hands the requests to a RequestDispatcher, which wakes it up through responseEvent_ once answers are ready.
+// Stream updates are pushed from the same thread, epoll_wait times out when the next one is due.
+class PipeServer : public IPipeServer
+{
+public:
+	PipeServer();
+	~PipeServer();
+	virtual DispatchCallback SetDispatchCallback(DispatchCallback callback) override;
+	virtual void SetMaxMessageSize(uint32_t maxMessageSize) override { maxMessageSize_ = maxMessageSize; }
+	virtual void SetNumDispatchThreads(uint32_t numThreads) override { numDispatchThreads_ = numThreads; }
+	virtual void RegisterStream(uint32_t streamID, float maxRate) override { streams_.RegisterStream(streamID, maxRate); }
+	virtual void PublishSnapshot(uint32_t streamID, uint64_t key, const void* data, uint32_t numBytes) override { streams_.Publish(streamID, key, data, numBytes); }
+	virtual bool HasSubscribers(uint32_t streamID, uint64_t key) override { return streams_.HasSubscribers(streamID, key); }
+	virtual void RunServer(const char* pipeName, size_t numInstances) override;
+	virtual void StopServer() override;
+private:
+	bool Listen(const char* pipeName, size_t numInstances);
+	void AcceptClients();
+	void SetListening(bool listen);
+	bool ReceiveRequests(size_t pipeIndex);
+	void ServiceInstance(size_t pipeIndex);
+	bool SendAnswers(size_t pipeIndex);
+	void PushStreamUpdates();
+	void Disconnect(size_t pipeIndex);
+
+	DispatchCallback dispatchCallback_;
+	uint32_t maxMessageSize_;
+	uint32_t numDispatchThreads_;
+	MessageBufferPool bufferPool_;
+	UniquePtr<RequestDispatcher> dispatcher_;
+	BigArray<RequestDispatcher::Response> responses_;
+	Array<uint32_t> readyInstances_;
+	StreamPublisher streams_;
+	Array<uint32_t> updatedInstances_;
+	Array<uint32_t> failedInstances_;
+
+	struct PipeInstance
+	{
+		PipeInstance(MessageBufferPool& pool, uint32_t maxMessageSize)
+			: socket_(-1)
+			, reader_(pool, maxMessageSize)
+			, writer_(maxMessageSize)
+			, epollEvents_(0)
+		{}
+
+		int socket_;
+		MessageReader reader_;
+		MessageWriter writer_;
+		uint32_t epollEvents_;
+	};
+	Array<UniquePtr<PipeInstance>> pipeInstances_;
+	size_t numConnected_;
+	int listenSocket_;
+	int epoll_;
+	int stopEvent_;
+	int responseEvent_;
+	bool isListening_;
+	std::atomic<bool> shutdownServer_;
+};
+
+PipeServer::PipeServer()
+	: dispatchCallback_(nullptr)
+	, maxMessageSize_(Default_Max_Message_Size)
+	, numDispatchThreads_(0)
+	, numConnected_(0)
+	, listenSocket_(-1)
+	, epoll_(-1)
+	, stopEvent_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+	, responseEvent_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+	, isListening_(false)
+	, shutdownServer_(false)
+{
+}
+
+PipeServer::~PipeServer()
+{
+	close(stopEvent_);
+	close(responseEvent_);
+}
+
+IPipeServer::DispatchCallback PipeServer::SetDispatchCallback(IPipeServer::DispatchCallback callback)
+{
+	auto tmp = dispatchCallback_;
+	dispatchCallback_ = callback;
+	return tmp;
+}
+
+UniquePtr<IPipeServer> IPipeServer::CreateServer()
+{
+	return UniquePtr<PipeServer>::MakeUnique();
+}
+
+void PipeServer::StopServer()
+{
+	shutdownServer_.store(true, std::memory_order_release);
+	uint64_t one = 1;
+	ssize_t result = write(stopEvent_, &one, sizeof(one));
+	(void)result;
+}
+
+bool PipeServer::Listen(const char* pipeName, size_t numInstances)
+{
+	sockaddr_un addr;
+	socklen_t addrLength;
+	bool isFile;
+	if (!UnixSocket::GetAddress(pipeName, addr, addrLength, isFile))
+		return false;
+
+	listenSocket_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listenSocket_ < 0)
+		return false;
+	// A socket file left behind by a server that did not shut down cleanly would make bind fail.
+	if (isFile)
+	{
+		unlink(addr.sun_path);
+	}
+	if (bind(listenSocket_, reinterpret_cast<const sockaddr*>(&addr), addrLength) != 0 ||
+		listen(listenSocket_, static_cast<int>(numInstances)) != 0)
+	{
+		return false;
+	}
+	return true;
+}
+
+void PipeServer::SetListening(bool listen)
+{
+	if (listen == isListening_)
+		return;
+	// Clients that connect while every instance is busy wait in the listen backlog, like they wait for a free
+	// instance on Windows.
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.u64 = Listen_Token;
+	epoll_ctl(epoll_, listen ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, listenSocket_, &event);
+	isListening_ = listen;
+}
+
+void PipeServer::AcceptClients()
+{
+	size_t pipeIndex = 0;
+	while (numConnected_ < pipeInstances_.Size())
+	{
+		int clientSocket = accept4(listenSocket_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (clientSocket < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		while (pipeInstances_[pipeIndex]->socket_ >= 0)
+		{
+			++pipeIndex;
+		}
+		PipeInstance& instance = *pipeInstances_[pipeIndex].Get();
+		instance.socket_ = clientSocket;
+		instance.epollEvents_ = EPOLLIN;
+		++numConnected_;
+
+		epoll_event event = {};
+		event.events = instance.epollEvents_;
+		event.data.u64 = pipeIndex;
+		epoll_ctl(epoll_, EPOLL_CTL_ADD, clientSocket, &event);
+	}
+	SetListening(numConnected_ < pipeInstances_.Size());
+}
+
+void PipeServer::Disconnect(size_t pipeIndex)
+{
+	PipeInstance& instance = *pipeInstances_[pipeIndex].Get();
+	ANIM_ASSERT(instance.socket_ >= 0);
+	// Closing the socket removes it from the epoll set.
+	close(instance.socket_);
+	instance.socket_ = -1;
+	instance.epollEvents_ = 0;
+	instance.reader_.Reset();
+	instance.writer_.Reset();
+	dispatcher_->Reset(static_cast<uint32_t>(pipeIndex));
+	streams_.RemoveConnection(static_cast<uint32_t>(pipeIndex));
+	--numConnected_;
+	SetListening(true);
+}
+
+// Sends as much of the queued answers as the socket takes. Returns false if the instance was disconnected.
+bool PipeServer::SendAnswers(size_t pipeIndex)
+{
+	PipeInstance& instance = *pipeInstances_[pipeIndex].Get();
+	while (instance.writer_.BeginSend())
+	{
+		iovec segments[Max_Write_Segments];
+		uint32_t numSegments = instance.writer_.GetNumSegments();
+		numSegments = numSegments < Max_Write_Segments ? numSegments : Max_Write_Segments;
+		for (uint32_t i = 0; i < numSegments; ++i)
+		{
+			MessageWriter::Segment segment = instance.writer_.GetSegment(i);
+			segments[i].iov_base = const_cast<uint8_t*>(segment.m_Data);
+			segments[i].iov_len = segment.m_Size;
+		}
+		msghdr header = {};
+		header.msg_iov = segments;
+		header.msg_iovlen = numSegments;
+		ssize_t numBytesWritten = sendmsg(instance.socket_, &header, MSG_NOSIGNAL);
+		if (numBytesWritten >= 0)
+		{
+			instance.writer_.CommitSend(static_cast<size_t>(numBytesWritten));
+			continue;
+		}
+		if (errno == EINTR)
+			continue;
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return true;
+		Disconnect(pipeIndex);
+		return false;
+	}
+	return true;
+}
+
+// Receives once, level triggered epoll reports data that did not fit again. Returns false if the instance was
+// disconnected.
+bool PipeServer::ReceiveRequests(size_t pipeIndex)
+{
+	PipeInstance& instance = *pipeInstances_[pipeIndex].Get();
+	uint8_t* dst;
+	uint32_t capacity;
+	instance.reader_.GetReceiveBuffer(dst, capacity);
+	ssize_t numBytesRead;
+	do
+	{
+		numBytesRead = recv(instance.socket_, dst, capacity, 0);
+	} while (numBytesRead < 0 && errno == EINTR);
+
+	if (numBytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return true;
+	if (numBytesRead <= 0)
+	{
+		Disconnect(pipeIndex);
+		return false;
+	}
+	instance.reader_.CommitReceive(static_cast<uint32_t>(numBytesRead));
+	return true;
+}
+
+// Sends the answers that are ready and hands the requests received so far to the dispatcher, except for
+// subscription requests, which are answered right away. Nothing is read
+// while answers are stuck or too many requests are queued, so a client that sends faster than it is answered
+// or does not read its answers is held up by its own socket buffers instead of growing the server's queues.
+void PipeServer::ServiceInstance(size_t pipeIndex)
+{
+	PipeInstance& instance = *pipeInstances_[pipeIndex].Get();
+	uint32_t connection = static_cast<uint32_t>(pipeIndex);
+	responses_.Clear();
+	dispatcher_->TakeResponses(connection, responses_);
+	for (const auto& response : responses_)
+	{
+		if (response.m_Message.Get() == nullptr || !instance.writer_.Encode(response.m_Message.Get(), response.m_RequestID))
+		{
+			responses_.Clear();
+			Disconnect(pipeIndex);
+			return;
+		}
+	}
+	responses_.Clear();
+	if (!SendAnswers(pipeIndex))
+		return;
+
+	uint32_t numQueued = dispatcher_->GetNumQueued(connection);
+	while (instance.writer_.IsDone() && numQueued < Max_Queued_Requests)
+	{
+		Message* msg = nullptr;
+		uint32_t requestID = 0;
+		MessageReader::Result result = instance.reader_.NextMessage(msg, requestID);
+		if (result == MessageReader::Result::Incomplete)
+			break;
+		if (result == MessageReader::Result::Error)
+		{
+			Disconnect(pipeIndex);
+			return;
+		}
+		UniquePtr<Message> answer = streams_.HandleRequest(connection, msg);
+		if (answer.Get() == nullptr)
+		{
+			dispatcher_->Push(connection, msg, requestID);
+			++numQueued;
+			continue;
+		}
+		DefaultAllocator::Destroy(msg);
+		if (!instance.writer_.Encode(answer.Get(), requestID))
+		{
+			Disconnect(pipeIndex);
+			return;
+		}
+	}
+	if (instance.writer_.HasDataToSend() && !SendAnswers(pipeIndex))
+		return;
+
+	uint32_t events = 0;
+	if (!instance.writer_.IsDone())
+	{
+		events = EPOLLOUT;
+	}
+	else if (numQueued < Max_Queued_Requests)
+	{
+		events = EPOLLIN;
+	}
+	if (events != instance.epollEvents_)
+	{
+		instance.epollEvents_ = events;
+		epoll_event event = {};
+		event.events = events;
+		event.data.u64 = pipeIndex;
+		epoll_ctl(epoll_, EPOLL_CTL_MOD, instance.socket_, &event);
+	}
+}
+
+// Updates only go to instances that sent everything before, the others skip them until they caught up.
+void PipeServer::PushStreamUpdates()
+{
+	updatedInstances_.Clear();
+	failedInstances_.Clear();
+	streams_.PushUpdates([this](uint32_t connection)
+	{
+		const PipeInstance& instance = *pipeInstances_[connection].Get();
+		return instance.socket_ >= 0 && instance.writer_.IsDone();
+	}, [this](uint32_t connection, const StreamUpdateMessage& update)
+	{
+		MessageWriter& writer = pipeInstances_[connection]->writer_;
+		bool isFirst = writer.GetNumQueuedBytes() == 0;
+		// Fails for snapshots larger than the maximum message size, the client could not read them either.
+		if (!writer.Encode(&update, 0))
+		{
+			failedInstances_.Push(connection);
+		}
+		else if (isFirst)
+		{
+			updatedInstances_.Push(connection);
+		}
+	});
+	// Not while PushUpdates runs, disconnecting removes subscriptions.
+	for (uint32_t pipeIndex : failedInstances_)
+	{
+		if (pipeInstances_[pipeIndex]->socket_ >= 0)
+		{
+			Disconnect(pipeIndex);
+		}
+	}
+	for (uint32_t pipeIndex : updatedInstances_)
+	{
+		if (pipeInstances_[pipeIndex]->socket_ >= 0)
+		{
+			ServiceInstance(pipeIndex);
+		}
+	}
+}
+
+void PipeServer::RunServer(const char* pipeName, size_t numInstances)
+{
+	ANIM_ASSERT(dispatchCallback_ != nullptr && numInstances > 0);
+	pipeInstances_.Resize(numInstances);
+	for (auto& instance : pipeInstances_)
+	{
+		instance = UniquePtr<PipeInstance>::MakeUnique(bufferPool_, maxMessageSize_);
+	}
+	numConnected_ = 0;
+	isListening_ = false;
+	int responseEvent = responseEvent_;
+	dispatcher_ = UniquePtr<RequestDispatcher>::MakeUnique(dispatchCallback_, static_cast<uint32_t>(numInstances), numDispatchThreads_, [responseEvent]()
+	{
+		uint64_t one = 1;
+		ssize_t result = write(responseEvent, &one, sizeof(one));
+		(void)result;
+	});
+
+	epoll_ = epoll_create1(EPOLL_CLOEXEC);
+	bool isRunning = epoll_ >= 0 && stopEvent_ >= 0 && responseEvent_ >= 0 && Listen(pipeName, numInstances);
+	if (isRunning)
+	{
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.u64 = Stop_Token;
+		epoll_ctl(epoll_, EPOLL_CTL_ADD, stopEvent_, &event);
+		event.data.u64 = Response_Token;
+		epoll_ctl(epoll_, EPOLL_CTL_ADD, responseEvent_, &event);
+		SetListening(true);
+	}
+	ANIM_ASSERT(isRunning);
+
+	epoll_event events[Max_Events];
+	while (isRunning && !shutdownServer_.load(std::memory_order_acquire))
+	{
+		int numEvents = epoll_wait(epoll_, events, Max_Events, streams_.GetMillisecondsUntilDue());
+		if (numEvents < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (int i = 0; i < numEvents; ++i)
+		{
+			uint64_t token = events[i].data.u64;
+			if (token == Stop_Token)
+			{
+				isRunning = false;
+				break;
+			}
+			if (token == Listen_Token)
+			{
+				AcceptClients();
+				continue;
+			}
+			if (token == Response_Token)
+			{
+				// Cleared before the ready instances are taken, answers finishing meanwhile signal it again.
+				uint64_t value;
+				ssize_t result = read(responseEvent_, &value, sizeof(value));
+				(void)result;
+				readyInstances_.Clear();
+				dispatcher_->TakeReadyConnections(readyInstances_);
+				for (uint32_t pipeIndex : readyInstances_)
+				{
+					if (pipeInstances_[pipeIndex]->socket_ >= 0)
+					{
+						ServiceInstance(pipeIndex);
+					}
+				}
+				continue;
+			}
+
+			// The instance may have been disconnected by an earlier event of this batch.
+			size_t pipeIndex = static_cast<size_t>(token);
+			if (pipeInstances_[pipeIndex]->socket_ < 0)
+				continue;
+			uint32_t eventMask = events[i].events;
+			if ((eventMask & EPOLLIN) != 0)
+			{
+				if (!ReceiveRequests(pipeIndex))
+					continue;
+			}
+			else if ((eventMask & (EPOLLERR | EPOLLHUP)) != 0)
+			{
+				Disconnect(pipeIndex);
+				continue;
+			}
+			ServiceInstance(pipeIndex);
+		}
+		if (isRunning)
+		{
+			PushStreamUpdates();
+		}
+	}
+
+	for (size_t i = 0; i < pipeInstances_.Size(); ++i)
+	{
+		if (pipeInstances_[i]->socket_ >= 0)
+		{
+			Disconnect(i);
+		}
+	}
+	dispatcher_.Reset();
+	if (listenSocket_ >= 0)
+	{
+		sockaddr_un addr;
+		socklen_t addrLength;
+		bool isFile;
+		if (UnixSocket::GetAddress(pipeName, addr, addrLength, isFile) && isFile)
+		{
+			unlink(addr.sun_path);
+		}
+		close(listenSocket_);
+		listenSocket_ = -1;
+	}
+	if (epoll_ >= 0)
+	{
+		close(epoll_);
+		epoll_ = -1;
+	}
+}
+
+ANIM_NAMESPACE_END
+
+#endif
@@ -0,0 +1,149 @@
+#include "request_dispatcher.h"
+#include "animcore/memory/default_allocator.h"
+#include "animcore/remoteprotocol/message.h"
+
+ANIM_NAMESPACE_BEGIN
+
+RequestDispatcher::RequestDispatcher(DispatchCallback callback, uint32_t numConnections, uint32_t numThreads, std::function<void()> onResponsesReady)
+	: m_Callback(callback)
+	, m_OnResponsesReady(std::move(onResponsesReady))
+{
+	m_Connections.Resize(numConnections);
+	m_Workers = UniquePtr<JobSystem>::MakeUnique(numThreads);
+}
+
+RequestDispatcher::~RequestDispatcher()
+{
+	// Nothing is left to dispatch afterwards, so no worker schedules another job while they are joined.
+	for (uint32_t i = 0; i < m_Connections.Size(); ++i)
+	{
+		Reset(i);
+	}
+	m_Workers.Reset();
+}
+
+void RequestDispatcher::Push(uint32_t connection, Message* msg, uint32_t requestID)
+{
+	bool startDispatching = false;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		Connection& queue = m_Connections[connection];
+		queue.m_Requests.Push({ msg, requestID });
+		++queue.m_NumQueued;
+		if (!queue.m_IsDispatching)
+		{
+			queue.m_IsDispatching = true;
+			startDispatching = true;
+		}
+	}
+	if (startDispatching)
+	{
+		m_Workers->Schedule([this, connection]() { DispatchRequests(connection); });
+	}
+}
+
+uint32_t RequestDispatcher::GetNumQueued(uint32_t connection)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Connections[connection].m_NumQueued;
+}
+
+void RequestDispatcher::TakeReadyConnections(Array<uint32_t>& connectionsOut)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	for (uint32_t connection : m_ReadyConnections)
+	{
+		m_Connections[connection].m_IsReady = false;
+		connectionsOut.Push(connection);
+	}
+	m_ReadyConnections.Clear();
+}
+
+void RequestDispatcher::TakeResponses(uint32_t connection, BigArray<Response>& responsesOut)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	Connection& queue = m_Connections[connection];
+	for (auto& response : queue.m_Responses)
+	{
+		responsesOut.Push(std::move(response));
+	}
+	queue.m_NumQueued -= queue.m_Responses.Size();
+	queue.m_Responses.Clear();
+}
+
+void RequestDispatcher::Reset(uint32_t connection)
+{
+	BigArray<Request> requests;
+	BigArray<Response> responses;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		Connection& queue = m_Connections[connection];
+		requests = std::move(queue.m_Requests);
+		responses = std::move(queue.m_Responses);
+		queue.m_NumQueued = 0;
+		++queue.m_Generation;
+	}
+	// Destroyed outside the lock, the workers keep going meanwhile.
+	for (auto& request : requests)
+	{
+		DefaultAllocator::Destroy(request.m_Message);
+	}
+}
+
+// Dispatches the requests that were queued when it started, then goes to the back of the job queue if more
+// arrived meanwhile, so a busy connection cannot keep a worker from the other connections.
+void RequestDispatcher::DispatchRequests(uint32_t connection)
+{
+	BigArray<Request> requests;
+	uint32_t generation;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		Connection& queue = m_Connections[connection];
+		requests = std::move(queue.m_Requests);
+		generation = queue.m_Generation;
+	}
+
+	for (uint32_t i = 0; i < requests.Size(); ++i)
+	{
+		UniquePtr<Message> responseMsg = m_Callback(UniquePtr<Message>(requests[i].m_Message));
+		bool wakeUp = false;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			Connection& queue = m_Connections[connection];
+			if (queue.m_Generation != generation)
+			{
+				// The client is gone, the rest of its requests are not worth dispatching.
+				for (uint32_t j = i + 1; j < requests.Size(); ++j)
+				{
+					DefaultAllocator::Destroy(requests[j].m_Message);
+				}
+				break;
+			}
+			queue.m_Responses.Push({ std::move(responseMsg), requests[i].m_RequestID });
+			if (!queue.m_IsReady)
+			{
+				queue.m_IsReady = true;
+				m_ReadyConnections.Push(connection);
+				wakeUp = true;
+			}
+		}
+		if (wakeUp)
+		{
+			m_OnResponsesReady();
+		}
+	}
+
+	bool dispatchMore;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		Connection& queue = m_Connections[connection];
+		dispatchMore = queue.m_Requests.Size() > 0;
+		queue.m_IsDispatching = dispatchMore;
+	}
+	if (dispatchMore)
+	{
+		m_Workers->Schedule([this, connection]() { DispatchRequests(connection); });
+	}
+}
+
+ANIM_NAMESPACE_END
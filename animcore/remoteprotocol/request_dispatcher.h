@@ -0,0 +1,79 @@
+#pragma once
+#include <stdint.h>
+#include <functional>
+#include <mutex>
+#include "animcore/util/namespace.h"
+#include "animcore/containers/array.h"
+#include "animcore/memory/pointers.h"
+#include "animcore/threading/job_system.h"
+
+ANIM_NAMESPACE_BEGIN
+
+class Message;
+
+// Runs the dispatch callback of a server on its own pool of worker threads, so a slow request only holds up the
+// connection that sent it. Requests of one connection are dispatched one after the other in the order they
+// were received, so their responses come back in order too. Different connections are dispatched in parallel.
+// Everything but the dispatch callback runs on the server's I/O thread.
+class RequestDispatcher
+{
+public:
+	typedef UniquePtr<Message>(*DispatchCallback)(UniquePtr<Message>);
+
+	struct Response
+	{
+		// nullptr if the callback did not answer, the connection should be dropped.
+		UniquePtr<Message> m_Message;
+		uint32_t m_RequestID;
+	};
+
+	// onResponsesReady is called on a worker thread when a connection without finished responses gets one, it
+	// should wake up the I/O thread. 0 threads picks one per hardware thread.
+	RequestDispatcher(DispatchCallback callback, uint32_t numConnections, uint32_t numThreads, std::function<void()> onResponsesReady);
+	// Waits for the requests that are being dispatched.
+	~RequestDispatcher();
+	RequestDispatcher(const RequestDispatcher&) = delete;
+	RequestDispatcher& operator=(const RequestDispatcher&) = delete;
+
+	// Takes ownership of msg.
+	void Push(uint32_t connection, Message* msg, uint32_t requestID);
+	// Requests of connection whose responses were not taken yet, including those still being dispatched.
+	uint32_t GetNumQueued(uint32_t connection);
+	// Appends the connections that have finished responses and forgets them.
+	void TakeReadyConnections(Array<uint32_t>& connectionsOut);
+	// Moves the finished responses of connection into responsesOut, in request order.
+	void TakeResponses(uint32_t connection, BigArray<Response>& responsesOut);
+	// Drops the queued requests and responses of connection, e.g. after the client disconnected. Responses of
+	// requests that are being dispatched right now are dropped once they are done.
+	void Reset(uint32_t connection);
+
+private:
+	struct Request
+	{
+		Message* m_Message;
+		uint32_t m_RequestID;
+	};
+
+	struct Connection
+	{
+		BigArray<Request> m_Requests;
+		BigArray<Response> m_Responses;
+		uint32_t m_NumQueued = 0;
+		// Incremented by Reset, responses of an older generation are dropped.
+		uint32_t m_Generation = 0;
+		bool m_IsDispatching = false;
+		bool m_IsReady = false;
+	};
+
+	void DispatchRequests(uint32_t connection);
+
+	DispatchCallback m_Callback;
+	std::function<void()> m_OnResponsesReady;
+	std::mutex m_Mutex;
+	Array<Connection> m_Connections;
+	Array<uint32_t> m_ReadyConnections;
+	// Declared last, so the workers are joined before anything they use is destroyed.
+	UniquePtr<JobSystem> m_Workers;
+};
+
+ANIM_NAMESPACE_END
@@ -0,0 +1,152 @@
+#include "stream_messages.h"
+#include "animcore/serialization/serialization.h"
+
+ANIM_NAMESPACE_BEGIN
+
+IMPLEMENT_CONCRETE_DERIVED_CLASS(SubscribeMessage, Message);
+IMPLEMENT_CONCRETE_DERIVED_CLASS(UnsubscribeMessage, Message);
+IMPLEMENT_CONCRETE_DERIVED_CLASS(SubscribeResponseMessage, Message);
+IMPLEMENT_CONCRETE_DERIVED_CLASS(StreamUpdateMessage, Message);
+
+void SubscribeMessage::Serialize(Serialization::Serializer& res) const
+{
+	res.Serialize(m_StreamID);
+	res.Serialize(m_Key);
+	res.Serialize(m_Rate);
+}
+
+void SubscribeMessage::Deserialize(Serialization::Deserializer& res)
+{
+	res.Deserialize(m_StreamID);
+	res.Deserialize(m_Key);
+	res.Deserialize(m_Rate);
+}
+
+void UnsubscribeMessage::Serialize(Serialization::Serializer& res) const
+{
+	res.Serialize(m_SubscriptionID);
+}
+
+void UnsubscribeMessage::Deserialize(Serialization::Deserializer& res)
+{
+	res.Deserialize(m_SubscriptionID);
+}
+
+void SubscribeResponseMessage::Serialize(Serialization::Serializer& res) const
+{
+	res.Serialize(m_SubscriptionID);
+	res.Serialize(m_Rate);
+}
+
+void SubscribeResponseMessage::Deserialize(Serialization::Deserializer& res)
+{
+	res.Deserialize(m_SubscriptionID);
+	res.Deserialize(m_Rate);
+}
+
+void StreamUpdateMessage::Serialize(Serialization::Serializer& res) const
+{
+	res.Serialize(m_SubscriptionID);
+	res.Serialize(m_Sequence);
+	res.Serialize(m_BaseSequence);
+	res.Serialize(m_Data);
+}
+
+void StreamUpdateMessage::Deserialize(Serialization::Deserializer& res)
+{
+	res.Deserialize(m_SubscriptionID);
+	res.Deserialize(m_Sequence);
+	res.Deserialize(m_BaseSequence);
+	res.Deserialize(m_Data);
+}
+
+namespace StreamDelta
+{
+	// Unchanged bytes between two changed ones that are cheaper to store than to start a new run for.
+	static constexpr uint32_t Min_Unchanged_Run = 4;
+
+	static void WriteVarint(BigArray<uint8_t>& out, uint32_t value)
+	{
+		while (value >= 0x80)
+		{
+			out.Push(static_cast<uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+		out.Push(static_cast<uint8_t>(value));
+	}
+
+	static bool ReadVarint(const BigArray<uint8_t>& in, uint32_t& position, uint32_t& valueOut)
+	{
+		valueOut = 0;
+		for (uint32_t shift = 0; shift < 35; shift += 7)
+		{
+			if (position >= in.Size())
+				return false;
+			uint8_t byte = in[position++];
+			valueOut |= static_cast<uint32_t>(byte & 0x7f) << shift;
+			if ((byte & 0x80) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	bool Encode(const BigArray<uint8_t>& base, const BigArray<uint8_t>& snapshot, BigArray<uint8_t>& deltaOut)
+	{
+		deltaOut.Clear();
+		uint32_t size = snapshot.Size();
+		if (base.Size() != size || size == 0)
+			return false;
+
+		uint32_t i = 0;
+		while (i < size)
+		{
+			uint32_t unchangedBegin = i;
+			while (i < size && base[i] == snapshot[i])
+			{
+				++i;
+			}
+			uint32_t changedBegin = i;
+			uint32_t numUnchanged = 0;
+			while (i < size && numUnchanged < Min_Unchanged_Run)
+			{
+				numUnchanged = base[i] == snapshot[i] ? numUnchanged + 1 : 0;
+				++i;
+			}
+			uint32_t changedEnd = i - numUnchanged;
+			i = changedEnd;
+
+			WriteVarint(deltaOut, changedBegin - unchangedBegin);
+			WriteVarint(deltaOut, changedEnd - changedBegin);
+			for (uint32_t j = changedBegin; j < changedEnd; ++j)
+			{
+				deltaOut.Push(snapshot[j] ^ base[j]);
+			}
+			if (deltaOut.Size() >= size)
+				return false;
+		}
+		return true;
+	}
+
+	bool Apply(BigArray<uint8_t>& base, const BigArray<uint8_t>& delta)
+	{
+		uint32_t position = 0;
+		uint32_t i = 0;
+		while (i < delta.Size())
+		{
+			uint32_t numUnchanged;
+			uint32_t numChanged;
+			if (!ReadVarint(delta, i, numUnchanged) || !ReadVarint(delta, i, numChanged))
+				return false;
+			if (numUnchanged > base.Size() - position || numChanged > base.Size() - position - numUnchanged || numChanged > delta.Size() - i)
+				return false;
+			position += numUnchanged;
+			for (uint32_t j = 0; j < numChanged; ++j)
+			{
+				base[position++] ^= delta[i++];
+			}
+		}
+		return true;
+	}
+}
+
+ANIM_NAMESPACE_END
@@ -0,0 +1,73 @@
+#pragma once
+#include <stdint.h>
+#include "animcore/util/namespace.h"
+#include "animcore/containers/array.h"
+#include "animcore/remoteprotocol/message.h"
+
+ANIM_NAMESPACE_BEGIN
+
+// Asks the server to push the snapshots published for m_Key on stream m_StreamID, e.g. the pose of an AnimHandle
+// every tick, at up to m_Rate snapshots per second. 0 takes the highest rate the stream allows.
+class SubscribeMessage : public Message
+{
+	DECLARE_DERIVED_CLASS();
+public:
+	virtual void Serialize(Serialization::Serializer& res) const override;
+	virtual void Deserialize(Serialization::Deserializer& res) override;
+
+	uint32_t m_StreamID = 0;
+	uint64_t m_Key = 0;
+	float m_Rate = 0.0f;
+};
+
+class UnsubscribeMessage : public Message
+{
+	DECLARE_DERIVED_CLASS();
+public:
+	virtual void Serialize(Serialization::Serializer& res) const override;
+	virtual void Deserialize(Serialization::Deserializer& res) override;
+
+	uint32_t m_SubscriptionID = 0;
+};
+
+// Answer to SubscribeMessage and UnsubscribeMessage. m_SubscriptionID is 0 if the server does not publish the
+// stream, m_Rate is the rate the server agreed to.
+class SubscribeResponseMessage : public Message
+{
+	DECLARE_DERIVED_CLASS();
+public:
+	virtual void Serialize(Serialization::Serializer& res) const override;
+	virtual void Deserialize(Serialization::Deserializer& res) override;
+
+	uint32_t m_SubscriptionID = 0;
+	float m_Rate = 0.0f;
+};
+
+// Pushed by the server with request id 0. m_Data is the whole snapshot if m_BaseSequence is 0, otherwise a
+// StreamDelta against snapshot m_BaseSequence, which is the one the client received last. Snapshots that were
+// published in between were coalesced away.
+class StreamUpdateMessage : public Message
+{
+	DECLARE_DERIVED_CLASS();
+public:
+	virtual void Serialize(Serialization::Serializer& res) const override;
+	virtual void Deserialize(Serialization::Deserializer& res) override;
+
+	uint32_t m_SubscriptionID = 0;
+	uint32_t m_Sequence = 0;
+	uint32_t m_BaseSequence = 0;
+	BigArray<uint8_t> m_Data;
+};
+
+// Byte wise delta of two snapshots of the same size: runs of unchanged bytes are skipped, changed bytes are stored
+// XORed with the base. Poses mostly keep their layout from tick to tick, so bones that did not move cost a few
+// bytes and moving ones mostly keep their sign and exponent bytes.
+namespace StreamDelta
+{
+	// False if the delta would not be smaller than the snapshot itself, deltaOut is undefined then.
+	bool Encode(const BigArray<uint8_t>& base, const BigArray<uint8_t>& snapshot, BigArray<uint8_t>& deltaOut);
+	// Turns base into the snapshot the delta was made from. False if the delta does not fit base.
+	bool Apply(BigArray<uint8_t>& base, const BigArray<uint8_t>& delta);
+}
+
+ANIM_NAMESPACE_END
@@ -0,0 +1,293 @@
+#include "stream_subscriptions.h"
+#include <string.h>
+#include "animcore/remoteprotocol/message.h"
+
+ANIM_NAMESPACE_BEGIN
+
+StreamPublisher::StreamPublisher()
+	: m_NextSubscriptionID(1)
+{
+}
+
+void StreamPublisher::RegisterStream(uint32_t streamID, float maxRate)
+{
+	ANIM_ASSERT(maxRate > 0.0f);
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Streams[streamID].m_MaxRate = maxRate;
+}
+
+void StreamPublisher::Publish(uint32_t streamID, uint64_t key, const void* data, uint32_t numBytes)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto stream = m_Streams.find(streamID);
+	if (stream == m_Streams.end())
+		return;
+	auto snapshot = stream->second.m_Snapshots.find(key);
+	if (snapshot == stream->second.m_Snapshots.end())
+		return;
+
+	Snapshot& latest = snapshot->second;
+	latest.m_Data.Resize(numBytes);
+	if (numBytes > 0)
+	{
+		memcpy(latest.m_Data.GetBuffer(), data, numBytes);
+	}
+	if (++latest.m_Sequence == 0)
+	{
+		latest.m_Sequence = 1;
+	}
+}
+
+bool StreamPublisher::HasSubscribers(uint32_t streamID, uint64_t key)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto stream = m_Streams.find(streamID);
+	return stream != m_Streams.end() && stream->second.m_Snapshots.count(key) != 0;
+}
+
+UniquePtr<Message> StreamPublisher::HandleRequest(uint32_t connection, const Message* msg)
+{
+	const Reflection::ClassInfo& classInfo = msg->GetReflectedClassInfo();
+	if (classInfo.DerivesFrom(SubscribeMessage::GetStaticClassInfo()))
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return Subscribe(connection, *static_cast<const SubscribeMessage*>(msg));
+	}
+	if (classInfo.DerivesFrom(UnsubscribeMessage::GetStaticClassInfo()))
+	{
+		auto response = UniquePtr<SubscribeResponseMessage>::MakeUnique();
+		uint32_t subscriptionID = static_cast<const UnsubscribeMessage*>(msg)->m_SubscriptionID;
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		auto iter = m_Subscriptions.find(subscriptionID);
+		if (iter != m_Subscriptions.end() && iter->second.m_Connection == connection)
+		{
+			Unsubscribe(iter);
+			response->m_SubscriptionID = subscriptionID;
+		}
+		return UniquePtr<Message>(std::move(response));
+	}
+	return UniquePtr<Message>();
+}
+
+UniquePtr<Message> StreamPublisher::Subscribe(uint32_t connection, const SubscribeMessage& request)
+{
+	auto response = UniquePtr<SubscribeResponseMessage>::MakeUnique();
+	auto stream = m_Streams.find(request.m_StreamID);
+	if (stream == m_Streams.end())
+		return UniquePtr<Message>(std::move(response));
+
+	// Clients asking for more than the stream allows, or for nothing in particular, get its maximum rate.
+	float maxRate = stream->second.m_MaxRate;
+	float rate = request.m_Rate > 0.0f && request.m_Rate < maxRate ? request.m_Rate : maxRate;
+
+	uint32_t subscriptionID = m_NextSubscriptionID;
+	while (subscriptionID == 0 || m_Subscriptions.count(subscriptionID) != 0)
+	{
+		++subscriptionID;
+	}
+	m_NextSubscriptionID = subscriptionID + 1;
+
+	Subscription& subscription = m_Subscriptions[subscriptionID];
+	subscription.m_Connection = connection;
+	subscription.m_StreamID = request.m_StreamID;
+	subscription.m_Key = request.m_Key;
+	subscription.m_Interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(1.0f / rate));
+	// The first update goes out as soon as there is a snapshot.
+	subscription.m_NextUpdate = Clock::now();
+	++stream->second.m_Snapshots[request.m_Key].m_NumSubscribers;
+
+	response->m_SubscriptionID = subscriptionID;
+	response->m_Rate = rate;
+	return UniquePtr<Message>(std::move(response));
+}
+
+// Returns the iterator erase returns.
+FlatHashMap<uint32_t, StreamPublisher::Subscription>::Iterator StreamPublisher::Unsubscribe(FlatHashMap<uint32_t, Subscription>::Iterator iter)
+{
+	const Subscription& subscription = iter->second;
+	auto stream = m_Streams.find(subscription.m_StreamID);
+	auto snapshot = stream->second.m_Snapshots.find(subscription.m_Key);
+	if (--snapshot->second.m_NumSubscribers == 0)
+	{
+		stream->second.m_Snapshots.erase(snapshot);
+	}
+	return m_Subscriptions.erase(iter);
+}
+
+void StreamPublisher::RemoveConnection(uint32_t connection)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	for (auto iter = m_Subscriptions.begin(); iter != m_Subscriptions.end();)
+	{
+		if (iter->second.m_Connection == connection)
+		{
+			iter = Unsubscribe(iter);
+		}
+		else
+		{
+			++iter;
+		}
+	}
+}
+
+int StreamPublisher::GetMillisecondsUntilDue()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (m_Subscriptions.empty())
+		return -1;
+
+	Clock::time_point nextUpdate = Clock::time_point::max();
+	for (const auto& entry : m_Subscriptions)
+	{
+		nextUpdate = entry.second.m_NextUpdate < nextUpdate ? entry.second.m_NextUpdate : nextUpdate;
+	}
+	Clock::time_point now = Clock::now();
+	if (nextUpdate <= now)
+		return 0;
+	// Rounded up, waking up early would find nothing to do.
+	auto wait = nextUpdate - now;
+	auto waitMs = std::chrono::duration_cast<std::chrono::milliseconds>(wait);
+	return static_cast<int>(waitMs.count()) + (waitMs < wait ? 1 : 0);
+}
+
+// Encoded while the lock is held, publishing waits for at most one delta per subscriber.
+void StreamPublisher::PushUpdates(const CanSendCallback& canSend, const SendCallback& send)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	Clock::time_point now = Clock::now();
+	for (auto& entry : m_Subscriptions)
+	{
+		Subscription& subscription = entry.second;
+		if (subscription.m_NextUpdate > now)
+			continue;
+		// Keeps the rate steady, but an update that was skipped or is late is not caught up on.
+		subscription.m_NextUpdate += subscription.m_Interval;
+		if (subscription.m_NextUpdate <= now)
+		{
+			subscription.m_NextUpdate = now + subscription.m_Interval;
+		}
+
+		const Snapshot& snapshot = m_Streams.find(subscription.m_StreamID)->second.m_Snapshots.find(subscription.m_Key)->second;
+		if (snapshot.m_Sequence == subscription.m_LastSequence || !canSend(subscription.m_Connection))
+			continue;
+
+		m_Update.m_SubscriptionID = entry.first;
+		m_Update.m_Sequence = snapshot.m_Sequence;
+		if (subscription.m_LastSequence != 0 && StreamDelta::Encode(subscription.m_LastSent, snapshot.m_Data, m_Update.m_Data))
+		{
+			m_Update.m_BaseSequence = subscription.m_LastSequence;
+		}
+		else
+		{
+			m_Update.m_BaseSequence = 0;
+			m_Update.m_Data = snapshot.m_Data;
+		}
+		subscription.m_LastSent = snapshot.m_Data;
+		subscription.m_LastSequence = snapshot.m_Sequence;
+		send(subscription.m_Connection, m_Update);
+	}
+}
+
+SubscriptionTable::SubscriptionTable()
+	: m_CallingID(0)
+	, m_IsCallingRemoved(false)
+{
+}
+
+uint32_t SubscriptionTable::Add(const Message* response, Callback callback, float* rateOut)
+{
+	if (response == nullptr || !response->GetReflectedClassInfo().DerivesFrom(SubscribeResponseMessage::GetStaticClassInfo()))
+		return 0;
+	const SubscribeResponseMessage* answer = static_cast<const SubscribeResponseMessage*>(response);
+	if (answer->m_SubscriptionID == 0)
+		return 0;
+
+	Subscription& subscription = m_Subscriptions[answer->m_SubscriptionID];
+	subscription.m_Callback = std::move(callback);
+	subscription.m_Snapshot.Clear();
+	subscription.m_Sequence = 0;
+	if (rateOut != nullptr)
+	{
+		*rateOut = answer->m_Rate;
+	}
+	return answer->m_SubscriptionID;
+}
+
+void SubscriptionTable::Remove(uint32_t subscriptionID)
+{
+	if (subscriptionID == m_CallingID)
+	{
+		m_IsCallingRemoved = true;
+		return;
+	}
+	m_Subscriptions.erase(subscriptionID);
+}
+
+void SubscriptionTable::Clear()
+{
+	if (m_CallingID != 0)
+	{
+		m_IsCallingRemoved = true;
+		// Kept until its callback returned.
+		for (auto iter = m_Subscriptions.begin(); iter != m_Subscriptions.end();)
+		{
+			if (iter->first != m_CallingID)
+			{
+				iter = m_Subscriptions.erase(iter);
+			}
+			else
+			{
+				++iter;
+			}
+		}
+		return;
+	}
+	m_Subscriptions.clear();
+}
+
+bool SubscriptionTable::HandleUpdate(const Message* msg)
+{
+	if (!msg->GetReflectedClassInfo().DerivesFrom(StreamUpdateMessage::GetStaticClassInfo()))
+		return false;
+	const StreamUpdateMessage* update = static_cast<const StreamUpdateMessage*>(msg);
+	auto iter = m_Subscriptions.find(update->m_SubscriptionID);
+	if (iter == m_Subscriptions.end())
+		return true;
+
+	Subscription& subscription = iter->second;
+	if (update->m_BaseSequence == 0)
+	{
+		subscription.m_Snapshot = update->m_Data;
+	}
+	else if (update->m_BaseSequence != subscription.m_Sequence || !StreamDelta::Apply(subscription.m_Snapshot, update->m_Data))
+	{
+		return false;
+	}
+	subscription.m_Sequence = update->m_Sequence;
+
+	// Callbacks may add subscriptions, which moves the others around, so the callback and the snapshot are
+	// taken out while it runs.
+	uint32_t subscriptionID = update->m_SubscriptionID;
+	Callback callback = std::move(subscription.m_Callback);
+	BigArray<uint8_t> snapshot = std::move(subscription.m_Snapshot);
+	uint32_t previousID = m_CallingID;
+	bool wasPreviousRemoved = m_IsCallingRemoved;
+	m_CallingID = subscriptionID;
+	m_IsCallingRemoved = false;
+	callback(snapshot.GetBuffer(), snapshot.Size(), update->m_Sequence);
+	iter = m_Subscriptions.find(subscriptionID);
+	if (m_IsCallingRemoved)
+	{
+		m_Subscriptions.erase(iter);
+	}
+	else
+	{
+		iter->second.m_Callback = std::move(callback);
+		iter->second.m_Snapshot = std::move(snapshot);
+	}
+	m_CallingID = previousID;
+	m_IsCallingRemoved = wasPreviousRemoved;
+	return true;
+}
+
+ANIM_NAMESPACE_END
@@ -0,0 +1,126 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include "animcore/util/namespace.h"
+#include "animcore/containers/array.h"
+#include "animcore/containers/flat_hash_map.h"
+#include "animcore/memory/pointers.h"
+#include "animcore/remoteprotocol/stream_messages.h"
+
+ANIM_NAMESPACE_BEGIN
+
+class Message;
+
+// Server side of stream subscriptions. The engine publishes the latest snapshot of a key from any thread, e.g.
+// the pose of an AnimHandle once per tick, and the server's I/O thread pushes it to every subscriber at the
+// subscriber's rate. Only the latest snapshot is kept: a subscriber whose connection still has unsent data when
+// its update is due skips it, and its next update is a delta against the last snapshot it did get. A client that
+// falls behind receives fewer updates instead of a growing queue.
+class StreamPublisher
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+	// Whether connection can take an update right now.
+	typedef std::function<bool(uint32_t connection)> CanSendCallback;
+	typedef std::function<void(uint32_t connection, const StreamUpdateMessage& update)> SendCallback;
+
+	StreamPublisher();
+	StreamPublisher(const StreamPublisher&) = delete;
+	StreamPublisher& operator=(const StreamPublisher&) = delete;
+
+	// Clients can subscribe to keys of streamID at up to maxRate snapshots per second.
+	void RegisterStream(uint32_t streamID, float maxRate);
+	// Replaces the snapshot of key. Does nothing if nobody subscribed to it.
+	void Publish(uint32_t streamID, uint64_t key, const void* data, uint32_t numBytes);
+	// Lets the engine skip gathering snapshots nobody looks at.
+	bool HasSubscribers(uint32_t streamID, uint64_t key);
+
+	// The rest is called on the server's I/O thread.
+
+	// Answers SubscribeMessage and UnsubscribeMessage of connection. Returns nullptr for any other message.
+	UniquePtr<Message> HandleRequest(uint32_t connection, const Message* msg);
+	// Drops the subscriptions of a connection that was closed.
+	void RemoveConnection(uint32_t connection);
+	// Milliseconds until the next update is due, -1 if there are no subscriptions.
+	int GetMillisecondsUntilDue();
+	// Sends the updates that are due to the connections that can take them.
+	void PushUpdates(const CanSendCallback& canSend, const SendCallback& send);
+
+private:
+	struct Snapshot
+	{
+		BigArray<uint8_t> m_Data;
+		// Incremented by every Publish, 0 until the first one.
+		uint32_t m_Sequence = 0;
+		uint32_t m_NumSubscribers = 0;
+	};
+
+	struct Stream
+	{
+		float m_MaxRate = 0.0f;
+		FlatHashMap<uint64_t, Snapshot> m_Snapshots;
+	};
+
+	struct Subscription
+	{
+		uint32_t m_Connection = 0;
+		uint32_t m_StreamID = 0;
+		uint64_t m_Key = 0;
+		Clock::duration m_Interval;
+		Clock::time_point m_NextUpdate;
+		// The snapshot the client has, the base of the next delta.
+		BigArray<uint8_t> m_LastSent;
+		uint32_t m_LastSequence = 0;
+	};
+
+	UniquePtr<Message> Subscribe(uint32_t connection, const SubscribeMessage& request);
+	FlatHashMap<uint32_t, Subscription>::Iterator Unsubscribe(FlatHashMap<uint32_t, Subscription>::Iterator iter);
+
+	std::mutex m_Mutex;
+	FlatHashMap<uint32_t, Stream> m_Streams;
+	FlatHashMap<uint32_t, Subscription> m_Subscriptions;
+	uint32_t m_NextSubscriptionID;
+	// Reused for every update to keep its buffer.
+	StreamUpdateMessage m_Update;
+};
+
+// Client side of stream subscriptions: rebuilds the snapshots from the updates the server pushes.
+class SubscriptionTable
+{
+public:
+	// Called with the latest snapshot. Sequences count the snapshots published for the key, gaps are snapshots
+	// that were coalesced away.
+	typedef std::function<void(const uint8_t* data, uint32_t numBytes, uint32_t sequence)> Callback;
+
+	SubscriptionTable();
+
+	// Adds the subscription confirmed by response, the answer to a SubscribeMessage. Returns its id, 0 if the
+	// server refused it. rateOut, if not nullptr, receives the rate the server agreed to.
+	uint32_t Add(const Message* response, Callback callback, float* rateOut);
+	// Callbacks may remove their own subscription.
+	void Remove(uint32_t subscriptionID);
+	void Clear();
+	// Applies an update the server pushed and calls the callback of its subscription. Updates of removed
+	// subscriptions are ignored, they may still be on their way. Returns false if msg is not a valid update.
+	bool HandleUpdate(const Message* msg);
+
+	size_t GetNumSubscriptions() const { return m_Subscriptions.size(); }
+
+private:
+	struct Subscription
+	{
+		Callback m_Callback;
+		BigArray<uint8_t> m_Snapshot;
+		uint32_t m_Sequence = 0;
+	};
+
+	FlatHashMap<uint32_t, Subscription> m_Subscriptions;
+	// The subscription whose callback is running, it is removed once the callback returned.
+	uint32_t m_CallingID;
+	bool m_IsCallingRemoved;
+};
+
+ANIM_NAMESPACE_END
@@ -0,0 +1,37 @@
+#pragma once
+#ifndef WIN32
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "animcore/util/namespace.h"
+
+ANIM_NAMESPACE_BEGIN
+
+namespace UnixSocket
+{
+	// Maps a pipe name to a socket address. Only the part after the last backslash is used, so Windows names
+	// like \\.\pipe\animengine work unchanged. Names containing a slash are socket files, anything else goes
+	// into the abstract namespace (Linux), which needs no cleanup when the server dies.
+	// Returns false if the name is too long.
+	inline bool GetAddress(const char* pipeName, sockaddr_un& addrOut, socklen_t& lengthOut, bool& isFileOut)
+	{
+		const char* name = strrchr(pipeName, '\\');
+		name = name != nullptr ? name + 1 : pipeName;
+		size_t nameLength = strlen(name);
+		isFileOut = strchr(name, '/') != nullptr;
+
+		memset(&addrOut, 0, sizeof(addrOut));
+		addrOut.sun_family = AF_UNIX;
+		// Abstract names start with a null byte, file names need room for a null terminator.
+		if (nameLength == 0 || nameLength + 1 > sizeof(addrOut.sun_path))
+			return false;
+		memcpy(addrOut.sun_path + (isFileOut ? 0 : 1), name, nameLength);
+		lengthOut = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + nameLength + 1);
+		return true;
+	}
+}
+
+ANIM_NAMESPACE_END
+
+#endif
@@ -0,0 +1,172 @@
+#include "asset_converter.h"
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#include "animcore/containers/array.h"
+#include "animcore/containers/string.h"
+#include "animcore/memory/intrusive_ptr.h"
+#include "animcore/objectmodel/managed_object.h"
+#include "animcore/serialization/chunked_write_stream.h"
+#include "animcore/serialization/mapped_file.h"
+#include "animcore/serialization/serialization.h"
+#include "animcore/threading/job_system.h"
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+ANIM_NAMESPACE_BEGIN
+
+namespace Serialization
+{
+	namespace
+	{
+#ifdef WIN32
+		void CollectFiles(const SimpleString& directory, BigArray<SimpleString>& filesOut)
+		{
+			WIN32_FIND_DATAA findData;
+			HANDLE handle = FindFirstFileA((directory + "\\*").c_str(), &findData);
+			if (handle == INVALID_HANDLE_VALUE)
+				return;
+			do
+			{
+				if (strcmp(findData.cFileName, ".") == 0 || strcmp(findData.cFileName, "..") == 0)
+					continue;
+				SimpleString path = directory + "\\" + findData.cFileName;
+				if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+					CollectFiles(path, filesOut);
+				else
+					filesOut.Push(std::move(path));
+			} while (FindNextFileA(handle, &findData));
+			FindClose(handle);
+		}
+
+		bool ReplaceFile(const char* from, const char* to)
+		{
+			return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+		}
+#else
+		void CollectFiles(const SimpleString& directory, BigArray<SimpleString>& filesOut)
+		{
+			DIR* dir = opendir(directory.c_str());
+			if (dir == nullptr)
+				return;
+			while (dirent* entry = readdir(dir))
+			{
+				if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+					continue;
+				SimpleString path = directory + "/" + entry->d_name;
+				struct stat info;
+				if (stat(path.c_str(), &info) != 0)
+					continue;
+				if (S_ISDIR(info.st_mode))
+					CollectFiles(path, filesOut);
+				else if (S_ISREG(info.st_mode))
+					filesOut.Push(std::move(path));
+			}
+			closedir(dir);
+		}
+
+		bool ReplaceFile(const char* from, const char* to)
+		{
+			return rename(from, to) == 0;
+		}
+#endif
+
+		bool WriteChunks(const char* path, const ChunkedWriteStream& stream)
+		{
+			FILE* file = fopen(path, "wb");
+			if (file == nullptr)
+				return false;
+			bool succeeded = true;
+			for (uint32_t i = 0; i < stream.GetNumChunks() && succeeded; ++i)
+			{
+				uint32_t size = stream.GetChunkSize(i);
+				succeeded = fwrite(stream.GetChunkData(i), 1, size, file) == size;
+			}
+			return fclose(file) == 0 && succeeded;
+		}
+	}
+
+	bool ConvertAssetFile(const char* path, uint32_t dataVersion, bool& wasUpToDateOut)
+	{
+		wasUpToDateOut = false;
+		ChunkedWriteStream output;
+		{
+			MappedFile file;
+			if (!file.Open(path) || file.GetSize() > UINT32_MAX)
+				return false;
+			MappedReadStream input(file, 0, static_cast<uint32_t>(file.GetSize()));
+			Deserializer res(input);
+			if (!res.IsValid())
+				return false;
+			if (res.GetFormatVersion() == SerializationFormatVersion && res.GetDataVersion() >= dataVersion)
+			{
+				wasUpToDateOut = true;
+				return true;
+			}
+
+			// The object can point into the mapping, so it has to be written out before the file is closed.
+			ManagedObject* data = nullptr;
+			res.Deserialize(data);
+			if (data != nullptr && !res.IsValid())
+			{
+				DefaultAllocator::Destroy(data);
+				data = nullptr;
+			}
+			if (data == nullptr)
+				return false;
+			IntrusivePtr<ManagedObject> object(data);
+
+			Serializer ser(output, dataVersion, res.GetEncodingFlags());
+			ser.Serialize(object.Get());
+		}
+
+		// Writing next to the original and renaming keeps the asset intact if anything fails half way.
+		SimpleString tempPath = SimpleString(path) + ".tmp";
+		if (!WriteChunks(tempPath.c_str(), output) || !ReplaceFile(tempPath.c_str(), path))
+		{
+			remove(tempPath.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	AssetConversionStats ConvertAssetDirectory(const char* directory, uint32_t dataVersion)
+	{
+		BigArray<SimpleString> files;
+		CollectFiles(directory, files);
+
+		std::atomic<uint32_t> numConverted(0);
+		std::atomic<uint32_t> numUpToDate(0);
+		std::atomic<uint32_t> numFailed(0);
+		std::atomic<uint32_t> numPending(files.Size());
+		JobSystem& jobSystem = JobSystem::Instance();
+		for (const SimpleString& path : files)
+		{
+			jobSystem.Schedule([&, path]()
+			{
+				bool wasUpToDate = false;
+				if (!ConvertAssetFile(path.c_str(), dataVersion, wasUpToDate))
+					numFailed.fetch_add(1, std::memory_order_relaxed);
+				else if (wasUpToDate)
+					numUpToDate.fetch_add(1, std::memory_order_relaxed);
+				else
+					numConverted.fetch_add(1, std::memory_order_relaxed);
+				numPending.fetch_sub(1, std::memory_order_release);
+			});
+		}
+		jobSystem.WaitUntil([&]() { return numPending.load(std::memory_order_acquire) == 0; });
+
+		AssetConversionStats stats;
+		stats.m_NumConverted = numConverted.load(std::memory_order_relaxed);
+		stats.m_NumUpToDate = numUpToDate.load(std::memory_order_relaxed);
+		stats.m_NumFailed = numFailed.load(std::memory_order_relaxed);
+		return stats;
+	}
+}
+
+ANIM_NAMESPACE_END
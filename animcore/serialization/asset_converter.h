@@ -0,0 +1,24 @@
+#pragma once
+#include <stdint.h>
+#include "animcore/util/namespace.h"
+
+ANIM_NAMESPACE_BEGIN
+
+namespace Serialization
+{
+	struct AssetConversionStats
+	{
+		uint32_t m_NumConverted = 0;
+		uint32_t m_NumUpToDate = 0;
+		uint32_t m_NumFailed = 0;
+	};
+
+	// Upgrades every asset below directory to the current SerializationFormatVersion and to dataVersion.
+	// Each file is loaded on the JobSystem, so objects migrate their old data in Deserialize exactly as they
+	// would at runtime, and is then written back through a temporary file. Files that are already up to date
+	// are only opened to read their header. Needs the runtime to be initialized.
+	AssetConversionStats ConvertAssetDirectory(const char* directory, uint32_t dataVersion);
+	bool ConvertAssetFile(const char* path, uint32_t dataVersion, bool& wasUpToDateOut);
+}
+
+ANIM_NAMESPACE_END
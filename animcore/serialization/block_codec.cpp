@@ -0,0 +1,273 @@
+#include "block_codec.h"
+#include <string.h>
+#include "animcore/util/assert.h"
+#ifdef ANIM_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+ANIM_NAMESPACE_BEGIN
+
+namespace Serialization
+{
+	namespace
+	{
+		// Format constants from the LZ4 block specification.
+		static constexpr uint32_t Lz4_Min_Match = 4;
+		// The last match has to start at least this far from the end of the block.
+		static constexpr uint32_t Lz4_Match_Start_Limit = 12;
+		// The last bytes of a block are always literals.
+		static constexpr uint32_t Lz4_Last_Literals = 5;
+		static constexpr uint32_t Lz4_Max_Offset = 65535;
+		static constexpr uint32_t Lz4_Hash_Bits = 12;
+
+		inline uint32_t Load32(const uint8_t* src)
+		{
+			uint32_t value;
+			memcpy(&value, src, sizeof(value));
+			return value;
+		}
+
+		inline uint32_t Lz4Hash(uint32_t sequence)
+		{
+			return (sequence * 2654435761u) >> (32 - Lz4_Hash_Bits);
+		}
+
+		inline uint8_t* Lz4WriteLength(uint8_t* dst, uint32_t length)
+		{
+			while (length >= 255)
+			{
+				*dst++ = 255;
+				length -= 255;
+			}
+			*dst++ = static_cast<uint8_t>(length);
+			return dst;
+		}
+
+		// Bytes a length of at least 15 takes after the token.
+		inline uint32_t Lz4GetLengthSize(uint32_t length)
+		{
+			return length >= 15 ? (length - 15) / 255 + 1 : 0;
+		}
+
+		// Exactly what Lz4WriteSequence writes, so a block that fits dstCapacity to the byte is not refused.
+		inline uint32_t Lz4GetSequenceSize(uint32_t numLiterals, uint32_t matchLength)
+		{
+			uint32_t size = 1 + Lz4GetLengthSize(numLiterals) + numLiterals;
+			return matchLength == 0 ? size : size + 2 + Lz4GetLengthSize(matchLength - Lz4_Min_Match);
+		}
+
+		uint8_t* Lz4WriteSequence(uint8_t* dst, const uint8_t* literals, uint32_t numLiterals, uint32_t offset, uint32_t matchLength)
+		{
+			uint8_t* token = dst++;
+			*token = static_cast<uint8_t>((numLiterals < 15 ? numLiterals : 15) << 4);
+			if (numLiterals >= 15)
+			{
+				dst = Lz4WriteLength(dst, numLiterals - 15);
+			}
+			if (numLiterals > 0)
+			{
+				memcpy(dst, literals, numLiterals);
+				dst += numLiterals;
+			}
+			if (matchLength == 0)
+				return dst;
+
+			*dst++ = static_cast<uint8_t>(offset);
+			*dst++ = static_cast<uint8_t>(offset >> 8);
+			uint32_t extraLength = matchLength - Lz4_Min_Match;
+			*token |= static_cast<uint8_t>(extraLength < 15 ? extraLength : 15);
+			if (extraLength >= 15)
+			{
+				dst = Lz4WriteLength(dst, extraLength - 15);
+			}
+			return dst;
+		}
+
+		// Returns 0 if the compressed block would not fit into dstCapacity bytes.
+		uint32_t Lz4Compress(const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t dstCapacity)
+		{
+			uint8_t* out = dst;
+			const uint8_t* outEnd = dst + dstCapacity;
+			uint32_t anchor = 0;
+			if (srcSize > Lz4_Match_Start_Limit)
+			{
+				uint32_t table[1 << Lz4_Hash_Bits] = {};
+				const uint32_t matchStartLimit = srcSize - Lz4_Match_Start_Limit;
+				const uint32_t matchEndLimit = srcSize - Lz4_Last_Literals;
+				uint32_t position = 0;
+				uint32_t numMisses = 0;
+				while (position < matchStartLimit)
+				{
+					const uint32_t sequence = Load32(src + position);
+					const uint32_t hash = Lz4Hash(sequence);
+					const uint32_t candidate = table[hash];
+					table[hash] = position;
+					if (candidate >= position || position - candidate > Lz4_Max_Offset || Load32(src + candidate) != sequence)
+					{
+						// Step further ahead the longer nothing matches, incompressible data gets through quickly.
+						position += 1 + (numMisses++ >> 6);
+						continue;
+					}
+					numMisses = 0;
+
+					uint32_t matchLength = Lz4_Min_Match;
+					while (position + matchLength < matchEndLimit && src[candidate + matchLength] == src[position + matchLength])
+					{
+						++matchLength;
+					}
+					if (Lz4GetSequenceSize(position - anchor, matchLength) > static_cast<size_t>(outEnd - out))
+						return 0;
+					out = Lz4WriteSequence(out, src + anchor, position - anchor, position - candidate, matchLength);
+					position += matchLength;
+					anchor = position;
+				}
+			}
+			if (Lz4GetSequenceSize(srcSize - anchor, 0) > static_cast<size_t>(outEnd - out))
+				return 0;
+			out = Lz4WriteSequence(out, src + anchor, srcSize - anchor, 0, 0);
+			return static_cast<uint32_t>(out - dst);
+		}
+
+		bool Lz4ReadLength(const uint8_t*& src, const uint8_t* srcEnd, uint32_t& length)
+		{
+			uint8_t byte;
+			do
+			{
+				if (src >= srcEnd)
+					return false;
+				byte = *src++;
+				length += byte;
+			} while (byte == 255);
+			return true;
+		}
+
+		bool Lz4Decompress(const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t rawSize)
+		{
+			const uint8_t* srcEnd = src + srcSize;
+			uint32_t position = 0;
+			while (src < srcEnd)
+			{
+				const uint8_t token = *src++;
+				uint32_t numLiterals = token >> 4;
+				if (numLiterals == 15 && !Lz4ReadLength(src, srcEnd, numLiterals))
+					return false;
+				if (numLiterals > static_cast<uint32_t>(srcEnd - src) || numLiterals > rawSize - position)
+					return false;
+				if (numLiterals > 0)
+				{
+					memcpy(dst + position, src, numLiterals);
+					src += numLiterals;
+					position += numLiterals;
+				}
+				if (src == srcEnd)
+					break;
+
+				if (srcEnd - src < 2)
+					return false;
+				const uint32_t offset = src[0] | (static_cast<uint32_t>(src[1]) << 8);
+				src += 2;
+				uint32_t matchLength = token & 15;
+				if (matchLength == 15 && !Lz4ReadLength(src, srcEnd, matchLength))
+					return false;
+				matchLength += Lz4_Min_Match;
+				if (offset == 0 || offset > position || matchLength > rawSize - position)
+					return false;
+
+				const uint8_t* match = dst + position - offset;
+				uint8_t* out = dst + position;
+				if (offset >= matchLength)
+				{
+					memcpy(out, match, matchLength);
+				}
+				else
+				{
+					// Overlapping matches repeat the last offset bytes.
+					for (uint32_t i = 0; i < matchLength; ++i)
+					{
+						out[i] = match[i];
+					}
+				}
+				position += matchLength;
+			}
+			return position == rawSize;
+		}
+	}
+
+	namespace BlockCodec
+	{
+		bool IsAvailable(CompressionCodec codec)
+		{
+			switch (codec)
+			{
+			case CompressionCodec::None:
+			case CompressionCodec::LZ4:
+				return true;
+			case CompressionCodec::Zstd:
+#ifdef ANIM_WITH_ZSTD
+				return true;
+#else
+				return false;
+#endif
+			}
+			return false;
+		}
+
+		uint32_t GetMaxCompressedSize(CompressionCodec codec, uint32_t srcSize)
+		{
+			switch (codec)
+			{
+			case CompressionCodec::LZ4:
+				return srcSize + srcSize / 255 + 16;
+#ifdef ANIM_WITH_ZSTD
+			case CompressionCodec::Zstd:
+				return static_cast<uint32_t>(ZSTD_compressBound(srcSize));
+#endif
+			default:
+				return srcSize;
+			}
+		}
+
+		uint32_t Compress(CompressionCodec codec, const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t dstCapacity)
+		{
+			uint32_t compressedSize = 0;
+			switch (codec)
+			{
+			case CompressionCodec::LZ4:
+				// Blocks that do not get smaller are stored raw anyway, give up as soon as that is certain.
+				compressedSize = Lz4Compress(src, srcSize, dst, dstCapacity < srcSize ? dstCapacity : srcSize);
+				break;
+#ifdef ANIM_WITH_ZSTD
+			case CompressionCodec::Zstd:
+			{
+				size_t result = ZSTD_compress(dst, dstCapacity, src, srcSize, ZSTD_CLEVEL_DEFAULT);
+				compressedSize = ZSTD_isError(result) ? 0 : static_cast<uint32_t>(result);
+				break;
+			}
+#endif
+			default:
+				break;
+			}
+			return compressedSize < srcSize ? compressedSize : 0;
+		}
+
+		bool Decompress(CompressionCodec codec, const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t rawSize)
+		{
+			switch (codec)
+			{
+			case CompressionCodec::LZ4:
+				return Lz4Decompress(src, srcSize, dst, rawSize);
+#ifdef ANIM_WITH_ZSTD
+			case CompressionCodec::Zstd:
+			{
+				size_t result = ZSTD_decompress(dst, rawSize, src, srcSize);
+				return !ZSTD_isError(result) && result == rawSize;
+			}
+#endif
+			default:
+				return false;
+			}
+		}
+	}
+}
+
+ANIM_NAMESPACE_END
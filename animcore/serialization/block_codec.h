@@ -0,0 +1,31 @@
+#pragma once
+#include <stdint.h>
+#include "animcore/util/namespace.h"
+
+ANIM_NAMESPACE_BEGIN
+
+namespace Serialization
+{
+	enum class CompressionCodec : uint8_t
+	{
+		None = 0,
+		// LZ4 block format, built in. Fast enough to decode at close to memory speed.
+		LZ4 = 1,
+		// Smaller but slower, for archives. Needs ANIM_WITH_ZSTD.
+		Zstd = 2,
+	};
+
+	namespace BlockCodec
+	{
+		bool IsAvailable(CompressionCodec codec);
+		// Worst case size of a compressed block of srcSize bytes.
+		uint32_t GetMaxCompressedSize(CompressionCodec codec, uint32_t srcSize);
+		// Returns the compressed size, 0 if the block did not get smaller or did not fit into dstCapacity bytes.
+		// Never writes more than dstCapacity bytes, GetMaxCompressedSize bytes are always enough.
+		uint32_t Compress(CompressionCodec codec, const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t dstCapacity);
+		// False if the block is corrupt or does not decode to exactly rawSize bytes.
+		bool Decompress(CompressionCodec codec, const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t rawSize);
+	}
+}
+
+ANIM_NAMESPACE_END
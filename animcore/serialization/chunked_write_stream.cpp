@@ -0,0 +1,147 @@
+#include "chunked_write_stream.h"
+#include <string.h>
+#include "animcore/memory/default_allocator.h"
+
+ANIM_NAMESPACE_BEGIN
+
+namespace Serialization
+{
+	ChunkedWriteStream::ChunkedWriteStream(uint32_t firstChunkSize)
+		: m_CurrentChunk(0)
+		, m_NumBytesWritten(0)
+		, m_FirstChunkSize(firstChunkSize > 0 ? firstChunkSize : Default_First_Chunk_Size)
+	{
+		Chunk chunk;
+		chunk.m_Data = static_cast<uint8_t*>(DefaultAllocator::Allocate(m_FirstChunkSize));
+		chunk.m_Capacity = m_FirstChunkSize;
+		chunk.m_Size = 0;
+		m_Chunks.Push(chunk);
+	}
+
+	ChunkedWriteStream::~ChunkedWriteStream()
+	{
+		for (auto& chunk : m_Chunks)
+		{
+			DefaultAllocator::Free(chunk.m_Data);
+		}
+	}
+
+	void ChunkedWriteStream::Write(const void* data, uint32_t numBytes)
+	{
+		const uint8_t* src = static_cast<const uint8_t*>(data);
+		m_NumBytesWritten += numBytes;
+		while (numBytes > 0)
+		{
+			Chunk& chunk = m_Chunks[m_CurrentChunk];
+			uint32_t available = chunk.m_Capacity - chunk.m_Size;
+			if (numBytes <= available)
+			{
+				memcpy(chunk.m_Data + chunk.m_Size, src, numBytes);
+				chunk.m_Size += numBytes;
+				return;
+			}
+			memcpy(chunk.m_Data + chunk.m_Size, src, available);
+			chunk.m_Size += available;
+			src += available;
+			numBytes -= available;
+			AdvanceChunk(1);
+		}
+	}
+
+	void ChunkedWriteStream::Reserve(uint32_t numBytes)
+	{
+		const Chunk& chunk = m_Chunks[m_CurrentChunk];
+		if (chunk.m_Capacity - chunk.m_Size < numBytes)
+		{
+			AdvanceChunk(numBytes);
+		}
+	}
+
+	void ChunkedWriteStream::Reset()
+	{
+		for (uint32_t i = 0; i <= m_CurrentChunk; ++i)
+		{
+			m_Chunks[i].m_Size = 0;
+		}
+		m_CurrentChunk = 0;
+		m_NumBytesWritten = 0;
+	}
+
+	void ChunkedWriteStream::Patch(uint32_t position, const void* data, uint32_t numBytes)
+	{
+		ANIM_ASSERT(position + numBytes <= m_NumBytesWritten);
+		const uint8_t* src = static_cast<const uint8_t*>(data);
+		for (uint32_t i = 0; i <= m_CurrentChunk && numBytes > 0; ++i)
+		{
+			const Chunk& chunk = m_Chunks[i];
+			if (position >= chunk.m_Size)
+			{
+				position -= chunk.m_Size;
+				continue;
+			}
+			uint32_t count = chunk.m_Size - position < numBytes ? chunk.m_Size - position : numBytes;
+			memcpy(chunk.m_Data + position, src, count);
+			src += count;
+			numBytes -= count;
+			position = 0;
+		}
+	}
+
+	void ChunkedWriteStream::Truncate(uint32_t numBytes)
+	{
+		ANIM_ASSERT(numBytes <= m_NumBytesWritten);
+		m_NumBytesWritten = numBytes;
+		uint32_t last = 0;
+		while (last < m_CurrentChunk && numBytes > m_Chunks[last].m_Size)
+		{
+			numBytes -= m_Chunks[last].m_Size;
+			++last;
+		}
+		m_Chunks[last].m_Size = numBytes;
+		for (uint32_t i = last + 1; i <= m_CurrentChunk; ++i)
+		{
+			m_Chunks[i].m_Size = 0;
+		}
+		m_CurrentChunk = last;
+	}
+
+	void ChunkedWriteStream::CopyTo(void* dst) const
+	{
+		uint8_t* out = static_cast<uint8_t*>(dst);
+		for (uint32_t i = 0; i <= m_CurrentChunk; ++i)
+		{
+			memcpy(out, m_Chunks[i].m_Data, m_Chunks[i].m_Size);
+			out += m_Chunks[i].m_Size;
+		}
+	}
+
+	void ChunkedWriteStream::AdvanceChunk(uint32_t minCapacity)
+	{
+		++m_CurrentChunk;
+		if (m_CurrentChunk < m_Chunks.Size())
+		{
+			Chunk& chunk = m_Chunks[m_CurrentChunk];
+			if (chunk.m_Capacity >= minCapacity)
+				return;
+			// A leftover chunk that is too small for the reservation is replaced.
+			DefaultAllocator::Free(chunk.m_Data);
+			chunk.m_Data = static_cast<uint8_t*>(DefaultAllocator::Allocate(minCapacity));
+			chunk.m_Capacity = minCapacity;
+			return;
+		}
+
+		uint32_t capacity = m_Chunks[m_CurrentChunk - 1].m_Capacity;
+		capacity = capacity < Max_Chunk_Size / 2 ? capacity * 2 : Max_Chunk_Size;
+		if (capacity < minCapacity)
+		{
+			capacity = minCapacity;
+		}
+		Chunk chunk;
+		chunk.m_Data = static_cast<uint8_t*>(DefaultAllocator::Allocate(capacity));
+		chunk.m_Capacity = capacity;
+		chunk.m_Size = 0;
+		m_Chunks.Push(chunk);
+	}
+}
+
+ANIM_NAMESPACE_END
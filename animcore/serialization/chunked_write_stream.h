@@ -0,0 +1,59 @@
+#pragma once
+#include <stdint.h>
+#include "animcore/util/namespace.h"
+#include "animcore/containers/array.h"
+#include "animcore/serialization/serialization.h"
+
+ANIM_NAMESPACE_BEGIN
+
+namespace Serialization
+{
+	// Write stream that grows by appending chunks instead of reallocating, so bytes are only ever copied once
+	// and the Serializer does not need to know the final size up front. Chunk sizes double up to
+	// Max_Chunk_Size. Reset keeps the chunks around so a stream can be reused without allocating.
+	class ChunkedWriteStream : public IWriteStream
+	{
+	public:
+		static constexpr uint32_t Default_First_Chunk_Size = 4 * 1024;
+		static constexpr uint32_t Max_Chunk_Size = 1024 * 1024;
+
+		explicit ChunkedWriteStream(uint32_t firstChunkSize = Default_First_Chunk_Size);
+		~ChunkedWriteStream();
+		ChunkedWriteStream(const ChunkedWriteStream&) = delete;
+		ChunkedWriteStream& operator=(const ChunkedWriteStream&) = delete;
+
+		virtual void Write(const void* data, uint32_t numBytes) override;
+		// Makes sure the next numBytes are written into a single chunk.
+		virtual void Reserve(uint32_t numBytes) override;
+		virtual void Reset() override;
+		virtual uint32_t GetNumBytesWritten() const override { return m_NumBytesWritten; }
+		virtual void Patch(uint32_t position, const void* data, uint32_t numBytes) override;
+		// Drops everything written after the first numBytes, keeping the chunks.
+		void Truncate(uint32_t numBytes);
+
+		// Chunks past the current one are empty leftovers from before the last Reset.
+		uint32_t GetNumChunks() const { return m_CurrentChunk + 1; }
+		const uint8_t* GetChunkData(uint32_t index) const { return m_Chunks[index].m_Data; }
+		uint32_t GetChunkSize(uint32_t index) const { return m_Chunks[index].m_Size; }
+
+		// dst must hold at least GetNumBytesWritten bytes.
+		void CopyTo(void* dst) const;
+
+	private:
+		struct Chunk
+		{
+			uint8_t* m_Data;
+			uint32_t m_Capacity;
+			uint32_t m_Size;
+		};
+
+		void AdvanceChunk(uint32_t minCapacity);
+
+		Array<Chunk> m_Chunks;
+		uint32_t m_CurrentChunk;
+		uint32_t m_NumBytesWritten;
+		uint32_t m_FirstChunkSize;
+	};
+}
+
+ANIM_NAMESPACE_END
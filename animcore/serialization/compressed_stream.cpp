@@ -0,0 +1,446 @@
+#include "compressed_stream.h"
+#include <atomic>
+#include <functional>
+#include <string.h>
+#include "animcore/threading/job_system.h"
+
+ANIM_NAMESPACE_BEGIN
+
+namespace Serialization
+{
+	namespace
+	{
+		struct StreamHeader
+		{
+			uint32_t m_Magic;
+			uint8_t m_Codec;
+			uint8_t m_Reserved[3];
+			uint32_t m_BlockSize;
+		};
+
+		struct BlockHeader
+		{
+			uint32_t m_RawSize;
+			uint32_t m_StoredSize;
+		};
+
+		struct StreamFooter
+		{
+			uint32_t m_NumBlocks;
+			uint32_t m_Reserved;
+			uint64_t m_IndexOffset;
+			uint32_t m_Magic;
+		};
+
+		static constexpr uint32_t Stream_Header_Size = 12;
+		static constexpr uint32_t Block_Header_Size = 8;
+		static constexpr uint32_t Stream_Footer_Size = 20;
+
+		// The structs are read and written field by field, the data in the stream is not aligned.
+		template <typename T>
+		T Load(const uint8_t* src)
+		{
+			T value;
+			memcpy(&value, src, sizeof(value));
+			return value;
+		}
+
+		// Runs work for every index in [0, count), spread over the JobSystem when it is running.
+		void RunParallel(uint32_t count, const std::function<void(uint32_t)>& work)
+		{
+			if (count < 2 || !JobSystem::IsInitialized())
+			{
+				for (uint32_t i = 0; i < count; ++i)
+				{
+					work(i);
+				}
+				return;
+			}
+			JobSystem& jobSystem = JobSystem::Instance();
+			std::atomic<uint32_t> numPending(count);
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				jobSystem.Schedule([&work, &numPending, i]()
+				{
+					work(i);
+					numPending.fetch_sub(1, std::memory_order_release);
+				});
+			}
+			jobSystem.WaitUntil([&numPending]() { return numPending.load(std::memory_order_acquire) == 0; });
+		}
+	}
+
+	CompressedWriteStream::CompressedWriteStream(IWriteStream& output, CompressionCodec codec, uint32_t blockSize)
+		: m_Output(output)
+		, m_Codec(codec)
+		, m_BlockSize(blockSize > 0 ? blockSize : Default_Compressed_Block_Size)
+		, m_OutputPosition(0)
+		, m_NumFlushedBytes(0)
+		, m_IsFinished(false)
+	{
+		if (!BlockCodec::IsAvailable(m_Codec))
+		{
+			// Streams a build without the codec could not read back are worse than a bigger file.
+			ANIM_ASSERT(false);
+			m_Codec = CompressionCodec::LZ4;
+		}
+		WriteHeader();
+	}
+
+	CompressedWriteStream::~CompressedWriteStream()
+	{
+		if (!m_IsFinished)
+		{
+			Finish();
+		}
+	}
+
+	void CompressedWriteStream::Write(const void* data, uint32_t numBytes)
+	{
+		ANIM_ASSERT(!m_IsFinished);
+		uint32_t offset = m_Pending.Size();
+		if (offset + numBytes > m_Pending.Capacity())
+		{
+			// Resize only reserves what it needs, grow ahead so small writes stay cheap.
+			uint32_t capacity = m_Pending.Capacity() * 2;
+			m_Pending.Reserve(capacity > offset + numBytes ? capacity : offset + numBytes);
+		}
+		m_Pending.Resize(offset + numBytes);
+		memcpy(m_Pending.GetBuffer() + offset, data, numBytes);
+	}
+
+	void CompressedWriteStream::Reset()
+	{
+		m_Output.Reset();
+		m_Pending.Clear();
+		m_BlockOffsets.Clear();
+		m_OutputPosition = 0;
+		m_NumFlushedBytes = 0;
+		m_IsFinished = false;
+		WriteHeader();
+	}
+
+	void CompressedWriteStream::Patch(uint32_t position, const void* data, uint32_t numBytes)
+	{
+		// Anything before the last Flush is already compressed.
+		ANIM_ASSERT(position >= m_NumFlushedBytes && position + numBytes <= GetNumBytesWritten());
+		memcpy(m_Pending.GetBuffer() + (position - m_NumFlushedBytes), data, numBytes);
+	}
+
+	void CompressedWriteStream::Flush()
+	{
+		uint32_t numBytes = m_Pending.Size() - m_Pending.Size() % m_BlockSize;
+		if (numBytes == 0)
+			return;
+		CompressBlocks(numBytes);
+		uint32_t remaining = m_Pending.Size() - numBytes;
+		memmove(m_Pending.GetBuffer(), m_Pending.GetBuffer() + numBytes, remaining);
+		m_Pending.Resize(remaining);
+	}
+
+	void CompressedWriteStream::Finish()
+	{
+		ANIM_ASSERT(!m_IsFinished);
+		CompressBlocks(m_Pending.Size());
+		m_Pending.Clear();
+
+		BlockHeader end = { 0, 0 };
+		WriteOutput(&end.m_RawSize, sizeof(end.m_RawSize));
+		StreamFooter footer;
+		footer.m_NumBlocks = m_BlockOffsets.Size();
+		footer.m_Reserved = 0;
+		footer.m_IndexOffset = m_OutputPosition;
+		footer.m_Magic = Compressed_Stream_Magic;
+		if (m_BlockOffsets.Size() > 0)
+		{
+			WriteOutput(m_BlockOffsets.GetBuffer(), m_BlockOffsets.Size() * sizeof(uint64_t));
+		}
+		WriteOutput(&footer.m_NumBlocks, sizeof(footer.m_NumBlocks));
+		WriteOutput(&footer.m_IndexOffset, sizeof(footer.m_IndexOffset));
+		WriteOutput(&footer.m_Reserved, sizeof(footer.m_Reserved));
+		WriteOutput(&footer.m_Magic, sizeof(footer.m_Magic));
+		m_IsFinished = true;
+	}
+
+	void CompressedWriteStream::WriteHeader()
+	{
+		StreamHeader header = {};
+		header.m_Magic = Compressed_Stream_Magic;
+		header.m_Codec = static_cast<uint8_t>(m_Codec);
+		header.m_BlockSize = m_BlockSize;
+		WriteOutput(&header.m_Magic, sizeof(header.m_Magic));
+		WriteOutput(&header.m_Codec, sizeof(header.m_Codec));
+		WriteOutput(header.m_Reserved, sizeof(header.m_Reserved));
+		WriteOutput(&header.m_BlockSize, sizeof(header.m_BlockSize));
+	}
+
+	void CompressedWriteStream::CompressBlocks(uint32_t numBytes)
+	{
+		if (numBytes == 0)
+			return;
+		const uint32_t numBlocks = (numBytes + m_BlockSize - 1) / m_BlockSize;
+		const uint32_t maxCompressedSize = BlockCodec::GetMaxCompressedSize(m_Codec, m_BlockSize);
+		m_Compressed.Resize(numBlocks * (maxCompressedSize + Block_Header_Size));
+
+		// Every block gets a slot big enough for its worst case, so they can all be compressed at once.
+		const uint8_t* raw = m_Pending.GetBuffer();
+		uint8_t* slots = m_Compressed.GetBuffer();
+		const uint32_t slotSize = maxCompressedSize + Block_Header_Size;
+		const uint32_t blockSize = m_BlockSize;
+		const CompressionCodec codec = m_Codec;
+		RunParallel(numBlocks, [=](uint32_t index)
+		{
+			uint32_t offset = index * blockSize;
+			BlockHeader header;
+			header.m_RawSize = numBytes - offset < blockSize ? numBytes - offset : blockSize;
+			uint8_t* slot = slots + index * slotSize;
+			header.m_StoredSize = BlockCodec::Compress(codec, raw + offset, header.m_RawSize, slot + Block_Header_Size, maxCompressedSize);
+			// Blocks that do not get smaller are stored as they are, readers tell them apart by the equal sizes.
+			if (header.m_StoredSize == 0 || header.m_StoredSize >= header.m_RawSize)
+			{
+				header.m_StoredSize = header.m_RawSize;
+				memcpy(slot + Block_Header_Size, raw + offset, header.m_RawSize);
+			}
+			memcpy(slot, &header.m_RawSize, sizeof(header.m_RawSize));
+			memcpy(slot + sizeof(header.m_RawSize), &header.m_StoredSize, sizeof(header.m_StoredSize));
+		});
+
+		for (uint32_t i = 0; i < numBlocks; ++i)
+		{
+			const uint8_t* slot = slots + i * slotSize;
+			m_BlockOffsets.Push(m_OutputPosition);
+			WriteOutput(slot, Block_Header_Size + Load<uint32_t>(slot + sizeof(uint32_t)));
+		}
+		m_NumFlushedBytes += numBytes;
+	}
+
+	void CompressedWriteStream::WriteOutput(const void* data, uint32_t numBytes)
+	{
+		m_Output.Write(data, numBytes);
+		m_OutputPosition += numBytes;
+	}
+
+	CompressedReadStream::CompressedReadStream(IReadStream& input)
+		: m_Input(input)
+		, m_Codec(CompressionCodec::None)
+		, m_BlockSize(0)
+		, m_BlockPosition(0)
+		, m_NumBytesRead(0)
+		, m_IsValid(false)
+		, m_HasFailed(false)
+	{
+		ReadHeader();
+	}
+
+	void CompressedReadStream::Read(void* dst, uint32_t numBytes)
+	{
+		uint8_t* out = static_cast<uint8_t*>(dst);
+		m_NumBytesRead += numBytes;
+		while (numBytes > 0)
+		{
+			if (m_BlockPosition == m_Block.Size() && !DecodeNextBlock())
+			{
+				memset(out, 0, numBytes);
+				return;
+			}
+			uint32_t available = m_Block.Size() - m_BlockPosition;
+			uint32_t count = numBytes < available ? numBytes : available;
+			memcpy(out, m_Block.GetBuffer() + m_BlockPosition, count);
+			m_BlockPosition += count;
+			out += count;
+			numBytes -= count;
+		}
+	}
+
+	void CompressedReadStream::Skip(uint32_t numBytes)
+	{
+		m_NumBytesRead += numBytes;
+		uint32_t available = m_Block.Size() - m_BlockPosition;
+		if (numBytes <= available)
+		{
+			m_BlockPosition += numBytes;
+			return;
+		}
+		numBytes -= available;
+		m_BlockPosition = m_Block.Size();
+		while (numBytes > 0 && !m_HasFailed)
+		{
+			uint32_t rawSize = 0;
+			uint32_t storedSize = 0;
+			if (!ReadBlockHeader(rawSize, storedSize))
+				return;
+			if (numBytes >= rawSize)
+			{
+				m_Input.Skip(storedSize);
+				numBytes -= rawSize;
+				continue;
+			}
+			// The skip ends inside this block, it has to be decoded after all.
+			m_Compressed.Resize(storedSize);
+			m_Input.Read(m_Compressed.GetBuffer(), storedSize);
+			m_Block.Resize(rawSize);
+			if (storedSize == rawSize)
+			{
+				memcpy(m_Block.GetBuffer(), m_Compressed.GetBuffer(), rawSize);
+			}
+			else if (!BlockCodec::Decompress(m_Codec, m_Compressed.GetBuffer(), storedSize, m_Block.GetBuffer(), rawSize))
+			{
+				m_HasFailed = true;
+				m_Block.Clear();
+				m_BlockPosition = 0;
+				return;
+			}
+			m_BlockPosition = numBytes;
+			return;
+		}
+	}
+
+	void CompressedReadStream::Reset()
+	{
+		m_Input.Reset();
+		m_Block.Clear();
+		m_BlockPosition = 0;
+		m_NumBytesRead = 0;
+		m_HasFailed = false;
+		ReadHeader();
+	}
+
+	void CompressedReadStream::ReadHeader()
+	{
+		StreamHeader header = {};
+		m_Input.Read(&header.m_Magic, sizeof(header.m_Magic));
+		m_Input.Read(&header.m_Codec, sizeof(header.m_Codec));
+		m_Input.Read(header.m_Reserved, sizeof(header.m_Reserved));
+		m_Input.Read(&header.m_BlockSize, sizeof(header.m_BlockSize));
+		m_Codec = static_cast<CompressionCodec>(header.m_Codec);
+		m_BlockSize = header.m_BlockSize;
+		m_IsValid = header.m_Magic == Compressed_Stream_Magic && BlockCodec::IsAvailable(m_Codec) && m_BlockSize > 0;
+		m_HasFailed = !m_IsValid;
+	}
+
+	bool CompressedReadStream::ReadBlockHeader(uint32_t& rawSizeOut, uint32_t& storedSizeOut)
+	{
+		if (m_HasFailed)
+			return false;
+		m_Input.Read(&rawSizeOut, sizeof(rawSizeOut));
+		if (rawSizeOut == 0)
+		{
+			// Reading past the end.
+			m_HasFailed = true;
+			return false;
+		}
+		m_Input.Read(&storedSizeOut, sizeof(storedSizeOut));
+		if (rawSizeOut > m_BlockSize || storedSizeOut > rawSizeOut)
+		{
+			m_HasFailed = true;
+			return false;
+		}
+		return true;
+	}
+
+	bool CompressedReadStream::DecodeNextBlock()
+	{
+		uint32_t rawSize = 0;
+		uint32_t storedSize = 0;
+		if (!ReadBlockHeader(rawSize, storedSize))
+			return false;
+
+		m_Block.Resize(rawSize);
+		m_BlockPosition = 0;
+		if (storedSize == rawSize)
+		{
+			m_Input.Read(m_Block.GetBuffer(), rawSize);
+			return true;
+		}
+		m_Compressed.Resize(storedSize);
+		m_Input.Read(m_Compressed.GetBuffer(), storedSize);
+		if (!BlockCodec::Decompress(m_Codec, m_Compressed.GetBuffer(), storedSize, m_Block.GetBuffer(), rawSize))
+		{
+			m_HasFailed = true;
+			m_Block.Clear();
+			return false;
+		}
+		return true;
+	}
+
+	namespace
+	{
+		// Checks the header and footer and finds the index, false if data is not a complete compressed stream.
+		bool ReadLayout(const uint8_t* data, uint64_t size, StreamHeader& headerOut, StreamFooter& footerOut)
+		{
+			if (size < Stream_Header_Size + sizeof(uint32_t) + Stream_Footer_Size)
+				return false;
+			headerOut.m_Magic = Load<uint32_t>(data);
+			headerOut.m_Codec = data[4];
+			headerOut.m_BlockSize = Load<uint32_t>(data + 8);
+			const uint8_t* footer = data + size - Stream_Footer_Size;
+			footerOut.m_NumBlocks = Load<uint32_t>(footer);
+			footerOut.m_IndexOffset = Load<uint64_t>(footer + 4);
+			footerOut.m_Magic = Load<uint32_t>(footer + 16);
+			return headerOut.m_Magic == Compressed_Stream_Magic && footerOut.m_Magic == Compressed_Stream_Magic &&
+				headerOut.m_BlockSize > 0 &&
+				footerOut.m_IndexOffset + uint64_t(footerOut.m_NumBlocks) * sizeof(uint64_t) == size - Stream_Footer_Size;
+		}
+	}
+
+	uint64_t GetDecompressedSize(const uint8_t* data, uint64_t size)
+	{
+		StreamHeader header;
+		StreamFooter footer;
+		if (!ReadLayout(data, size, header, footer) || footer.m_NumBlocks == 0)
+			return 0;
+		// Every block but the last is full.
+		uint64_t lastBlock = Load<uint64_t>(data + footer.m_IndexOffset + (footer.m_NumBlocks - 1) * sizeof(uint64_t));
+		if (lastBlock + Block_Header_Size > footer.m_IndexOffset)
+			return 0;
+		return uint64_t(footer.m_NumBlocks - 1) * header.m_BlockSize + Load<uint32_t>(data + lastBlock);
+	}
+
+	bool DecompressParallel(const uint8_t* data, uint64_t size, uint8_t* output)
+	{
+		StreamHeader header;
+		StreamFooter footer;
+		if (!ReadLayout(data, size, header, footer))
+			return false;
+		const CompressionCodec codec = static_cast<CompressionCodec>(header.m_Codec);
+		if (!BlockCodec::IsAvailable(codec))
+			return false;
+
+		std::atomic<bool> succeeded(true);
+		const uint8_t* index = data + footer.m_IndexOffset;
+		const uint64_t indexOffset = footer.m_IndexOffset;
+		const uint32_t numBlocks = footer.m_NumBlocks;
+		const uint32_t blockSize = header.m_BlockSize;
+		RunParallel(numBlocks, [&, data, index, indexOffset, numBlocks, blockSize, codec](uint32_t i)
+		{
+			uint64_t offset = Load<uint64_t>(index + i * sizeof(uint64_t));
+			if (offset + Block_Header_Size > indexOffset)
+			{
+				succeeded.store(false, std::memory_order_relaxed);
+				return;
+			}
+			const uint32_t rawSize = Load<uint32_t>(data + offset);
+			const uint32_t storedSize = Load<uint32_t>(data + offset + sizeof(uint32_t));
+			const uint8_t* stored = data + offset + Block_Header_Size;
+			uint8_t* dst = output + uint64_t(i) * blockSize;
+			bool isSizeValid = rawSize > 0 && (rawSize == blockSize || (i == numBlocks - 1 && rawSize < blockSize)) &&
+				storedSize <= rawSize && storedSize <= indexOffset - offset - Block_Header_Size;
+			if (!isSizeValid)
+			{
+				succeeded.store(false, std::memory_order_relaxed);
+				return;
+			}
+			if (storedSize == rawSize)
+			{
+				memcpy(dst, stored, rawSize);
+			}
+			else if (!BlockCodec::Decompress(codec, stored, storedSize, dst, rawSize))
+			{
+				succeeded.store(false, std::memory_order_relaxed);
+			}
+		});
+		return succeeded.load(std::memory_order_relaxed);
+	}
+}
+
+ANIM_NAMESPACE_END
@@ -0,0 +1,107 @@
+#pragma once
+#include <stdint.h>
+#include "animcore/util/namespace.h"
+#include "animcore/containers/array.h"
+#include "animcore/serialization/block_codec.h"
+#include "animcore/serialization/serialization.h"
+
+ANIM_NAMESPACE_BEGIN
+
+namespace Serialization
+{
+	// Block compressed streams. Data is cut into blocks of a fixed raw size that are compressed on their own,
+	// so a reader can start at any block and a whole stream in memory can be decoded on every core at once
+	// with DecompressParallel. Layout:
+	//	header:	magic, codec, block size
+	//	blocks:	raw size, stored size, data (stored uncompressed when the stored size equals the raw size)
+	//	end:	raw size 0
+	//	index:	offset of every block from the start of the stream
+	//	footer:	number of blocks, offset of the index, magic
+	// Positions seen by the Serializer are positions in the uncompressed data, so alignment still works.
+	static constexpr uint32_t Compressed_Stream_Magic = 0x5A434E41; // "ANCZ"
+	static constexpr uint32_t Default_Compressed_Block_Size = 256 * 1024;
+
+	// Keeps written data uncompressed until Flush or Finish, so Patch works on anything after the last Flush.
+	// Only Flush while no Serializer field or sized block is open. Finish compresses the remaining blocks on
+	// the JobSystem when it is running.
+	class CompressedWriteStream : public IWriteStream
+	{
+	public:
+		CompressedWriteStream(IWriteStream& output, CompressionCodec codec, uint32_t blockSize = Default_Compressed_Block_Size);
+		// Finishes the stream if that was not done yet.
+		~CompressedWriteStream();
+		CompressedWriteStream(const CompressedWriteStream&) = delete;
+		CompressedWriteStream& operator=(const CompressedWriteStream&) = delete;
+
+		virtual void Write(const void* data, uint32_t numBytes) override;
+		virtual void Reserve(uint32_t) override {}
+		// Resets the output stream too and starts a new compressed stream.
+		virtual void Reset() override;
+		virtual uint32_t GetNumBytesWritten() const override { return m_NumFlushedBytes + m_Pending.Size(); }
+		virtual void Patch(uint32_t position, const void* data, uint32_t numBytes) override;
+
+		// Compresses and writes out every complete block.
+		void Flush();
+		// Writes the last block, the index and the footer. Nothing can be written afterwards.
+		void Finish();
+
+		CompressionCodec GetCodec() const { return m_Codec; }
+
+	private:
+		void WriteHeader();
+		void CompressBlocks(uint32_t numBytes);
+		void WriteOutput(const void* data, uint32_t numBytes);
+
+		IWriteStream& m_Output;
+		CompressionCodec m_Codec;
+		uint32_t m_BlockSize;
+		BigArray<uint8_t> m_Pending;
+		BigArray<uint8_t> m_Compressed;
+		BigArray<uint64_t> m_BlockOffsets;
+		uint64_t m_OutputPosition;
+		uint32_t m_NumFlushedBytes;
+		bool m_IsFinished;
+	};
+
+	// Decodes one block at a time while reading, so memory use does not depend on the size of the stream.
+	class CompressedReadStream : public IReadStream
+	{
+	public:
+		explicit CompressedReadStream(IReadStream& input);
+
+		virtual void Read(void* dst, uint32_t numBytes) override;
+		// Blocks that are skipped completely are not decoded.
+		virtual void Skip(uint32_t numBytes) override;
+		virtual void Reset() override;
+		virtual uint32_t GetNumBytesRead() const override { return m_NumBytesRead; }
+
+		bool IsValid() const { return m_IsValid; }
+		// Set when the data is corrupt or read past its end, reads return zeros from then on.
+		bool HasFailed() const { return m_HasFailed; }
+
+	private:
+		void ReadHeader();
+		// Fails the stream on sizes no writer produces, so a corrupt header cannot make it allocate or read
+		// more than one block.
+		bool ReadBlockHeader(uint32_t& rawSizeOut, uint32_t& storedSizeOut);
+		bool DecodeNextBlock();
+
+		IReadStream& m_Input;
+		CompressionCodec m_Codec;
+		uint32_t m_BlockSize;
+		BigArray<uint8_t> m_Block;
+		BigArray<uint8_t> m_Compressed;
+		uint32_t m_BlockPosition;
+		uint32_t m_NumBytesRead;
+		bool m_IsValid;
+		bool m_HasFailed;
+	};
+
+	// Size of the uncompressed data of a complete compressed stream, 0 if data is not one.
+	uint64_t GetDecompressedSize(const uint8_t* data, uint64_t size);
+	// Decodes every block of a complete compressed stream as its own JobSystem job, or on the calling thread
+	// when the JobSystem is not running. output has to hold GetDecompressedSize bytes.
+	bool DecompressParallel(const uint8_t* data, uint64_t size, uint8_t* output);
+}
+
+ANIM_NAMESPACE_END
@@ -0,0 +1,111 @@
+#include "file_stream.h"
+#include <string.h>
+
+ANIM_NAMESPACE_BEGIN
+
+namespace Serialization
+{
+	FileWriteStream::FileWriteStream(const char* path)
+		: m_Path(path)
+		, m_File(fopen(path, "wb"))
+		, m_NumBytesWritten(0)
+		, m_HasFailed(m_File == nullptr)
+	{
+	}
+
+	FileWriteStream::~FileWriteStream()
+	{
+		Close();
+	}
+
+	void FileWriteStream::Write(const void* data, uint32_t numBytes)
+	{
+		m_NumBytesWritten += numBytes;
+		if (m_File == nullptr || fwrite(data, 1, numBytes, m_File) != numBytes)
+		{
+			m_HasFailed = true;
+		}
+	}
+
+	void FileWriteStream::Reset()
+	{
+		if (m_File != nullptr)
+		{
+			m_File = freopen(m_Path.c_str(), "wb", m_File);
+		}
+		m_NumBytesWritten = 0;
+		m_HasFailed = m_File == nullptr;
+	}
+
+	void FileWriteStream::Patch(uint32_t position, const void* data, uint32_t numBytes)
+	{
+		ANIM_ASSERT(position + numBytes <= m_NumBytesWritten);
+		if (m_File == nullptr)
+			return;
+		if (fseek(m_File, static_cast<long>(position), SEEK_SET) != 0 ||
+			fwrite(data, 1, numBytes, m_File) != numBytes ||
+			fseek(m_File, 0, SEEK_END) != 0)
+		{
+			m_HasFailed = true;
+		}
+	}
+
+	bool FileWriteStream::Close()
+	{
+		if (m_File != nullptr)
+		{
+			if (fclose(m_File) != 0)
+			{
+				m_HasFailed = true;
+			}
+			m_File = nullptr;
+		}
+		return !m_HasFailed;
+	}
+
+	FileReadStream::FileReadStream(const char* path)
+		: m_File(fopen(path, "rb"))
+		, m_NumBytesRead(0)
+		, m_HasFailed(m_File == nullptr)
+	{
+	}
+
+	FileReadStream::~FileReadStream()
+	{
+		if (m_File != nullptr)
+		{
+			fclose(m_File);
+		}
+	}
+
+	void FileReadStream::Read(void* dst, uint32_t numBytes)
+	{
+		size_t numRead = m_File != nullptr ? fread(dst, 1, numBytes, m_File) : 0;
+		if (numRead != numBytes)
+		{
+			memset(static_cast<uint8_t*>(dst) + numRead, 0, numBytes - numRead);
+			m_HasFailed = true;
+		}
+		m_NumBytesRead += numBytes;
+	}
+
+	void FileReadStream::Skip(uint32_t numBytes)
+	{
+		if (m_File == nullptr || fseek(m_File, static_cast<long>(numBytes), SEEK_CUR) != 0)
+		{
+			m_HasFailed = true;
+		}
+		m_NumBytesRead += numBytes;
+	}
+
+	void FileReadStream::Reset()
+	{
+		if (m_File != nullptr)
+		{
+			rewind(m_File);
+		}
+		m_NumBytesRead = 0;
+	}
+}
+
+ANIM_NAMESPACE_END
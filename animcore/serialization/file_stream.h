@@ -0,0 +1,65 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include "animcore/util/namespace.h"
+#include "animcore/containers/string.h"
+#include "animcore/serialization/serialization.h"
+
+ANIM_NAMESPACE_BEGIN
+
+namespace Serialization
+{
+	// Buffered through stdio. Check IsOpen after constructing and HasFailed once done, the streams themselves
+	// keep going after an error.
+	class FileWriteStream : public IWriteStream
+	{
+	public:
+		explicit FileWriteStream(const char* path);
+		~FileWriteStream();
+		FileWriteStream(const FileWriteStream&) = delete;
+		FileWriteStream& operator=(const FileWriteStream&) = delete;
+
+		virtual void Write(const void* data, uint32_t numBytes) override;
+		virtual void Reserve(uint32_t) override {}
+		// Truncates the file.
+		virtual void Reset() override;
+		virtual uint32_t GetNumBytesWritten() const override { return m_NumBytesWritten; }
+		virtual void Patch(uint32_t position, const void* data, uint32_t numBytes) override;
+
+		bool IsOpen() const { return m_File != nullptr; }
+		bool HasFailed() const { return m_HasFailed; }
+		// Flushes and closes the file, false if anything could not be written.
+		bool Close();
+
+	private:
+		SimpleString m_Path;
+		FILE* m_File;
+		uint32_t m_NumBytesWritten;
+		bool m_HasFailed;
+	};
+
+	// Reads past the end of the file return zeros and set HasFailed.
+	class FileReadStream : public IReadStream
+	{
+	public:
+		explicit FileReadStream(const char* path);
+		~FileReadStream();
+		FileReadStream(const FileReadStream&) = delete;
+		FileReadStream& operator=(const FileReadStream&) = delete;
+
+		virtual void Read(void* dst, uint32_t numBytes) override;
+		virtual void Skip(uint32_t numBytes) override;
+		virtual void Reset() override;
+		virtual uint32_t GetNumBytesRead() const override { return m_NumBytesRead; }
+
+		bool IsOpen() const { return m_File != nullptr; }
+		bool HasFailed() const { return m_HasFailed; }
+
+	private:
+		FILE* m_File;
+		uint32_t m_NumBytesRead;
+		bool m_HasFailed;
+	};
+}
+
+ANIM_NAMESPACE_END
@@ -0,0 +1,10 @@
+#include "i_serializable.h"
+
+ANIM_NAMESPACE_BEGIN
+
+namespace Serialization
+{
+	IMPLEMENT_ABSTRACT_ROOT_CLASS(ISerializable);
+}
+
+ANIM_NAMESPACE_END
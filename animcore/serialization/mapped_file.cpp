@@ -0,0 +1,175 @@
+#include "mapped_file.h"
+#include <string.h>
+#include "animcore/util/assert.h"
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+ANIM_NAMESPACE_BEGIN
+
+namespace Serialization
+{
+	MappedFile::MappedFile()
+		: m_Data(nullptr)
+		, m_Size(0)
+#ifdef WIN32
+		, m_FileHandle(INVALID_HANDLE_VALUE)
+		, m_MappingHandle(nullptr)
+#endif
+	{
+	}
+
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+#ifdef WIN32
+	bool MappedFile::Open(const char* path)
+	{
+		Close();
+		m_FileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (m_FileHandle == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_FileHandle, &size) || size.QuadPart == 0)
+		{
+			Close();
+			return false;
+		}
+
+		m_MappingHandle = CreateFileMappingA(m_FileHandle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+		if (m_MappingHandle == nullptr)
+		{
+			Close();
+			return false;
+		}
+
+		m_Data = static_cast<uint8_t*>(MapViewOfFile(m_MappingHandle, FILE_MAP_COPY, 0, 0, 0));
+		if (m_Data == nullptr)
+		{
+			Close();
+			return false;
+		}
+		m_Size = static_cast<uint64_t>(size.QuadPart);
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+		if (m_Data != nullptr)
+			UnmapViewOfFile(m_Data);
+		if (m_MappingHandle != nullptr)
+			CloseHandle(m_MappingHandle);
+		if (m_FileHandle != INVALID_HANDLE_VALUE)
+			CloseHandle(m_FileHandle);
+		m_Data = nullptr;
+		m_Size = 0;
+		m_MappingHandle = nullptr;
+		m_FileHandle = INVALID_HANDLE_VALUE;
+	}
+#else
+	bool MappedFile::Open(const char* path)
+	{
+		Close();
+		int fd = open(path, O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0)
+		{
+			close(fd);
+			return false;
+		}
+
+		// The mapping keeps its own reference to the file.
+		void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (data == MAP_FAILED)
+			return false;
+
+		m_Data = static_cast<uint8_t*>(data);
+		m_Size = static_cast<uint64_t>(info.st_size);
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+		if (m_Data != nullptr)
+			munmap(m_Data, static_cast<size_t>(m_Size));
+		m_Data = nullptr;
+		m_Size = 0;
+	}
+#endif
+
+	MappedReadStream::MappedReadStream(const MappedFile& file, uint64_t offset, uint32_t size)
+		: m_Data(file.GetData())
+		, m_Size(0)
+		, m_Position(0)
+		, m_IsRangeValid(file.IsOpen() && offset <= file.GetSize() && size <= file.GetSize() - offset)
+		, m_HasFailed(!m_IsRangeValid)
+	{
+		ANIM_ASSERT(offset % Max_Data_Alignment == 0);
+		if (m_IsRangeValid)
+		{
+			m_Data += offset;
+			m_Size = size;
+		}
+	}
+
+	void MappedReadStream::Read(void* dst, uint32_t numBytes)
+	{
+		uint32_t available = m_Size - m_Position;
+		if (numBytes > available)
+		{
+			memset(static_cast<uint8_t*>(dst) + available, 0, numBytes - available);
+			numBytes = available;
+			m_HasFailed = true;
+		}
+		if (numBytes > 0)
+		{
+			memcpy(dst, m_Data + m_Position, numBytes);
+			m_Position += numBytes;
+		}
+	}
+
+	// Fails instead of returning nullptr past the end, the Deserializer would fall back to allocating numBytes.
+	const void* MappedReadStream::ReadInPlace(uint32_t numBytes)
+	{
+		if (numBytes > m_Size - m_Position)
+		{
+			m_Position = m_Size;
+			m_HasFailed = true;
+			return nullptr;
+		}
+		const void* data = m_Data + m_Position;
+		m_Position += numBytes;
+		return data;
+	}
+
+	void MappedReadStream::Skip(uint32_t numBytes)
+	{
+		if (numBytes > m_Size - m_Position)
+		{
+			numBytes = m_Size - m_Position;
+			m_HasFailed = true;
+		}
+		m_Position += numBytes;
+	}
+
+	void MappedReadStream::Reset()
+	{
+		m_Position = 0;
+		m_HasFailed = !m_IsRangeValid;
+	}
+}
+
+ANIM_NAMESPACE_END
@@ -0,0 +1,63 @@
+#pragma once
+#include <stdint.h>
+#include "animcore/util/namespace.h"
+#include "animcore/serialization/serialization.h"
+
+ANIM_NAMESPACE_BEGIN
+
+namespace Serialization
+{
+	// A whole file mapped into memory. Pages are only read from disk when first touched and are shared with
+	// every other process mapping the same file. The mapping is copy-on-write: data deserialized in place can
+	// still be modified, the modified pages just stop being shared and are never written back.
+	class MappedFile
+	{
+	public:
+		MappedFile();
+		~MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool Open(const char* path);
+		void Close();
+
+		bool IsOpen() const { return m_Data != nullptr; }
+		const uint8_t* GetData() const { return m_Data; }
+		uint64_t GetSize() const { return m_Size; }
+
+	private:
+		uint8_t* m_Data;
+		uint64_t m_Size;
+#ifdef WIN32
+		void* m_FileHandle;
+		void* m_MappingHandle;
+#endif
+	};
+
+	// Reads one serialized object out of a MappedFile. Bulk arrays are not copied but point straight into the
+	// mapping, so the MappedFile has to stay open for as long as anything deserialized from this stream lives.
+	// The Serializer aligns array data relative to the start of the stream, so offset has to be a multiple
+	// of Max_Data_Alignment. Files are not trusted: a range outside the file reads as empty, and reads past the
+	// end return zeros, both set HasFailed.
+	class MappedReadStream : public IReadStream
+	{
+	public:
+		MappedReadStream(const MappedFile& file, uint64_t offset, uint32_t size);
+
+		virtual void Read(void* dst, uint32_t numBytes) override;
+		virtual const void* ReadInPlace(uint32_t numBytes) override;
+		virtual void Skip(uint32_t numBytes) override;
+		virtual void Reset() override;
+		virtual uint32_t GetNumBytesRead() const override { return m_Position; }
+		virtual bool HasFailed() const override { return m_HasFailed; }
+
+	private:
+		const uint8_t* m_Data;
+		uint32_t m_Size;
+		uint32_t m_Position;
+		bool m_IsRangeValid;
+		bool m_HasFailed;
+	};
+}
+
+ANIM_NAMESPACE_END
@@ -0,0 +1,87 @@
+#include "memory_stream.h"
+#include <string.h>
+
+ANIM_NAMESPACE_BEGIN
+
+namespace Serialization
+{
+	MemoryStream::MemoryStream(void* buffer, uint32_t size)
+		: m_Buffer(static_cast<uint8_t*>(buffer))
+		, m_Size(size)
+		, m_ReadPosition(0)
+		, m_WritePosition(0)
+		, m_HasOverflowed(false)
+	{
+	}
+
+	void MemoryStream::Read(void* dst, uint32_t numBytes)
+	{
+		uint32_t available = m_Size - m_ReadPosition;
+		if (numBytes > available)
+		{
+			memset(static_cast<uint8_t*>(dst) + available, 0, numBytes - available);
+			numBytes = available;
+			m_HasOverflowed = true;
+		}
+		if (numBytes > 0)
+		{
+			memcpy(dst, m_Buffer + m_ReadPosition, numBytes);
+			m_ReadPosition += numBytes;
+		}
+	}
+
+	const void* MemoryStream::ReadInPlace(uint32_t numBytes)
+	{
+		if (numBytes > m_Size - m_ReadPosition)
+			return nullptr;
+		const void* data = m_Buffer + m_ReadPosition;
+		m_ReadPosition += numBytes;
+		return data;
+	}
+
+	void MemoryStream::Skip(uint32_t numBytes)
+	{
+		if (numBytes > m_Size - m_ReadPosition)
+		{
+			numBytes = m_Size - m_ReadPosition;
+			m_HasOverflowed = true;
+		}
+		m_ReadPosition += numBytes;
+	}
+
+	void MemoryStream::Write(const void* data, uint32_t numBytes)
+	{
+		uint32_t available = m_Size - m_WritePosition;
+		if (numBytes > available)
+		{
+			numBytes = available;
+			m_HasOverflowed = true;
+		}
+		if (numBytes > 0)
+		{
+			memcpy(m_Buffer + m_WritePosition, data, numBytes);
+			m_WritePosition += numBytes;
+		}
+	}
+
+	void MemoryStream::Patch(uint32_t position, const void* data, uint32_t numBytes)
+	{
+		ANIM_ASSERT(position + numBytes <= m_WritePosition || m_HasOverflowed);
+		if (position >= m_WritePosition)
+			return;
+		if (numBytes > m_WritePosition - position)
+		{
+			numBytes = m_WritePosition - position;
+		}
+		memcpy(m_Buffer + position, data, numBytes);
+	}
+
+	void MemoryStream::Reset()
+	{
+		m_ReadPosition = 0;
+		m_WritePosition = 0;
+		m_HasOverflowed = false;
+	}
+}
+
+ANIM_NAMESPACE_END
@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+#include "animcore/util/namespace.h"
+#include "animcore/serialization/serialization.h"
+
+ANIM_NAMESPACE_BEGIN
+
+namespace Serialization
+{
+	// Reads and writes a fixed buffer owned by the caller, for messages with a known maximum size. Writes past
+	// the end are dropped and reads past the end return zeros, both set HasOverflowed.
+	class MemoryStream : public IReadStream, public IWriteStream
+	{
+	public:
+		MemoryStream(void* buffer, uint32_t size);
+
+		virtual void Read(void* dst, uint32_t numBytes) override;
+		// The data stays valid for as long as the buffer does.
+		virtual const void* ReadInPlace(uint32_t numBytes) override;
+		virtual void Skip(uint32_t numBytes) override;
+		virtual uint32_t GetNumBytesRead() const override { return m_ReadPosition; }
+		// Once anything overflowed, so a Deserializer that read past the end is not valid anymore.
+		virtual bool HasFailed() const override { return m_HasOverflowed; }
+
+		virtual void Write(const void* data, uint32_t numBytes) override;
+		virtual void Reserve(uint32_t) override {}
+		virtual uint32_t GetNumBytesWritten() const override { return m_WritePosition; }
+		virtual void Patch(uint32_t position, const void* data, uint32_t numBytes) override;
+
+		// Rewinds both reading and writing.
+		virtual void Reset() override;
+
+		bool HasOverflowed() const { return m_HasOverflowed; }
+		uint8_t* GetBuffer() const { return m_Buffer; }
+		uint32_t GetSize() const { return m_Size; }
+
+	private:
+		uint8_t* m_Buffer;
+		uint32_t m_Size;
+		uint32_t m_ReadPosition;
+		uint32_t m_WritePosition;
+		bool m_HasOverflowed;
+	};
+}
+
+ANIM_NAMESPACE_END
@@ -1,5 +1,8 @@
 #include "object_serializer.h"
+#include <mutex>
+#include <shared_mutex>
 #include "serialization.h"
+#include "animcore/containers/flat_hash_map.h"
 
 ANIM_NAMESPACE_BEGIN
 
@@ -80,6 +83,178 @@ namespace Serialization
 		void SerializeAssociativeContainer(const rttr::variant_associative_view& view, Serializer& res);
 		void SerializeVariant(const  rttr::variant& var, Serializer& res);
 	}
+
+	namespace
+	{
+		template <typename T>
+		const void* GetBoundAddress(const rttr::variant& value)
+		{
+			if (value.is_type<T*>())
+				return value.get_value<T*>();
+			if (value.is_type<const T*>())
+				return value.get_value<const T*>();
+			return nullptr;
+		}
+
+		template <typename T, typename Next, typename... Rest>
+		const void* GetBoundAddress(const rttr::variant& value)
+		{
+			const void* address = GetBoundAddress<T>(value);
+			return address != nullptr ? address : GetBoundAddress<Next, Rest...>(value);
+		}
+
+		template <typename T>
+		uint64_t LoadVarintValue(const uint8_t* src)
+		{
+			T value;
+			memcpy(&value, src, sizeof(value));
+			return ImplDetails::ZigZagEncode(value);
+		}
+
+		// Same value the integer SerializeHelper passes to SerializeVarint.
+		uint64_t LoadVarintValue(const uint8_t* src, uint32_t size, bool isSigned)
+		{
+			switch (size)
+			{
+			case 2: return isSigned ? LoadVarintValue<int16_t>(src) : LoadVarintValue<uint16_t>(src);
+			case 4: return isSigned ? LoadVarintValue<int32_t>(src) : LoadVarintValue<uint32_t>(src);
+			default: return isSigned ? LoadVarintValue<int64_t>(src) : LoadVarintValue<uint64_t>(src);
+			}
+		}
+	}
+
+	SerializationPlan::SerializationPlan(const rttr::type& type, const void* object, const rttr::instance& instance)
+	{
+		const uint8_t* base = static_cast<const uint8_t*>(object);
+		for (const rttr::property& prop : type.get_properties())
+		{
+			const rttr::type propType = prop.get_type();
+			const rttr::type valueType = propType.get_raw_type();
+			const bool isString = valueType == rttr::type::get<SimpleString>();
+			if (!propType.is_pointer() || !(valueType.is_arithmetic() || isString))
+			{
+				ANIM_ASSERT(!propType.is_pointer());
+				Operation op;
+				op.m_Offset = 0;
+				op.m_Size = 0;
+				op.m_Kind = OperationKind::Variant;
+				op.m_ElementSize = 0;
+				op.m_PropertyIndex = m_VariantProperties.Size();
+				m_Operations.Push(op);
+				m_VariantProperties.Push(prop);
+				continue;
+			}
+
+			// bind_as_ptr properties hand out the address of the member, which only has to be looked up once.
+			const void* address = GetBoundAddress<bool, char, int8_t, int16_t, int32_t, int64_t,
+				uint8_t, uint16_t, uint32_t, uint64_t, float, double, SimpleString>(prop.get_value(instance));
+			ANIM_ASSERT(address != nullptr);
+			uint32_t offset = static_cast<uint32_t>(static_cast<const uint8_t*>(address) - base);
+			ANIM_ASSERT(offset < type.get_sizeof());
+			if (isString)
+			{
+				Operation op;
+				op.m_Offset = offset;
+				op.m_Size = sizeof(SimpleString);
+				op.m_Kind = OperationKind::String;
+				op.m_ElementSize = 0;
+				op.m_PropertyIndex = 0;
+				m_Operations.Push(op);
+				continue;
+			}
+
+			// Integers that Encoding_Compact_Integers writes as varints only merge with integers of the same
+			// size and signedness, so a run can still be encoded element by element.
+			uint32_t size = static_cast<uint32_t>(valueType.get_sizeof());
+			OperationKind kind = OperationKind::Bytes;
+			if (valueType.is_arithmetic() && size > 1 && valueType != rttr::type::get<float>() && valueType != rttr::type::get<double>())
+			{
+				const bool isSigned = valueType == rttr::type::get<int16_t>() || valueType == rttr::type::get<int32_t>() ||
+					valueType == rttr::type::get<int64_t>();
+				kind = isSigned ? OperationKind::SignedIntegers : OperationKind::UnsignedIntegers;
+			}
+			if (m_Operations.Size() > 0)
+			{
+				Operation& last = m_Operations[m_Operations.Size() - 1];
+				if (last.m_Kind == kind && last.m_ElementSize == size && last.m_Offset + last.m_Size == offset)
+				{
+					last.m_Size += size;
+					continue;
+				}
+			}
+			Operation op;
+			op.m_Offset = offset;
+			op.m_Size = size;
+			op.m_Kind = kind;
+			op.m_ElementSize = static_cast<uint8_t>(size);
+			op.m_PropertyIndex = 0;
+			m_Operations.Push(op);
+		}
+	}
+
+	void SerializationPlan::Execute(const void* object, const rttr::instance& instance, Serializer& res) const
+	{
+		const uint8_t* base = static_cast<const uint8_t*>(object);
+		for (const Operation& op : m_Operations)
+		{
+			switch (op.m_Kind)
+			{
+			case OperationKind::Bytes:
+				res.Serialize(base + op.m_Offset, op.m_Size);
+				break;
+			case OperationKind::SignedIntegers:
+			case OperationKind::UnsignedIntegers:
+				if (!res.UsesCompactIntegers())
+				{
+					res.Serialize(base + op.m_Offset, op.m_Size);
+					break;
+				}
+				for (uint32_t offset = 0; offset < op.m_Size; offset += op.m_ElementSize)
+				{
+					res.SerializeVarint(LoadVarintValue(base + op.m_Offset + offset, op.m_ElementSize,
+						op.m_Kind == OperationKind::SignedIntegers));
+				}
+				break;
+			case OperationKind::String:
+				ImplDetails::SerializeHelper<SimpleString>::Apply(
+					*reinterpret_cast<const SimpleString*>(base + op.m_Offset), res);
+				break;
+			case OperationKind::Variant:
+			{
+				const rttr::property& prop = m_VariantProperties[op.m_PropertyIndex];
+				if (!ImplDetails::SerializeAtomicType(prop.get_type(), prop.get_value(instance), res))
+				{
+					ANIM_ASSERT(false);
+				}
+				break;
+			}
+			}
+		}
+	}
+
+	const SerializationPlan& SerializationPlan::Get(const rttr::type& type, const void* object, const rttr::instance& instance)
+	{
+		static std::shared_timed_mutex s_Mutex;
+		static FlatHashMap<uint64_t, SerializationPlan*> s_Plans;
+
+		const uint64_t key = static_cast<uint64_t>(type.get_id());
+		{
+			std::shared_lock<std::shared_timed_mutex> lock(s_Mutex);
+			auto iter = s_Plans.find(key);
+			if (iter != s_Plans.end())
+				return *iter->second;
+		}
+
+		SerializationPlan* plan = ANIM_NEW(SerializationPlan, type, object, instance);
+		std::unique_lock<std::shared_timed_mutex> lock(s_Mutex);
+		auto result = s_Plans.emplace(key, plan);
+		if (!result.second)
+		{
+			// Another thread compiled the same type first.
+			ANIM_DELETE(plan);
+		}
+		return *result.first->second;
+	}
 }
 
 ANIM_NAMESPACE_END
\ No newline at end of file
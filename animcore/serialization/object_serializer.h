@@ -1,7 +1,67 @@
 #pragma once
 #include <rttr/type.h>
 #include "animcore/util/namespace.h"
+#include "animcore/containers/array.h"
 
 ANIM_NAMESPACE_BEGIN
 
+namespace Serialization
+{
+	class Serializer;
+
+	// Flat list of operations that writes the RTTR properties of one type, compiled the first time an object of
+	// that type is serialized. Arithmetic and string properties registered with policy::prop::bind_as_ptr are
+	// read straight from their offset in the object, and runs of arithmetic properties that are laid out back to
+	// back are written with a single copy, unless the Serializer encodes integers as varints. Every other property
+	// still goes through an rttr::variant. RTTR only hands out copies of properties registered by value, so their
+	// offsets cannot be looked up: register the members of serialized types with bind_as_ptr.
+	class SerializationPlan
+	{
+	public:
+		// object is the address of the most derived object instance refers to.
+		SerializationPlan(const rttr::type& type, const void* object, const rttr::instance& instance);
+
+		void Execute(const void* object, const rttr::instance& instance, Serializer& res) const;
+
+		uint32_t GetNumOperations() const { return m_Operations.Size(); }
+
+		// Plans are cached per type and live until the end of the program.
+		static const SerializationPlan& Get(const rttr::type& type, const void* object, const rttr::instance& instance);
+
+	private:
+		enum class OperationKind : uint8_t
+		{
+			Bytes,
+			SignedIntegers,
+			UnsignedIntegers,
+			String,
+			Variant,
+		};
+
+		struct Operation
+		{
+			uint32_t m_Offset;
+			uint32_t m_Size;
+			OperationKind m_Kind;
+			// Size of each integer in an Integers run.
+			uint8_t m_ElementSize;
+			// Index into m_VariantProperties for Variant operations.
+			uint32_t m_PropertyIndex;
+		};
+
+		BigArray<Operation> m_Operations;
+		BigArray<rttr::property> m_VariantProperties;
+	};
+
+	// Writes every RTTR property of obj, in registration order, in the same format as SerializeAtomicType.
+	template <typename T>
+	void SerializeObject(const T& obj, Serializer& res)
+	{
+		static_assert(std::is_polymorphic<T>::value, "SerializeObject needs a type with RTTR_ENABLE");
+		rttr::instance instance(obj);
+		const void* object = dynamic_cast<const void*>(&obj);
+		SerializationPlan::Get(rttr::type::get(obj), object, instance).Execute(object, instance, res);
+	}
+}
+
 ANIM_NAMESPACE_END
\ No newline at end of file
@@ -1,30 +1,27 @@
 #pragma once
 #include <stdint.h>
 #include "animcore/util/namespace.h"
-#include "animcore/containers/unordered_map.h"
+#include "animcore/containers/flat_hash_map.h"
+#include "animcore/math/hash64.h"
+#include "animcore/memory/default_allocator.h"
 
 ANIM_NAMESPACE_BEGIN
 
 namespace Reflection
 {
 	class RootReflectedClass;
-	constexpr uint64_t Fnv1(uint64_t h, const char * s)
-	{
-		return (*s == 0) ? h : Fnv1((h * 1099511628211ull) ^ static_cast<uint64_t>(*s), s + 1);
-	}
-
-	constexpr uint64_t Fnv1(const char * s)
-	{
-		return true ? Fnv1(14695981039346656037ull, s) : throw "Hashing at runtime!";
-	}
 
 	struct ClassInfo
 	{
 		typedef RootReflectedClass * (*FactoryFunction)();
 		const char * m_TypeName;
+		// Hash of m_TypeName, computed at compile time by the IMPLEMENT_ macros.
+		uint64_t m_TypeID;
 		const ClassInfo * m_SuperClass;
 		FactoryFunction Construct;
-		inline uint64_t GetTypeID() const { return Fnv1(m_TypeName); }
+		// Links every registered class, see TypeRegistry.
+		const ClassInfo * m_NextRegistered;
+		inline uint64_t GetTypeID() const { return m_TypeID; }
 		bool DerivesFrom(uint64_t typeIDOther) const
 		{
 			const ClassInfo * curInfo = this;
@@ -45,12 +42,17 @@ namespace Reflection
 		RegistrationProxy(bool value) { (void)(value); }
 	};
 
+	// Objects made by ClassInfo::Construct come from DefaultAllocator::Create and are destroyed through a pointer
+	// to one of their bases with DefaultAllocator::Destroy.
 	class RootReflectedClass
 	{
 	public:
+		virtual ~RootReflectedClass() {}
 		virtual const Reflection::ClassInfo & GetReflectedClassInfo() const = 0;
 	};
 
+	// Classes register themselves during static initialization, before the engine's allocator can be used, so
+	// RegisterType only links them into a list. Initialize indexes them by type id; lookups find nothing before.
 	class TypeRegistry
 	{
 	public:
@@ -60,17 +62,36 @@ namespace Reflection
 			return registry;
 		}
 
-		static bool RegisterType(const ClassInfo * info)
+		static bool RegisterType(ClassInfo * info)
 		{
 			auto & registry = GetRegistry();
-			auto iter = registry._allTypes.find(info->GetTypeID());
-			if (iter == registry._allTypes.end())
+			info->m_NextRegistered = registry._registered;
+			registry._registered = info;
+			if (registry._isInitialized)
 			{
-				registry._allTypes[info->GetTypeID()] = info;
+				registry._allTypes.emplace(info->GetTypeID(), info);
 			}
 			return true;
 		}
 
+		static void Initialize()
+		{
+			auto & registry = GetRegistry();
+			for (const ClassInfo * info = registry._registered; info != nullptr; info = info->m_NextRegistered)
+			{
+				registry._allTypes.emplace(info->GetTypeID(), info);
+			}
+			registry._isInitialized = true;
+		}
+
+		// Frees the index while the engine's allocator is still there.
+		static void Shutdown()
+		{
+			auto & registry = GetRegistry();
+			registry._allTypes = FlatHashMap<uint64_t, const ClassInfo *>();
+			registry._isInitialized = false;
+		}
+
 		template <typename T>
 		static T * FactoryClass(uint64_t typeID)
 		{
@@ -90,7 +111,15 @@ namespace Reflection
 		}
 
 	private:
-		UnorderedMap<uint64_t, const ClassInfo *> _allTypes;
+		TypeRegistry()
+			: _registered(nullptr)
+			, _isInitialized(false)
+		{
+		}
+
+		FlatHashMap<uint64_t, const ClassInfo *> _allTypes;
+		const ClassInfo * _registered;
+		bool _isInitialized;
 	};
 }
 
@@ -123,30 +152,31 @@ protected:
 	static Reflection::RegistrationProxy s_RegistrationProxy
 
 #define IMPLEMENT_ABSTRACT_ROOT_CLASS(a)                                                                               \
-	const Reflection::ClassInfo & a## ::GetReflectedClassInfo() const { return s_ClassInfo; }                          \
+	const Reflection::ClassInfo & a::GetReflectedClassInfo() const { return s_ClassInfo; }                             \
 	\
-Reflection::ClassInfo a## ::s_ClassInfo = {#a, nullptr, nullptr};                                                      \
+Reflection::ClassInfo a::s_ClassInfo = {#a, HashUtils::ComputeConstexpr(#a), nullptr, nullptr, nullptr};               \
 	\
-Reflection::RegistrationProxy a## ::s_RegistrationProxy = Reflection::TypeRegistry::RegisterType(&##a## ::s_ClassInfo)
+Reflection::RegistrationProxy a::s_RegistrationProxy = Reflection::TypeRegistry::RegisterType(&a::s_ClassInfo)
 
 #define IMPLEMENT_CONCRETE_ROOT_CLASS(a)                                                                               \
-	const Reflection::ClassInfo & a## ::GetReflectedClassInfo() const { return s_ClassInfo; }                          \
+	const Reflection::ClassInfo & a::GetReflectedClassInfo() const { return s_ClassInfo; }                             \
 	\
-Reflection::ClassInfo a## ::s_ClassInfo = {#a, nullptr, []() -> Reflection::RootReflectedClass * { return new a(); }}; \
+Reflection::ClassInfo a::s_ClassInfo = {                                                                               \
+		#a, HashUtils::ComputeConstexpr(#a), nullptr, []() -> Reflection::RootReflectedClass * { return DefaultAllocator::Create<a>(); }, nullptr}; \
 	\
-Reflection::RegistrationProxy a## ::s_RegistrationProxy = Reflection::TypeRegistry::RegisterType(&##a## ::s_ClassInfo)
+Reflection::RegistrationProxy a::s_RegistrationProxy = Reflection::TypeRegistry::RegisterType(&a::s_ClassInfo)
 
 #define IMPLEMENT_ABSTRACT_DERIVED_CLASS(a, b)                                                                         \
-	const Reflection::ClassInfo & a## ::GetReflectedClassInfo() const { return s_ClassInfo; }                          \
+	const Reflection::ClassInfo & a::GetReflectedClassInfo() const { return s_ClassInfo; }                             \
 	\
-Reflection::ClassInfo a## ::s_ClassInfo = {#a, &b## ::s_ClassInfo, nullptr};                                           \
+Reflection::ClassInfo a::s_ClassInfo = {#a, HashUtils::ComputeConstexpr(#a), &b::s_ClassInfo, nullptr, nullptr};       \
 	\
-Reflection::RegistrationProxy a## ::s_RegistrationProxy = Reflection::TypeRegistry::RegisterType(&##a## ::s_ClassInfo)
+Reflection::RegistrationProxy a::s_RegistrationProxy = Reflection::TypeRegistry::RegisterType(&a::s_ClassInfo)
 
 #define IMPLEMENT_CONCRETE_DERIVED_CLASS(a, b)                                                                         \
-	const Reflection::ClassInfo & a## ::GetReflectedClassInfo() const { return s_ClassInfo; }                          \
+	const Reflection::ClassInfo & a::GetReflectedClassInfo() const { return s_ClassInfo; }                             \
 	\
-Reflection::ClassInfo a## ::s_ClassInfo = {                                                                            \
-		#a, &b## ::s_ClassInfo, []() -> Reflection::RootReflectedClass * { return new a(); }};                         \
+Reflection::ClassInfo a::s_ClassInfo = {                                                                               \
+		#a, HashUtils::ComputeConstexpr(#a), &b::s_ClassInfo, []() -> Reflection::RootReflectedClass * { return DefaultAllocator::Create<a>(); }, nullptr}; \
 	\
-Reflection::RegistrationProxy a## ::s_RegistrationProxy = Reflection::TypeRegistry::RegisterType(&##a## ::s_ClassInfo)
+Reflection::RegistrationProxy a::s_RegistrationProxy = Reflection::TypeRegistry::RegisterType(&a::s_ClassInfo)
@@ -1,11 +1,16 @@
 #pragma once
 #include <stdint.h>
+#include <string.h>
 #include <type_traits>
 #include <unordered_map>
 #include <functional>
 #include "animcore/util/namespace.h"
 #include "animcore/containers/array.h"
 #include "animcore/containers/string.h"
+#include "animcore/containers/string_table.h"
+#include "animcore/math/half_float.h"
+#include "animcore/math/vector3.h"
+#include "animcore/math/quaternion.h"
 #include "animcore/memory/pointers.h"
 #include "animcore/objectmodel/object_id.h"
 #include "animcore/objectmodel/reference.h"
@@ -15,11 +20,42 @@
 
 ANIM_NAMESPACE_BEGIN
 
+template <typename BaseType, uint32_t PRECISION>
+class FixedPoint;
+
 namespace Serialization
 {
 	class Serializer;
 	class Deserializer;
-	static constexpr uint32_t SerializationFormatVersion = 1;
+	// 3: bulk array data is aligned relative to the start of the serialized data so it can be used in place.
+	// 4: ISerializable pointers are followed by the size of the object, so classes that no longer exist are skipped.
+	// 5: the header stores the EncodingFlags the stream was written with.
+	static constexpr uint32_t SerializationFormatVersion = 5;
+	// Oldest format the Deserializer still reads.
+	static constexpr uint32_t Min_Supported_Format_Version = 2;
+	// Largest alignment the Serializer pads array data to.
+	static constexpr uint32_t Max_Data_Alignment = 16;
+
+	// Serialized data is little endian. Values, bulk arrays included, are written as their bytes in memory and
+	// in place loading hands those bytes out unchanged, so big endian hosts would need to swap on every path.
+	// MSVC only targets little endian machines and does not define __BYTE_ORDER__.
+#if defined(__BYTE_ORDER__)
+	static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "Serialized data is little endian, big endian hosts are not supported");
+#endif
+
+	// Chosen per Serializer and stored in the header, so the Deserializer always matches it.
+	enum EncodingFlags : uint32_t
+	{
+		// Integers wider than a byte and enums are written as LEB128 varints, zigzagged when signed, and
+		// SerializeSortedKeys stores differences between keys.
+		Encoding_Compact_Integers = 1 << 0,
+		// Float channels written with SerializeTolerantFloats are stored at half precision.
+		Encoding_Half_Float_Channels = 1 << 1,
+	};
+
+	// Integer types that Encoding_Compact_Integers writes as varints. Single bytes gain nothing from it.
+	template<typename T>
+	struct IsVarintEncoded : std::integral_constant<bool, std::is_integral<T>::value && (sizeof(T) > 1)> {};
 	
 	class IReadStream
 	{
@@ -27,6 +63,27 @@ namespace Serialization
 		virtual void Read(void * dst, uint32_t numBytes) = 0;
 		virtual void Reset() = 0;
 		virtual uint32_t GetNumBytesRead() const = 0;
+		// Skips the next numBytes and returns a pointer to them in the stream's own storage, or nullptr if the
+		// stream cannot hand out its memory. Deserialized arrays then point into that storage.
+		virtual const void * ReadInPlace(uint32_t) { return nullptr; }
+		// Streams that can tell should return true once a read went past the end of their data. The Deserializer
+		// is not valid anymore then.
+		virtual bool HasFailed() const { return false; }
+
+		// Streams that can seek should override this, the default reads the bytes into a scratch buffer unless
+		// they can be read in place.
+		virtual void Skip(uint32_t numBytes)
+		{
+			if (numBytes == 0 || ReadInPlace(numBytes) != nullptr)
+				return;
+			uint8_t buffer[256];
+			while (numBytes > 0)
+			{
+				uint32_t chunk = numBytes < sizeof(buffer) ? numBytes : static_cast<uint32_t>(sizeof(buffer));
+				Read(buffer, chunk);
+				numBytes -= chunk;
+			}
+		}
 	};
 
 	class IWriteStream
@@ -36,23 +93,55 @@ namespace Serialization
 		virtual void Reserve(uint32_t numBytes) = 0;
 		virtual void Reset() = 0;
 		virtual uint32_t GetNumBytesWritten() const = 0;
+		// Overwrites bytes that were already written, used to fill in the length of tagged fields.
+		virtual void Patch(uint32_t position, const void * data, uint32_t numBytes) = 0;
 	};
 
-	namespace ImplDetails
+	// Tag of a field named name, never 0.
+	constexpr uint32_t FieldTag(const char * name)
 	{
-		class SizeAccumulator : public IWriteStream
-		{
-		public:
-			SizeAccumulator() : m_CurSize(0) {}
-			virtual void Write(const void *, uint32_t numBytes) override { m_CurSize += numBytes; }
-			virtual void Reserve(uint32_t) override {}
-			virtual void Reset() override { m_CurSize = 0; }
-			virtual uint32_t GetNumBytesWritten() const override { return m_CurSize; }
-		private:
-			uint32_t m_CurSize;
-		};
+		return static_cast<uint32_t>(HashUtils::ComputeConstexpr(name)) | 1u;
 	}
 
+	// Types whose bytes in memory are exactly their serialized form. Arrays of them are written and read with
+	// a single stream call instead of one per element. Both paths write values as they are in memory, which is
+	// the little endian byte order of the format, see below.
+	// Opt in for trivially copyable types without pointers or padding by specializing.
+	template<typename T, class Enable = void>
+	struct IsBulkSerializable : std::integral_constant<bool, std::is_integral<T>::value || std::is_floating_point<T>::value> {};
+
+	template<>
+	struct IsBulkSerializable<Vector3> : std::true_type {};
+
+	template<>
+	struct IsBulkSerializable<Quaternion> : std::true_type {};
+
+	template<typename BaseType, uint32_t PRECISION>
+	struct IsBulkSerializable<FixedPoint<BaseType, PRECISION>> : std::true_type {};
+
+	// Serialized size of types whose size does not depend on their value, 0 if unknown. Lets the Serializer
+	// reserve space for a whole array at once. Opt in for other fixed-layout types by specializing.
+	template<typename T, class Enable = void>
+	struct FixedSerializedSize : std::integral_constant<uint32_t, 0> {};
+
+	template<typename T>
+	struct FixedSerializedSize<T, typename std::enable_if<std::is_class<T>::value && IsBulkSerializable<T>::value>::type>
+		: std::integral_constant<uint32_t, sizeof(T)> {};
+
+	template<typename T>
+	struct FixedSerializedSize<T, typename std::enable_if<std::is_integral<T>::value || std::is_floating_point<T>::value>::type>
+		: std::integral_constant<uint32_t, sizeof(T)> {};
+
+	template<typename T>
+	struct FixedSerializedSize<T, typename std::enable_if<std::is_enum<T>::value>::type>
+		: std::integral_constant<uint32_t, sizeof(uint64_t)> {};
+
+	template<>
+	struct FixedSerializedSize<ObjectID> : std::integral_constant<uint32_t, sizeof(ObjectID::m_Data)> {};
+
+	template<typename T>
+	struct FixedSerializedSize<Reference<T>> : FixedSerializedSize<ObjectID> {};
+
 
 	namespace ImplDetails
 	{
@@ -60,13 +149,15 @@ namespace Serialization
 		struct SerializeHelper;
 		template<typename T, class Enable = void>
 		struct DeserializeHelper;
+		template<typename T, class Enable = void>
+		struct SharedObjectHelper;
 	}
 
 	class Serializer
 	{
 	public:
-		Serializer(IWriteStream & stream, uint32_t version)
-			: m_Stream(stream), m_RecursiveCount(0), m_Version(version)
+		Serializer(IWriteStream & stream, uint32_t version, uint32_t encodingFlags = 0)
+			: m_Version(version), m_EncodingFlags(encodingFlags), m_Stream(stream), m_BaseOffset(stream.GetNumBytesWritten())
 		{
 			m_Stream.Write(
 				reinterpret_cast<const uint8_t *>(&SerializationFormatVersion), 
@@ -74,6 +165,7 @@ namespace Serialization
 			m_Stream.Write(
 				reinterpret_cast<uint8_t *>(&version), 
 				sizeof(version));
+			m_Stream.Write(&encodingFlags, sizeof(encodingFlags));
 		}
 		Serializer(const Serializer &) = delete;
 		Serializer & operator=(const Serializer &) = delete;
@@ -85,19 +177,58 @@ namespace Serialization
 		void Serialize(T * obj);
 
 		inline void Serialize(const void * src, uint32_t numBytes);
+		// Pads with zeros up to the next multiple of alignment, counted from where the Serializer started writing,
+		// which is where the Deserializer starts reading. Streams holding several messages then decode alike.
+		inline void AlignTo(uint32_t alignment);
+
+		// Tagged fields let objects add, remove and reorder members without breaking data written earlier.
+		// A field is its tag, its length in bytes and its contents, so readers can skip fields they do not
+		// know without parsing them. EndFields marks the end of an object's fields.
+		template <typename T>
+		void SerializeField(uint32_t tag, const T & obj)
+		{
+			uint32_t lengthPosition = BeginField(tag);
+			Serialize(obj);
+			EndField(lengthPosition);
+		}
+		// Returns what EndField needs to fill in the length.
+		inline uint32_t BeginField(uint32_t tag);
+		inline void EndField(uint32_t lengthPosition);
+		inline void EndFields();
+		// A length followed by whatever is written until EndSizedBlock, without a tag.
+		inline uint32_t BeginSizedBlock();
+		inline void EndSizedBlock(uint32_t lengthPosition);
+
+		inline void SerializeVarint(uint64_t value);
+		// Array of ascending keys, like keyframe times. Under Encoding_Compact_Integers only the differences
+		// between neighbours are stored, which stays lossless for floats and for keys that are not sorted.
+		template <typename ArrayType>
+		void SerializeSortedKeys(const ArrayType & keys);
+		// Float array that tolerates half precision, like most animation channels.
+		template <typename ArrayType>
+		void SerializeTolerantFloats(const ArrayType & values);
+
 		uint32_t GetVersion() const { return m_Version; }
+		uint32_t GetEncodingFlags() const { return m_EncodingFlags; }
+		bool UsesCompactIntegers() const { return (m_EncodingFlags & Encoding_Compact_Integers) != 0; }
 	private:
 		uint32_t m_Version;
-		template <typename T>
-		inline typename std::enable_if<!std::is_pointer<T>::value, uint32_t>::type GetSize(const T & obj) const;
-		template <typename T>
-		inline uint32_t GetSize(T * obj) const;
+		uint32_t m_EncodingFlags;
+
+		// Assigns ids to shared objects in the order they are first written, starting at 1.
+		uint32_t GetSharedObjectID(const void * identity, bool & isNewOut)
+		{
+			auto result = m_SharedObjectIDs.emplace(identity, static_cast<uint32_t>(m_SharedObjectIDs.size() + 1));
+			isNewOut = result.second;
+			return result.first->second;
+		}
 
 	private:
 		template <typename T, class Enable>
 		friend struct ImplDetails::SerializeHelper;
 		IWriteStream & m_Stream;
-		uint16_t m_RecursiveCount;
+		uint32_t m_BaseOffset;
+		FlatHashMap<const void *, uint32_t> m_SharedObjectIDs;
 	};
 
 	class Deserializer
@@ -105,35 +236,107 @@ namespace Serialization
 	public:
 		Deserializer(IReadStream & stream) 
 			: m_Stream(stream)
+			, m_BaseOffset(stream.GetNumBytesRead())
 			, m_IsValid(false)
 		{
-			uint32_t serializationVersion;
-			m_Stream.Read(reinterpret_cast<uint8_t *>(&serializationVersion), sizeof(serializationVersion));
-			if (serializationVersion == SerializationFormatVersion)
+			m_FormatVersion = 0;
+			m_Stream.Read(reinterpret_cast<uint8_t *>(&m_FormatVersion), sizeof(m_FormatVersion));
+			m_EncodingFlags = 0;
+			if (m_FormatVersion >= Min_Supported_Format_Version && m_FormatVersion <= SerializationFormatVersion)
 			{
 				m_IsValid = true;
 				m_Stream.Read(reinterpret_cast<uint8_t *>(&m_Version), sizeof(m_Version));
+				if (m_FormatVersion >= 5)
+				{
+					m_Stream.Read(&m_EncodingFlags, sizeof(m_EncodingFlags));
+				}
 			}
 		}
 		Deserializer(const Deserializer &) = delete;
 		Deserializer & operator=(const Deserializer &) = delete;
 
 
-		inline bool IsValid() const { return m_IsValid; }
+		inline bool IsValid() const { return m_IsValid && !m_Stream.HasFailed(); }
 		template <typename T>
 		inline void Deserialize(T & obj);
 		inline void Deserialize(void * dst, uint32_t numBytes);
+		inline void SkipToAlignment(uint32_t alignment);
+		// nullptr if the stream does not support reading in place, the data has to be copied out then.
+		inline const void * DeserializeInPlace(uint32_t numBytes);
 
+		// Objects migrate data written by older versions while reading it, by checking GetDataVersion.
 		uint32_t GetDataVersion() const { return m_Version; }
+		uint32_t GetFormatVersion() const { return m_FormatVersion; }
+		uint32_t GetEncodingFlags() const { return m_EncodingFlags; }
+		bool UsesCompactIntegers() const { return (m_EncodingFlags & Encoding_Compact_Integers) != 0; }
+
+		inline uint64_t DeserializeVarint();
+		template <typename ArrayType>
+		void DeserializeSortedKeys(ArrayType & keys);
+		template <typename ArrayType>
+		void DeserializeTolerantFloats(ArrayType & values);
+
+		// Reads the length written by Serializer::BeginSizedBlock and returns where the block ends.
+		inline uint32_t BeginSizedBlock();
+		// Skips whatever was not read of the block.
+		inline void EndSizedBlock(uint32_t blockEnd);
+
+		// Copies characters into storage owned by the Deserializer, see DeserializeHelper<StringView>.
+		inline StringView CopyString(StringView str);
+
+		// Walks the fields an object wrote with Serializer::SerializeField:
+		//	Deserializer::FieldReader fields(res);
+		//	while (fields.Next())
+		//	{
+		//		if (fields.GetTag() == FieldTag("m_Keys"))
+		//			res.Deserialize(m_Keys);
+		//	}
+		// Fields that are not read, or only partially read, are skipped. Next has to be called until it
+		// returns false.
+		class FieldReader
+		{
+		public:
+			explicit FieldReader(Deserializer & res)
+				: m_Deserializer(res), m_FieldEnd(0), m_Tag(0)
+			{
+			}
+			FieldReader(const FieldReader &) = delete;
+			FieldReader & operator=(const FieldReader &) = delete;
+
+			inline bool Next();
+			uint32_t GetTag() const { return m_Tag; }
+
+		private:
+			Deserializer & m_Deserializer;
+			uint32_t m_FieldEnd;
+			uint32_t m_Tag;
+		};
+
 	private:
 		template <typename T>
 		inline T * FactoryObject();
 
+		// Every shared object read so far, indexed by id - 1. Keeps objects only reachable through a WeakPtr
+		// alive until the Deserializer goes away.
+		struct SharedObject
+		{
+			SharedPtr<void> m_Owner;
+			void * m_Identity;
+		};
+
 		IReadStream & m_Stream;
+		// Alignment is counted from here, see Serializer::AlignTo.
+		uint32_t m_BaseOffset;
 		template <typename T, class Enable>
 		friend struct ImplDetails::DeserializeHelper;
+		template <typename T, class Enable>
+		friend struct ImplDetails::SharedObjectHelper;
 		uint32_t m_Version;
+		uint32_t m_FormatVersion;
+		uint32_t m_EncodingFlags;
 		bool m_IsValid;
+		BigArray<SharedObject> m_SharedObjects;
+		BigArray<BigArray<char>> m_CopiedStrings;
 	};
 
 	namespace ImplDetails
@@ -159,9 +362,56 @@ namespace Serialization
 
 #pragma region integraltypes
 		template <typename T>
-		struct SerializeHelper<T,
-			typename std::enable_if<(std::is_integral<T>::value || std::is_floating_point<T>::value) &&
-			!std::is_pointer<T>::value>::type>
+		typename std::enable_if<std::is_signed<T>::value, uint64_t>::type ZigZagEncode(T value)
+		{
+			int64_t wide = static_cast<int64_t>(value);
+			return (static_cast<uint64_t>(wide) << 1) ^ static_cast<uint64_t>(wide >> 63);
+		}
+		template <typename T>
+		typename std::enable_if<std::is_unsigned<T>::value, uint64_t>::type ZigZagEncode(T value)
+		{
+			return static_cast<uint64_t>(value);
+		}
+		template <typename T>
+		typename std::enable_if<std::is_signed<T>::value, T>::type ZigZagDecode(uint64_t value)
+		{
+			return static_cast<T>(static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1));
+		}
+		template <typename T>
+		typename std::enable_if<std::is_unsigned<T>::value, T>::type ZigZagDecode(uint64_t value)
+		{
+			return static_cast<T>(value);
+		}
+
+		template <typename T>
+		struct SerializeHelper<T, typename std::enable_if<std::is_integral<T>::value>::type>
+		{
+			static void Apply(const T & obj, Serializer & res)
+			{
+				if (IsVarintEncoded<T>::value && res.UsesCompactIntegers())
+				{
+					res.SerializeVarint(ZigZagEncode(obj));
+					return;
+				}
+				res.Serialize(&obj, sizeof(T));
+			}
+		};
+		template <typename T>
+		struct DeserializeHelper<T, typename std::enable_if<std::is_integral<T>::value>::type>
+		{
+			static void Apply(Deserializer & res, T & obj)
+			{
+				if (IsVarintEncoded<T>::value && res.UsesCompactIntegers())
+				{
+					obj = ZigZagDecode<T>(res.DeserializeVarint());
+					return;
+				}
+				res.Deserialize(reinterpret_cast<uint8_t *>(&obj), sizeof(T));
+			}
+		};
+
+		template <typename T>
+		struct SerializeHelper<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
 		{
 			static void Apply(const T & obj, Serializer & res)
 			{
@@ -169,12 +419,44 @@ namespace Serialization
 			}
 		};
 		template <typename T>
-		struct DeserializeHelper<T,
-			typename std::enable_if<(std::is_integral<T>::value || std::is_floating_point<T>::value) &&
-			!std::is_pointer<T>::value>::type>
+		struct DeserializeHelper<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
 		{
 			static void Apply(Deserializer & res, T & obj) { res.Deserialize(reinterpret_cast<uint8_t *>(&obj), sizeof(T)); }
 		};
+
+		// Maps keys to unsigned integers in the same order, so differences between sorted keys are small and
+		// positive. Floats flip all bits when negative and only the sign bit otherwise.
+		template <typename T, class Enable = void>
+		struct SortedKeyBits;
+
+		template <typename T>
+		struct SortedKeyBits<T, typename std::enable_if<std::is_integral<T>::value>::type>
+		{
+			static constexpr uint64_t Sign_Bit = std::is_signed<T>::value ? (uint64_t(1) << 63) : 0;
+			static uint64_t ToBits(T value) { return static_cast<uint64_t>(value) ^ Sign_Bit; }
+			static T FromBits(uint64_t bits) { return static_cast<T>(bits ^ Sign_Bit); }
+		};
+
+		template <typename T>
+		struct SortedKeyBits<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+		{
+			typedef typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type BitsType;
+			static constexpr BitsType Sign_Bit = BitsType(1) << (sizeof(T) * 8 - 1);
+			static uint64_t ToBits(T value)
+			{
+				BitsType bits;
+				memcpy(&bits, &value, sizeof(bits));
+				return (bits & Sign_Bit) ? static_cast<BitsType>(~bits) : (bits | Sign_Bit);
+			}
+			static T FromBits(uint64_t wideBits)
+			{
+				BitsType bits = static_cast<BitsType>(wideBits);
+				bits = (bits & Sign_Bit) ? (bits ^ Sign_Bit) : static_cast<BitsType>(~bits);
+				T value;
+				memcpy(&value, &bits, sizeof(value));
+				return value;
+			}
+		};
 #pragma endregion integraltypes
 
 #pragma region enumtypes
@@ -183,6 +465,13 @@ namespace Serialization
 		{
 			static void Apply(const T & obj, Serializer & res)
 			{
+				if (res.UsesCompactIntegers())
+				{
+					// Zigzag enums with a signed underlying type, so negative values stay small.
+					typedef typename std::underlying_type<T>::type UnderlyingType;
+					res.SerializeVarint(ZigZagEncode(static_cast<UnderlyingType>(obj)));
+					return;
+				}
 				uint64_t value = static_cast<uint64_t>(obj);
 				SerializeHelper<uint64_t>::Apply(value, res);
 			}
@@ -193,6 +482,12 @@ namespace Serialization
 		{
 			static void Apply(Deserializer & res, T & obj)
 			{
+				if (res.UsesCompactIntegers())
+				{
+					typedef typename std::underlying_type<T>::type UnderlyingType;
+					obj = static_cast<T>(ZigZagDecode<UnderlyingType>(res.DeserializeVarint()));
+					return;
+				}
 				uint64_t value;
 				DeserializeHelper<uint64_t>::Apply(res, value);
 				obj = static_cast<T>(value);
@@ -200,13 +495,44 @@ namespace Serialization
 		};
 #pragma endregion enumtypes
 
+#pragma region bulktypes
+		template <typename T>
+		struct SerializeHelper<T, typename std::enable_if<std::is_class<T>::value && IsBulkSerializable<T>::value>::type>
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "Bulk serializable types must be trivially copyable");
+			static void Apply(const T & obj, Serializer & res)
+			{
+				res.Serialize(&obj, sizeof(T));
+			}
+		};
+
+		template <typename T>
+		struct DeserializeHelper<T, typename std::enable_if<std::is_class<T>::value && IsBulkSerializable<T>::value>::type>
+		{
+			static void Apply(Deserializer & res, T & obj) { res.Deserialize(&obj, sizeof(T)); }
+		};
+#pragma endregion bulktypes
+
 #pragma region Array
-		template<typename CountType, typename T, typename Allocator>
-		struct SerializeHelper<BaseArray<CountType, T, Allocator>>
+		template<typename CountType, typename T, typename Allocator, typename GrowthPolicy, bool Copyable>
+		struct SerializeHelper<BaseArray<CountType, T, Allocator, GrowthPolicy, Copyable>>
 		{
-			static void Apply(const BaseArray<CountType, T, Allocator>& obj, Serializer& res)
+			static void Apply(const BaseArray<CountType, T, Allocator, GrowthPolicy, Copyable>& obj, Serializer& res)
 			{
+				if (FixedSerializedSize<T>::value != 0)
+				{
+					res.m_Stream.Reserve(sizeof(CountType) + Max_Data_Alignment + obj.Size() * FixedSerializedSize<T>::value);
+				}
 				SerializeHelper<CountType>::Apply(obj.Size(), res);
+				if (IsBulkSerializable<T>::value && !(IsVarintEncoded<T>::value && res.UsesCompactIntegers()))
+				{
+					res.AlignTo(alignof(T));
+					if (obj.Size() > 0)
+					{
+						res.Serialize(obj.GetBuffer(), obj.Size() * sizeof(T));
+					}
+					return;
+				}
 				for (const auto& cur : obj)
 				{
 					SerializeHelper<T>::Apply(cur, res);
@@ -214,14 +540,33 @@ namespace Serialization
 			}
 		};
 
-		template<typename CountType, typename T, typename Allocator>
-		struct DeserializeHelper<BaseArray<CountType, T, Allocator>>
+		template<typename CountType, typename T, typename Allocator, typename GrowthPolicy, bool Copyable>
+		struct DeserializeHelper<BaseArray<CountType, T, Allocator, GrowthPolicy, Copyable>>
 		{
-			static void Apply(Deserializer & res, BaseArray<CountType, T, Allocator> & obj)
+			static void Apply(Deserializer & res, BaseArray<CountType, T, Allocator, GrowthPolicy, Copyable> & obj)
 			{
 				ANIM_ASSERT(obj.Size() == 0);
 				CountType numItems;
 				DeserializeHelper<CountType>::Apply(res, numItems);
+				if (IsBulkSerializable<T>::value && !(IsVarintEncoded<T>::value && res.UsesCompactIntegers()))
+				{
+					res.SkipToAlignment(alignof(T));
+					if (numItems > 0)
+					{
+						const void * inPlace = res.DeserializeInPlace(numItems * sizeof(T));
+						if (inPlace != nullptr)
+						{
+							obj.AttachExternalBuffer(static_cast<T*>(const_cast<void*>(inPlace)), numItems);
+							return;
+						}
+						// A stream that can read in place fails instead when numItems runs past its end.
+						if (!res.IsValid())
+							return;
+						obj.Resize(numItems);
+						res.Deserialize(obj.GetBuffer(), numItems * sizeof(T));
+					}
+					return;
+				}
 				obj.Resize(numItems);
 				for (CountType i = 0; i < numItems; ++i)
 				{
@@ -229,6 +574,18 @@ namespace Serialization
 				}
 			}
 		};
+
+		template<typename T, uint32_t INLINE_CAPACITY, typename Allocator>
+		struct SerializeHelper<SmallArray<T, INLINE_CAPACITY, Allocator>>
+			: SerializeHelper<BaseArray<uint16_t, T, Allocator>>
+		{
+		};
+
+		template<typename T, uint32_t INLINE_CAPACITY, typename Allocator>
+		struct DeserializeHelper<SmallArray<T, INLINE_CAPACITY, Allocator>>
+			: DeserializeHelper<BaseArray<uint16_t, T, Allocator>>
+		{
+		};
 #pragma endregion Array
 
 #pragma region voidstar
@@ -266,7 +623,7 @@ namespace Serialization
 		template<typename T>
 		struct DeserializeHelper<T, typename std::enable_if<std::is_base_of<ISerializable, T>::value>::type>
 		{
-			static void Apply(Serializer& res, ISerializable& obj)
+			static void Apply(Deserializer& res, ISerializable& obj)
 			{
 				obj.Deserialize(res);
 			}
@@ -284,8 +641,12 @@ namespace Serialization
 				{
 					const auto & classInfo = obj->GetReflectedClassInfo();
 					ANIM_ASSERT(classInfo.GetTypeID() != 0);
-					SerializeHelper<uint64_t>::Apply(classInfo.GetTypeID(), res);
+					// Type ids are hashes, a varint would only make them longer.
+					uint64_t typeID = classInfo.GetTypeID();
+					res.Serialize(&typeID, sizeof(typeID));
+					uint32_t lengthPosition = res.BeginSizedBlock();
 					SerializeHelper<T>::Apply(*obj, res);
+					res.EndSizedBlock(lengthPosition);
 				}
 			}
 		};
@@ -300,11 +661,22 @@ namespace Serialization
 				if (hasObject)
 				{
 					uint64_t typeID = 0;
-					DeserializeHelper<uint64_t>::Apply(res, typeID);
+					res.Deserialize(&typeID, sizeof(typeID));
 					ANIM_ASSERT(typeID != 0);
 					obj = Reflection::TypeRegistry::FactoryClass<T>(typeID);
-					ANIM_ASSERT(obj != nullptr);
-					DeserializeHelper<T>::Apply(res, *obj);
+					if (res.GetFormatVersion() < 4)
+					{
+						ANIM_ASSERT(obj != nullptr);
+						DeserializeHelper<T>::Apply(res, *obj);
+						return;
+					}
+					// Objects of classes that were removed are dropped.
+					uint32_t blockEnd = res.BeginSizedBlock();
+					if (obj != nullptr)
+					{
+						DeserializeHelper<T>::Apply(res, *obj);
+					}
+					res.EndSizedBlock(blockEnd);
 				}
 			}
 		};
@@ -360,20 +732,104 @@ namespace Serialization
 			static void Apply(Deserializer& res, SimpleString& obj)
 			{
 				ANIM_ASSERT(obj.empty());
-				uint32_t strLen;
+				uint32_t strLen = 0;
 				DeserializeHelper<uint32_t>::Apply(res, strLen);
-				char* buffer = static_cast<char*>(alloca(strLen));
-				res.Deserialize(buffer, strLen);
 				obj.resize(strLen);
-				char* next = buffer;
-				for (uint32_t i = 0; i < strLen; ++i, ++buffer)
+				if (strLen > 0)
 				{
-					obj.at(i) = *buffer;
+					res.Deserialize(&obj[0], strLen);
 				}
 			}
 		};
 #pragma endregion SimpleString
 
+#pragma region StringView
+		// Same layout as SimpleString, so a field can switch between the two without a new data version.
+		template<>
+		struct SerializeHelper<StringView>
+		{
+			static void Apply(const StringView & obj, Serializer & res)
+			{
+				SerializeHelper<uint32_t>::Apply(obj.Length(), res);
+				res.Serialize(reinterpret_cast<const uint8_t*>(obj.Data()), obj.Length());
+			}
+		};
+
+		// Hands the characters of a string to consume without allocating: straight out of a mapped file if the
+		// stream supports it, else out of a scratch buffer that only goes to the heap for long strings.
+		template<typename Fn>
+		inline void DeserializeStringCharacters(Deserializer& res, Fn&& consume)
+		{
+			uint32_t strLen = 0;
+			DeserializeHelper<uint32_t>::Apply(res, strLen);
+			if (strLen == 0 || !res.IsValid())
+			{
+				consume(StringView(), false);
+				return;
+			}
+			const void* inPlace = res.DeserializeInPlace(strLen);
+			if (inPlace != nullptr)
+			{
+				consume(StringView(static_cast<const char*>(inPlace), strLen), true);
+				return;
+			}
+			if (!res.IsValid())
+			{
+				consume(StringView(), false);
+				return;
+			}
+			char scratch[256];
+			BigArray<char> heapBuffer;
+			char* buffer = scratch;
+			if (strLen > sizeof(scratch))
+			{
+				heapBuffer.Resize(strLen);
+				buffer = heapBuffer.GetBuffer();
+			}
+			res.Deserialize(buffer, strLen);
+			consume(StringView(buffer, strLen), false);
+		}
+
+		// Points into the mapped file when read in place, so the file has to stay mapped like it has to for in
+		// place arrays. Other streams go away after loading, the characters are copied into the Deserializer then
+		// and are only valid until it is destroyed. Nothing is interned here, pipe messages would grow the
+		// StringTable for good; keep a StringID or a SimpleString to hold on to a name.
+		template<>
+		struct DeserializeHelper<StringView>
+		{
+			static void Apply(Deserializer& res, StringView& obj)
+			{
+				DeserializeStringCharacters(res, [&res, &obj](StringView str, bool isInPlace)
+				{
+					obj = (str.IsEmpty() || isInPlace) ? str : res.CopyString(str);
+				});
+			}
+		};
+#pragma endregion StringView
+
+#pragma region StringID
+		template<>
+		struct SerializeHelper<StringID>
+		{
+			static void Apply(const StringID & obj, Serializer & res)
+			{
+				SerializeHelper<StringView>::Apply(StringTable::Instance().GetString(obj), res);
+			}
+		};
+
+		template<>
+		struct DeserializeHelper<StringID>
+		{
+			static void Apply(Deserializer& res, StringID& obj)
+			{
+				DeserializeStringCharacters(res, [&obj](StringView str, bool)
+				{
+					obj = str.IsEmpty() ? StringID() : StringTable::Instance().Intern(str);
+				});
+			}
+		};
+#pragma endregion StringID
+
 #pragma region UniquePtr
 		template<typename T>
 		struct SerializeHelper<UniquePtr<T>>
@@ -398,12 +854,62 @@ namespace Serialization
 #pragma endregion UniquePtr
 
 #pragma region SharedPtr
+		// Shared objects are identified through their ISerializable base when they have one, so the same object
+		// is recognized whichever pointer type in its hierarchy refers to it. Other types must always be
+		// shared through the same T.
+		template<typename T, class Enable>
+		struct SharedObjectHelper
+		{
+			static const void * GetIdentity(const T * obj) { return obj; }
+			static T * FromIdentity(void * identity) { return static_cast<T *>(identity); }
+			static void WriteType(const T *, Serializer &) {}
+			static T * Construct(Deserializer & res) { return res.FactoryObject<T>(); }
+		};
+
+		template<typename T>
+		struct SharedObjectHelper<T, typename std::enable_if<std::is_base_of<ISerializable, T>::value>::type>
+		{
+			static const void * GetIdentity(const T * obj) { return static_cast<const ISerializable *>(obj); }
+			static T * FromIdentity(void * identity) { return static_cast<T *>(static_cast<ISerializable *>(identity)); }
+
+			static void WriteType(const T * obj, Serializer & res)
+			{
+				const auto & classInfo = obj->GetReflectedClassInfo();
+				ANIM_ASSERT(classInfo.GetTypeID() != 0);
+				uint64_t typeID = classInfo.GetTypeID();
+				res.Serialize(&typeID, sizeof(typeID));
+			}
+
+			static T * Construct(Deserializer & res)
+			{
+				uint64_t typeID = 0;
+				res.Deserialize(&typeID, sizeof(typeID));
+				ANIM_ASSERT(typeID != 0);
+				return Reflection::TypeRegistry::FactoryClass<T>(typeID);
+			}
+		};
+
+		// Written as an id, 0 for null. The first occurrence of an id is followed by the object itself, later
+		// ones refer back to it, so every object is stored once and shared again after loading.
 		template<typename T>
 		struct SerializeHelper<SharedPtr<T>>
 		{
 			static void Apply(const SharedPtr<T>& obj, Serializer& res)
 			{
-				static_assert(!std::is_same<T, T>::value, "Do not support serialization of SharedPtr");
+				const T * object = obj.Get();
+				if (object == nullptr)
+				{
+					SerializeHelper<uint32_t>::Apply(0, res);
+					return;
+				}
+				bool isNew = false;
+				uint32_t id = res.GetSharedObjectID(SharedObjectHelper<T>::GetIdentity(object), isNew);
+				SerializeHelper<uint32_t>::Apply(id, res);
+				if (isNew)
+				{
+					SharedObjectHelper<T>::WriteType(object, res);
+					SerializeHelper<T>::Apply(*object, res);
+				}
 			}
 		};
 
@@ -412,11 +918,62 @@ namespace Serialization
 		{
 			static void Apply(Deserializer& res, SharedPtr<T>& obj)
 			{
-				static_assert(!std::is_same<T, T>::value, "Do not support serialization of SharedPtr");
+				uint32_t id = 0;
+				DeserializeHelper<uint32_t>::Apply(res, id);
+				if (id == 0)
+				{
+					obj = nullptr;
+					return;
+				}
+				if (id <= res.m_SharedObjects.Size())
+				{
+					const auto & shared = res.m_SharedObjects[id - 1];
+					obj = SharedPtr<T>(shared.m_Owner, SharedObjectHelper<T>::FromIdentity(shared.m_Identity));
+					return;
+				}
+
+				ANIM_ASSERT(id == res.m_SharedObjects.Size() + 1);
+				// Both factories allocate with DefaultAllocator::Create, the control block releases with
+				// DefaultAllocator::Destroy through T, which has to reach the destructor of the actual class.
+				static_assert(!std::is_base_of<ISerializable, T>::value || std::has_virtual_destructor<T>::value,
+					"Objects made by a ClassInfo factory are destroyed through a base pointer");
+				T * object = SharedObjectHelper<T>::Construct(res);
+				ANIM_ASSERT(object != nullptr);
+				obj = SharedPtr<T>(object, &shared_ptr_detail::DestroyWithAllocator<T>, nullptr);
+				// Registered before reading the object so references back to it from inside resolve.
+				Deserializer::SharedObject shared;
+				shared.m_Owner = obj;
+				shared.m_Identity = const_cast<void *>(SharedObjectHelper<T>::GetIdentity(object));
+				res.m_SharedObjects.Push(std::move(shared));
+				DeserializeHelper<T>::Apply(res, *object);
 			}
 		};
 #pragma endregion SharedPtr
 
+#pragma region WeakPtr
+		// Cycles have to go through a WeakPtr. An object first reached through a WeakPtr is owned by the
+		// Deserializer until a SharedPtr picks it up, and expires with the Deserializer otherwise.
+		template<typename T>
+		struct SerializeHelper<WeakPtr<T>>
+		{
+			static void Apply(const WeakPtr<T>& obj, Serializer& res)
+			{
+				SerializeHelper<SharedPtr<T>>::Apply(obj.Lock(), res);
+			}
+		};
+
+		template<typename T>
+		struct DeserializeHelper<WeakPtr<T>>
+		{
+			static void Apply(Deserializer& res, WeakPtr<T>& obj)
+			{
+				SharedPtr<T> shared;
+				DeserializeHelper<SharedPtr<T>>::Apply(res, shared);
+				obj = shared.GetWeakPtr();
+			}
+		};
+#pragma endregion WeakPtr
+
 #pragma region ObjectID
 		template<>
 		struct SerializeHelper<ObjectID>
@@ -450,61 +1007,131 @@ namespace Serialization
 		template<typename T>
 		struct DeserializeHelper<Reference<T>>
 		{
-			static void Apply(const Reference<T>& obj, Serializer& res)
+			// Only kicks off the load, so every reference in a graph streams in in parallel.
+			static void Apply(Deserializer& res, Reference<T>& obj)
 			{
 				DeserializeHelper<ObjectID>::Apply(res, obj.m_ObjectID);
-				obj.m_ObjPtr = ObjectManager::Instance().LoadManagedObject(obj.m_ObjectID);
+				obj.SetLoad(ObjectManager::Instance().LoadManagedObjectAsync<T>(obj.m_ObjectID));
 			}
 		};
 #pragma endregion Reference
 	}
 
+	// Single pass: the stream grows as needed instead of being sized by walking the graph twice.
 	template <typename T>
-	inline uint32_t Serializer::GetSize(T * obj) const
+	typename std::enable_if<!std::is_pointer<T>::value, void>::type Serializer::Serialize(const T & obj)
 	{
-		ImplDetails::SizeAccumulator acc;
-		Serializer res(acc, m_Version);
-		res.Serialize(obj);
-		return acc.GetNumBytesWritten();
+		ImplDetails::SerializeHelper<T>::Apply(obj, *this);
 	}
 
-
 	template <typename T>
-	inline typename std::enable_if<!std::is_pointer<T>::value, uint32_t>::type Serializer::GetSize(const T & obj) const
+	void Serializer::Serialize(T * obj)
 	{
-		ImplDetails::SizeAccumulator acc;
-		Serializer res(acc, m_Version);
-		res.Serialize(obj);
-		return acc.GetNumBytesWritten();
+		ImplDetails::SerializeHelper<T *>::Apply(obj, *this);
 	}
 
-	template <typename T>
-	typename std::enable_if<!std::is_pointer<T>::value, void>::type Serializer::Serialize(const T & obj)
+	inline void Serializer::Serialize(const void * src, uint32_t numBytes)
+	{
+		m_Stream.Write(src, numBytes);
+	}
+
+	inline void Serializer::SerializeVarint(uint64_t value)
 	{
-		if (m_RecursiveCount++ == 0)
+		uint8_t buffer[10];
+		uint32_t numBytes = 0;
+		while (value >= 0x80)
 		{
-			uint32_t size = GetSize(obj);
-			m_Stream.Reserve(size);
+			buffer[numBytes++] = static_cast<uint8_t>(value) | 0x80;
+			value >>= 7;
 		}
-		ImplDetails::SerializeHelper<T>::Apply(obj, *this);
-		--m_RecursiveCount;
+		buffer[numBytes++] = static_cast<uint8_t>(value);
+		m_Stream.Write(buffer, numBytes);
 	}
 
-	template <typename T>
-	void Serializer::Serialize(T * obj)
+	template <typename ArrayType>
+	void Serializer::SerializeSortedKeys(const ArrayType & keys)
 	{
-		if (m_RecursiveCount++ == 0)
+		if (!UsesCompactIntegers())
 		{
-			uint32_t size = GetSize<T>(obj);
-			m_Stream.Reserve(size);
+			Serialize(keys);
+			return;
+		}
+		typedef typename std::remove_cv<typename std::remove_reference<decltype(keys[0])>::type>::type KeyType;
+		const uint32_t numKeys = keys.Size();
+		SerializeVarint(numKeys);
+		uint64_t previous = 0;
+		for (uint32_t i = 0; i < numKeys; ++i)
+		{
+			uint64_t bits = ImplDetails::SortedKeyBits<KeyType>::ToBits(keys[i]);
+			SerializeVarint(bits - previous);
+			previous = bits;
 		}
-		ImplDetails::SerializeHelper<T *>::Apply(obj, *this);
-		--m_RecursiveCount;
 	}
 
-	inline void Serializer::Serialize(const void * src, uint32_t numBytes)
+	template <typename ArrayType>
+	void Serializer::SerializeTolerantFloats(const ArrayType & values)
 	{
-		m_Stream.Write(src, numBytes);
+		if ((m_EncodingFlags & Encoding_Half_Float_Channels) == 0)
+		{
+			Serialize(values);
+			return;
+		}
+		const uint32_t numValues = values.Size();
+		ImplDetails::SerializeHelper<uint32_t>::Apply(numValues, *this);
+		AlignTo(alignof(uint16_t));
+		uint16_t buffer[256];
+		for (uint32_t first = 0; first < numValues; first += 256)
+		{
+			uint32_t count = numValues - first < 256 ? numValues - first : 256;
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				buffer[i] = FloatToHalf(values[first + i]);
+			}
+			m_Stream.Write(buffer, count * sizeof(uint16_t));
+		}
+	}
+
+	inline uint32_t Serializer::BeginField(uint32_t tag)
+	{
+		ANIM_ASSERT(tag != 0);
+		m_Stream.Write(&tag, sizeof(tag));
+		return BeginSizedBlock();
+	}
+
+	inline void Serializer::EndField(uint32_t lengthPosition)
+	{
+		EndSizedBlock(lengthPosition);
+	}
+
+	inline uint32_t Serializer::BeginSizedBlock()
+	{
+		uint32_t lengthPosition = m_Stream.GetNumBytesWritten();
+		uint32_t length = 0;
+		m_Stream.Write(&length, sizeof(length));
+		return lengthPosition;
+	}
+
+	inline void Serializer::EndSizedBlock(uint32_t lengthPosition)
+	{
+		uint32_t length = m_Stream.GetNumBytesWritten() - lengthPosition - sizeof(uint32_t);
+		m_Stream.Patch(lengthPosition, &length, sizeof(length));
+	}
+
+	inline void Serializer::EndFields()
+	{
+		uint32_t endTag = 0;
+		m_Stream.Write(&endTag, sizeof(endTag));
+	}
+
+	inline void Serializer::AlignTo(uint32_t alignment)
+	{
+		static const uint8_t padding[Max_Data_Alignment] = {};
+		ANIM_ASSERT(alignment <= Max_Data_Alignment);
+		uint32_t offset = (m_Stream.GetNumBytesWritten() - m_BaseOffset) % alignment;
+		if (offset != 0)
+		{
+			m_Stream.Write(padding, alignment - offset);
+		}
 	}
 
 	template <typename T>
@@ -522,6 +1149,132 @@ namespace Serialization
 		m_Stream.Read(dst, numBytes);
 	}
 
+	inline void Deserializer::SkipToAlignment(uint32_t alignment)
+	{
+		// Array data was not padded before format 3.
+		if (!m_IsValid || m_FormatVersion < 3)
+			return;
+		uint32_t offset = (m_Stream.GetNumBytesRead() - m_BaseOffset) % alignment;
+		if (offset != 0)
+		{
+			m_Stream.Skip(alignment - offset);
+		}
+	}
+
+	inline const void * Deserializer::DeserializeInPlace(uint32_t numBytes)
+	{
+		if (!m_IsValid || m_FormatVersion < 3)
+			return nullptr;
+		return m_Stream.ReadInPlace(numBytes);
+	}
+
+	inline uint64_t Deserializer::DeserializeVarint()
+	{
+		uint64_t value = 0;
+		if (!m_IsValid)
+			return value;
+		for (uint32_t shift = 0; shift < 64; shift += 7)
+		{
+			uint8_t byte = 0;
+			m_Stream.Read(&byte, sizeof(byte));
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+				break;
+		}
+		return value;
+	}
+
+	template <typename ArrayType>
+	void Deserializer::DeserializeSortedKeys(ArrayType & keys)
+	{
+		if (!UsesCompactIntegers())
+		{
+			Deserialize(keys);
+			return;
+		}
+		typedef typename std::remove_cv<typename std::remove_reference<decltype(keys[0])>::type>::type KeyType;
+		ANIM_ASSERT(keys.Size() == 0);
+		const uint32_t numKeys = static_cast<uint32_t>(DeserializeVarint());
+		keys.Resize(numKeys);
+		uint64_t bits = 0;
+		for (uint32_t i = 0; i < numKeys; ++i)
+		{
+			bits += DeserializeVarint();
+			keys[i] = ImplDetails::SortedKeyBits<KeyType>::FromBits(bits);
+		}
+	}
+
+	template <typename ArrayType>
+	void Deserializer::DeserializeTolerantFloats(ArrayType & values)
+	{
+		if ((m_EncodingFlags & Encoding_Half_Float_Channels) == 0)
+		{
+			Deserialize(values);
+			return;
+		}
+		ANIM_ASSERT(values.Size() == 0);
+		uint32_t numValues = 0;
+		ImplDetails::DeserializeHelper<uint32_t>::Apply(*this, numValues);
+		SkipToAlignment(alignof(uint16_t));
+		values.Resize(numValues);
+		uint16_t buffer[256];
+		for (uint32_t first = 0; first < numValues; first += 256)
+		{
+			uint32_t count = numValues - first < 256 ? numValues - first : 256;
+			Deserialize(buffer, count * sizeof(uint16_t));
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				values[first + i] = HalfToFloat(buffer[i]);
+			}
+		}
+	}
+
+	inline uint32_t Deserializer::BeginSizedBlock()
+	{
+		uint32_t length = 0;
+		if (m_IsValid)
+		{
+			m_Stream.Read(&length, sizeof(length));
+		}
+		return m_Stream.GetNumBytesRead() + length;
+	}
+
+	inline void Deserializer::EndSizedBlock(uint32_t blockEnd)
+	{
+		if (!m_IsValid)
+			return;
+		uint32_t position = m_Stream.GetNumBytesRead();
+		ANIM_ASSERT(position <= blockEnd);
+		m_Stream.Skip(blockEnd - position);
+	}
+
+	inline StringView Deserializer::CopyString(StringView str)
+	{
+		BigArray<char> & copy = m_CopiedStrings.EmplaceBack();
+		copy.Resize(str.Length());
+		memcpy(copy.GetBuffer(), str.Data(), str.Length());
+		return StringView(copy.GetBuffer(), str.Length());
+	}
+
+	inline bool Deserializer::FieldReader::Next()
+	{
+		if (m_Tag != 0)
+		{
+			m_Deserializer.EndSizedBlock(m_FieldEnd);
+			m_Tag = 0;
+		}
+		if (!m_Deserializer.m_IsValid)
+			return false;
+
+		uint32_t tag = 0;
+		m_Deserializer.m_Stream.Read(&tag, sizeof(tag));
+		if (tag == 0)
+			return false;
+		m_Tag = tag;
+		m_FieldEnd = m_Deserializer.BeginSizedBlock();
+		return true;
+	}
+
 	template <typename T>
 	inline T * Deserializer::FactoryObject()
 	{
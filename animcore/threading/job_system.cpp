@@ -0,0 +1,88 @@
+#include "job_system.h"
+
+ANIM_NAMESPACE_BEGIN
+
+static thread_local bool t_IsWorkerThread = false;
+
+JobSystem::JobSystem(uint32_t numWorkers)
+	: m_IsShuttingDown(false)
+{
+	if (numWorkers == 0)
+	{
+		uint32_t numHardwareThreads = std::thread::hardware_concurrency();
+		numWorkers = numHardwareThreads > 1 ? numHardwareThreads - 1 : 1;
+	}
+	m_Workers.Reserve(numWorkers);
+	for (uint32_t i = 0; i < numWorkers; ++i)
+	{
+		m_Workers.EmplaceBack([this]() { WorkerMain(); });
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_IsShuttingDown = true;
+	}
+	m_JobAvailable.notify_all();
+	for (auto& worker : m_Workers)
+	{
+		worker.join();
+	}
+}
+
+void JobSystem::Schedule(Job job)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Jobs.push_back(std::move(job));
+	}
+	m_JobAvailable.notify_one();
+}
+
+bool JobSystem::TryRunJob(std::unique_lock<std::mutex>& lock)
+{
+	if (m_Jobs.empty())
+		return false;
+
+	Job job = std::move(m_Jobs.front());
+	m_Jobs.pop_front();
+	lock.unlock();
+	job();
+	job = nullptr;
+	lock.lock();
+	m_JobFinished.notify_all();
+	return true;
+}
+
+void JobSystem::WaitUntil(const std::function<bool()>& isDone)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (!isDone())
+	{
+		if (!TryRunJob(lock))
+			m_JobFinished.wait(lock);
+	}
+}
+
+bool JobSystem::IsWorkerThread()
+{
+	return t_IsWorkerThread;
+}
+
+void JobSystem::WorkerMain()
+{
+	t_IsWorkerThread = true;
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (true)
+	{
+		if (TryRunJob(lock))
+			continue;
+		if (m_IsShuttingDown)
+			break;
+		m_JobAvailable.wait(lock);
+	}
+}
+
+ANIM_NAMESPACE_END
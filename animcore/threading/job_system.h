@@ -0,0 +1,51 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "animcore/util/namespace.h"
+#include "animcore/containers/array.h"
+#include "animcore/containers/singleton.h"
+#include "animcore/memory/default_allocator.h"
+
+ANIM_NAMESPACE_BEGIN
+
+// Fixed pool of worker threads draining a single FIFO job queue.
+// Jobs must not block on other jobs; use WaitUntil instead, which keeps running queued jobs on the
+// waiting thread so nested waits cannot starve the pool.
+class JobSystem : public Singleton<JobSystem>
+{
+public:
+	typedef std::function<void()> Job;
+
+	// 0 workers picks one per hardware thread, minus the calling thread.
+	explicit JobSystem(uint32_t numWorkers = 0);
+	// Runs every job that is still queued before joining the workers.
+	~JobSystem();
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	void Schedule(Job job);
+	// Executes queued jobs on the calling thread until isDone returns true. isDone is re-evaluated
+	// every time a job finishes anywhere in the pool.
+	void WaitUntil(const std::function<bool()>& isDone);
+
+	uint32_t GetNumWorkers() const { return m_Workers.Size(); }
+	static bool IsWorkerThread();
+
+private:
+	bool TryRunJob(std::unique_lock<std::mutex>& lock);
+	void WorkerMain();
+
+	std::mutex m_Mutex;
+	std::condition_variable m_JobAvailable;
+	std::condition_variable m_JobFinished;
+	std::deque<Job, DefaultSTDAllocator<Job>> m_Jobs;
+	BigArray<std::thread> m_Workers;
+	bool m_IsShuttingDown;
+};
+
+ANIM_NAMESPACE_END
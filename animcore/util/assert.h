@@ -1,9 +1,12 @@
 #pragma once
+#include <stdlib.h>
 #include "namespace.h"
 
 ANIM_NAMESPACE_BEGIN
 
 #define ANIM_ASSERT(expr)
 #define ANIM_ASSERT_SLOW(expr)
+// Checked in every build, for errors that would corrupt memory if execution went on.
+#define ANIM_VERIFY(expr) do { if (!(expr)) abort(); } while (false)
 
 ANIM_NAMESPACE_END
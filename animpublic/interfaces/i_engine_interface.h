@@ -10,6 +10,7 @@ public:
 	IEngineInterface() {}
 	virtual void InitializeRuntime() = 0;
 	virtual void FinalizeRuntime() = 0;
+	virtual void BeginFrame() = 0;
 	virtual void RegisterCoreCommands(CoreCommands& commandStruct) = 0;
 	virtual ~IEngineInterface() {}
 private:
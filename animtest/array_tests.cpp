@@ -0,0 +1,215 @@
+#include "array_tests.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "animcore/containers/array.h"
+#include "animcore/memory/pointers.h"
+#include "test_harness.h"
+
+using namespace animengine;
+
+namespace
+{
+	// Counts how it is constructed, copied and moved to check that relocation moves elements.
+	struct TrackedValue
+	{
+		static uint32_t s_NumAlive;
+		static uint32_t s_NumCopies;
+
+		TrackedValue(uint32_t value) : m_Value(value) { ++s_NumAlive; }
+		TrackedValue(const TrackedValue& other) : m_Value(other.m_Value) { ++s_NumAlive; ++s_NumCopies; }
+		TrackedValue(TrackedValue&& other) : m_Value(other.m_Value) { other.m_Value = 0; ++s_NumAlive; }
+		~TrackedValue() { --s_NumAlive; }
+		TrackedValue& operator=(const TrackedValue& other) { m_Value = other.m_Value; ++s_NumCopies; return *this; }
+		TrackedValue& operator=(TrackedValue&& other) { m_Value = other.m_Value; other.m_Value = 0; return *this; }
+
+		uint32_t m_Value;
+	};
+
+	uint32_t TrackedValue::s_NumAlive = 0;
+	uint32_t TrackedValue::s_NumCopies = 0;
+
+	template<typename GrowthPolicy>
+	using PolicyArray = BaseArray<uint32_t, uint32_t, DefaultAllocatorT<uint32_t>, GrowthPolicy>;
+
+	// Capacities an array goes through while numPushes elements are pushed.
+	template<typename GrowthPolicy>
+	std::vector<uint32_t> GetCapacities(uint32_t numPushes)
+	{
+		std::vector<uint32_t> capacities;
+		PolicyArray<GrowthPolicy> values;
+		for (uint32_t i = 0; i < numPushes; ++i)
+		{
+			values.Push(i);
+			if (capacities.empty() || capacities.back() != values.Capacity())
+				capacities.push_back(values.Capacity());
+		}
+		return capacities;
+	}
+
+	void TestGrowthPolicies()
+	{
+		ANIM_CHECK((GetCapacities<DefaultArrayGrowthPolicy>(20) == std::vector<uint32_t>{ 4, 6, 9, 13, 19, 28 }));
+		ANIM_CHECK((GetCapacities<DoublingArrayGrowthPolicy>(20) == std::vector<uint32_t>{ 4, 8, 16, 32 }));
+		ANIM_CHECK((GetCapacities<ExactArrayGrowthPolicy>(5) == std::vector<uint32_t>{ 1, 2, 3, 4, 5 }));
+
+		BigArray<uint32_t> values;
+		bool isIntact = true;
+		for (uint32_t i = 0; i < 100000; ++i)
+		{
+			values.Push(i * 7);
+		}
+		for (uint32_t i = 0; i < values.Size(); ++i)
+		{
+			isIntact &= values[i] == i * 7;
+		}
+		ANIM_CHECK(values.Size() == 100000);
+		ANIM_CHECK(isIntact);
+		values.ShrinkToFit();
+		ANIM_CHECK(values.Capacity() == values.Size());
+	}
+
+	void TestRelocationMoves()
+	{
+		{
+			Array<TrackedValue> values;
+			for (uint32_t i = 1; i <= 1000; ++i)
+			{
+				values.Push(TrackedValue(i));
+			}
+			bool isIntact = true;
+			for (uint32_t i = 0; i < values.Size(); ++i)
+			{
+				isIntact &= values[i].m_Value == i + 1;
+			}
+			ANIM_CHECK(isIntact);
+			ANIM_CHECK(TrackedValue::s_NumCopies == 0);
+			ANIM_CHECK(TrackedValue::s_NumAlive == 1000);
+
+			// The argument refers to an element that moves when the push reallocates.
+			while (values.Size() < values.Capacity())
+			{
+				values.EmplaceBack(0u);
+			}
+			values.EmplaceBack(values[0]);
+			ANIM_CHECK(values.Last().m_Value == 1);
+			ANIM_CHECK(values[0].m_Value == 1);
+		}
+		ANIM_CHECK(TrackedValue::s_NumAlive == 0);
+
+		Array<UniquePtr<uint32_t>> owners;
+		for (uint32_t i = 0; i < 100; ++i)
+		{
+			owners.EmplaceBack(UniquePtr<uint32_t>::MakeUnique(i));
+		}
+		ANIM_CHECK(*owners[99].Get() == 99);
+		// Removing does not keep the order, the last element moves into the gap.
+		owners.RemoveAt(0);
+		ANIM_CHECK(owners.Size() == 99 && *owners[0].Get() == 99);
+	}
+
+	void TestCountLimit()
+	{
+		// Array counts in uint16_t and can hold exactly its maximum, one more aborts.
+		Array<uint8_t> values;
+		for (uint32_t i = 0; i < std::numeric_limits<uint16_t>::max(); ++i)
+		{
+			values.Push(static_cast<uint8_t>(i));
+		}
+		ANIM_CHECK(values.Size() == std::numeric_limits<uint16_t>::max());
+		ANIM_CHECK(values.Capacity() == std::numeric_limits<uint16_t>::max());
+		ANIM_CHECK(values.Last() == static_cast<uint8_t>(std::numeric_limits<uint16_t>::max() - 1));
+	}
+
+	void TestSmallArray()
+	{
+		{
+			SmallArray<TrackedValue, 4> values;
+			for (uint32_t i = 1; i <= 4; ++i)
+			{
+				values.EmplaceBack(i);
+			}
+			ANIM_CHECK(values.IsInline());
+			values.EmplaceBack(5u);
+			ANIM_CHECK(!values.IsInline() && values.Size() == 5);
+
+			// A moved-from array that had spilled is empty and usable with its inline buffer again.
+			SmallArray<TrackedValue, 4> moved(std::move(values));
+			ANIM_CHECK(moved.Size() == 5 && moved[4].m_Value == 5);
+			ANIM_CHECK(values.Size() == 0 && values.IsInline());
+			values.EmplaceBack(6u);
+			ANIM_CHECK(values.IsInline() && values[0].m_Value == 6);
+
+			SmallArray<TrackedValue, 4> assigned;
+			assigned = std::move(moved);
+			ANIM_CHECK(moved.Size() == 0 && moved.IsInline());
+
+			// Shrinking returns to the inline buffer once the elements fit.
+			assigned.Pop();
+			assigned.Pop();
+			assigned.ShrinkToFit();
+			ANIM_CHECK(assigned.IsInline() && assigned.Size() == 3);
+			ANIM_CHECK(assigned[0].m_Value == 1 && assigned[2].m_Value == 3);
+
+			SmallArray<TrackedValue, 4> copy(assigned);
+			ANIM_CHECK(copy.IsInline() && copy.Size() == 3 && copy[1].m_Value == 2);
+		}
+		ANIM_CHECK(TrackedValue::s_NumAlive == 0);
+	}
+
+	template<typename ArrayType, typename MakeValue>
+	void BenchmarkPushes(const char* name, uint32_t numPushes, MakeValue makeValue)
+	{
+		auto start = BenchmarkClock::now();
+		ArrayType values;
+		uint32_t numReallocations = 0;
+		for (uint32_t i = 0; i < numPushes; ++i)
+		{
+			auto capacity = values.Capacity();
+			values.Push(makeValue(i));
+			numReallocations += values.Capacity() != capacity ? 1 : 0;
+		}
+		double seconds = SecondsSince(start);
+		UseBenchmarkResult(values.Size());
+		printf("  %-28s %10u pushes %8.2f ns/push %6u reallocations\n", name, numPushes, seconds * 1e9 / numPushes, numReallocations);
+	}
+
+	// std::vector with the names BenchmarkPushes uses.
+	template<typename T>
+	struct Vector : std::vector<T>
+	{
+		size_t Capacity() const { return std::vector<T>::capacity(); }
+		void Push(T&& value) { std::vector<T>::push_back(std::move(value)); }
+		void Push(const T& value) { std::vector<T>::push_back(value); }
+		size_t Size() const { return std::vector<T>::size(); }
+	};
+}
+
+void RunArrayTests()
+{
+	TestGrowthPolicies();
+	TestRelocationMoves();
+	TestCountLimit();
+	TestSmallArray();
+}
+
+void RunArrayBenchmark()
+{
+	const uint32_t Num_Values = 10000000;
+	const uint32_t Num_Strings = 1000000;
+	const uint32_t Num_Exact = 50000;
+	auto makeInt = [](uint32_t i) { return i; };
+	auto makeString = [](uint32_t i) { return std::string(32, static_cast<char>('a' + i % 26)); };
+
+	printf("array push, uint32_t:\n");
+	BenchmarkPushes<BaseArray<uint32_t, uint32_t, DefaultAllocatorT<uint32_t>, DefaultArrayGrowthPolicy>>("BigArray 1.5x", Num_Values, makeInt);
+	BenchmarkPushes<BaseArray<uint32_t, uint32_t, DefaultAllocatorT<uint32_t>, DoublingArrayGrowthPolicy>>("BigArray 2x", Num_Values, makeInt);
+	BenchmarkPushes<BaseArray<uint32_t, uint32_t, DefaultAllocatorT<uint32_t>, ExactArrayGrowthPolicy>>("BigArray exact", Num_Exact, makeInt);
+	BenchmarkPushes<Vector<uint32_t>>("std::vector", Num_Values, makeInt);
+
+	printf("array push, 32 character std::string:\n");
+	BenchmarkPushes<BaseArray<uint32_t, std::string, DefaultAllocatorT<std::string>, DefaultArrayGrowthPolicy>>("BigArray 1.5x", Num_Strings, makeString);
+	BenchmarkPushes<BaseArray<uint32_t, std::string, DefaultAllocatorT<std::string>, DoublingArrayGrowthPolicy>>("BigArray 2x", Num_Strings, makeString);
+	BenchmarkPushes<BaseArray<uint32_t, std::string, DefaultAllocatorT<std::string>, ExactArrayGrowthPolicy>>("BigArray exact", Num_Exact, makeString);
+	BenchmarkPushes<Vector<std::string>>("std::vector", Num_Strings, makeString);
+}
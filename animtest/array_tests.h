@@ -0,0 +1,5 @@
+#pragma once
+
+void RunArrayTests();
+// Pushes into BaseArray with each growth policy and into std::vector, for trivially copyable and movable elements.
+void RunArrayBenchmark();
@@ -0,0 +1,331 @@
+#include "compressed_stream_tests.h"
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <vector>
+#include <string.h>
+#include "animcore/serialization/block_codec.h"
+#include "animcore/serialization/chunked_write_stream.h"
+#include "animcore/serialization/compressed_stream.h"
+#include "animcore/serialization/memory_stream.h"
+#include "animcore/serialization/serialization.h"
+#include "test_harness.h"
+
+using namespace animengine;
+using namespace animengine::Serialization;
+
+namespace
+{
+	// Curves sampled at 1/1000 precision, like the float channels of a clip, num curves of numSamples floats.
+	std::vector<uint8_t> MakeCurveData(uint32_t numCurves, uint32_t numSamples)
+	{
+		std::vector<float> samples;
+		samples.reserve(numCurves * numSamples);
+		for (uint32_t curve = 0; curve < numCurves; ++curve)
+		{
+			for (uint32_t i = 0; i < numSamples; ++i)
+			{
+				samples.push_back(std::round(std::sin(i * 0.001f * curve) * 1000.0f) / 1000.0f);
+			}
+		}
+		std::vector<uint8_t> bytes(samples.size() * sizeof(float));
+		memcpy(bytes.data(), samples.data(), bytes.size());
+		return bytes;
+	}
+
+	std::vector<uint8_t> CopyOut(const ChunkedWriteStream& stream)
+	{
+		std::vector<uint8_t> bytes(stream.GetNumBytesWritten());
+		stream.CopyTo(bytes.data());
+		return bytes;
+	}
+
+	std::vector<uint8_t> CompressStream(const std::vector<uint8_t>& raw, CompressionCodec codec, uint32_t blockSize)
+	{
+		ChunkedWriteStream output;
+		{
+			CompressedWriteStream compressed(output, codec, blockSize);
+			compressed.Write(raw.data(), static_cast<uint32_t>(raw.size()));
+			compressed.Finish();
+		}
+		return CopyOut(output);
+	}
+
+	void TestBlockRoundTrip()
+	{
+		std::vector<uint8_t> raw = MakeCurveData(4, 4096);
+		std::mt19937 random(29);
+		std::vector<uint8_t> noise(4096);
+		for (uint8_t& byte : noise)
+		{
+			byte = static_cast<uint8_t>(random());
+		}
+
+		uint32_t rawSize = static_cast<uint32_t>(raw.size());
+		std::vector<uint8_t> compressed(BlockCodec::GetMaxCompressedSize(CompressionCodec::LZ4, rawSize));
+		uint32_t compressedSize = BlockCodec::Compress(CompressionCodec::LZ4, raw.data(), rawSize, compressed.data(), static_cast<uint32_t>(compressed.size()));
+		ANIM_CHECK(compressedSize > 0 && compressedSize < rawSize);
+		std::vector<uint8_t> decoded(rawSize);
+		ANIM_CHECK(BlockCodec::Decompress(CompressionCodec::LZ4, compressed.data(), compressedSize, decoded.data(), rawSize));
+		ANIM_CHECK(decoded == raw);
+
+		// Incompressible data is reported as such instead of growing.
+		std::vector<uint8_t> noiseOut(BlockCodec::GetMaxCompressedSize(CompressionCodec::LZ4, 4096));
+		ANIM_CHECK(BlockCodec::Compress(CompressionCodec::LZ4, noise.data(), 4096, noiseOut.data(), static_cast<uint32_t>(noiseOut.size())) == 0);
+
+		// Compression stops at dstCapacity, the guard bytes after it stay untouched.
+		bool isBounded = true;
+		for (uint32_t capacity : { 0u, 1u, 16u, compressedSize / 2, compressedSize - 1 })
+		{
+			std::vector<uint8_t> small(capacity + 64, 0xCD);
+			isBounded &= BlockCodec::Compress(CompressionCodec::LZ4, raw.data(), rawSize, small.data(), capacity) == 0;
+			for (uint32_t i = capacity; i < small.size(); ++i)
+			{
+				isBounded &= small[i] == 0xCD;
+			}
+		}
+		ANIM_CHECK(isBounded);
+		ANIM_CHECK(BlockCodec::Compress(CompressionCodec::LZ4, raw.data(), rawSize, compressed.data(), compressedSize) == compressedSize);
+	}
+
+	void TestCorruptBlocksAreRejected()
+	{
+		std::vector<uint8_t> raw = MakeCurveData(2, 2048);
+		uint32_t rawSize = static_cast<uint32_t>(raw.size());
+		std::vector<uint8_t> compressed(BlockCodec::GetMaxCompressedSize(CompressionCodec::LZ4, rawSize));
+		uint32_t compressedSize = BlockCodec::Compress(CompressionCodec::LZ4, raw.data(), rawSize, compressed.data(), static_cast<uint32_t>(compressed.size()));
+		compressed.resize(compressedSize);
+
+		// Every truncation fails. The output buffers are exactly rawSize bytes, so the ASan build catches
+		// writes past them.
+		bool isRejected = true;
+		for (uint32_t size = 0; size < compressedSize; ++size)
+		{
+			std::vector<uint8_t> truncated(compressed.begin(), compressed.begin() + size);
+			std::vector<uint8_t> decoded(rawSize);
+			isRejected &= !BlockCodec::Decompress(CompressionCodec::LZ4, truncated.data(), size, decoded.data(), rawSize);
+		}
+		ANIM_CHECK(isRejected);
+
+		// Too little or too much room for the output fails too.
+		std::vector<uint8_t> decoded(rawSize + 1);
+		ANIM_CHECK(!BlockCodec::Decompress(CompressionCodec::LZ4, compressed.data(), compressedSize, decoded.data(), rawSize - 1));
+		ANIM_CHECK(!BlockCodec::Decompress(CompressionCodec::LZ4, compressed.data(), compressedSize, decoded.data(), rawSize + 1));
+
+		// Random damage either fails or decodes to rawSize bytes, never more.
+		std::mt19937 random(31);
+		uint32_t numRejected = 0;
+		for (uint32_t i = 0; i < 2000; ++i)
+		{
+			std::vector<uint8_t> damaged = compressed;
+			for (uint32_t j = 0; j < 1 + i % 4; ++j)
+			{
+				damaged[random() % compressedSize] ^= static_cast<uint8_t>(1 + random() % 255);
+			}
+			std::vector<uint8_t> output(rawSize);
+			numRejected += BlockCodec::Decompress(CompressionCodec::LZ4, damaged.data(), compressedSize, output.data(), rawSize) ? 0 : 1;
+		}
+		ANIM_CHECK(numRejected > 0);
+	}
+
+	void TestCompressedStreamRoundTrip()
+	{
+		// Serialized through a compressed stream with small blocks, so values and arrays straddle blocks.
+		std::vector<uint8_t> curves = MakeCurveData(3, 1000);
+		BigArray<float> samples;
+		samples.Resize(static_cast<uint32_t>(curves.size() / sizeof(float)));
+		memcpy(samples.GetBuffer(), curves.data(), curves.size());
+		BigArray<uint32_t> ids;
+		for (uint32_t i = 0; i < 777; ++i)
+		{
+			ids.Push(i * 7919u);
+		}
+
+		ChunkedWriteStream output;
+		{
+			CompressedWriteStream compressed(output, CompressionCodec::LZ4, 1024);
+			Serializer res(compressed, 1);
+			res.Serialize(ids);
+			res.Serialize(samples);
+			res.Serialize(static_cast<uint32_t>(0xFEEDu));
+			compressed.Finish();
+		}
+		std::vector<uint8_t> bytes = CopyOut(output);
+
+		MemoryStream input(bytes.data(), static_cast<uint32_t>(bytes.size()));
+		CompressedReadStream decompressed(input);
+		ANIM_CHECK(decompressed.IsValid());
+		BigArray<uint32_t> loadedIDs;
+		BigArray<float> loadedSamples;
+		uint32_t last = 0;
+		{
+			Deserializer res(decompressed);
+			res.Deserialize(loadedIDs);
+			res.Deserialize(loadedSamples);
+			res.Deserialize(last);
+			ANIM_CHECK(res.IsValid());
+		}
+		ANIM_CHECK(loadedIDs.Size() == ids.Size() && memcmp(loadedIDs.GetBuffer(), ids.GetBuffer(), ids.Size() * sizeof(uint32_t)) == 0);
+		ANIM_CHECK(loadedSamples.Size() == samples.Size() && memcmp(loadedSamples.GetBuffer(), samples.GetBuffer(), curves.size()) == 0);
+		ANIM_CHECK(last == 0xFEEDu);
+
+		// The whole stream decodes at once to the same bytes.
+		uint64_t rawSize = GetDecompressedSize(bytes.data(), bytes.size());
+		ANIM_CHECK(rawSize == decompressed.GetNumBytesRead());
+		std::vector<uint8_t> raw(static_cast<size_t>(rawSize));
+		ANIM_CHECK(DecompressParallel(bytes.data(), bytes.size(), raw.data()));
+		MemoryStream rawInput(raw.data(), static_cast<uint32_t>(raw.size()));
+		BigArray<uint32_t> rawIDs;
+		{
+			Deserializer res(rawInput);
+			res.Deserialize(rawIDs);
+			ANIM_CHECK(res.IsValid());
+		}
+		ANIM_CHECK(rawIDs.Size() == ids.Size() && memcmp(rawIDs.GetBuffer(), ids.GetBuffer(), ids.Size() * sizeof(uint32_t)) == 0);
+	}
+
+	void TestCorruptStreamsFail()
+	{
+		std::vector<uint8_t> raw = MakeCurveData(2, 3000);
+		std::vector<uint8_t> bytes = CompressStream(raw, CompressionCodec::LZ4, 4096);
+
+		// Cut anywhere, reading the raw size fails instead of returning garbage.
+		bool isRejected = true;
+		for (uint32_t size = 0; size < bytes.size(); size += 1 + size / 16)
+		{
+			std::vector<uint8_t> truncated(bytes.begin(), bytes.begin() + size);
+			MemoryStream input(truncated.data(), size);
+			CompressedReadStream decompressed(input);
+			std::vector<uint8_t> decoded(raw.size());
+			decompressed.Read(decoded.data(), static_cast<uint32_t>(decoded.size()));
+			isRejected &= !decompressed.IsValid() || decompressed.HasFailed();
+			isRejected &= GetDecompressedSize(truncated.data(), size) == 0;
+		}
+		ANIM_CHECK(isRejected);
+
+		// Damaged blocks fail, or decode to the right size, but never crash or overrun.
+		std::mt19937 random(37);
+		uint32_t numFailed = 0;
+		for (uint32_t i = 0; i < 500; ++i)
+		{
+			std::vector<uint8_t> damaged = bytes;
+			damaged[random() % damaged.size()] ^= static_cast<uint8_t>(1 + random() % 255);
+			MemoryStream input(damaged.data(), static_cast<uint32_t>(damaged.size()));
+			CompressedReadStream decompressed(input);
+			std::vector<uint8_t> decoded(raw.size());
+			decompressed.Read(decoded.data(), static_cast<uint32_t>(decoded.size()));
+			numFailed += !decompressed.IsValid() || decompressed.HasFailed() || decoded != raw ? 1 : 0;
+
+			uint64_t rawSize = GetDecompressedSize(damaged.data(), damaged.size());
+			if (rawSize > 0 && rawSize <= raw.size() * 2)
+			{
+				std::vector<uint8_t> parallel(static_cast<size_t>(rawSize));
+				DecompressParallel(damaged.data(), damaged.size(), parallel.data());
+			}
+		}
+		ANIM_CHECK(numFailed > 0);
+
+		// Blocks claiming more than the block size, or more stored than raw bytes, fail before anything is
+		// allocated or read for them, whether the block is read or skipped.
+		const uint32_t First_Block_Offset = 12;
+		bool isSizeRejected = true;
+		for (uint32_t rawSize : { 4097u, 0xFFFFFFF0u, 4096u })
+		{
+			uint32_t storedSize = rawSize == 4096 ? rawSize + 1 : rawSize;
+			std::vector<uint8_t> damaged = bytes;
+			memcpy(&damaged[First_Block_Offset], &rawSize, sizeof(rawSize));
+			memcpy(&damaged[First_Block_Offset + sizeof(rawSize)], &storedSize, sizeof(storedSize));
+			for (bool isSkipped : { false, true })
+			{
+				MemoryStream input(damaged.data(), static_cast<uint32_t>(damaged.size()));
+				CompressedReadStream decompressed(input);
+				uint8_t value = 0;
+				if (isSkipped)
+					decompressed.Skip(100);
+				else
+					decompressed.Read(&value, sizeof(value));
+				isSizeRejected &= decompressed.HasFailed() && value == 0;
+			}
+		}
+		ANIM_CHECK(isSizeRejected);
+	}
+
+	void TestReadPastEndInvalidatesDeserializer()
+	{
+		ChunkedWriteStream output;
+		{
+			Serializer res(output, 1);
+			res.Serialize(static_cast<uint64_t>(42));
+		}
+		std::vector<uint8_t> bytes = CopyOut(output);
+		MemoryStream input(bytes.data(), static_cast<uint32_t>(bytes.size()) - 1);
+		uint64_t value = 0;
+		Deserializer res(input);
+		res.Deserialize(value);
+		ANIM_CHECK(input.HasOverflowed());
+		ANIM_CHECK(!res.IsValid());
+	}
+
+	double MeasureMegabytesPerSecond(uint64_t numBytes, uint32_t numRounds, const std::function<void()>& run)
+	{
+		auto start = BenchmarkClock::now();
+		for (uint32_t round = 0; round < numRounds; ++round)
+		{
+			run();
+		}
+		return static_cast<double>(numBytes) * numRounds / (1024.0 * 1024.0) / SecondsSince(start);
+	}
+}
+
+void RunCompressedStreamTests()
+{
+	TestBlockRoundTrip();
+	TestCorruptBlocksAreRejected();
+	TestCompressedStreamRoundTrip();
+	TestCorruptStreamsFail();
+	TestReadPastEndInvalidatesDeserializer();
+}
+
+void RunCompressionBenchmark()
+{
+	const uint32_t Num_Rounds = 5;
+	std::vector<uint8_t> raw = MakeCurveData(200, 20000);
+	std::vector<uint8_t> copy(raw.size());
+	printf("%.1f MB of quantized float curves, %u KB blocks:\n", raw.size() / (1024.0 * 1024.0), Default_Compressed_Block_Size / 1024);
+	double copySpeed = MeasureMegabytesPerSecond(raw.size(), Num_Rounds, [&]()
+	{
+		memcpy(copy.data(), raw.data(), raw.size());
+		UseBenchmarkResult(copy[copy.size() / 2]);
+	});
+	printf("  memcpy %25s %7.0f MB/s\n", "", copySpeed);
+
+	for (CompressionCodec codec : { CompressionCodec::LZ4, CompressionCodec::Zstd })
+	{
+		const char* name = codec == CompressionCodec::LZ4 ? "LZ4" : "Zstd";
+		if (!BlockCodec::IsAvailable(codec))
+		{
+			printf("  %-6s not built, needs ANIM_WITH_ZSTD\n", name);
+			continue;
+		}
+		std::vector<uint8_t> compressed;
+		double compressSpeed = MeasureMegabytesPerSecond(raw.size(), Num_Rounds, [&]()
+		{
+			compressed = CompressStream(raw, codec, Default_Compressed_Block_Size);
+		});
+		double decompressSpeed = MeasureMegabytesPerSecond(raw.size(), Num_Rounds, [&]()
+		{
+			MemoryStream input(compressed.data(), static_cast<uint32_t>(compressed.size()));
+			CompressedReadStream decompressed(input);
+			decompressed.Read(copy.data(), static_cast<uint32_t>(copy.size()));
+			UseBenchmarkResult(copy[copy.size() / 2]);
+		});
+		double parallelSpeed = MeasureMegabytesPerSecond(raw.size(), Num_Rounds, [&]()
+		{
+			DecompressParallel(compressed.data(), compressed.size(), copy.data());
+			UseBenchmarkResult(copy[copy.size() / 2]);
+		});
+		printf("  %-6s ratio %5.2f  compress %5.0f MB/s  decompress %5.0f MB/s  parallel %5.0f MB/s\n", name,
+			static_cast<double>(raw.size()) / compressed.size(), compressSpeed, decompressSpeed, parallelSpeed);
+	}
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+void RunCompressedStreamTests();
+// Compresses and decompresses 16 MB of quantized float curves with every available codec, against memcpy.
+void RunCompressionBenchmark();
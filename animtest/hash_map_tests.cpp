@@ -0,0 +1,245 @@
+#include "hash_map_tests.h"
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "animcore/containers/flat_hash_map.h"
+#include "animcore/containers/unordered_map.h"
+#include "animcore/objectmodel/object_id.h"
+#include "test_harness.h"
+
+using namespace animengine;
+
+namespace
+{
+	typedef FlatHashMap<uint64_t, uint64_t> TestMap;
+
+	// Home slot of key in a map of the given capacity, mirrors FlatHashMap::H1.
+	uint32_t GetHomeSlot(uint64_t key, uint32_t capacity)
+	{
+		return static_cast<uint32_t>(flat_hash_map_detail::MixHash(std::hash<uint64_t>()(key)) >> 7) & (capacity - 1);
+	}
+
+	// Keys whose home slot is the given one, so the test controls where the probe runs go.
+	std::vector<uint64_t> FindKeysWithHome(uint32_t home, uint32_t capacity, uint32_t numKeys, uint64_t& nextCandidate)
+	{
+		std::vector<uint64_t> keys;
+		while (keys.size() < numKeys)
+		{
+			uint64_t key = nextCandidate++;
+			if (GetHomeSlot(key, capacity) == home)
+				keys.push_back(key);
+		}
+		return keys;
+	}
+
+	bool ContainsExactly(const TestMap& map, const std::vector<uint64_t>& keys)
+	{
+		if (map.size() != keys.size())
+			return false;
+		for (uint64_t key : keys)
+		{
+			auto iter = map.find(key);
+			if (iter == map.end() || iter->second != key * 3)
+				return false;
+		}
+		return true;
+	}
+
+	void TestEraseWrapsAround()
+	{
+		// Five keys homed in the last slot of the smallest table fill it and wrap into slots 0 to 3, two keys
+		// homed in slot 0 are pushed to 4 and 5. Erasing from the start of the run has to shift entries back
+		// across the end of the table.
+		const uint32_t Capacity = flat_hash_map_detail::Min_Capacity;
+		uint64_t nextCandidate = 1;
+		std::vector<uint64_t> keys = FindKeysWithHome(Capacity - 1, Capacity, 5, nextCandidate);
+		std::vector<uint64_t> homedAtZero = FindKeysWithHome(0, Capacity, 2, nextCandidate);
+		keys.insert(keys.end(), homedAtZero.begin(), homedAtZero.end());
+
+		for (uint32_t erased = 0; erased < keys.size(); ++erased)
+		{
+			TestMap map;
+			for (uint64_t key : keys)
+			{
+				map[key] = key * 3;
+			}
+			ANIM_CHECK(map.capacity() == Capacity);
+
+			std::vector<uint64_t> remaining = keys;
+			remaining.erase(remaining.begin() + erased);
+			ANIM_CHECK(map.erase(keys[erased]) == 1);
+			ANIM_CHECK(map.count(keys[erased]) == 0);
+			ANIM_CHECK(ContainsExactly(map, remaining));
+
+			// Erasing everything else in insertion order empties the run without losing anything on the way.
+			for (uint64_t key : std::vector<uint64_t>(remaining))
+			{
+				map.erase(key);
+				remaining.erase(remaining.begin());
+				ANIM_CHECK(ContainsExactly(map, remaining));
+			}
+		}
+	}
+
+	void TestEraseWhileIterating()
+	{
+		TestMap map;
+		for (uint64_t key = 0; key < 1000; ++key)
+		{
+			map[key] = key * 3;
+		}
+		// Entries that wrap around may be visited twice, but none is skipped.
+		for (auto iter = map.begin(); iter != map.end();)
+		{
+			if (iter->first % 3 != 0)
+				iter = map.erase(iter);
+			else
+				++iter;
+		}
+		std::vector<uint64_t> remaining;
+		for (uint64_t key = 0; key < 1000; key += 3)
+		{
+			remaining.push_back(key);
+		}
+		ANIM_CHECK(ContainsExactly(map, remaining));
+	}
+
+	void TestAgainstUnorderedMap()
+	{
+		// Random churn on a small key space keeps the probe runs long and hits every wraparound case.
+		std::mt19937_64 random(42);
+		TestMap map;
+		std::unordered_map<uint64_t, uint64_t> expected;
+		bool matches = true;
+		for (uint32_t i = 0; i < 200000 && matches; ++i)
+		{
+			uint64_t key = random() % 300;
+			if (random() % 2 == 0)
+			{
+				map[key] = key * 3;
+				expected[key] = key * 3;
+			}
+			else
+			{
+				matches &= map.erase(key) == expected.erase(key);
+			}
+			if (i % 1000 == 0)
+			{
+				std::vector<uint64_t> keys;
+				for (const auto& entry : expected)
+				{
+					keys.push_back(entry.first);
+				}
+				matches &= ContainsExactly(map, keys);
+			}
+		}
+		ANIM_CHECK(matches);
+		ANIM_CHECK(map.size() == expected.size());
+	}
+
+	void TestOwnership()
+	{
+		FlatHashMap<uint32_t, std::string> strings;
+		for (uint32_t i = 0; i < 100; ++i)
+		{
+			strings.emplace(i, std::string(40, static_cast<char>('a' + i % 26)));
+		}
+		FlatHashMap<uint32_t, std::string> copy(strings);
+		FlatHashMap<uint32_t, std::string> moved(std::move(strings));
+		ANIM_CHECK(strings.empty() && moved.size() == 100 && copy.size() == 100);
+		ANIM_CHECK(copy[99] == moved[99] && moved[99] == std::string(40, 'v'));
+		ANIM_CHECK(!moved.emplace(5, "ignored").second && moved[5] == std::string(40, 'f'));
+		moved.clear();
+		ANIM_CHECK(moved.empty() && moved.find(5) == moved.end());
+	}
+
+	template<typename MapType, typename Key>
+	void BenchmarkMap(const char* name, const std::vector<Key>& keys, const std::vector<Key>& missingKeys)
+	{
+		const uint32_t Min_Operations = 4000000;
+		uint32_t numRounds = Min_Operations / static_cast<uint32_t>(keys.size()) + 1;
+		double insertSeconds = 0.0;
+		double findSeconds = 0.0;
+		double missSeconds = 0.0;
+		double eraseSeconds = 0.0;
+		uint64_t found = 0;
+		for (uint32_t round = 0; round < numRounds; ++round)
+		{
+			MapType map;
+			auto start = BenchmarkClock::now();
+			for (const Key& key : keys)
+			{
+				map[key] = 1;
+			}
+			insertSeconds += SecondsSince(start);
+
+			start = BenchmarkClock::now();
+			for (const Key& key : keys)
+			{
+				found += map.find(key) != map.end() ? 1 : 0;
+			}
+			findSeconds += SecondsSince(start);
+
+			start = BenchmarkClock::now();
+			for (const Key& key : missingKeys)
+			{
+				found += map.find(key) != map.end() ? 1 : 0;
+			}
+			missSeconds += SecondsSince(start);
+
+			start = BenchmarkClock::now();
+			for (const Key& key : keys)
+			{
+				map.erase(key);
+			}
+			eraseSeconds += SecondsSince(start);
+		}
+		UseBenchmarkResult(found);
+		double numOperations = static_cast<double>(numRounds) * keys.size();
+		printf("  %-14s %8u keys: insert %6.1f ns  find %6.1f ns  miss %6.1f ns  erase %6.1f ns\n", name, static_cast<uint32_t>(keys.size()),
+			insertSeconds * 1e9 / numOperations, findSeconds * 1e9 / numOperations, missSeconds * 1e9 / numOperations, eraseSeconds * 1e9 / numOperations);
+	}
+
+	template<typename Key, typename MakeKey>
+	void BenchmarkKeys(const char* keyName, MakeKey makeKey)
+	{
+		// 10M keys no longer fit any cache, and make the tables grow through 2^24 buckets.
+		for (uint32_t numKeys : { 1000u, 100000u, 1000000u, 10000000u })
+		{
+			std::vector<Key> keys;
+			std::vector<Key> missingKeys;
+			for (uint32_t i = 0; i < numKeys; ++i)
+			{
+				keys.push_back(makeKey());
+				missingKeys.push_back(makeKey());
+			}
+			printf("%s keys:\n", keyName);
+			BenchmarkMap<FlatHashMap<Key, uint32_t>>("FlatHashMap", keys, missingKeys);
+			BenchmarkMap<UnorderedMap<Key, uint32_t>>("UnorderedMap", keys, missingKeys);
+		}
+	}
+}
+
+void RunHashMapTests()
+{
+	TestEraseWrapsAround();
+	TestEraseWhileIterating();
+	TestAgainstUnorderedMap();
+	TestOwnership();
+}
+
+void RunHashMapBenchmark()
+{
+	std::mt19937_64 random(7);
+	BenchmarkKeys<uint64_t>("uint64_t", [&random]() { return static_cast<uint64_t>(random()); });
+	// Random like GUIDs, CreateNewGuid is only implemented on Windows.
+	BenchmarkKeys<ObjectID>("ObjectID", [&random]()
+	{
+		ObjectID id;
+		uint64_t halves[2] = { random(), random() };
+		memcpy(id.m_Data, halves, sizeof(id.m_Data));
+		return id;
+	});
+}
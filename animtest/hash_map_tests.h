@@ -0,0 +1,5 @@
+#pragma once
+
+void RunHashMapTests();
+// Inserts, finds, misses and erases uint64_t and ObjectID keys in FlatHashMap and UnorderedMap.
+void RunHashMapBenchmark();
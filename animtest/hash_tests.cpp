@@ -0,0 +1,267 @@
+#include "hash_tests.h"
+#include <cstdio>
+#include <random>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "animcore/math/hash64.h"
+#include "animcore/objectmodel/object_id.h"
+#include "test_harness.h"
+
+using namespace animengine;
+
+namespace
+{
+	// The hash HashUtils::Compute replaced, kept for comparison.
+	uint64_t ComputeFnv1a(const void* data, size_t length)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for (size_t i = 0; i < length; ++i)
+		{
+			hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	uint32_t CountBits(uint64_t value)
+	{
+		uint32_t numBits = 0;
+		for (; value != 0; value &= value - 1)
+		{
+			++numBits;
+		}
+		return numBits;
+	}
+
+	void TestConstexprMatchesRuntime()
+	{
+		constexpr uint64_t Compile_Time_ID = HashUtils::ComputeConstexpr("animengine::Message");
+		ANIM_CHECK(Compile_Time_ID == HashUtils::Compute("animengine::Message"));
+
+		// Every length up to two 48 byte steps, each taking a different tail path.
+		std::string text;
+		bool matches = true;
+		for (uint32_t length = 0; length <= 100; ++length)
+		{
+			matches &= HashUtils::ComputeConstexpr(text.c_str()) == HashUtils::Compute(text.c_str());
+			matches &= HashUtils::ComputeConstexpr(text.c_str(), 1234) == HashUtils::Compute(text.c_str(), text.size(), 1234);
+			text.push_back(static_cast<char>('!' + length % 90));
+		}
+		ANIM_CHECK(matches);
+		ANIM_CHECK(HashUtils::Compute("name", 4, 1) != HashUtils::Compute("name", 4, 2));
+	}
+
+	void TestAvalanche()
+	{
+		// Flipping any input bit should flip every output bit with probability 1/2.
+		std::mt19937_64 random(3);
+		for (uint32_t length : { 4u, 8u, 16u, 33u, 200u })
+		{
+			std::vector<uint8_t> key(length);
+			uint64_t flippedPerBit[64] = {};
+			uint32_t numSamples = 0;
+			for (uint32_t sample = 0; sample < 200; ++sample)
+			{
+				for (auto& byte : key)
+				{
+					byte = static_cast<uint8_t>(random());
+				}
+				uint64_t hash = HashUtils::Compute(key.data(), length);
+				for (uint32_t bit = 0; bit < length * 8; ++bit)
+				{
+					key[bit / 8] ^= static_cast<uint8_t>(1u << (bit % 8));
+					uint64_t changed = hash ^ HashUtils::Compute(key.data(), length);
+					key[bit / 8] ^= static_cast<uint8_t>(1u << (bit % 8));
+					for (uint32_t out = 0; out < 64; ++out)
+					{
+						flippedPerBit[out] += (changed >> out) & 1;
+					}
+					++numSamples;
+				}
+			}
+			double worstBias = 0.0;
+			for (uint32_t out = 0; out < 64; ++out)
+			{
+				double bias = static_cast<double>(flippedPerBit[out]) / numSamples - 0.5;
+				worstBias = bias < 0.0 ? (-bias > worstBias ? -bias : worstBias) : (bias > worstBias ? bias : worstBias);
+			}
+			ANIM_CHECK(worstBias < 0.05);
+		}
+	}
+
+	void TestIntegerKeysSpread()
+	{
+		// Sequential ids must not collide in the low bits hash maps index with.
+		const uint32_t Num_Keys = 1 << 16;
+		std::vector<uint8_t> buckets(Num_Keys);
+		uint32_t numCollisions = 0;
+		for (uint64_t key = 0; key < Num_Keys; ++key)
+		{
+			uint8_t& bucket = buckets[HashUtils::Compute(key) & (Num_Keys - 1)];
+			numCollisions += bucket;
+			bucket = 1;
+		}
+		// A random function puts about Num_Keys / e keys into occupied buckets.
+		ANIM_CHECK(numCollisions > Num_Keys * 0.33 && numCollisions < Num_Keys * 0.40);
+		ANIM_CHECK(CountBits(HashUtils::Compute(uint64_t(1)) ^ HashUtils::Compute(uint64_t(2))) > 16);
+	}
+
+	ObjectID MakeObjectID(uint64_t low, uint64_t high)
+	{
+		ObjectID objectID;
+		memcpy(objectID.m_Data, &low, sizeof(low));
+		memcpy(objectID.m_Data + sizeof(low), &high, sizeof(high));
+		return objectID;
+	}
+
+	void TestObjectIDAvalanche()
+	{
+		// Every one of the 128 input bits has to flip every output bit about half the time, not just on average.
+		const uint32_t Num_Samples = 4000;
+		std::mt19937_64 random(9);
+		std::vector<uint32_t> flipped(128 * 64);
+		for (uint32_t sample = 0; sample < Num_Samples; ++sample)
+		{
+			ObjectID objectID = MakeObjectID(random(), random());
+			uint64_t hash = objectID.GetHash();
+			for (uint32_t bit = 0; bit < 128; ++bit)
+			{
+				objectID.m_Data[bit / 8] ^= static_cast<uint8_t>(1u << (bit % 8));
+				uint64_t changed = hash ^ objectID.GetHash();
+				objectID.m_Data[bit / 8] ^= static_cast<uint8_t>(1u << (bit % 8));
+				for (uint32_t out = 0; out < 64; ++out)
+				{
+					flipped[bit * 64 + out] += (changed >> out) & 1;
+				}
+			}
+		}
+		// Sampling noise alone stays below 0.035 here, a single folded multiply reaches 0.08.
+		double worstBias = 0.0;
+		for (uint32_t count : flipped)
+		{
+			double bias = static_cast<double>(count) / Num_Samples - 0.5;
+			worstBias = bias < 0.0 ? (-bias > worstBias ? -bias : worstBias) : (bias > worstBias ? bias : worstBias);
+		}
+		ANIM_CHECK(worstBias < 0.05);
+		ANIM_CHECK(HashUtils::Mix(0, 0) != 0 && HashUtils::Mix(0, 1) != HashUtils::Mix(1, 0));
+	}
+
+	// Share of keys that land in a bucket another key took already, about 1/e for a random function.
+	template<typename KeyFunction>
+	double GetCollisionRate(uint32_t numKeys, uint32_t shift, KeyFunction makeKey)
+	{
+		std::vector<uint8_t> buckets(numKeys);
+		uint32_t numCollisions = 0;
+		for (uint32_t i = 0; i < numKeys; ++i)
+		{
+			uint8_t& bucket = buckets[(makeKey(i).GetHash() >> shift) & (numKeys - 1)];
+			numCollisions += bucket;
+			bucket = 1;
+		}
+		return static_cast<double>(numCollisions) / numKeys;
+	}
+
+	void TestObjectIDSpread()
+	{
+		// Random GUIDs, and ids that count up in one half, spread over the low bits hash maps index with and over
+		// the high bits.
+		const uint32_t Num_Keys = 1 << 16;
+		std::mt19937_64 random(13);
+		std::vector<ObjectID> randomIDs;
+		for (uint32_t i = 0; i < Num_Keys; ++i)
+		{
+			randomIDs.push_back(MakeObjectID(random(), random()));
+		}
+		bool isSpread = true;
+		for (uint32_t shift : { 0u, 48u })
+		{
+			for (double rate : {
+				GetCollisionRate(Num_Keys, shift, [&randomIDs](uint32_t i) { return randomIDs[i]; }),
+				GetCollisionRate(Num_Keys, shift, [](uint32_t i) { return MakeObjectID(i, 0x1234567890abcdefull); }),
+				GetCollisionRate(Num_Keys, shift, [](uint32_t i) { return MakeObjectID(0, i); }),
+				GetCollisionRate(Num_Keys, shift, [](uint32_t i) { return MakeObjectID(uint64_t(i) << 40, uint64_t(i) << 40); }) })
+			{
+				isSpread &= rate > 0.33 && rate < 0.40;
+			}
+		}
+		ANIM_CHECK(isSpread);
+	}
+
+	template<typename HashFunction>
+	void BenchmarkObjectIDHash(const char* name, const std::vector<ObjectID>& objectIDs, HashFunction hash)
+	{
+		const uint32_t Num_Rounds = 4000;
+		uint64_t result = 0;
+		auto start = BenchmarkClock::now();
+		for (uint32_t round = 0; round < Num_Rounds; ++round)
+		{
+			for (const ObjectID& objectID : objectIDs)
+			{
+				result += hash(objectID);
+			}
+		}
+		double seconds = SecondsSince(start);
+		UseBenchmarkResult(result);
+		printf("  %-24s %6.2f ns/hash\n", name, seconds * 1e9 / (static_cast<double>(Num_Rounds) * objectIDs.size()));
+	}
+
+	template<typename HashFunction>
+	void BenchmarkHash(const char* name, const std::vector<uint8_t>& data, uint32_t keySize, HashFunction hash)
+	{
+		const uint64_t Bytes_Per_Run = 256ull << 20;
+		uint32_t numKeys = static_cast<uint32_t>(data.size() / keySize);
+		uint64_t numRounds = Bytes_Per_Run / (static_cast<uint64_t>(numKeys) * keySize) + 1;
+		uint64_t result = 0;
+		auto start = BenchmarkClock::now();
+		for (uint64_t round = 0; round < numRounds; ++round)
+		{
+			for (uint32_t i = 0; i < numKeys; ++i)
+			{
+				result += hash(&data[i * keySize], keySize);
+			}
+		}
+		double seconds = SecondsSince(start);
+		UseBenchmarkResult(result);
+		double numHashes = static_cast<double>(numRounds) * numKeys;
+		printf("  %-16s %5u bytes: %8.2f ns/hash %8.0f MB/s\n", name, keySize, seconds * 1e9 / numHashes, numHashes * keySize / seconds / 1e6);
+	}
+}
+
+void RunHashTests()
+{
+	TestConstexprMatchesRuntime();
+	TestAvalanche();
+	TestIntegerKeysSpread();
+	TestObjectIDAvalanche();
+	TestObjectIDSpread();
+}
+
+void RunHashBenchmark()
+{
+	// 64 KB of keys stay in the cache, the benchmark measures the hash and not memory.
+	std::vector<uint8_t> data(64 * 1024);
+	std::mt19937 random(5);
+	for (auto& byte : data)
+	{
+		byte = static_cast<uint8_t>(random());
+	}
+	printf("hash throughput:\n");
+	for (uint32_t keySize : { 4u, 8u, 16u, 32u, 64u, 256u, 4096u })
+	{
+		BenchmarkHash("HashUtils", data, keySize, [](const uint8_t* key, size_t length) { return HashUtils::Compute(key, length); });
+		BenchmarkHash("FNV-1a", data, keySize, [](const uint8_t* key, size_t length) { return ComputeFnv1a(key, length); });
+	}
+
+	// 4096 ids, 64 KB, like the keys of a busy ObjectManager shard that stay in the cache.
+	std::vector<ObjectID> objectIDs;
+	std::mt19937_64 idRandom(7);
+	for (uint32_t i = 0; i < 4096; ++i)
+	{
+		objectIDs.push_back(MakeObjectID(idRandom(), idRandom()));
+	}
+	printf("ObjectID hash:\n");
+	BenchmarkObjectIDHash("ObjectID::GetHash", objectIDs, [](const ObjectID& objectID) { return objectID.GetHash(); });
+	BenchmarkObjectIDHash("HashUtils::Compute", objectIDs, [](const ObjectID& objectID) { return HashUtils::Compute(objectID.m_Data, sizeof(objectID.m_Data)); });
+	BenchmarkObjectIDHash("FNV-1a over 16 bytes", objectIDs, [](const ObjectID& objectID) { return ComputeFnv1a(objectID.m_Data, sizeof(objectID.m_Data)); });
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+void RunHashTests();
+// Hashes keys of 4 bytes to 4 KB with HashUtils::Compute and with FNV-1a, the hash it replaced.
+void RunHashBenchmark();
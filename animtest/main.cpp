@@ -2,6 +2,23 @@
 #include "animpublic/commands/core_commands.h"
 
 #include "core_commands_integration.h"
+#include "array_tests.h"
+#include "compressed_stream_tests.h"
+#include "hash_map_tests.h"
+#include "hash_tests.h"
+#include "message_framing_tests.h"
+#include "object_library_benchmark.h"
+#include "object_manager_tests.h"
+#include "object_serializer_tests.h"
+#include "pipe_latency_benchmark.h"
+#include "pipe_server_benchmark.h"
+#include "request_dispatcher_tests.h"
+#include "serialization_tests.h"
+#include "shared_ptr_tests.h"
+#include "stream_subscription_tests.h"
+#include "test_harness.h"
+#include <cstdio>
+#include <string.h>
 #include <rttr/rttr_enable.h>
 #include <rttr/type.h>
 #include <rttr/registration.h>
@@ -39,7 +56,47 @@
 
 
 using namespace animengine;
-int main()
+
+namespace
+{
+	void RunTests()
+	{
+		RunArrayTests();
+		RunHashMapTests();
+		RunHashTests();
+		RunSharedPtrTests();
+		RunSerializationTests();
+		RunObjectSerializerTests();
+		RunCompressedStreamTests();
+		RunMessageFramingTests();
+		RunRequestDispatcherTests();
+		RunObjectManagerTests();
+		RunStreamSubscriptionTests();
+	}
+
+	struct Mode
+	{
+		const char* m_Argument;
+		void (*m_Run)();
+	};
+
+	const Mode Modes[] = {
+		{ "--tests", &RunTests },
+		{ "--array-benchmark", &RunArrayBenchmark },
+		{ "--hash-map-benchmark", &RunHashMapBenchmark },
+		{ "--hash-benchmark", &RunHashBenchmark },
+		{ "--shared-ptr-benchmark", &RunSharedPtrBenchmark },
+		{ "--serializer-benchmark", &RunSerializerBenchmark },
+		{ "--bulk-array-benchmark", &RunBulkArrayBenchmark },
+		{ "--object-serializer-benchmark", &RunObjectSerializerBenchmark },
+		{ "--compression-benchmark", &RunCompressionBenchmark },
+		{ "--library-benchmark", &RunObjectLibraryBenchmark },
+		{ "--pipe-latency-benchmark", &RunPipeLatencyBenchmark },
+		{ "--pipe-benchmark", []() { RunPipeServerBenchmark(8, 4, 20); } },
+	};
+}
+
+int main(int argc, char** argv)
 {
 	auto& animController = anim::GetAnimEngineInterfaceController();
 	{
@@ -50,5 +107,29 @@ int main()
 	}
 
 	animController.InitializeRuntime();
+	bool isKnownMode = argc <= 1;
+	for (const Mode& mode : Modes)
+	{
+		if (argc > 1 && strcmp(argv[1], mode.m_Argument) == 0)
+		{
+			mode.m_Run();
+			isKnownMode = true;
+		}
+	}
+	if (!isKnownMode)
+	{
+		printf("usage: animtest [mode], modes:\n");
+		for (const Mode& mode : Modes)
+		{
+			printf("  %s\n", mode.m_Argument);
+		}
+	}
+	animController.BeginFrame();
 	animController.FinalizeRuntime();
+
+	if (GetNumChecks() > 0)
+	{
+		printf("%u of %u checks failed\n", GetNumFailedChecks(), GetNumChecks());
+	}
+	return isKnownMode && GetNumFailedChecks() == 0 ? 0 : 1;
 }
\ No newline at end of file
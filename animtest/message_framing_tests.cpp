@@ -0,0 +1,160 @@
+#include "message_framing_tests.h"
+#include <algorithm>
+#include <vector>
+#include <string.h>
+#include "animcore/remoteprotocol/message.h"
+#include "animcore/remoteprotocol/message_framing.h"
+#include "animcore/serialization/serialization.h"
+#include "test_harness.h"
+
+ANIM_NAMESPACE_BEGIN
+
+// Odd sized fields around aligned arrays, so messages in a batch end at every possible offset.
+class FramingTestMessage : public Message
+{
+	DECLARE_DERIVED_CLASS();
+public:
+	virtual void Serialize(Serialization::Serializer& res) const override
+	{
+		res.Serialize(m_Tag);
+		res.Serialize(m_Values);
+		res.SerializeTolerantFloats(m_Weights);
+		res.Serialize(m_Wide);
+		res.Serialize(m_Tag);
+	}
+	virtual void Deserialize(Serialization::Deserializer& res) override
+	{
+		res.Deserialize(m_Tag);
+		res.Deserialize(m_Values);
+		res.DeserializeTolerantFloats(m_Weights);
+		res.Deserialize(m_Wide);
+		res.Deserialize(m_Tag);
+	}
+
+	uint8_t m_Tag = 0;
+	BigArray<float> m_Values;
+	BigArray<float> m_Weights;
+	BigArray<uint64_t> m_Wide;
+};
+
+IMPLEMENT_CONCRETE_DERIVED_CLASS(FramingTestMessage, Message);
+
+ANIM_NAMESPACE_END
+
+using namespace animengine;
+
+namespace
+{
+	void FillMessage(FramingTestMessage& msg, uint32_t index)
+	{
+		msg.m_Tag = static_cast<uint8_t>(index);
+		for (uint32_t i = 0; i < index * 3 + 1; ++i)
+		{
+			msg.m_Values.Push(index + i * 0.5f);
+			msg.m_Weights.Push(i * 0.25f);
+		}
+		for (uint32_t i = 0; i < index % 5; ++i)
+		{
+			msg.m_Wide.Push(static_cast<uint64_t>(index) << 40 | i);
+		}
+	}
+
+	bool IsMessageEqual(const FramingTestMessage& msg, const FramingTestMessage& expected)
+	{
+		if (msg.m_Tag != expected.m_Tag || msg.m_Values.Size() != expected.m_Values.Size()
+			|| msg.m_Weights.Size() != expected.m_Weights.Size() || msg.m_Wide.Size() != expected.m_Wide.Size())
+			return false;
+		for (uint32_t i = 0; i < expected.m_Values.Size(); ++i)
+		{
+			if (msg.m_Values[i] != expected.m_Values[i] || msg.m_Weights[i] != expected.m_Weights[i])
+				return false;
+		}
+		for (uint32_t i = 0; i < expected.m_Wide.Size(); ++i)
+		{
+			if (msg.m_Wide[i] != expected.m_Wide[i])
+				return false;
+		}
+		return true;
+	}
+
+	// Messages batched into one write start wherever the previous one ended, their arrays are aligned relative
+	// to the start of each message and not to the start of the batch.
+	void TestBatchedMessagesKeepAlignment()
+	{
+		const uint32_t Num_Messages = 40;
+		MessageWriter writer;
+		for (uint32_t i = 0; i < Num_Messages; ++i)
+		{
+			FramingTestMessage msg;
+			FillMessage(msg, i);
+			ANIM_CHECK(writer.Encode(&msg, i + 1));
+		}
+
+		std::vector<uint8_t> wire;
+		uint32_t numBatches = 0;
+		while (writer.BeginSend())
+		{
+			size_t numBytes = 0;
+			for (uint32_t i = 0; i < writer.GetNumSegments(); ++i)
+			{
+				MessageWriter::Segment segment = writer.GetSegment(i);
+				wire.insert(wire.end(), segment.m_Data, segment.m_Data + segment.m_Size);
+				numBytes += segment.m_Size;
+			}
+			writer.CommitSend(numBytes);
+			++numBatches;
+		}
+		ANIM_CHECK(numBatches == 1);
+
+		// Most messages must start at an offset that is not a multiple of 8, or the test proves nothing.
+		uint32_t numUnaligned = 0;
+		for (size_t offset = 0; offset + sizeof(MessageHeader) <= wire.size();)
+		{
+			MessageHeader header;
+			memcpy(&header, wire.data() + offset, sizeof(header));
+			offset += sizeof(header);
+			numUnaligned += offset % 8 != 0 ? 1 : 0;
+			offset += header.m_Size;
+		}
+		ANIM_CHECK(numUnaligned > Num_Messages / 2);
+
+		// Received in pieces that split headers and arrays.
+		MessageBufferPool pool;
+		MessageReader reader(pool);
+		uint32_t numReceived = 0;
+		bool isEqual = true;
+		bool hasFailed = false;
+		for (size_t position = 0; position < wire.size() && !hasFailed;)
+		{
+			uint8_t* dst;
+			uint32_t capacity;
+			reader.GetReceiveBuffer(dst, capacity);
+			uint32_t numBytes = static_cast<uint32_t>(std::min<size_t>(std::min<size_t>(capacity, 777), wire.size() - position));
+			memcpy(dst, wire.data() + position, numBytes);
+			position += numBytes;
+			reader.CommitReceive(numBytes);
+
+			Message* msg;
+			uint32_t requestID;
+			MessageReader::Result result;
+			while ((result = reader.NextMessage(msg, requestID)) == MessageReader::Result::Complete)
+			{
+				FramingTestMessage expected;
+				FillMessage(expected, requestID - 1);
+				isEqual &= requestID == numReceived + 1 && msg->GetReflectedClassInfo().DerivesFrom(FramingTestMessage::GetStaticClassInfo())
+					&& IsMessageEqual(*static_cast<FramingTestMessage*>(msg), expected);
+				DefaultAllocator::Destroy(msg);
+				++numReceived;
+			}
+			hasFailed = result == MessageReader::Result::Error;
+		}
+		ANIM_CHECK(!hasFailed);
+		ANIM_CHECK(numReceived == Num_Messages);
+		ANIM_CHECK(isEqual);
+	}
+}
+
+void RunMessageFramingTests()
+{
+	TestBatchedMessagesKeepAlignment();
+}
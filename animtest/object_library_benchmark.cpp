@@ -0,0 +1,131 @@
+#include "object_library_benchmark.h"
+#include <cstdio>
+#include <random>
+#include <string>
+#include <string.h>
+#include "animcore/containers/string.h"
+#include "animcore/objectmodel/managed_object.h"
+#include "animcore/objectmodel/object_library.h"
+#include "animcore/objectmodel/object_manager.h"
+#include "animcore/serialization/file_stream.h"
+#include "animcore/serialization/serialization.h"
+#include "animcore/threading/job_system.h"
+#include "test_harness.h"
+
+ANIM_NAMESPACE_BEGIN
+
+class LibraryBenchmarkCurve : public ManagedObject
+{
+	DECLARE_DERIVED_CLASS();
+public:
+	virtual void Serialize(Serialization::Serializer& res) const override
+	{
+		res.Serialize(m_Name);
+		res.Serialize(m_Frames);
+		res.Serialize(m_Values);
+	}
+	virtual void Deserialize(Serialization::Deserializer& res) override
+	{
+		res.Deserialize(m_Name);
+		res.Deserialize(m_Frames);
+		res.Deserialize(m_Values);
+	}
+
+	SimpleString m_Name;
+	// Varints under Encoding_Compact_Integers, so they are decoded one by one.
+	BigArray<uint32_t> m_Frames;
+	// Read in place from the mapping.
+	BigArray<float> m_Values;
+};
+
+IMPLEMENT_CONCRETE_DERIVED_CLASS(LibraryBenchmarkCurve, ManagedObject);
+
+ANIM_NAMESPACE_END
+
+using namespace animengine;
+
+namespace
+{
+	const char* Library_Path = "animtest_library.bin";
+	const uint32_t Num_Curves = 50000;
+	const uint32_t Num_Keys = 32;
+
+	bool WriteLibrary()
+	{
+		std::mt19937_64 random(41);
+		Serialization::FileWriteStream file(Library_Path);
+		if (!file.IsOpen())
+			return false;
+		ObjectLibraryWriter writer(file, 1, Serialization::Encoding_Compact_Integers);
+		for (uint32_t i = 0; i < Num_Curves; ++i)
+		{
+			LibraryBenchmarkCurve curve;
+			curve.m_Name = "skeleton/bone_";
+			curve.m_Name += std::to_string(i).c_str();
+			for (uint32_t key = 0; key < Num_Keys; ++key)
+			{
+				curve.m_Frames.Push(key * 2 + static_cast<uint32_t>(random() % 2));
+				curve.m_Values.Push(static_cast<float>(random() % 1000) / 1000.0f);
+			}
+			// Random like GUIDs, CreateNewGuid is only implemented on Windows.
+			ObjectID objectID;
+			uint64_t halves[2] = { random(), random() };
+			memcpy(objectID.m_Data, halves, sizeof(objectID.m_Data));
+			writer.AddObject(objectID, &curve);
+		}
+		writer.Finish();
+		file.Close();
+		return !file.HasFailed();
+	}
+}
+
+void RunObjectLibraryBenchmark()
+{
+	if (!WriteLibrary())
+	{
+		printf("cannot write %s\n", Library_Path);
+		return;
+	}
+
+	ObjectLibrary library;
+	if (!library.Open(Library_Path))
+	{
+		printf("cannot open %s\n", Library_Path);
+		return;
+	}
+
+	// Loads once to fault the mapping in, so every row reads from memory.
+	{
+		BigArray<IntrusivePtr<ManagedObject>> objects;
+		library.LoadAll(&objects);
+	}
+
+	printf("%u curves of %u keys:\n", Num_Curves, Num_Keys);
+	const uint32_t Num_Rounds = 5;
+	double baseSeconds = 0.0;
+	for (uint32_t numWorkers : { 1u, 2u, 4u, 8u, 16u, 32u })
+	{
+		JobSystem::Shutdown();
+		JobSystem::Initialize(numWorkers);
+		double seconds = 0.0;
+		uint32_t numFailed = 0;
+		for (uint32_t round = 0; round < Num_Rounds; ++round)
+		{
+			BigArray<IntrusivePtr<ManagedObject>> objects;
+			auto start = BenchmarkClock::now();
+			numFailed += library.LoadAll(&objects);
+			seconds += SecondsSince(start);
+			UseBenchmarkResult(objects.Size());
+			// Released outside the measurement, which unregisters the objects again.
+		}
+		seconds /= Num_Rounds;
+		baseSeconds = numWorkers == 1 ? seconds : baseSeconds;
+		printf("  %2u workers %7.2f ms %6.2f M objects/s speedup %5.2f%s\n", numWorkers, seconds * 1e3,
+			Num_Curves / seconds * 1e-6, baseSeconds / seconds, numFailed != 0 ? " FAILED" : "");
+	}
+	JobSystem::Shutdown();
+	JobSystem::Initialize();
+
+	library.Close();
+	remove(Library_Path);
+}
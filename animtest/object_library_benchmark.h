@@ -0,0 +1,4 @@
+#pragma once
+
+// Loads an object library of many small curves with LoadAll on 1 to 32 JobSystem workers.
+void RunObjectLibraryBenchmark();
@@ -0,0 +1,74 @@
+#include "object_manager_tests.h"
+#include <random>
+#include <string.h>
+#include "animcore/objectmodel/managed_object.h"
+#include "animcore/objectmodel/object_manager.h"
+#include "animcore/serialization/serialization.h"
+#include "test_harness.h"
+
+ANIM_NAMESPACE_BEGIN
+
+class ObjectManagerTestObject : public ManagedObject
+{
+	DECLARE_DERIVED_CLASS();
+public:
+	ObjectManagerTestObject() { ++s_NumAlive; }
+	virtual ~ObjectManagerTestObject() { --s_NumAlive; }
+
+	virtual void Serialize(Serialization::Serializer& res) const override { res.Serialize(m_Value); }
+	virtual void Deserialize(Serialization::Deserializer& res) override { res.Deserialize(m_Value); }
+
+	uint32_t m_Value = 0;
+	static int s_NumAlive;
+};
+
+IMPLEMENT_CONCRETE_DERIVED_CLASS(ObjectManagerTestObject, ManagedObject);
+
+int ObjectManagerTestObject::s_NumAlive = 0;
+
+ANIM_NAMESPACE_END
+
+using namespace animengine;
+
+namespace
+{
+	// CreateNewGuid is only implemented on Windows.
+	ObjectID MakeObjectID(std::mt19937_64& random)
+	{
+		ObjectID objectID;
+		uint64_t halves[2] = { random(), random() };
+		memcpy(objectID.m_Data, halves, sizeof(objectID.m_Data));
+		return objectID;
+	}
+
+	// The engine shuts the manager down right after the JobSystem, whose last loads may have queued Main callbacks
+	// that nobody dispatches anymore. Those hold the last references to their results.
+	void TestShutdownWithPendingMainCallback()
+	{
+		std::mt19937_64 random(17);
+		int numAliveBefore = ObjectManagerTestObject::s_NumAlive;
+		ObjectManager::Shutdown();
+		ObjectManager::Initialize();
+
+		bool hasRun = false;
+		{
+			ObjectID objectID = MakeObjectID(random);
+			IntrusivePtr<ManagedObject> object(DefaultAllocator::Create<ObjectManagerTestObject>());
+			ObjectManager::Instance().RegisterManagedObject(objectID, object);
+			LoadHandle<ObjectManagerTestObject> handle = ObjectManager::Instance().LoadManagedObjectAsync<ObjectManagerTestObject>(objectID);
+			ANIM_CHECK(handle.IsDone());
+			handle.OnComplete([&hasRun](const IntrusivePtr<ObjectManagerTestObject>&) { hasRun = true; }, LoadCallbackThread::Main);
+		}
+		ANIM_CHECK(ObjectManagerTestObject::s_NumAlive == numAliveBefore + 1);
+
+		ObjectManager::Shutdown();
+		ANIM_CHECK(!hasRun);
+		ANIM_CHECK(ObjectManagerTestObject::s_NumAlive == numAliveBefore);
+		ObjectManager::Initialize();
+	}
+}
+
+void RunObjectManagerTests()
+{
+	TestShutdownWithPendingMainCallback();
+}
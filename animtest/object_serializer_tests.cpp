@@ -0,0 +1,256 @@
+#include "object_serializer_tests.h"
+#include <cstdio>
+#include <vector>
+#include <rttr/registration.h>
+#include <rttr/rttr_enable.h>
+#include "animcore/serialization/chunked_write_stream.h"
+#include "animcore/serialization/object_serializer.h"
+#include "animcore/serialization/serialization.h"
+#include "test_harness.h"
+
+ANIM_NAMESPACE_BEGIN
+
+// Registered once bound by pointer and once by value, see RTTR_REGISTRATION below. Only the registration
+// differs, so both must serialize to the same bytes.
+template<bool IS_POINTER_BOUND>
+struct PlanTestPose
+{
+	virtual ~PlanTestPose() {}
+
+	uint32_t m_Frame = 0;
+	uint32_t m_Flags = 0;
+	int16_t m_Layer = 0;
+	float m_Weight = 0.0f;
+	float m_Speed = 0.0f;
+	double m_Time = 0.0;
+	SimpleString m_Name;
+
+	RTTR_ENABLE()
+};
+
+typedef PlanTestPose<true> PointerBoundPose;
+typedef PlanTestPose<false> ValueBoundPose;
+
+// Wide poses of 10, 50 and 200 properties, a uint32_t and a float per field. The defaults differ per field.
+#define PLAN_TEST_FIELD(n) uint32_t m_Frame##n = 1##n; float m_Weight##n = 1##n * 0.25f;
+#define PLAN_TEST_FIELDS_5(n) PLAN_TEST_FIELD(n##0) PLAN_TEST_FIELD(n##1) PLAN_TEST_FIELD(n##2) PLAN_TEST_FIELD(n##3) PLAN_TEST_FIELD(n##4)
+#define PLAN_TEST_FIELDS_25(n) PLAN_TEST_FIELDS_5(n##0) PLAN_TEST_FIELDS_5(n##1) PLAN_TEST_FIELDS_5(n##2) PLAN_TEST_FIELDS_5(n##3) PLAN_TEST_FIELDS_5(n##4)
+#define PLAN_TEST_FIELDS_100(n) PLAN_TEST_FIELDS_25(n##0) PLAN_TEST_FIELDS_25(n##1) PLAN_TEST_FIELDS_25(n##2) PLAN_TEST_FIELDS_25(n##3)
+
+#define PLAN_TEST_WIDE_POSE(NAME, FIELDS, NUM_PROPERTIES) \
+	template<bool IS_POINTER_BOUND> \
+	struct NAME \
+	{ \
+		static const uint32_t Num_Properties = NUM_PROPERTIES; \
+		virtual ~NAME() {} \
+		FIELDS(0) \
+		RTTR_ENABLE() \
+	};
+
+PLAN_TEST_WIDE_POSE(PlanTestPose10, PLAN_TEST_FIELDS_5, 10)
+PLAN_TEST_WIDE_POSE(PlanTestPose50, PLAN_TEST_FIELDS_25, 50)
+PLAN_TEST_WIDE_POSE(PlanTestPose200, PLAN_TEST_FIELDS_100, 200)
+
+ANIM_NAMESPACE_END
+
+RTTR_REGISTRATION
+{
+	using namespace rttr;
+	using namespace animengine;
+	registration::class_<PointerBoundPose>("PointerBoundPose")
+		.property("m_Frame", &PointerBoundPose::m_Frame)(policy::prop::bind_as_ptr)
+		.property("m_Flags", &PointerBoundPose::m_Flags)(policy::prop::bind_as_ptr)
+		.property("m_Layer", &PointerBoundPose::m_Layer)(policy::prop::bind_as_ptr)
+		.property("m_Weight", &PointerBoundPose::m_Weight)(policy::prop::bind_as_ptr)
+		.property("m_Speed", &PointerBoundPose::m_Speed)(policy::prop::bind_as_ptr)
+		.property("m_Time", &PointerBoundPose::m_Time)(policy::prop::bind_as_ptr)
+		.property("m_Name", &PointerBoundPose::m_Name)(policy::prop::bind_as_ptr);
+	registration::class_<ValueBoundPose>("ValueBoundPose")
+		.property("m_Frame", &ValueBoundPose::m_Frame)
+		.property("m_Flags", &ValueBoundPose::m_Flags)
+		.property("m_Layer", &ValueBoundPose::m_Layer)
+		.property("m_Weight", &ValueBoundPose::m_Weight)
+		.property("m_Speed", &ValueBoundPose::m_Speed)
+		.property("m_Time", &ValueBoundPose::m_Time)
+		.property("m_Name", &ValueBoundPose::m_Name);
+
+#define PLAN_TEST_REGISTER_POINTER(TYPE, n) \
+	.property("m_Frame" #n, &TYPE::m_Frame##n)(policy::prop::bind_as_ptr) \
+	.property("m_Weight" #n, &TYPE::m_Weight##n)(policy::prop::bind_as_ptr)
+#define PLAN_TEST_REGISTER_VALUE(TYPE, n) \
+	.property("m_Frame" #n, &TYPE::m_Frame##n) \
+	.property("m_Weight" #n, &TYPE::m_Weight##n)
+#define PLAN_TEST_REGISTER_5(REGISTER, TYPE, n) REGISTER(TYPE, n##0) REGISTER(TYPE, n##1) REGISTER(TYPE, n##2) REGISTER(TYPE, n##3) REGISTER(TYPE, n##4)
+#define PLAN_TEST_REGISTER_25(REGISTER, TYPE, n) PLAN_TEST_REGISTER_5(REGISTER, TYPE, n##0) PLAN_TEST_REGISTER_5(REGISTER, TYPE, n##1) \
+	PLAN_TEST_REGISTER_5(REGISTER, TYPE, n##2) PLAN_TEST_REGISTER_5(REGISTER, TYPE, n##3) PLAN_TEST_REGISTER_5(REGISTER, TYPE, n##4)
+#define PLAN_TEST_REGISTER_100(REGISTER, TYPE, n) PLAN_TEST_REGISTER_25(REGISTER, TYPE, n##0) PLAN_TEST_REGISTER_25(REGISTER, TYPE, n##1) \
+	PLAN_TEST_REGISTER_25(REGISTER, TYPE, n##2) PLAN_TEST_REGISTER_25(REGISTER, TYPE, n##3)
+
+	registration::class_<PlanTestPose10<true>>("PointerBoundPose10") PLAN_TEST_REGISTER_5(PLAN_TEST_REGISTER_POINTER, PlanTestPose10<true>, 0);
+	registration::class_<PlanTestPose10<false>>("ValueBoundPose10") PLAN_TEST_REGISTER_5(PLAN_TEST_REGISTER_VALUE, PlanTestPose10<false>, 0);
+	registration::class_<PlanTestPose50<true>>("PointerBoundPose50") PLAN_TEST_REGISTER_25(PLAN_TEST_REGISTER_POINTER, PlanTestPose50<true>, 0);
+	registration::class_<PlanTestPose50<false>>("ValueBoundPose50") PLAN_TEST_REGISTER_25(PLAN_TEST_REGISTER_VALUE, PlanTestPose50<false>, 0);
+	registration::class_<PlanTestPose200<true>>("PointerBoundPose200") PLAN_TEST_REGISTER_100(PLAN_TEST_REGISTER_POINTER, PlanTestPose200<true>, 0);
+	registration::class_<PlanTestPose200<false>>("ValueBoundPose200") PLAN_TEST_REGISTER_100(PLAN_TEST_REGISTER_VALUE, PlanTestPose200<false>, 0);
+}
+
+using namespace animengine;
+using namespace animengine::Serialization;
+
+namespace
+{
+	const uint32_t Num_Pose_Properties = 7;
+
+	template<typename Pose>
+	void FillPose(uint32_t index, Pose& poseOut)
+	{
+		poseOut.m_Frame = index;
+		poseOut.m_Flags = index * 2654435761u;
+		poseOut.m_Layer = static_cast<int16_t>(-static_cast<int32_t>(index % 7));
+		poseOut.m_Weight = 1.0f / (index + 1);
+		poseOut.m_Speed = index * 0.5f;
+		poseOut.m_Time = index / 30.0;
+		poseOut.m_Name = "pose";
+	}
+
+	template<typename Pose>
+	std::vector<uint8_t> SavePose(const Pose& pose, uint32_t encodingFlags)
+	{
+		ChunkedWriteStream stream;
+		{
+			Serializer res(stream, 1, encodingFlags);
+			SerializeObject(pose, res);
+		}
+		std::vector<uint8_t> bytes(stream.GetNumBytesWritten());
+		stream.CopyTo(bytes.data());
+		return bytes;
+	}
+
+	template<typename Pose>
+	uint32_t GetNumPlanOperations(const Pose& pose)
+	{
+		return SerializationPlan::Get(rttr::type::get(pose), &pose, rttr::instance(pose)).GetNumOperations();
+	}
+
+	void TestPlanMatchesVariant()
+	{
+		bool isSame = true;
+		for (uint32_t encodingFlags : { 0u, static_cast<uint32_t>(Encoding_Compact_Integers) })
+		{
+			for (uint32_t i = 0; i < 100; ++i)
+			{
+				PointerBoundPose pointerBound;
+				ValueBoundPose valueBound;
+				FillPose(i * 1000, pointerBound);
+				FillPose(i * 1000, valueBound);
+				isSame &= SavePose(pointerBound, encodingFlags) == SavePose(valueBound, encodingFlags);
+			}
+		}
+		ANIM_CHECK(isSame);
+
+		// Neighbouring members of the same kind are merged, by value every property stays a variant.
+		PointerBoundPose pointerBound;
+		ValueBoundPose valueBound;
+		ANIM_CHECK(GetNumPlanOperations(pointerBound) < Num_Pose_Properties);
+		ANIM_CHECK(GetNumPlanOperations(valueBound) == Num_Pose_Properties);
+	}
+
+	template<template<bool> class WidePose>
+	void TestWidePlanMatchesVariant()
+	{
+		WidePose<true> pointerBound;
+		WidePose<false> valueBound;
+		for (uint32_t encodingFlags : { 0u, static_cast<uint32_t>(Encoding_Compact_Integers) })
+		{
+			ANIM_CHECK(SavePose(pointerBound, encodingFlags) == SavePose(valueBound, encodingFlags));
+		}
+		ANIM_CHECK(GetNumPlanOperations(valueBound) == WidePose<false>::Num_Properties);
+	}
+
+	template<typename Pose>
+	double MeasureNanosecondsPerObject(std::vector<Pose>& poses, uint32_t encodingFlags, ChunkedWriteStream& stream)
+	{
+		const uint32_t Num_Rounds = 10;
+		double seconds = 0.0;
+		for (uint32_t round = 0; round < Num_Rounds; ++round)
+		{
+			stream.Reset();
+			auto start = BenchmarkClock::now();
+			Serializer res(stream, 1, encodingFlags);
+			for (const Pose& pose : poses)
+			{
+				SerializeObject(pose, res);
+			}
+			seconds += SecondsSince(start);
+		}
+		UseBenchmarkResult(stream.GetNumBytesWritten());
+		return seconds * 1e9 / (static_cast<double>(poses.size()) * Num_Rounds);
+	}
+
+	// The same number of properties per row, so rows compare by ns per property.
+	template<template<bool> class WidePose>
+	void BenchmarkWidePoses()
+	{
+		const uint32_t Num_Properties = WidePose<true>::Num_Properties;
+		const uint32_t Num_Poses = 2000000 / Num_Properties;
+		std::vector<WidePose<true>> pointerBound(Num_Poses);
+		std::vector<WidePose<false>> valueBound(Num_Poses);
+		ChunkedWriteStream stream;
+		double pointerNanoseconds = MeasureNanosecondsPerObject(pointerBound, 0, stream);
+		double valueNanoseconds = MeasureNanosecondsPerObject(valueBound, 0, stream);
+		printf("  %3u properties: bind_as_ptr %8.1f ns per object, by value %8.1f ns per object, %5.1fx\n", Num_Properties,
+			pointerNanoseconds, valueNanoseconds, valueNanoseconds / pointerNanoseconds);
+	}
+
+	template<typename Pose>
+	void BenchmarkPoses(const char* name, uint32_t encodingFlags)
+	{
+		const uint32_t Num_Poses = 100000;
+		const uint32_t Num_Rounds = 10;
+		std::vector<Pose> poses(Num_Poses);
+		for (uint32_t i = 0; i < Num_Poses; ++i)
+		{
+			FillPose(i, poses[i]);
+		}
+
+		ChunkedWriteStream stream;
+		double seconds = 0.0;
+		for (uint32_t round = 0; round < Num_Rounds; ++round)
+		{
+			stream.Reset();
+			auto start = BenchmarkClock::now();
+			Serializer res(stream, 1, encodingFlags);
+			for (const Pose& pose : poses)
+			{
+				SerializeObject(pose, res);
+			}
+			seconds += SecondsSince(start);
+		}
+		UseBenchmarkResult(stream.GetNumBytesWritten());
+		double numPoses = static_cast<double>(Num_Poses) * Num_Rounds;
+		printf("  %-14s %6.1f ns per object %7.1f MB/s\n", name, seconds * 1e9 / numPoses,
+			stream.GetNumBytesWritten() * static_cast<double>(Num_Rounds) / (1024.0 * 1024.0) / seconds);
+	}
+}
+
+void RunObjectSerializerTests()
+{
+	TestPlanMatchesVariant();
+	TestWidePlanMatchesVariant<PlanTestPose10>();
+	TestWidePlanMatchesVariant<PlanTestPose50>();
+	TestWidePlanMatchesVariant<PlanTestPose200>();
+}
+
+void RunObjectSerializerBenchmark()
+{
+	printf("%u properties, fixed size integers:\n", Num_Pose_Properties);
+	BenchmarkPoses<PointerBoundPose>("bind_as_ptr", 0);
+	BenchmarkPoses<ValueBoundPose>("by value", 0);
+	printf("%u properties, compact integers:\n", Num_Pose_Properties);
+	BenchmarkPoses<PointerBoundPose>("bind_as_ptr", Encoding_Compact_Integers);
+	BenchmarkPoses<ValueBoundPose>("by value", Encoding_Compact_Integers);
+	printf("wide poses, fixed size integers:\n");
+	BenchmarkWidePoses<PlanTestPose10>();
+	BenchmarkWidePoses<PlanTestPose50>();
+	BenchmarkWidePoses<PlanTestPose200>();
+}
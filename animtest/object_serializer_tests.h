@@ -0,0 +1,6 @@
+#pragma once
+
+void RunObjectSerializerTests();
+// Serializes RTTR objects whose properties are bound by pointer, which the plan copies straight from the object,
+// and the same objects with properties bound by value, which go through rttr::variant, at 7 to 200 properties.
+void RunObjectSerializerBenchmark();
@@ -0,0 +1,182 @@
+#include "pipe_latency_benchmark.h"
+#include <cstdio>
+#include <thread>
+#include "animcore/containers/array.h"
+#include "animcore/remoteprotocol/message.h"
+#include "animcore/remoteprotocol/pipe_client.h"
+#include "animcore/remoteprotocol/pipe_server.h"
+#include "animcore/serialization/serialization.h"
+#include "test_harness.h"
+
+ANIM_NAMESPACE_BEGIN
+
+class LatencyBenchmarkMessage : public Message
+{
+	DECLARE_DERIVED_CLASS();
+public:
+	virtual void Serialize(Serialization::Serializer& res) const override
+	{
+		res.Serialize(m_Sequence);
+		res.Serialize(m_Payload);
+	}
+	virtual void Deserialize(Serialization::Deserializer& res) override
+	{
+		res.Deserialize(m_Sequence);
+		res.Deserialize(m_Payload);
+	}
+
+	uint32_t m_Sequence = 0;
+	BigArray<uint8_t> m_Payload;
+};
+
+IMPLEMENT_CONCRETE_DERIVED_CLASS(LatencyBenchmarkMessage, Message);
+
+ANIM_NAMESPACE_END
+
+using namespace animengine;
+
+namespace
+{
+	const char* Latency_Pipe_Name = "\\\\.\\pipe\\animengine_latency_benchmark";
+
+	UniquePtr<Message> EchoMessage(UniquePtr<Message> msg)
+	{
+		return msg;
+	}
+
+	// Runs an echo server on its own thread for as long as it lives.
+	class EchoServer
+	{
+	public:
+		EchoServer()
+			: m_Server(IPipeServer::CreateServer())
+		{
+			m_Server->SetDispatchCallback(&EchoMessage);
+			m_Server->SetNumDispatchThreads(1);
+			m_Thread = std::thread([this]() { m_Server->RunServer(Latency_Pipe_Name, 1); });
+		}
+		~EchoServer()
+		{
+			m_Server->StopServer();
+			m_Thread.join();
+		}
+
+	private:
+		UniquePtr<IPipeServer> m_Server;
+		std::thread m_Thread;
+	};
+
+	bool Connect(IPipeClient& client)
+	{
+		auto start = BenchmarkClock::now();
+		while (!client.ConnectToServer(Latency_Pipe_Name))
+		{
+			if (SecondsSince(start) > 5.0)
+				return false;
+		}
+		return true;
+	}
+
+	// Returns the average seconds per round trip, numFailedOut counts wrong or missing responses.
+	double MeasureRoundTrips(IPipeClient& client, LatencyBenchmarkMessage& request, uint32_t numRoundTrips, uint32_t& numFailedOut)
+	{
+		auto start = BenchmarkClock::now();
+		for (uint32_t i = 0; i < numRoundTrips; ++i)
+		{
+			++request.m_Sequence;
+			Message* response = client.SendMessage(&request);
+			if (response == nullptr || static_cast<LatencyBenchmarkMessage*>(response)->m_Sequence != request.m_Sequence
+				|| static_cast<LatencyBenchmarkMessage*>(response)->m_Payload.Size() != request.m_Payload.Size())
+			{
+				++numFailedOut;
+			}
+			DefaultAllocator::Destroy(response);
+		}
+		return SecondsSince(start) / numRoundTrips;
+	}
+
+	void RunSmallMessages(IPipeClient& client)
+	{
+		const uint32_t Num_Round_Trips = 50000;
+		LatencyBenchmarkMessage request;
+		uint32_t numFailed = 0;
+		// Warms up the connection and the buffers.
+		MeasureRoundTrips(client, request, 1000, numFailed);
+		double seconds = MeasureRoundTrips(client, request, Num_Round_Trips, numFailed);
+		printf("  sync, small messages %8.2f us per round trip %8.0f messages/s%s\n", seconds * 1e6, 1.0 / seconds,
+			numFailed != 0 ? " FAILED" : "");
+	}
+
+	void RunPayloads(IPipeClient& client)
+	{
+		struct Payload { uint32_t m_NumBytes; uint32_t m_NumRoundTrips; };
+		const Payload payloads[] = { { 1024, 20000 }, { 1024 * 1024, 200 }, { 64 * 1024 * 1024, 5 } };
+		for (const Payload& payload : payloads)
+		{
+			LatencyBenchmarkMessage request;
+			request.m_Payload.Resize(payload.m_NumBytes);
+			for (uint32_t i = 0; i < payload.m_NumBytes; ++i)
+			{
+				request.m_Payload[i] = static_cast<uint8_t>(i * 7);
+			}
+			uint32_t numFailed = 0;
+			MeasureRoundTrips(client, request, 1, numFailed);
+			double seconds = MeasureRoundTrips(client, request, payload.m_NumRoundTrips, numFailed);
+			printf("  sync, %8u B payload %10.2f us per round trip %8.1f MB/s each way%s\n", payload.m_NumBytes, seconds * 1e6,
+				payload.m_NumBytes / seconds * 1e-6, numFailed != 0 ? " FAILED" : "");
+		}
+	}
+
+	void RunBatches(IPipeClient& client)
+	{
+		const uint32_t Num_Rounds = 10;
+		for (uint32_t batchSize : { 1000u, 10000u })
+		{
+			LatencyBenchmarkMessage request;
+			uint32_t numFailed = 0;
+			uint32_t numAnswered = 0;
+			auto start = BenchmarkClock::now();
+			for (uint32_t round = 0; round < Num_Rounds; ++round)
+			{
+				for (uint32_t i = 0; i < batchSize; ++i)
+				{
+					uint32_t sequence = ++request.m_Sequence;
+					uint32_t requestID = client.SendMessageAsync(&request, [sequence, &numFailed, &numAnswered](UniquePtr<Message> response)
+					{
+						++numAnswered;
+						if (response.Get() == nullptr || static_cast<LatencyBenchmarkMessage*>(response.Get())->m_Sequence != sequence)
+						{
+							++numFailed;
+						}
+					});
+					numFailed += requestID == 0 ? 1 : 0;
+				}
+				if (!client.WaitForResponses())
+				{
+					++numFailed;
+				}
+			}
+			double seconds = SecondsSince(start) / (Num_Rounds * batchSize);
+			numFailed += numAnswered != Num_Rounds * batchSize ? 1 : 0;
+			printf("  async, %5u queued   %8.2f us per request   %8.0f messages/s%s\n", batchSize, seconds * 1e6, 1.0 / seconds,
+				numFailed != 0 ? " FAILED" : "");
+		}
+	}
+}
+
+void RunPipeLatencyBenchmark()
+{
+	EchoServer server;
+	auto client = IPipeClient::CreateClient();
+	if (!Connect(*client.Get()))
+	{
+		printf("cannot connect to %s\n", Latency_Pipe_Name);
+		return;
+	}
+
+	printf("pipe echo, 1 client:\n");
+	RunSmallMessages(*client.Get());
+	RunPayloads(*client.Get());
+	RunBatches(*client.Get());
+	client->DisconnectFromServer();
+}
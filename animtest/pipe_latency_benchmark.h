@@ -0,0 +1,5 @@
+#pragma once
+
+// Echoes messages between one client and a server over the local transport and prints the round trip times,
+// synchronous and with many requests queued at once.
+void RunPipeLatencyBenchmark();
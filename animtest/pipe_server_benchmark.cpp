@@ -0,0 +1,138 @@
+#include "pipe_server_benchmark.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include "animcore/containers/array.h"
+#include "animcore/remoteprotocol/message.h"
+#include "animcore/remoteprotocol/pipe_client.h"
+#include "animcore/remoteprotocol/pipe_server.h"
+#include "animcore/serialization/serialization.h"
+
+ANIM_NAMESPACE_BEGIN
+
+class BenchmarkMessage : public Message
+{
+	DECLARE_DERIVED_CLASS();
+public:
+	virtual void Serialize(Serialization::Serializer& res) const override
+	{
+		res.Serialize(m_Sequence);
+		res.Serialize(m_HandlerMilliseconds);
+	}
+	virtual void Deserialize(Serialization::Deserializer& res) override
+	{
+		res.Deserialize(m_Sequence);
+		res.Deserialize(m_HandlerMilliseconds);
+	}
+
+	uint32_t m_Sequence = 0;
+	uint32_t m_HandlerMilliseconds = 0;
+};
+
+IMPLEMENT_CONCRETE_DERIVED_CLASS(BenchmarkMessage, Message);
+
+ANIM_NAMESPACE_END
+
+using namespace animengine;
+
+namespace
+{
+	const char* Benchmark_Pipe_Name = "\\\\.\\pipe\\animengine_benchmark";
+	const double Benchmark_Seconds = 2.0;
+
+	UniquePtr<Message> HandleBenchmarkMessage(UniquePtr<Message> msg)
+	{
+		const BenchmarkMessage* request = static_cast<const BenchmarkMessage*>(msg.Get());
+		if (request->m_HandlerMilliseconds > 0)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(request->m_HandlerMilliseconds));
+		}
+		return msg;
+	}
+
+	struct ClientResult
+	{
+		uint32_t m_NumRequests = 0;
+		uint32_t m_NumFailed = 0;
+		double m_WorstLatency = 0.0;
+	};
+
+	void RunClient(uint32_t handlerMilliseconds, ClientResult& result)
+	{
+		auto client = IPipeClient::CreateClient();
+		auto start = std::chrono::steady_clock::now();
+		while (!client->ConnectToServer(Benchmark_Pipe_Name))
+		{
+			if (std::chrono::steady_clock::now() - start > std::chrono::seconds(5))
+			{
+				++result.m_NumFailed;
+				return;
+			}
+		}
+
+		BenchmarkMessage request;
+		request.m_HandlerMilliseconds = handlerMilliseconds;
+		start = std::chrono::steady_clock::now();
+		auto now = start;
+		while (std::chrono::duration<double>(now - start).count() < Benchmark_Seconds)
+		{
+			++request.m_Sequence;
+			Message* response = client->SendMessage(&request);
+			if (response == nullptr || static_cast<BenchmarkMessage*>(response)->m_Sequence != request.m_Sequence)
+			{
+				++result.m_NumFailed;
+			}
+			DefaultAllocator::Destroy(response);
+
+			auto sent = now;
+			now = std::chrono::steady_clock::now();
+			double latency = std::chrono::duration<double>(now - sent).count();
+			result.m_WorstLatency = latency > result.m_WorstLatency ? latency : result.m_WorstLatency;
+			++result.m_NumRequests;
+		}
+	}
+
+	void RunConfiguration(uint32_t numFastClients, uint32_t numDispatchThreads, uint32_t slowMilliseconds)
+	{
+		auto server = IPipeServer::CreateServer();
+		server->SetDispatchCallback(&HandleBenchmarkMessage);
+		server->SetNumDispatchThreads(numDispatchThreads);
+		std::thread serverThread([&server, numFastClients]() { server->RunServer(Benchmark_Pipe_Name, numFastClients + 1); });
+
+		BigArray<ClientResult> results;
+		results.Resize(numFastClients + 1);
+		BigArray<std::thread> clients;
+		for (uint32_t i = 0; i <= numFastClients; ++i)
+		{
+			// The last client is the slow one.
+			uint32_t handlerMilliseconds = i == numFastClients ? slowMilliseconds : 0;
+			ClientResult& result = results[i];
+			clients.EmplaceBack([handlerMilliseconds, &result]() { RunClient(handlerMilliseconds, result); });
+		}
+		for (auto& client : clients)
+		{
+			client.join();
+		}
+		server->StopServer();
+		serverThread.join();
+
+		ClientResult fast;
+		for (uint32_t i = 0; i < numFastClients; ++i)
+		{
+			fast.m_NumRequests += results[i].m_NumRequests;
+			fast.m_NumFailed += results[i].m_NumFailed;
+			fast.m_WorstLatency = results[i].m_WorstLatency > fast.m_WorstLatency ? results[i].m_WorstLatency : fast.m_WorstLatency;
+		}
+		const ClientResult& slow = results[numFastClients];
+		printf("%2u dispatch threads: fast clients %8.0f requests/s, worst latency %7.2f ms | slow client %4u requests | %u failed\n",
+			numDispatchThreads, fast.m_NumRequests / Benchmark_Seconds, fast.m_WorstLatency * 1000.0, slow.m_NumRequests, fast.m_NumFailed + slow.m_NumFailed);
+	}
+}
+
+void RunPipeServerBenchmark(uint32_t numFastClients, uint32_t numDispatchThreads, uint32_t slowMilliseconds)
+{
+	printf("pipe server: %u fast clients, 1 client with a %u ms handler, %.0f s each\n", numFastClients, slowMilliseconds, Benchmark_Seconds);
+	RunConfiguration(numFastClients, 1, slowMilliseconds);
+	RunConfiguration(numFastClients, numDispatchThreads, slowMilliseconds);
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include <stdint.h>
+
+// Serves numFastClients clients whose requests are answered right away next to one client whose requests take
+// slowMilliseconds to handle, and prints how the fast clients fare with a single dispatch thread and with
+// numDispatchThreads.
+void RunPipeServerBenchmark(uint32_t numFastClients, uint32_t numDispatchThreads, uint32_t slowMilliseconds);
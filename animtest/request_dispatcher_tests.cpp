@@ -0,0 +1,192 @@
+#include "request_dispatcher_tests.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include "animcore/remoteprotocol/message.h"
+#include "animcore/remoteprotocol/request_dispatcher.h"
+#include "animcore/serialization/serialization.h"
+#include "test_harness.h"
+
+ANIM_NAMESPACE_BEGIN
+
+class DispatcherTestMessage : public Message
+{
+	DECLARE_DERIVED_CLASS();
+public:
+	DispatcherTestMessage() { ++s_NumAlive; }
+	virtual ~DispatcherTestMessage() { --s_NumAlive; }
+
+	virtual void Serialize(Serialization::Serializer& res) const override { res.Serialize(m_Value); }
+	virtual void Deserialize(Serialization::Deserializer& res) override { res.Deserialize(m_Value); }
+
+	uint32_t m_Value = 0;
+	static std::atomic<int> s_NumAlive;
+};
+
+IMPLEMENT_CONCRETE_DERIVED_CLASS(DispatcherTestMessage, Message);
+
+std::atomic<int> DispatcherTestMessage::s_NumAlive(0);
+
+ANIM_NAMESPACE_END
+
+using namespace animengine;
+
+namespace
+{
+	// The dispatch callback is a plain function, so what it shares with a test lives here.
+	std::mutex s_Mutex;
+	std::condition_variable s_Changed;
+	bool s_IsHandlerBlocked = false;
+	bool s_IsHandlerWaiting = false;
+	bool s_AreResponsesReady = false;
+	std::atomic<uint32_t> s_NumDispatched(0);
+
+	// Answers with the request's value plus one. Holds the handler while s_IsHandlerBlocked is set.
+	UniquePtr<Message> HandleTestMessage(UniquePtr<Message> msg)
+	{
+		++s_NumDispatched;
+		{
+			std::unique_lock<std::mutex> lock(s_Mutex);
+			s_IsHandlerWaiting = true;
+			s_Changed.notify_all();
+			s_Changed.wait(lock, []() { return !s_IsHandlerBlocked; });
+			s_IsHandlerWaiting = false;
+		}
+		static_cast<DispatcherTestMessage*>(msg.Get())->m_Value += 1;
+		return msg;
+	}
+
+	void OnResponsesReady()
+	{
+		std::lock_guard<std::mutex> lock(s_Mutex);
+		s_AreResponsesReady = true;
+		s_Changed.notify_all();
+	}
+
+	// Returns false if nothing became ready within a few seconds.
+	bool WaitForReady(RequestDispatcher& dispatcher, Array<uint32_t>& connectionsOut)
+	{
+		{
+			std::unique_lock<std::mutex> lock(s_Mutex);
+			if (!s_Changed.wait_for(lock, std::chrono::seconds(5), []() { return s_AreResponsesReady; }))
+				return false;
+			s_AreResponsesReady = false;
+		}
+		dispatcher.TakeReadyConnections(connectionsOut);
+		return true;
+	}
+
+	void PushRequest(RequestDispatcher& dispatcher, uint32_t connection, uint32_t value)
+	{
+		DispatcherTestMessage* msg = DefaultAllocator::Create<DispatcherTestMessage>();
+		msg->m_Value = value;
+		dispatcher.Push(connection, msg, value);
+	}
+
+	bool IsResponse(const RequestDispatcher::Response& response, uint32_t requestID)
+	{
+		return response.m_RequestID == requestID && response.m_Message.Get() != nullptr
+			&& static_cast<const DispatcherTestMessage*>(response.m_Message.Get())->m_Value == requestID + 1;
+	}
+
+	void TestResponsesKeepRequestOrder()
+	{
+		const uint32_t Num_Connections = 3;
+		const uint32_t Num_Requests = 200;
+		s_AreResponsesReady = false;
+		RequestDispatcher dispatcher(&HandleTestMessage, Num_Connections, 2, &OnResponsesReady);
+		for (uint32_t i = 1; i <= Num_Requests; ++i)
+		{
+			for (uint32_t connection = 0; connection < Num_Connections; ++connection)
+			{
+				PushRequest(dispatcher, connection, i);
+			}
+		}
+
+		BigArray<RequestDispatcher::Response> responses[Num_Connections];
+		uint32_t numResponses = 0;
+		Array<uint32_t> ready;
+		while (numResponses < Num_Connections * Num_Requests && WaitForReady(dispatcher, ready))
+		{
+			for (uint32_t connection : ready)
+			{
+				uint32_t numBefore = responses[connection].Size();
+				dispatcher.TakeResponses(connection, responses[connection]);
+				numResponses += responses[connection].Size() - numBefore;
+			}
+			ready.Clear();
+		}
+
+		bool isInOrder = true;
+		for (uint32_t connection = 0; connection < Num_Connections; ++connection)
+		{
+			ANIM_CHECK(responses[connection].Size() == Num_Requests);
+			ANIM_CHECK(dispatcher.GetNumQueued(connection) == 0);
+			for (uint32_t i = 0; i < responses[connection].Size(); ++i)
+			{
+				isInOrder &= IsResponse(responses[connection][i], i + 1);
+			}
+		}
+		ANIM_CHECK(isInOrder);
+	}
+
+	// A client disconnects while one of its requests is being dispatched and reconnects on the same connection.
+	// The old answers must not reach the new client, and nothing may leak.
+	void TestResetWhileDispatching()
+	{
+		int numAliveBefore = DispatcherTestMessage::s_NumAlive;
+		s_AreResponsesReady = false;
+		s_NumDispatched = 0;
+		{
+			RequestDispatcher dispatcher(&HandleTestMessage, 2, 2, &OnResponsesReady);
+			{
+				std::lock_guard<std::mutex> lock(s_Mutex);
+				s_IsHandlerBlocked = true;
+			}
+			for (uint32_t i = 1; i <= 3; ++i)
+			{
+				PushRequest(dispatcher, 0, i);
+			}
+			{
+				std::unique_lock<std::mutex> lock(s_Mutex);
+				ANIM_CHECK(s_Changed.wait_for(lock, std::chrono::seconds(5), []() { return s_IsHandlerWaiting; }));
+			}
+			ANIM_CHECK(dispatcher.GetNumQueued(0) == 3);
+
+			dispatcher.Reset(0);
+			ANIM_CHECK(dispatcher.GetNumQueued(0) == 0);
+			// The new client's request queues up behind the job that is still running.
+			PushRequest(dispatcher, 0, 100);
+			ANIM_CHECK(dispatcher.GetNumQueued(0) == 1);
+			{
+				std::lock_guard<std::mutex> lock(s_Mutex);
+				s_IsHandlerBlocked = false;
+				s_Changed.notify_all();
+			}
+
+			BigArray<RequestDispatcher::Response> responses;
+			Array<uint32_t> ready;
+			while (responses.Size() == 0 && WaitForReady(dispatcher, ready))
+			{
+				for (uint32_t connection : ready)
+				{
+					ANIM_CHECK(connection == 0);
+					dispatcher.TakeResponses(connection, responses);
+				}
+				ready.Clear();
+			}
+			ANIM_CHECK(responses.Size() == 1 && IsResponse(responses[0], 100));
+			ANIM_CHECK(dispatcher.GetNumQueued(0) == 0);
+			// The blocked request and the new one, the two queued behind the blocked one were dropped.
+			ANIM_CHECK(s_NumDispatched == 2);
+		}
+		ANIM_CHECK(DispatcherTestMessage::s_NumAlive == numAliveBefore);
+	}
+}
+
+void RunRequestDispatcherTests()
+{
+	TestResponsesKeepRequestOrder();
+	TestResetWhileDispatching();
+}
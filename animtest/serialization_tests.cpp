@@ -0,0 +1,1326 @@
+#include "serialization_tests.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <errno.h>
+#include <limits>
+#include <random>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "animcore/containers/string_table.h"
+#include "animcore/objectmodel/managed_object.h"
+#include "animcore/serialization/asset_converter.h"
+#include "animcore/serialization/chunked_write_stream.h"
+#include "animcore/math/half_float.h"
+#include "animcore/serialization/file_stream.h"
+#include "animcore/serialization/i_serializable.h"
+#include "animcore/serialization/mapped_file.h"
+#include "animcore/serialization/memory_stream.h"
+#include "animcore/serialization/serialization.h"
+#include "test_harness.h"
+#ifdef WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+ANIM_NAMESPACE_BEGIN
+
+class SerializationTestKey : public Serialization::ISerializable
+{
+	DECLARE_DERIVED_CLASS();
+public:
+	virtual void Serialize(Serialization::Serializer& res) const override
+	{
+		res.Serialize(m_Time);
+		res.Serialize(m_Value);
+		res.Serialize(m_Flags);
+	}
+	virtual void Deserialize(Serialization::Deserializer& res) override
+	{
+		res.Deserialize(m_Time);
+		res.Deserialize(m_Value);
+		res.Deserialize(m_Flags);
+	}
+
+	bool operator==(const SerializationTestKey& other) const
+	{
+		return m_Time == other.m_Time && m_Value == other.m_Value && m_Flags == other.m_Flags;
+	}
+
+	float m_Time = 0.0f;
+	float m_Value = 0.0f;
+	uint16_t m_Flags = 0;
+};
+
+// A small composite object, like a curve of a clip: values, a string, a bulk array and an array of objects.
+class SerializationTestTrack : public Serialization::ISerializable
+{
+	DECLARE_DERIVED_CLASS();
+public:
+	virtual void Serialize(Serialization::Serializer& res) const override
+	{
+		res.Serialize(m_ID);
+		res.Serialize(m_Name);
+		res.Serialize(m_Offset);
+		res.Serialize(m_Samples);
+		res.Serialize(m_Keys);
+	}
+	virtual void Deserialize(Serialization::Deserializer& res) override
+	{
+		res.Deserialize(m_ID);
+		res.Deserialize(m_Name);
+		res.Deserialize(m_Offset);
+		res.Deserialize(m_Samples);
+		res.Deserialize(m_Keys);
+	}
+
+	bool operator==(const SerializationTestTrack& other) const
+	{
+		if (m_ID != other.m_ID || m_Name != other.m_Name || m_Samples.Size() != other.m_Samples.Size() || m_Keys.Size() != other.m_Keys.Size())
+			return false;
+		if (m_Offset.m_X != other.m_Offset.m_X || m_Offset.m_Y != other.m_Offset.m_Y || m_Offset.m_Z != other.m_Offset.m_Z)
+			return false;
+		for (uint32_t i = 0; i < m_Samples.Size(); ++i)
+		{
+			if (m_Samples[i] != other.m_Samples[i])
+				return false;
+		}
+		for (uint32_t i = 0; i < m_Keys.Size(); ++i)
+		{
+			if (!(m_Keys[i] == other.m_Keys[i]))
+				return false;
+		}
+		return true;
+	}
+
+	uint32_t m_ID = 0;
+	SimpleString m_Name;
+	Vector3 m_Offset;
+	BigArray<float> m_Samples;
+	BigArray<SerializationTestKey> m_Keys;
+};
+
+// Shared graph nodes: children are owned, parents are weak so the graph can have cycles.
+class SerializationTestNode : public Serialization::ISerializable
+{
+	DECLARE_DERIVED_CLASS();
+public:
+	SerializationTestNode() { ++s_NumAlive; }
+	virtual ~SerializationTestNode() { --s_NumAlive; }
+
+	virtual void Serialize(Serialization::Serializer& res) const override
+	{
+		res.Serialize(m_Value);
+		res.Serialize(m_Children);
+		res.Serialize(m_Parent);
+	}
+	virtual void Deserialize(Serialization::Deserializer& res) override
+	{
+		res.Deserialize(m_Value);
+		res.Deserialize(m_Children);
+		res.Deserialize(m_Parent);
+	}
+
+	static int s_NumAlive;
+
+	uint32_t m_Value = 0;
+	BigArray<SharedPtr<SerializationTestNode>> m_Children;
+	WeakPtr<SerializationTestNode> m_Parent;
+};
+
+class SerializationTestNamedNode : public SerializationTestNode
+{
+	DECLARE_DERIVED_CLASS();
+public:
+	virtual void Serialize(Serialization::Serializer& res) const override
+	{
+		SerializationTestNode::Serialize(res);
+		res.Serialize(m_Name);
+	}
+	virtual void Deserialize(Serialization::Deserializer& res) override
+	{
+		SerializationTestNode::Deserialize(res);
+		res.Deserialize(m_Name);
+	}
+
+	SimpleString m_Name;
+};
+
+// Two releases of the same pose written as tagged fields. The second one added m_Blend and writes its fields in
+// a different order.
+class SerializationTestPoseV1 : public Serialization::ISerializable
+{
+	DECLARE_DERIVED_CLASS();
+public:
+	virtual void Serialize(Serialization::Serializer& res) const override
+	{
+		res.SerializeField(Serialization::FieldTag("m_Frame"), m_Frame);
+		res.SerializeField(Serialization::FieldTag("m_Weights"), m_Weights);
+		res.EndFields();
+	}
+	virtual void Deserialize(Serialization::Deserializer& res) override
+	{
+		Serialization::Deserializer::FieldReader fields(res);
+		while (fields.Next())
+		{
+			if (fields.GetTag() == Serialization::FieldTag("m_Frame"))
+				res.Deserialize(m_Frame);
+			else if (fields.GetTag() == Serialization::FieldTag("m_Weights"))
+				res.Deserialize(m_Weights);
+		}
+	}
+
+	uint32_t m_Frame = 0;
+	BigArray<float> m_Weights;
+};
+
+class SerializationTestPoseV2 : public Serialization::ISerializable
+{
+	DECLARE_DERIVED_CLASS();
+public:
+	virtual void Serialize(Serialization::Serializer& res) const override
+	{
+		res.SerializeField(Serialization::FieldTag("m_Blend"), m_Blend);
+		res.SerializeField(Serialization::FieldTag("m_Weights"), m_Weights);
+		res.SerializeField(Serialization::FieldTag("m_Frame"), m_Frame);
+		res.EndFields();
+	}
+	virtual void Deserialize(Serialization::Deserializer& res) override
+	{
+		Serialization::Deserializer::FieldReader fields(res);
+		while (fields.Next())
+		{
+			if (fields.GetTag() == Serialization::FieldTag("m_Frame"))
+				res.Deserialize(m_Frame);
+			else if (fields.GetTag() == Serialization::FieldTag("m_Weights"))
+				res.Deserialize(m_Weights);
+			else if (fields.GetTag() == Serialization::FieldTag("m_Blend"))
+				res.Deserialize(m_Blend);
+		}
+	}
+
+	uint32_t m_Frame = 0;
+	BigArray<float> m_Weights;
+	float m_Blend = 1.0f;
+};
+
+// Stored its duration in milliseconds up to data version 1 and in seconds since.
+class SerializationTestAsset : public ManagedObject
+{
+	DECLARE_DERIVED_CLASS();
+public:
+	virtual void Serialize(Serialization::Serializer& res) const override
+	{
+		res.Serialize(m_Duration);
+	}
+	virtual void Deserialize(Serialization::Deserializer& res) override
+	{
+		if (res.GetDataVersion() < 2)
+		{
+			uint32_t durationMs = 0;
+			res.Deserialize(durationMs);
+			m_Duration = durationMs / 1000.0f;
+			return;
+		}
+		res.Deserialize(m_Duration);
+	}
+
+	float m_Duration = 0.0f;
+};
+
+int SerializationTestNode::s_NumAlive = 0;
+
+IMPLEMENT_CONCRETE_DERIVED_CLASS(SerializationTestKey, Serialization::ISerializable);
+IMPLEMENT_CONCRETE_DERIVED_CLASS(SerializationTestTrack, Serialization::ISerializable);
+IMPLEMENT_CONCRETE_DERIVED_CLASS(SerializationTestNode, Serialization::ISerializable);
+IMPLEMENT_CONCRETE_DERIVED_CLASS(SerializationTestNamedNode, SerializationTestNode);
+IMPLEMENT_CONCRETE_DERIVED_CLASS(SerializationTestPoseV1, Serialization::ISerializable);
+IMPLEMENT_CONCRETE_DERIVED_CLASS(SerializationTestPoseV2, Serialization::ISerializable);
+IMPLEMENT_CONCRETE_DERIVED_CLASS(SerializationTestAsset, ManagedObject);
+
+ANIM_NAMESPACE_END
+
+using namespace animengine;
+using namespace animengine::Serialization;
+
+namespace
+{
+	const uint32_t Test_Data_Version = 1;
+
+	void MakeTracks(uint32_t numTracks, uint32_t numSamples, uint32_t numKeys, BigArray<SerializationTestTrack>& tracksOut)
+	{
+		std::mt19937 random(11);
+		std::uniform_real_distribution<float> values(-1.0f, 1.0f);
+		tracksOut.Resize(numTracks);
+		for (uint32_t i = 0; i < numTracks; ++i)
+		{
+			SerializationTestTrack& track = tracksOut[i];
+			track.m_ID = random();
+			track.m_Name = "track_";
+			track.m_Name += std::to_string(i).c_str();
+			track.m_Offset = Vector3(values(random), values(random), values(random));
+			for (uint32_t j = 0; j < numSamples; ++j)
+			{
+				track.m_Samples.Push(values(random));
+			}
+			for (uint32_t j = 0; j < numKeys; ++j)
+			{
+				SerializationTestKey key;
+				key.m_Time = static_cast<float>(j) / 30.0f;
+				key.m_Value = values(random);
+				key.m_Flags = static_cast<uint16_t>(random());
+				track.m_Keys.Push(key);
+			}
+		}
+	}
+
+	bool AreTracksEqual(const BigArray<SerializationTestTrack>& a, const BigArray<SerializationTestTrack>& b)
+	{
+		if (a.Size() != b.Size())
+			return false;
+		for (uint32_t i = 0; i < a.Size(); ++i)
+		{
+			if (!(a[i] == b[i]))
+				return false;
+		}
+		return true;
+	}
+
+	std::vector<uint8_t> CopyOut(const ChunkedWriteStream& stream)
+	{
+		std::vector<uint8_t> bytes(stream.GetNumBytesWritten());
+		stream.CopyTo(bytes.data());
+		return bytes;
+	}
+
+	// Has no ReadInPlace, so arrays are copied out like from a file or a socket.
+	class CopyingReadStream : public IReadStream
+	{
+	public:
+		explicit CopyingReadStream(const std::vector<uint8_t>& bytes)
+			: m_Bytes(bytes), m_Position(0)
+		{
+		}
+
+		virtual void Read(void* dst, uint32_t numBytes) override
+		{
+			ANIM_ASSERT(numBytes <= m_Bytes.size() - m_Position);
+			memcpy(dst, m_Bytes.data() + m_Position, numBytes);
+			m_Position += numBytes;
+		}
+		virtual void Reset() override { m_Position = 0; }
+		virtual uint32_t GetNumBytesRead() const override { return m_Position; }
+
+	private:
+		const std::vector<uint8_t>& m_Bytes;
+		uint32_t m_Position;
+	};
+
+	template<typename ArrayType>
+	bool AreArraysEqual(const ArrayType& a, const ArrayType& b)
+	{
+		return a.Size() == b.Size() && (a.Size() == 0 || memcmp(a.GetBuffer(), b.GetBuffer(), a.Size() * sizeof(a[0])) == 0);
+	}
+
+	void TestRoundTripAcrossChunks()
+	{
+		BigArray<SerializationTestTrack> tracks;
+		MakeTracks(200, 37, 5, tracks);
+
+		// Small first chunk, so the data and the arrays reserved up front span many chunks.
+		ChunkedWriteStream stream(64);
+		{
+			Serializer res(stream, Test_Data_Version);
+			res.Serialize(tracks);
+		}
+		uint32_t numChunkBytes = 0;
+		for (uint32_t i = 0; i < stream.GetNumChunks(); ++i)
+		{
+			numChunkBytes += stream.GetChunkSize(i);
+		}
+		ANIM_CHECK(stream.GetNumChunks() > 1);
+		ANIM_CHECK(numChunkBytes == stream.GetNumBytesWritten());
+
+		std::vector<uint8_t> bytes = CopyOut(stream);
+		MemoryStream input(bytes.data(), static_cast<uint32_t>(bytes.size()));
+		BigArray<SerializationTestTrack> loaded;
+		{
+			Deserializer res(input);
+			ANIM_CHECK(res.GetDataVersion() == Test_Data_Version);
+			res.Deserialize(loaded);
+			ANIM_CHECK(res.IsValid());
+		}
+		ANIM_CHECK(input.GetNumBytesRead() == bytes.size());
+		ANIM_CHECK(AreTracksEqual(tracks, loaded));
+
+		// A reset stream reuses its chunks and writes the same bytes again.
+		uint32_t numChunks = stream.GetNumChunks();
+		stream.Reset();
+		ANIM_CHECK(stream.GetNumBytesWritten() == 0);
+		{
+			Serializer res(stream, Test_Data_Version);
+			res.Serialize(tracks);
+		}
+		ANIM_CHECK(stream.GetNumChunks() == numChunks);
+		ANIM_CHECK(CopyOut(stream) == bytes);
+	}
+
+	void TestBulkArrayLayout()
+	{
+		// The array data is the buffer as is, after the count and the padding up to its alignment.
+		BigArray<double> values;
+		for (uint32_t i = 0; i < 100; ++i)
+		{
+			values.Push(i * 0.25 - 3.0);
+		}
+		ChunkedWriteStream stream;
+		uint32_t headerSize = 0;
+		{
+			Serializer res(stream, Test_Data_Version);
+			headerSize = stream.GetNumBytesWritten();
+			res.Serialize(static_cast<uint8_t>(7));
+			res.Serialize(values);
+		}
+		std::vector<uint8_t> bytes = CopyOut(stream);
+		uint32_t count = 0;
+		memcpy(&count, &bytes[headerSize + 1], sizeof(count));
+		// Alignment counts from where the Serializer started, its header included.
+		uint32_t dataOffset = (headerSize + 1 + sizeof(count) + alignof(double) - 1) / alignof(double) * alignof(double);
+		ANIM_CHECK(bytes[headerSize] == 7);
+		ANIM_CHECK(count == values.Size());
+		ANIM_CHECK(bytes.size() == dataOffset + values.Size() * sizeof(double));
+		bool isPaddingZero = true;
+		for (uint32_t i = headerSize + 1 + sizeof(count); i < dataOffset; ++i)
+		{
+			isPaddingZero &= bytes[i] == 0;
+		}
+		ANIM_CHECK(isPaddingZero);
+		ANIM_CHECK(memcmp(&bytes[dataOffset], values.GetBuffer(), values.Size() * sizeof(double)) == 0);
+	}
+
+	void TestBulkArrayRoundTrip()
+	{
+		std::mt19937 random(5);
+		std::uniform_real_distribution<float> values(-10.0f, 10.0f);
+		BigArray<float> floats;
+		Array<int16_t> shorts;
+		BigArray<Vector3> positions;
+		SmallArray<Quaternion, 4> rotations;
+		BigArray<double> empty;
+		for (uint32_t i = 0; i < 1001; ++i)
+		{
+			floats.Push(values(random));
+			shorts.Push(static_cast<int16_t>(random()));
+			positions.Push(Vector3(values(random), values(random), values(random)));
+		}
+		for (uint32_t i = 0; i < 9; ++i)
+		{
+			Quaternion rotation;
+			rotation.m_X = values(random);
+			rotation.m_W = 1.0f;
+			rotations.Push(rotation);
+		}
+
+		ChunkedWriteStream stream;
+		{
+			Serializer res(stream, Test_Data_Version);
+			// Misaligns everything after it.
+			res.Serialize(static_cast<uint8_t>(1));
+			res.Serialize(floats);
+			res.Serialize(shorts);
+			res.Serialize(positions);
+			res.Serialize(empty);
+			res.Serialize(rotations);
+		}
+		std::vector<uint8_t> bytes = CopyOut(stream);
+		CopyingReadStream input(bytes);
+		uint8_t first = 0;
+		BigArray<float> loadedFloats;
+		Array<int16_t> loadedShorts;
+		BigArray<Vector3> loadedPositions;
+		SmallArray<Quaternion, 4> loadedRotations;
+		BigArray<double> loadedEmpty;
+		{
+			Deserializer res(input);
+			res.Deserialize(first);
+			res.Deserialize(loadedFloats);
+			res.Deserialize(loadedShorts);
+			res.Deserialize(loadedPositions);
+			res.Deserialize(loadedEmpty);
+			res.Deserialize(loadedRotations);
+			ANIM_CHECK(res.IsValid());
+		}
+		ANIM_CHECK(first == 1);
+		ANIM_CHECK(AreArraysEqual(floats, loadedFloats));
+		ANIM_CHECK(AreArraysEqual(shorts, loadedShorts));
+		ANIM_CHECK(AreArraysEqual(positions, loadedPositions));
+		ANIM_CHECK(loadedEmpty.Size() == 0);
+		ANIM_CHECK(AreArraysEqual(rotations, loadedRotations));
+		ANIM_CHECK(input.GetNumBytesRead() == bytes.size());
+	}
+
+	// Arrays loaded from a mapping point into it, and entries cut short fail without reading past the mapping.
+	void TestMappedReadInPlace()
+	{
+		const char* path = "animtest_mapped.bin";
+		BigArray<SerializationTestTrack> tracks;
+		MakeTracks(1, 1000, 4, tracks);
+		{
+			FileWriteStream file(path);
+			ANIM_CHECK(file.IsOpen());
+			{
+				Serializer res(file, Test_Data_Version);
+				res.Serialize(tracks[0]);
+			}
+			ANIM_CHECK(file.Close());
+		}
+
+		MappedFile file;
+		ANIM_CHECK(file.Open(path));
+		const uint32_t fileSize = static_cast<uint32_t>(file.GetSize());
+		{
+			MappedReadStream input(file, 0, fileSize);
+			SerializationTestTrack loaded;
+			Deserializer res(input);
+			res.Deserialize(loaded);
+			ANIM_CHECK(res.IsValid());
+			ANIM_CHECK(loaded == tracks[0]);
+			ANIM_CHECK(!loaded.m_Samples.OwnsBuffer());
+			const uint8_t* samples = reinterpret_cast<const uint8_t*>(loaded.m_Samples.GetBuffer());
+			ANIM_CHECK(samples >= file.GetData() && samples + loaded.m_Samples.Size() * sizeof(float) <= file.GetData() + fileSize);
+		}
+
+		bool isTruncationDetected = true;
+		for (uint32_t size : { 0u, 1u, 7u, fileSize / 2, fileSize - 1 })
+		{
+			MappedReadStream input(file, 0, size);
+			SerializationTestTrack loaded;
+			Deserializer res(input);
+			res.Deserialize(loaded);
+			isTruncationDetected &= !res.IsValid() && input.HasFailed() && input.GetNumBytesRead() <= size;
+		}
+		ANIM_CHECK(isTruncationDetected);
+
+		// A range outside the file, like a corrupt library entry, is empty.
+		{
+			MappedReadStream input(file, Max_Data_Alignment, fileSize);
+			ANIM_CHECK(input.HasFailed());
+			uint32_t value = 1;
+			input.Read(&value, sizeof(value));
+			ANIM_CHECK(value == 0 && input.ReadInPlace(1) == nullptr);
+		}
+		file.Close();
+		remove(path);
+	}
+
+	template<typename T>
+	std::vector<uint8_t> SaveToBytes(const T& obj)
+	{
+		ChunkedWriteStream stream;
+		{
+			Serializer res(stream, Test_Data_Version);
+			res.Serialize(obj);
+		}
+		return CopyOut(stream);
+	}
+
+	template<typename T>
+	bool LoadFromBytes(const std::vector<uint8_t>& bytes, T& objOut)
+	{
+		MemoryStream input(const_cast<uint8_t*>(bytes.data()), static_cast<uint32_t>(bytes.size()));
+		Deserializer res(input);
+		res.Deserialize(objOut);
+		return res.IsValid() && input.GetNumBytesRead() == bytes.size();
+	}
+
+	void TestSharedGraphKeepsIdentity()
+	{
+		int numAliveBefore = SerializationTestNode::s_NumAlive;
+		{
+			// root owns a and b, both own the named node, which points back at root.
+			BigArray<SharedPtr<SerializationTestNode>> roots;
+			{
+				auto root = SharedPtr<SerializationTestNode>::MakeShared();
+				auto a = SharedPtr<SerializationTestNode>::MakeShared();
+				auto b = SharedPtr<SerializationTestNode>::MakeShared();
+				auto named = SharedPtr<SerializationTestNamedNode>::MakeShared();
+				root->m_Value = 1;
+				a->m_Value = 2;
+				b->m_Value = 3;
+				named->m_Value = 4;
+				named->m_Name = "a name long enough to be allocated";
+				named->m_Parent = root.GetWeakPtr();
+				root->m_Children.Push(a);
+				root->m_Children.Push(b);
+				a->m_Children.Push(named);
+				b->m_Children.Push(named);
+				roots.Push(root);
+				roots.Push(named);
+			}
+			std::vector<uint8_t> bytes = SaveToBytes(roots);
+
+			BigArray<SharedPtr<SerializationTestNode>> loaded;
+			ANIM_CHECK(LoadFromBytes(bytes, loaded));
+			ANIM_CHECK(loaded.Size() == 2);
+			const SerializationTestNode* root = loaded[0].Get();
+			const SerializationTestNode* named = loaded[1].Get();
+			ANIM_CHECK(root->m_Value == 1 && root->m_Children.Size() == 2);
+			ANIM_CHECK(root->m_Children[0]->m_Value == 2 && root->m_Children[1]->m_Value == 3);
+			ANIM_CHECK(root->m_Children[0]->m_Children[0].Get() == named);
+			ANIM_CHECK(root->m_Children[1]->m_Children[0].Get() == named);
+			ANIM_CHECK(named->m_Parent.Lock().Get() == root);
+			ANIM_CHECK(&named->GetReflectedClassInfo() == &SerializationTestNamedNode::GetStaticClassInfo());
+			ANIM_CHECK(static_cast<const SerializationTestNamedNode*>(named)->m_Name == "a name long enough to be allocated");
+			// Held by loaded, by a and by b.
+			ANIM_CHECK(loaded[1].GetUseCount() == 3);
+			ANIM_CHECK(SerializationTestNode::s_NumAlive == numAliveBefore + 8);
+
+			// The second reference to a shared object is its id alone.
+			auto single = SharedPtr<SerializationTestNode>::MakeShared();
+			BigArray<SharedPtr<SerializationTestNode>> once;
+			once.Push(single);
+			BigArray<SharedPtr<SerializationTestNode>> twice = once;
+			twice.Push(single);
+			ANIM_CHECK(SaveToBytes(twice).size() == SaveToBytes(once).size() + sizeof(uint32_t));
+		}
+		ANIM_CHECK(SerializationTestNode::s_NumAlive == numAliveBefore);
+	}
+
+	void TestWeakOnlyObjectExpires()
+	{
+		int numAliveBefore = SerializationTestNode::s_NumAlive;
+		{
+			auto owned = SharedPtr<SerializationTestNode>::MakeShared();
+			owned->m_Value = 5;
+			WeakPtr<SerializationTestNode> weak = owned.GetWeakPtr();
+			std::vector<uint8_t> bytes = SaveToBytes(weak);
+
+			// Nothing but the Deserializer owns what only a WeakPtr refers to.
+			WeakPtr<SerializationTestNode> loaded;
+			ANIM_CHECK(LoadFromBytes(bytes, loaded));
+			ANIM_CHECK(loaded.Lock().Get() == nullptr);
+			ANIM_CHECK(SerializationTestNode::s_NumAlive == numAliveBefore + 1);
+
+			// A SharedPtr after the WeakPtr picks the object up.
+			std::vector<uint8_t> pairBytes;
+			{
+				ChunkedWriteStream stream;
+				Serializer res(stream, Test_Data_Version);
+				res.Serialize(weak);
+				res.Serialize(owned);
+				pairBytes = CopyOut(stream);
+			}
+			WeakPtr<SerializationTestNode> loadedWeak;
+			SharedPtr<SerializationTestNode> loadedShared;
+			{
+				MemoryStream input(pairBytes.data(), static_cast<uint32_t>(pairBytes.size()));
+				Deserializer res(input);
+				res.Deserialize(loadedWeak);
+				res.Deserialize(loadedShared);
+				ANIM_CHECK(res.IsValid());
+			}
+			ANIM_CHECK(loadedShared.Get() != nullptr && loadedShared->m_Value == 5);
+			ANIM_CHECK(loadedWeak.Lock().Get() == loadedShared.Get());
+		}
+		ANIM_CHECK(SerializationTestNode::s_NumAlive == numAliveBefore);
+	}
+
+	enum class SignedTestEnum : int32_t
+	{
+		Negative = -3,
+		Large = 100000,
+	};
+
+	template<typename T>
+	std::vector<uint8_t> SaveCompact(const T& obj, uint32_t encodingFlags = Encoding_Compact_Integers)
+	{
+		ChunkedWriteStream stream;
+		uint32_t headerSize = 0;
+		{
+			Serializer res(stream, Test_Data_Version, encodingFlags);
+			headerSize = stream.GetNumBytesWritten();
+			res.Serialize(obj);
+		}
+		std::vector<uint8_t> bytes = CopyOut(stream);
+		// Without the header, so sizes can be compared.
+		return std::vector<uint8_t>(bytes.begin() + headerSize, bytes.end());
+	}
+
+	template<typename T>
+	bool RoundTripsCompact(const T& value, uint32_t expectedNumBytes)
+	{
+		ChunkedWriteStream stream;
+		{
+			Serializer res(stream, Test_Data_Version, Encoding_Compact_Integers);
+			res.Serialize(value);
+		}
+		std::vector<uint8_t> bytes = CopyOut(stream);
+		T loaded = T();
+		bool isLoaded = LoadFromBytes(bytes, loaded);
+		return isLoaded && loaded == value && SaveCompact(value).size() == expectedNumBytes;
+	}
+
+	void TestVarintsAndZigZag()
+	{
+		// LEB128, 7 bits per byte. Zigzag keeps small negative numbers short.
+		ANIM_CHECK(RoundTripsCompact<uint32_t>(0, 1));
+		ANIM_CHECK(RoundTripsCompact<uint32_t>(127, 1));
+		ANIM_CHECK(RoundTripsCompact<uint32_t>(128, 2));
+		ANIM_CHECK(RoundTripsCompact<uint32_t>(16383, 2));
+		ANIM_CHECK(RoundTripsCompact<uint32_t>(16384, 3));
+		ANIM_CHECK(RoundTripsCompact<uint32_t>(std::numeric_limits<uint32_t>::max(), 5));
+		ANIM_CHECK(RoundTripsCompact<uint64_t>(std::numeric_limits<uint64_t>::max(), 10));
+		ANIM_CHECK(RoundTripsCompact<int32_t>(-1, 1));
+		ANIM_CHECK(RoundTripsCompact<int32_t>(-64, 1));
+		ANIM_CHECK(RoundTripsCompact<int32_t>(64, 2));
+		ANIM_CHECK(RoundTripsCompact<int16_t>(std::numeric_limits<int16_t>::min(), 3));
+		ANIM_CHECK(RoundTripsCompact<int32_t>(std::numeric_limits<int32_t>::min(), 5));
+		ANIM_CHECK(RoundTripsCompact<int64_t>(std::numeric_limits<int64_t>::min(), 10));
+		ANIM_CHECK(RoundTripsCompact<int64_t>(std::numeric_limits<int64_t>::max(), 10));
+		ANIM_CHECK(RoundTripsCompact(SignedTestEnum::Negative, 1));
+		ANIM_CHECK(RoundTripsCompact(SignedTestEnum::Large, 3));
+		// Single bytes gain nothing from varints.
+		ANIM_CHECK(RoundTripsCompact<uint8_t>(255, 1));
+
+		// Integer arrays are varints element by element, counts included.
+		BigArray<int32_t> values;
+		std::mt19937 random(17);
+		for (uint32_t i = 0; i < 1000; ++i)
+		{
+			int32_t magnitude = static_cast<int32_t>(random() >> (random() % 32));
+			values.Push(i % 2 == 0 ? magnitude : -magnitude);
+		}
+		values.Push(std::numeric_limits<int32_t>::min());
+		values.Push(std::numeric_limits<int32_t>::max());
+		std::vector<uint8_t> bytes;
+		{
+			ChunkedWriteStream stream;
+			Serializer res(stream, Test_Data_Version, Encoding_Compact_Integers);
+			res.Serialize(values);
+			bytes = CopyOut(stream);
+		}
+		BigArray<int32_t> loaded;
+		ANIM_CHECK(LoadFromBytes(bytes, loaded));
+		ANIM_CHECK(AreArraysEqual(values, loaded));
+	}
+
+	template<typename ArrayType>
+	std::vector<uint8_t> SaveSortedKeys(const ArrayType& keys, uint32_t encodingFlags)
+	{
+		ChunkedWriteStream stream;
+		{
+			Serializer res(stream, Test_Data_Version, encodingFlags);
+			res.SerializeSortedKeys(keys);
+		}
+		return CopyOut(stream);
+	}
+
+	template<typename ArrayType>
+	bool RoundTripsSortedKeys(const ArrayType& keys, uint32_t encodingFlags)
+	{
+		std::vector<uint8_t> bytes = SaveSortedKeys(keys, encodingFlags);
+		MemoryStream input(bytes.data(), static_cast<uint32_t>(bytes.size()));
+		ArrayType loaded;
+		Deserializer res(input);
+		res.DeserializeSortedKeys(loaded);
+		return res.IsValid() && input.GetNumBytesRead() == bytes.size() && AreArraysEqual(keys, loaded);
+	}
+
+	void TestSortedKeyDeltas()
+	{
+		// Keyframe times at 30 fps, compared bit for bit, so the deltas must be lossless.
+		BigArray<float> times;
+		for (uint32_t i = 0; i < 300; ++i)
+		{
+			times.Push(i / 30.0f);
+		}
+		ANIM_CHECK(RoundTripsSortedKeys(times, 0));
+		ANIM_CHECK(RoundTripsSortedKeys(times, Encoding_Compact_Integers));
+
+		// Negative keys, both zeros, infinities, and keys out of order still round trip.
+		BigArray<float> unusual;
+		for (float key : { -std::numeric_limits<float>::infinity(), -5.5f, -0.0f, 0.0f, 1e-40f, 3.0f, 2.0f,
+			std::numeric_limits<float>::max(), std::numeric_limits<float>::infinity(), -1.0f })
+		{
+			unusual.Push(key);
+		}
+		ANIM_CHECK(RoundTripsSortedKeys(unusual, Encoding_Compact_Integers));
+
+		BigArray<double> wideTimes;
+		for (uint32_t i = 0; i < 100; ++i)
+		{
+			wideTimes.Push(i * 0.125 - 4.0);
+		}
+		ANIM_CHECK(RoundTripsSortedKeys(wideTimes, Encoding_Compact_Integers));
+
+		// Frame numbers a few apart take a byte each.
+		BigArray<int32_t> frames;
+		for (int32_t i = -100; i < 900; ++i)
+		{
+			frames.Push(i * 3);
+		}
+		frames.Push(std::numeric_limits<int32_t>::min());
+		frames.Push(std::numeric_limits<int32_t>::max());
+		ANIM_CHECK(RoundTripsSortedKeys(frames, Encoding_Compact_Integers));
+		frames.Resize(1000);
+		ANIM_CHECK(SaveSortedKeys(frames, Encoding_Compact_Integers).size() < SaveSortedKeys(frames, 0).size() / 3);
+	}
+
+	void TestHalfFloatChannels()
+	{
+		// Every half converts to the float it stands for and back to the same bits.
+		bool isExact = true;
+		for (uint32_t bits = 0; bits <= 0xFFFF; ++bits)
+		{
+			float value = HalfToFloat(static_cast<uint16_t>(bits));
+			isExact &= std::isnan(value) ? std::isnan(HalfToFloat(FloatToHalf(value))) : FloatToHalf(value) == bits;
+		}
+		ANIM_CHECK(isExact);
+
+		// Floats up to the largest half round to the nearest one, ties to even.
+		std::mt19937 random(23);
+		std::uniform_real_distribution<float> exponents(-26.0f, std::log2(65504.0f));
+		bool isNearest = true;
+		for (uint32_t i = 0; i < 200000; ++i)
+		{
+			float value = std::exp2(exponents(random));
+			uint16_t half = FloatToHalf(value);
+			float error = std::fabs(HalfToFloat(half) - value);
+			isNearest &= error <= std::fabs(HalfToFloat(half + 1) - value);
+			isNearest &= half == 0 || error <= std::fabs(HalfToFloat(half - 1) - value);
+		}
+		ANIM_CHECK(isNearest);
+		ANIM_CHECK(FloatToHalf(1.0f + 1.0f / 2048.0f) == FloatToHalf(1.0f));
+		ANIM_CHECK(FloatToHalf(1.0f + 3.0f / 2048.0f) == FloatToHalf(1.0f) + 2);
+		ANIM_CHECK(HalfToFloat(FloatToHalf(65504.0f)) == 65504.0f);
+		ANIM_CHECK(std::isinf(HalfToFloat(FloatToHalf(65520.0f))));
+		ANIM_CHECK(FloatToHalf(-0.0f) == 0x8000);
+
+		// Channels are half precision only when the Serializer was asked for it.
+		BigArray<float> channel;
+		for (uint32_t i = 0; i < 1000; ++i)
+		{
+			channel.Push(std::sin(i * 0.01f));
+		}
+		for (uint32_t encodingFlags : { 0u, static_cast<uint32_t>(Encoding_Half_Float_Channels) })
+		{
+			std::vector<uint8_t> bytes;
+			{
+				ChunkedWriteStream stream;
+				Serializer res(stream, Test_Data_Version, encodingFlags);
+				res.SerializeTolerantFloats(channel);
+				res.Serialize(static_cast<uint32_t>(12345));
+				bytes = CopyOut(stream);
+			}
+			MemoryStream input(bytes.data(), static_cast<uint32_t>(bytes.size()));
+			BigArray<float> loaded;
+			uint32_t after = 0;
+			{
+				Deserializer res(input);
+				res.DeserializeTolerantFloats(loaded);
+				res.Deserialize(after);
+				ANIM_CHECK(res.IsValid());
+			}
+			ANIM_CHECK(after == 12345 && loaded.Size() == channel.Size());
+			bool isHalf = encodingFlags != 0;
+			bool matches = true;
+			for (uint32_t i = 0; i < channel.Size() && i < loaded.Size(); ++i)
+			{
+				matches &= isHalf ? loaded[i] == HalfToFloat(FloatToHalf(channel[i])) : loaded[i] == channel[i];
+			}
+			ANIM_CHECK(matches);
+			ANIM_CHECK(bytes.size() < (isHalf ? 1000 * sizeof(uint16_t) + 64 : 1000 * sizeof(float) + 64));
+		}
+	}
+
+	void TestStringTable()
+	{
+		bool ownsTable = !StringTable::IsInitialized();
+		if (ownsTable)
+			StringTable::Initialize();
+		StringTable& table = StringTable::Instance();
+
+		// Equal strings share an id and the table keeps its own copy of the characters.
+		char name[] = "Spine_01";
+		StringID spine = table.Intern(StringView(name, 8));
+		ANIM_CHECK(!spine.IsEmpty());
+		ANIM_CHECK(table.Intern("Spine_01") == spine);
+		ANIM_CHECK(table.Intern("Spine_02") != spine);
+		name[0] = 'X';
+		ANIM_CHECK(table.GetString(spine) == StringView("Spine_01"));
+		ANIM_CHECK(table.Find("Spine_01") == spine);
+		ANIM_CHECK(table.Find("Spine_03").IsEmpty());
+		ANIM_CHECK(table.GetString(StringID()).IsEmpty());
+
+		// Ids are stable across blocks and pages.
+		BigArray<StringID> ids;
+		for (uint32_t i = 0; i < 3 * StringTable::Strings_Per_Block; ++i)
+		{
+			ids.Push(table.Intern(StringView(std::to_string(i).c_str())));
+		}
+		bool isStable = true;
+		for (uint32_t i = 0; i < ids.Size(); ++i)
+		{
+			std::string text = std::to_string(i);
+			isStable &= table.GetString(ids[i]) == StringView(text.c_str());
+			isStable &= table.Find(StringView(text.c_str())) == ids[i];
+		}
+		ANIM_CHECK(isStable);
+
+		// Names round trip as text, and views read from a stream that goes away are not interned.
+		std::vector<uint8_t> bytes;
+		{
+			ChunkedWriteStream stream;
+			Serializer res(stream, Test_Data_Version);
+			res.Serialize(spine);
+			res.Serialize(StringView("Clavicle_L"));
+			res.Serialize(StringID());
+			res.Serialize(StringView());
+			bytes = CopyOut(stream);
+		}
+		uint32_t numStrings = table.GetNumStrings();
+		MemoryStream input(bytes.data(), static_cast<uint32_t>(bytes.size()));
+		{
+			Deserializer res(input);
+			StringID loadedID;
+			StringView loadedView;
+			StringID emptyID(7);
+			StringView emptyView("unchanged");
+			res.Deserialize(loadedID);
+			res.Deserialize(loadedView);
+			res.Deserialize(emptyID);
+			res.Deserialize(emptyView);
+			ANIM_CHECK(res.IsValid());
+			ANIM_CHECK(loadedID == spine);
+			ANIM_CHECK(loadedView == StringView("Clavicle_L"));
+			ANIM_CHECK(emptyID.IsEmpty() && emptyView.IsEmpty());
+		}
+		ANIM_CHECK(table.GetNumStrings() == numStrings);
+		ANIM_CHECK(table.Find("Clavicle_L").IsEmpty());
+
+		if (ownsTable)
+			StringTable::Shutdown();
+	}
+
+	// Data as an older build wrote it, for formats the Serializer no longer produces.
+	template<typename T>
+	void AppendRaw(std::vector<uint8_t>& bytes, const T& value)
+	{
+		const uint8_t* data = reinterpret_cast<const uint8_t*>(&value);
+		bytes.insert(bytes.end(), data, data + sizeof(T));
+	}
+
+	// Fields the reader does not know, or only reads partly, are skipped by their length.
+	void TestFieldReaderSkipsFields()
+	{
+		BigArray<float> weights;
+		for (uint32_t i = 0; i < 100; ++i)
+		{
+			weights.Push(i * 0.01f);
+		}
+		ChunkedWriteStream stream;
+		{
+			Serializer res(stream, Test_Data_Version);
+			res.SerializeField(FieldTag("m_Removed"), weights);
+			res.SerializeField(FieldTag("m_Weights"), weights);
+			res.SerializeField(FieldTag("m_Frame"), static_cast<uint32_t>(42));
+			res.EndFields();
+			res.Serialize(static_cast<uint32_t>(0xC0FFEE));
+		}
+		std::vector<uint8_t> bytes = CopyOut(stream);
+
+		MemoryStream input(bytes.data(), static_cast<uint32_t>(bytes.size()));
+		Deserializer res(input);
+		uint32_t numFields = 0;
+		uint32_t numWeights = 0;
+		uint32_t frame = 0;
+		{
+			Deserializer::FieldReader fields(res);
+			while (fields.Next())
+			{
+				++numFields;
+				// Only the count of the weights is read.
+				if (fields.GetTag() == FieldTag("m_Weights"))
+					res.Deserialize(numWeights);
+				else if (fields.GetTag() == FieldTag("m_Frame"))
+					res.Deserialize(frame);
+			}
+		}
+		uint32_t sentinel = 0;
+		res.Deserialize(sentinel);
+		ANIM_CHECK(res.IsValid());
+		ANIM_CHECK(numFields == 3 && numWeights == 100 && frame == 42);
+		ANIM_CHECK(sentinel == 0xC0FFEE && input.GetNumBytesRead() == bytes.size());
+	}
+
+	// Poses written by the previous release load in the current one, and the other way round.
+	void TestSchemaVersionsRoundTrip()
+	{
+		SerializationTestPoseV1 oldPose;
+		oldPose.m_Frame = 12;
+		oldPose.m_Weights.Push(0.25f);
+		oldPose.m_Weights.Push(0.5f);
+		SerializationTestPoseV2 newPose;
+		newPose.m_Frame = 13;
+		newPose.m_Weights.Push(0.75f);
+		newPose.m_Blend = 0.5f;
+
+		// The field the old writer did not know keeps its default. The weights are read in place, so the bytes
+		// have to outlive the poses.
+		std::vector<uint8_t> oldBytes = SaveToBytes(oldPose);
+		SerializationTestPoseV2 upgraded;
+		ANIM_CHECK(LoadFromBytes(oldBytes, upgraded));
+		ANIM_CHECK(upgraded.m_Frame == 12 && upgraded.m_Blend == 1.0f);
+		ANIM_CHECK(upgraded.m_Weights.Size() == 2 && upgraded.m_Weights[0] == 0.25f && upgraded.m_Weights[1] == 0.5f);
+
+		// The old reader skips the field it does not know and finds the others in their new order.
+		std::vector<uint8_t> newBytes = SaveToBytes(newPose);
+		SerializationTestPoseV1 downgraded;
+		ANIM_CHECK(LoadFromBytes(newBytes, downgraded));
+		ANIM_CHECK(downgraded.m_Frame == 13 && downgraded.m_Weights.Size() == 1 && downgraded.m_Weights[0] == 0.75f);
+	}
+
+	// Format 4 prefixes every object with its size, so one whose class is no longer registered is dropped and
+	// whatever follows it still loads.
+	void TestUnregisteredClassIsSkipped()
+	{
+		SerializationTestPoseV1 pose;
+		pose.m_Frame = 5;
+		pose.m_Weights.Resize(33);
+		SerializationTestKey key;
+		key.m_Time = 1.5f;
+		key.m_Value = -3.0f;
+		key.m_Flags = 9;
+		ChunkedWriteStream stream;
+		{
+			Serializer res(stream, Test_Data_Version);
+			res.Serialize(&pose);
+			res.Serialize(&key);
+			res.Serialize(static_cast<uint32_t>(0xC0FFEE));
+		}
+		std::vector<uint8_t> bytes = CopyOut(stream);
+
+		// Pretend the pose class was removed by giving it a type id nothing is registered under.
+		uint64_t typeID = SerializationTestPoseV1::GetStaticClassInfo().GetTypeID();
+		uint64_t removedTypeID = typeID ^ 0x5A5A5A5A5A5A5A5Aull;
+		ANIM_CHECK(Reflection::TypeRegistry::GetReflectedClassInfo(removedTypeID) == nullptr);
+		auto typeIDPosition = std::search(bytes.begin(), bytes.end(), reinterpret_cast<const uint8_t*>(&typeID),
+			reinterpret_cast<const uint8_t*>(&typeID) + sizeof(typeID));
+		ANIM_CHECK(typeIDPosition != bytes.end());
+		if (typeIDPosition == bytes.end())
+			return;
+		memcpy(&*typeIDPosition, &removedTypeID, sizeof(removedTypeID));
+
+		MemoryStream input(bytes.data(), static_cast<uint32_t>(bytes.size()));
+		Deserializer res(input);
+		ISerializable* removed = nullptr;
+		SerializationTestKey* loadedKey = nullptr;
+		uint32_t sentinel = 0;
+		res.Deserialize(removed);
+		res.Deserialize(loadedKey);
+		res.Deserialize(sentinel);
+		ANIM_CHECK(res.IsValid());
+		ANIM_CHECK(removed == nullptr);
+		ANIM_CHECK(loadedKey != nullptr && *loadedKey == key);
+		ANIM_CHECK(sentinel == 0xC0FFEE && input.GetNumBytesRead() == bytes.size());
+		DefaultAllocator::Destroy(loadedKey);
+	}
+
+	// Streams from before object sizes (format 3) and before array alignment (format 2) still load.
+	void TestOlderFormatsLoad()
+	{
+		SerializationTestKey key;
+		key.m_Time = 0.5f;
+		key.m_Value = -2.0f;
+		key.m_Flags = 3;
+		const float samples[] = { 1.0f, 2.5f, -4.0f };
+		for (uint32_t formatVersion : { 2u, 3u })
+		{
+			std::vector<uint8_t> bytes;
+			AppendRaw(bytes, formatVersion);
+			AppendRaw(bytes, Test_Data_Version);
+			AppendRaw(bytes, true);
+			AppendRaw(bytes, SerializationTestKey::GetStaticClassInfo().GetTypeID());
+			AppendRaw(bytes, key.m_Time);
+			AppendRaw(bytes, key.m_Value);
+			AppendRaw(bytes, key.m_Flags);
+			AppendRaw(bytes, static_cast<uint32_t>(3));
+			// 31 bytes so far, format 3 pads the array data to a multiple of 4.
+			if (formatVersion >= 3)
+				bytes.resize((bytes.size() + alignof(float) - 1) / alignof(float) * alignof(float));
+			for (float sample : samples)
+			{
+				AppendRaw(bytes, sample);
+			}
+			AppendRaw(bytes, static_cast<uint32_t>(0xC0FFEE));
+
+			MemoryStream input(bytes.data(), static_cast<uint32_t>(bytes.size()));
+			Deserializer res(input);
+			SerializationTestKey* loadedKey = nullptr;
+			BigArray<float> loadedSamples;
+			uint32_t sentinel = 0;
+			res.Deserialize(loadedKey);
+			res.Deserialize(loadedSamples);
+			res.Deserialize(sentinel);
+			ANIM_CHECK(res.IsValid() && res.GetFormatVersion() == formatVersion);
+			ANIM_CHECK(loadedKey != nullptr && *loadedKey == key);
+			ANIM_CHECK(loadedSamples.Size() == 3 && memcmp(loadedSamples.GetBuffer(), samples, sizeof(samples)) == 0);
+			ANIM_CHECK(sentinel == 0xC0FFEE && input.GetNumBytesRead() == bytes.size());
+			DefaultAllocator::Destroy(loadedKey);
+		}
+	}
+
+	bool MakeDirectory(const char* path)
+	{
+#ifdef WIN32
+		return _mkdir(path) == 0 || errno == EEXIST;
+#else
+		return mkdir(path, 0755) == 0 || errno == EEXIST;
+#endif
+	}
+
+	void DeleteDirectory(const char* path)
+	{
+#ifdef WIN32
+		_rmdir(path);
+#else
+		rmdir(path);
+#endif
+	}
+
+	bool WriteBytes(const char* path, const std::vector<uint8_t>& bytes)
+	{
+		FileWriteStream file(path);
+		file.Write(bytes.data(), static_cast<uint32_t>(bytes.size()));
+		return file.Close();
+	}
+
+	bool LoadAsset(const char* path, uint32_t& formatVersionOut, uint32_t& dataVersionOut, float& durationOut)
+	{
+		FileReadStream input(path);
+		Deserializer res(input);
+		SerializationTestAsset* asset = nullptr;
+		res.Deserialize(asset);
+		formatVersionOut = res.GetFormatVersion();
+		dataVersionOut = res.GetDataVersion();
+		durationOut = asset != nullptr ? asset->m_Duration : 0.0f;
+		bool isValid = res.IsValid() && asset != nullptr;
+		DefaultAllocator::Destroy(asset);
+		return isValid;
+	}
+
+	// Every asset below a directory is brought to the current format and data version, each object migrating
+	// its own data while it loads. Assets that are current already are left alone, broken ones are reported.
+	void TestAssetConverter()
+	{
+		const char* directory = "animtest_assets";
+		const char* subdirectory = "animtest_assets/clips";
+		const char* oldFormatPath = "animtest_assets/old_format.anim";
+		const char* oldDataPath = "animtest_assets/clips/old_data.anim";
+		const char* currentPath = "animtest_assets/clips/current.anim";
+		const char* brokenPath = "animtest_assets/broken.anim";
+		ANIM_CHECK(MakeDirectory(directory) && MakeDirectory(subdirectory));
+
+		const uint64_t typeID = SerializationTestAsset::GetStaticClassInfo().GetTypeID();
+		const uint32_t durationMs = 1500;
+		// Format 3, data version 1: no encoding flags and no object size.
+		std::vector<uint8_t> oldFormat;
+		AppendRaw(oldFormat, 3u);
+		AppendRaw(oldFormat, 1u);
+		AppendRaw(oldFormat, true);
+		AppendRaw(oldFormat, typeID);
+		AppendRaw(oldFormat, durationMs);
+		ANIM_CHECK(WriteBytes(oldFormatPath, oldFormat));
+		// Current format, data version 1.
+		std::vector<uint8_t> oldData;
+		AppendRaw(oldData, SerializationFormatVersion);
+		AppendRaw(oldData, 1u);
+		AppendRaw(oldData, 0u);
+		AppendRaw(oldData, true);
+		AppendRaw(oldData, typeID);
+		AppendRaw(oldData, static_cast<uint32_t>(sizeof(durationMs)));
+		AppendRaw(oldData, durationMs);
+		ANIM_CHECK(WriteBytes(oldDataPath, oldData));
+		{
+			SerializationTestAsset asset;
+			asset.m_Duration = 2.0f;
+			FileWriteStream file(currentPath);
+			{
+				Serializer res(file, 2);
+				res.Serialize(&asset);
+			}
+			ANIM_CHECK(file.Close());
+		}
+		const char broken[] = "not an asset";
+		ANIM_CHECK(WriteBytes(brokenPath, std::vector<uint8_t>(broken, broken + sizeof(broken))));
+
+		AssetConversionStats stats = ConvertAssetDirectory(directory, 2);
+		ANIM_CHECK(stats.m_NumConverted == 2 && stats.m_NumUpToDate == 1 && stats.m_NumFailed == 1);
+
+		bool isConverted = true;
+		for (const char* path : { oldFormatPath, oldDataPath, currentPath })
+		{
+			uint32_t formatVersion = 0;
+			uint32_t dataVersion = 0;
+			float duration = 0.0f;
+			isConverted &= LoadAsset(path, formatVersion, dataVersion, duration);
+			isConverted &= formatVersion == SerializationFormatVersion && dataVersion == 2;
+			isConverted &= duration == (path == currentPath ? 2.0f : 1.5f);
+		}
+		ANIM_CHECK(isConverted);
+
+		// Converted files are current now.
+		bool wasUpToDate = false;
+		ANIM_CHECK(ConvertAssetFile(oldFormatPath, 2, wasUpToDate) && wasUpToDate);
+
+		for (const char* path : { oldFormatPath, oldDataPath, currentPath, brokenPath })
+		{
+			remove(path);
+		}
+		DeleteDirectory(subdirectory);
+		DeleteDirectory(directory);
+	}
+}
+
+void RunSerializationTests()
+{
+	TestRoundTripAcrossChunks();
+	TestBulkArrayLayout();
+	TestBulkArrayRoundTrip();
+	TestMappedReadInPlace();
+	TestSharedGraphKeepsIdentity();
+	TestWeakOnlyObjectExpires();
+	TestVarintsAndZigZag();
+	TestSortedKeyDeltas();
+	TestHalfFloatChannels();
+	TestStringTable();
+	TestFieldReaderSkipsFields();
+	TestSchemaVersionsRoundTrip();
+	TestUnregisteredClassIsSkipped();
+	TestOlderFormatsLoad();
+	TestAssetConverter();
+}
+
+void RunSerializerBenchmark()
+{
+	const uint32_t Num_Tracks = 100000;
+	const uint32_t Num_Rounds = 10;
+	BigArray<SerializationTestTrack> tracks;
+	MakeTracks(Num_Tracks, 16, 8, tracks);
+
+	// The stream is reused like the pipe's message writer reuses it, so after the first round saving does not
+	// allocate.
+	ChunkedWriteStream stream;
+	double saveSeconds = 0.0;
+	for (uint32_t round = 0; round < Num_Rounds; ++round)
+	{
+		stream.Reset();
+		auto start = BenchmarkClock::now();
+		Serializer res(stream, Test_Data_Version);
+		res.Serialize(tracks);
+		saveSeconds += SecondsSince(start);
+	}
+	std::vector<uint8_t> bytes = CopyOut(stream);
+
+	double loadSeconds = 0.0;
+	uint64_t numLoaded = 0;
+	for (uint32_t round = 0; round < Num_Rounds; ++round)
+	{
+		MemoryStream input(bytes.data(), static_cast<uint32_t>(bytes.size()));
+		BigArray<SerializationTestTrack> loaded;
+		auto start = BenchmarkClock::now();
+		Deserializer res(input);
+		res.Deserialize(loaded);
+		loadSeconds += SecondsSince(start);
+		numLoaded += loaded.Size();
+	}
+	UseBenchmarkResult(numLoaded);
+
+	double numMegabytes = static_cast<double>(bytes.size()) * Num_Rounds / (1024.0 * 1024.0);
+	double numObjects = static_cast<double>(Num_Tracks) * Num_Rounds;
+	printf("%u tracks of 16 samples and 8 keys, %.1f MB:\n", Num_Tracks, bytes.size() / (1024.0 * 1024.0));
+	printf("  save %7.1f MB/s %6.2f M objects/s\n", numMegabytes / saveSeconds, numObjects / saveSeconds * 1e-6);
+	printf("  load %7.1f MB/s %6.2f M objects/s\n", numMegabytes / loadSeconds, numObjects / loadSeconds * 1e-6);
+}
+
+void RunBulkArrayBenchmark()
+{
+	const uint32_t Num_Floats = 10000000;
+	const uint32_t Num_Rounds = 5;
+	BigArray<float> values;
+	values.Reserve(Num_Floats);
+	for (uint32_t i = 0; i < Num_Floats; ++i)
+	{
+		values.Push(static_cast<float>(i) * 0.001f);
+	}
+
+	ChunkedWriteStream stream;
+	double bulkSaveSeconds = 0.0;
+	double elementSaveSeconds = 0.0;
+	for (uint32_t round = 0; round < Num_Rounds; ++round)
+	{
+		// What arrays did before the bulk path, one stream call per float.
+		stream.Reset();
+		auto start = BenchmarkClock::now();
+		{
+			Serializer res(stream, Test_Data_Version);
+			res.Serialize(values.Size());
+			for (float value : values)
+			{
+				res.Serialize(value);
+			}
+		}
+		elementSaveSeconds += SecondsSince(start);
+
+		stream.Reset();
+		start = BenchmarkClock::now();
+		{
+			Serializer res(stream, Test_Data_Version);
+			res.Serialize(values);
+		}
+		bulkSaveSeconds += SecondsSince(start);
+	}
+	std::vector<uint8_t> bytes = CopyOut(stream);
+
+	double bulkLoadSeconds = 0.0;
+	double elementLoadSeconds = 0.0;
+	uint64_t sum = 0;
+	for (uint32_t round = 0; round < Num_Rounds; ++round)
+	{
+		CopyingReadStream input(bytes);
+		BigArray<float> loaded;
+		auto start = BenchmarkClock::now();
+		{
+			Deserializer res(input);
+			uint32_t count = 0;
+			res.Deserialize(count);
+			res.SkipToAlignment(alignof(float));
+			loaded.Resize(count);
+			for (float& value : loaded)
+			{
+				res.Deserialize(value);
+			}
+		}
+		elementLoadSeconds += SecondsSince(start);
+		sum += static_cast<uint64_t>(loaded[Num_Floats - 1]);
+
+		input.Reset();
+		loaded = BigArray<float>();
+		start = BenchmarkClock::now();
+		{
+			Deserializer res(input);
+			res.Deserialize(loaded);
+		}
+		bulkLoadSeconds += SecondsSince(start);
+		sum += static_cast<uint64_t>(loaded[Num_Floats - 1]);
+	}
+	UseBenchmarkResult(sum);
+
+	double numMegabytes = static_cast<double>(Num_Floats) * sizeof(float) * Num_Rounds / (1024.0 * 1024.0);
+	printf("%u floats:\n", Num_Floats);
+	printf("  per element  save %7.1f MB/s  load %7.1f MB/s\n", numMegabytes / elementSaveSeconds, numMegabytes / elementLoadSeconds);
+	printf("  bulk         save %7.1f MB/s  load %7.1f MB/s\n", numMegabytes / bulkSaveSeconds, numMegabytes / bulkLoadSeconds);
+}
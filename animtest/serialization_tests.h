@@ -0,0 +1,7 @@
+#pragma once
+
+void RunSerializationTests();
+// Saves and loads many small objects through ChunkedWriteStream and MemoryStream.
+void RunSerializerBenchmark();
+// Saves and loads 10M floats one at a time and in bulk.
+void RunBulkArrayBenchmark();
@@ -0,0 +1,177 @@
+#include "shared_ptr_tests.h"
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "animcore/containers/array.h"
+#include "animcore/memory/pointers.h"
+#include "test_harness.h"
+
+using namespace animengine;
+
+namespace
+{
+	struct Counted
+	{
+		static std::atomic<uint32_t> s_NumAlive;
+
+		Counted() { ++s_NumAlive; }
+		~Counted() { --s_NumAlive; }
+		uint32_t m_Value = 7;
+	};
+
+	std::atomic<uint32_t> Counted::s_NumAlive(0);
+
+	void TestCounts()
+	{
+		{
+			auto shared = SharedPtr<Counted>::MakeShared();
+			// 16 bit counts wrapped here.
+			BigArray<SharedPtr<Counted>> owners;
+			for (uint32_t i = 0; i < 70000; ++i)
+			{
+				owners.Push(shared);
+			}
+			ANIM_CHECK(shared.GetUseCount() == 70001);
+			owners.Clear();
+			ANIM_CHECK(shared.GetUseCount() == 1 && Counted::s_NumAlive == 1);
+
+			WeakPtr<Counted> weak = shared.GetWeakPtr();
+			ANIM_CHECK(weak.Lock().Get() == shared.Get());
+			shared.Release();
+			ANIM_CHECK(Counted::s_NumAlive == 0);
+			ANIM_CHECK(weak.Lock().Get() == nullptr);
+		}
+
+		uint32_t numDeleted = 0;
+		{
+			SharedPtr<Counted> custom(DefaultAllocator::Create<Counted>(), [&numDeleted](Counted* object)
+			{
+				++numDeleted;
+				DefaultAllocator::Destroy(object);
+			});
+			SharedPtr<Counted> copy = custom;
+			custom.Release();
+			ANIM_CHECK(numDeleted == 0 && copy->m_Value == 7);
+		}
+		ANIM_CHECK(numDeleted == 1 && Counted::s_NumAlive == 0);
+	}
+
+	void TestConcurrentRelease()
+	{
+		// Threads copy and drop references while others lock weak ones, the object dies exactly once and no
+		// Lock revives it afterwards.
+		const uint32_t Num_Threads = 8;
+		for (uint32_t round = 0; round < 200; ++round)
+		{
+			auto shared = SharedPtr<Counted>::MakeShared();
+			WeakPtr<Counted> weak = shared.GetWeakPtr();
+			std::atomic<uint32_t> numRevived(0);
+			std::vector<std::thread> threads;
+			for (uint32_t i = 0; i < Num_Threads; ++i)
+			{
+				SharedPtr<Counted> owner = shared;
+				threads.emplace_back([owner, weak, i, &numRevived]() mutable
+				{
+					if (i % 2 == 0)
+					{
+						for (uint32_t j = 0; j < 100; ++j)
+						{
+							SharedPtr<Counted> copy = owner;
+						}
+						owner.Release();
+						return;
+					}
+					owner.Release();
+					bool wasGone = false;
+					for (uint32_t j = 0; j < 1000; ++j)
+					{
+						SharedPtr<Counted> locked = weak.Lock();
+						if (locked.Get() == nullptr)
+							wasGone = true;
+						else if (wasGone || locked->m_Value != 7)
+							++numRevived;
+					}
+				});
+			}
+			shared.Release();
+			for (auto& thread : threads)
+			{
+				thread.join();
+			}
+			if (Counted::s_NumAlive != 0 || numRevived != 0 || weak.Lock().Get() != nullptr)
+			{
+				ANIM_CHECK(Counted::s_NumAlive == 0 && numRevived == 0);
+				return;
+			}
+		}
+	}
+
+	// Each thread copies and drops a reference numCopies times.
+	template<typename Pointer>
+	double TimeCopies(const std::vector<Pointer>& targets, uint32_t numThreads, uint32_t numCopies)
+	{
+		std::atomic<uint32_t> numReady(0);
+		std::vector<std::thread> threads;
+		auto start = BenchmarkClock::now();
+		for (uint32_t i = 0; i < numThreads; ++i)
+		{
+			const Pointer& target = targets[i % targets.size()];
+			threads.emplace_back([&target, &numReady, numThreads, numCopies]()
+			{
+				++numReady;
+				while (numReady < numThreads)
+				{
+					std::this_thread::yield();
+				}
+				uint64_t sum = 0;
+				for (uint32_t j = 0; j < numCopies; ++j)
+				{
+					Pointer copy = target;
+					sum += copy->m_Value;
+				}
+				UseBenchmarkResult(sum);
+			});
+		}
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+		return SecondsSince(start);
+	}
+
+	template<typename Pointer, typename MakePointer>
+	void BenchmarkPointer(const char* name, MakePointer makePointer)
+	{
+		const uint32_t Num_Copies = 4000000;
+		for (uint32_t numThreads = 1; numThreads <= 64; numThreads *= 2)
+		{
+			uint32_t numCopies = Num_Copies / numThreads;
+			std::vector<Pointer> one(1, makePointer());
+			std::vector<Pointer> each;
+			for (uint32_t i = 0; i < numThreads; ++i)
+			{
+				each.push_back(makePointer());
+			}
+			double contended = TimeCopies(one, numThreads, numCopies);
+			double uncontended = TimeCopies(each, numThreads, numCopies);
+			double numOperations = static_cast<double>(numCopies) * numThreads;
+			printf("  %-16s %2u threads: one object %6.2f ns/copy, one per thread %6.2f ns/copy\n", name, numThreads,
+				contended * 1e9 / numOperations, uncontended * 1e9 / numOperations);
+		}
+	}
+}
+
+void RunSharedPtrTests()
+{
+	TestCounts();
+	TestConcurrentRelease();
+}
+
+void RunSharedPtrBenchmark()
+{
+	printf("shared pointer copy and release, wall time per copy:\n");
+	BenchmarkPointer<SharedPtr<Counted>>("SharedPtr", []() { return SharedPtr<Counted>::MakeShared(); });
+	BenchmarkPointer<std::shared_ptr<Counted>>("std::shared_ptr", []() { return std::make_shared<Counted>(); });
+}
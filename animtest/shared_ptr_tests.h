@@ -0,0 +1,5 @@
+#pragma once
+
+void RunSharedPtrTests();
+// Copies and releases SharedPtr and std::shared_ptr on 1 to 64 threads, to one shared object and to one per thread.
+void RunSharedPtrBenchmark();
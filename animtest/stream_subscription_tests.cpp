@@ -0,0 +1,242 @@
+#include "stream_subscription_tests.h"
+#include <chrono>
+#include <random>
+#include <thread>
+#include <string.h>
+#include "animcore/remoteprotocol/stream_messages.h"
+#include "animcore/remoteprotocol/stream_subscriptions.h"
+#include "test_harness.h"
+
+using namespace animengine;
+
+namespace
+{
+	const uint32_t Pose_Stream = 1;
+	const uint64_t Pose_Key = 42;
+	const uint32_t Connection = 7;
+
+	BigArray<uint8_t> MakePose(uint32_t numBones, uint32_t seed)
+	{
+		std::mt19937 random(seed);
+		std::uniform_real_distribution<float> values(-1.0f, 1.0f);
+		BigArray<uint8_t> pose;
+		pose.Resize(numBones * 10 * sizeof(float));
+		float* floats = reinterpret_cast<float*>(pose.GetBuffer());
+		for (uint32_t i = 0; i < numBones * 10; ++i)
+		{
+			floats[i] = values(random);
+		}
+		return pose;
+	}
+
+	bool AreEqual(const BigArray<uint8_t>& a, const BigArray<uint8_t>& b)
+	{
+		return a.Size() == b.Size() && (a.Size() == 0 || memcmp(a.GetBuffer(), b.GetBuffer(), a.Size()) == 0);
+	}
+
+	bool RoundTrips(const BigArray<uint8_t>& base, const BigArray<uint8_t>& snapshot, uint32_t& deltaSizeOut)
+	{
+		BigArray<uint8_t> delta;
+		if (!StreamDelta::Encode(base, snapshot, delta))
+			return false;
+		deltaSizeOut = delta.Size();
+		BigArray<uint8_t> rebuilt = base;
+		return StreamDelta::Apply(rebuilt, delta) && AreEqual(rebuilt, snapshot);
+	}
+
+	void TestDeltaRoundTrips()
+	{
+		BigArray<uint8_t> base = MakePose(64, 1);
+		uint32_t deltaSize = 0;
+
+		// Nothing moved: a single run of unchanged bytes.
+		ANIM_CHECK(RoundTrips(base, base, deltaSize));
+		ANIM_CHECK(deltaSize <= 4);
+
+		// A few bones moved a little.
+		BigArray<uint8_t> moved = base;
+		float* floats = reinterpret_cast<float*>(moved.GetBuffer());
+		for (uint32_t bone = 0; bone < 64; bone += 8)
+		{
+			floats[bone * 10] += 0.001f;
+			floats[bone * 10 + 3] -= 0.002f;
+		}
+		ANIM_CHECK(RoundTrips(base, moved, deltaSize));
+		ANIM_CHECK(deltaSize < base.Size() / 8);
+
+		// Every byte changed: the delta would not be smaller, the snapshot is sent whole.
+		BigArray<uint8_t> different = base;
+		for (uint8_t& value : different)
+		{
+			value ^= 0xFF;
+		}
+		BigArray<uint8_t> delta;
+		ANIM_CHECK(!StreamDelta::Encode(base, different, delta));
+
+		// Snapshots of another size, or empty ones, have no delta.
+		BigArray<uint8_t> grown = base;
+		grown.Push(0);
+		ANIM_CHECK(!StreamDelta::Encode(base, grown, delta));
+		ANIM_CHECK(!StreamDelta::Encode(grown, base, delta));
+		ANIM_CHECK(!StreamDelta::Encode(BigArray<uint8_t>(), BigArray<uint8_t>(), delta));
+	}
+
+	BigArray<uint8_t> MakeDelta(std::initializer_list<uint8_t> bytes)
+	{
+		BigArray<uint8_t> delta;
+		for (uint8_t value : bytes)
+		{
+			delta.Push(value);
+		}
+		return delta;
+	}
+
+	// Deltas that do not fit the base fail instead of writing past it.
+	void TestCorruptDeltasAreRejected()
+	{
+		BigArray<uint8_t> base;
+		base.Resize(100);
+		memset(base.GetBuffer(), 0, base.Size());
+		BigArray<uint8_t> target = base;
+
+		// Skips past the end of the base.
+		ANIM_CHECK(!StreamDelta::Apply(target, MakeDelta({ 101, 0 })));
+		// Changes bytes past the end of the base.
+		ANIM_CHECK(!StreamDelta::Apply(target, MakeDelta({ 98, 3, 1, 2, 3 })));
+		// Claims more changed bytes than the delta holds.
+		ANIM_CHECK(!StreamDelta::Apply(target, MakeDelta({ 0, 10, 1, 2, 3, 4, 5 })));
+		// A varint that never ends, and one cut short.
+		ANIM_CHECK(!StreamDelta::Apply(target, MakeDelta({ 0x80, 0x80, 0x80, 0x80, 0x80, 0x01 })));
+		ANIM_CHECK(!StreamDelta::Apply(target, MakeDelta({ 4, 0x80 })));
+
+		// A delta made for a larger snapshot.
+		BigArray<uint8_t> larger = MakePose(64, 2);
+		BigArray<uint8_t> changed = larger;
+		changed[changed.Size() - 1] ^= 1;
+		BigArray<uint8_t> delta;
+		ANIM_CHECK(StreamDelta::Encode(larger, changed, delta));
+		ANIM_CHECK(!StreamDelta::Apply(target, delta));
+		ANIM_CHECK(target.Size() == base.Size());
+	}
+
+	UniquePtr<Message> Subscribe(StreamPublisher& publisher, uint32_t streamID, float rate)
+	{
+		SubscribeMessage request;
+		request.m_StreamID = streamID;
+		request.m_Key = Pose_Key;
+		request.m_Rate = rate;
+		return publisher.HandleRequest(Connection, &request);
+	}
+
+	float GetAgreedRate(const UniquePtr<Message>& response)
+	{
+		return static_cast<const SubscribeResponseMessage*>(response.Get())->m_Rate;
+	}
+
+	// A subscriber whose connection is busy gets the latest snapshot once it is free, as a delta against the
+	// last one it received, not every snapshot published meanwhile.
+	void TestBusySubscriberIsCoalesced()
+	{
+		StreamPublisher publisher;
+		publisher.RegisterStream(Pose_Stream, 1000.0f);
+		SubscriptionTable table;
+		BigArray<uint8_t> received;
+		uint32_t receivedSequence = 0;
+		uint32_t numCallbacks = 0;
+		uint32_t subscriptionID = table.Add(Subscribe(publisher, Pose_Stream, 0.0f).Get(),
+			[&](const uint8_t* data, uint32_t numBytes, uint32_t sequence)
+			{
+				received.Resize(0);
+				received.Append(data, numBytes);
+				receivedSequence = sequence;
+				++numCallbacks;
+			}, nullptr);
+		ANIM_CHECK(subscriptionID != 0);
+		ANIM_CHECK(publisher.HasSubscribers(Pose_Stream, Pose_Key));
+
+		bool isBusy = false;
+		uint32_t numSent = 0;
+		uint32_t lastBaseSequence = 0;
+		bool isEveryUpdateValid = true;
+		auto canSend = [&isBusy](uint32_t connection) { return connection == Connection && !isBusy; };
+		auto send = [&](uint32_t connection, const StreamUpdateMessage& update)
+		{
+			++numSent;
+			lastBaseSequence = update.m_BaseSequence;
+			isEveryUpdateValid &= connection == Connection && table.HandleUpdate(&update);
+		};
+		// The stream allows an update every millisecond.
+		auto pushLater = [&]()
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			publisher.PushUpdates(canSend, send);
+		};
+
+		BigArray<uint8_t> pose = MakePose(32, 3);
+		publisher.Publish(Pose_Stream, Pose_Key, pose.GetBuffer(), pose.Size());
+		pushLater();
+		ANIM_CHECK(numSent == 1 && lastBaseSequence == 0);
+		ANIM_CHECK(receivedSequence == 1 && AreEqual(received, pose));
+
+		isBusy = true;
+		float* floats = reinterpret_cast<float*>(pose.GetBuffer());
+		for (uint32_t i = 0; i < 10; ++i)
+		{
+			floats[i] += 0.5f;
+			publisher.Publish(Pose_Stream, Pose_Key, pose.GetBuffer(), pose.Size());
+			pushLater();
+		}
+		ANIM_CHECK(numSent == 1);
+
+		isBusy = false;
+		pushLater();
+		pushLater();
+		ANIM_CHECK(numSent == 2 && lastBaseSequence == 1);
+		ANIM_CHECK(receivedSequence == 11 && AreEqual(received, pose) && numCallbacks == 2);
+		ANIM_CHECK(isEveryUpdateValid);
+
+		// An update against a snapshot the client does not have is refused.
+		StreamUpdateMessage stale;
+		stale.m_SubscriptionID = subscriptionID;
+		stale.m_Sequence = 13;
+		stale.m_BaseSequence = 12;
+		stale.m_Data.Push(0);
+		stale.m_Data.Push(0);
+		ANIM_CHECK(!table.HandleUpdate(&stale));
+
+		publisher.RemoveConnection(Connection);
+		ANIM_CHECK(!publisher.HasSubscribers(Pose_Stream, Pose_Key));
+		ANIM_CHECK(publisher.GetMillisecondsUntilDue() == -1);
+	}
+
+	void TestRateIsClamped()
+	{
+		StreamPublisher publisher;
+		publisher.RegisterStream(Pose_Stream, 60.0f);
+		ANIM_CHECK(GetAgreedRate(Subscribe(publisher, Pose_Stream, 1000.0f)) == 60.0f);
+		ANIM_CHECK(GetAgreedRate(Subscribe(publisher, Pose_Stream, 0.0f)) == 60.0f);
+		ANIM_CHECK(GetAgreedRate(Subscribe(publisher, Pose_Stream, -5.0f)) == 60.0f);
+		ANIM_CHECK(GetAgreedRate(Subscribe(publisher, Pose_Stream, 30.0f)) == 30.0f);
+
+		// Streams the server does not publish are refused.
+		UniquePtr<Message> refused = Subscribe(publisher, Pose_Stream + 1, 30.0f);
+		ANIM_CHECK(static_cast<const SubscribeResponseMessage*>(refused.Get())->m_SubscriptionID == 0);
+
+		// A clamped subscription is not due again before 1/60 s.
+		uint32_t numSent = 0;
+		BigArray<uint8_t> pose = MakePose(4, 4);
+		publisher.Publish(Pose_Stream, Pose_Key, pose.GetBuffer(), pose.Size());
+		publisher.PushUpdates([](uint32_t) { return true; }, [&numSent](uint32_t, const StreamUpdateMessage&) { ++numSent; });
+		ANIM_CHECK(numSent == 4);
+		int wait = publisher.GetMillisecondsUntilDue();
+		ANIM_CHECK(wait > 0 && wait <= 17);
+	}
+}
+
+void RunStreamSubscriptionTests()
+{
+	TestDeltaRoundTrips();
+	TestCorruptDeltasAreRejected();
+	TestBusySubscriberIsCoalesced();
+	TestRateIsClamped();
+}
@@ -0,0 +1,36 @@
+#include "test_harness.h"
+#include <atomic>
+#include <cstdio>
+
+namespace
+{
+	std::atomic<uint32_t> s_NumChecks(0);
+	std::atomic<uint32_t> s_NumFailedChecks(0);
+	volatile uint64_t s_BenchmarkSink = 0;
+}
+
+bool CheckTestExpression(bool passed, const char* expression, const char* file, int line)
+{
+	++s_NumChecks;
+	if (!passed)
+	{
+		++s_NumFailedChecks;
+		printf("%s(%d): check failed: %s\n", file, line, expression);
+	}
+	return passed;
+}
+
+uint32_t GetNumChecks()
+{
+	return s_NumChecks;
+}
+
+uint32_t GetNumFailedChecks()
+{
+	return s_NumFailedChecks;
+}
+
+void UseBenchmarkResult(uint64_t value)
+{
+	s_BenchmarkSink = s_BenchmarkSink + value;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <stdint.h>
+#include <chrono>
+
+// Checks of the --tests mode print the failed expression and keep going, main returns non-zero if any failed.
+#define ANIM_CHECK(expr) CheckTestExpression((expr), #expr, __FILE__, __LINE__)
+
+bool CheckTestExpression(bool passed, const char* expression, const char* file, int line);
+uint32_t GetNumChecks();
+uint32_t GetNumFailedChecks();
+
+typedef std::chrono::steady_clock BenchmarkClock;
+
+inline double SecondsSince(BenchmarkClock::time_point start)
+{
+	return std::chrono::duration<double>(BenchmarkClock::now() - start).count();
+}
+
+// Keeps the optimizer from dropping work whose result a benchmark never reads.
+void UseBenchmarkResult(uint64_t value);